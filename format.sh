@@ -4,7 +4,7 @@ BASE_FOLDER=$(pwd)
 BASE_TEST_FOLDER=./tests
 BASE_TOOLS_FOLDER=./tools
 LIB_FOLDER=./src
-TEST_FIRMWARES="test_firmware_usb_loopback test_firmware_loopback test_firmware_hspi test_firmware_serdes test_firmware_usb_speedtest test_firmware_unittests"
+TEST_FIRMWARES="test_firmware_usb_loopback test_firmware_loopback test_firmware_hspi test_firmware_serdes test_firmware_usb_speedtest test_firmware_unittests test_firmware_benchmarks"
 TOOLS_FIRMWARES="firmware_debug_board"
 SCRIPTS_FOLDERS="${BASE_TOOLS_FOLDER}/scripts ${BASE_TEST_FOLDER}/scripts"
 
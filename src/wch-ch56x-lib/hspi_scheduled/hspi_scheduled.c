@@ -22,7 +22,7 @@ limitations under the License.
 #include "wch-ch56x-lib/logging/log_to_buffer.h"
 #include "wch-ch56x-lib/logging/logging.h"
 #include "wch-ch56x-lib/memory/fifo.h"
-#include "wch-ch56x-lib/memory/pool.h"
+#include "wch-ch56x-lib/memory/typed_fifo.h"
 #include "wch-ch56x-lib/utils/critical_section.h"
 #include <stdint.h>
 
@@ -31,9 +31,8 @@ __attribute__((aligned(16))) uint8_t* hspi_rx_buffer_1;
 __attribute__((aligned(16))) uint8_t* hspi_tx_buffer_0;
 __attribute__((aligned(16))) uint8_t* hspi_tx_buffer_1;
 
-#define HSPI_DMA0_MASK 1 << 0
-#define HSPI_DMA1_MASK 1 << 1
-#define HSPI_MAX_SCHEDULED INTERRUPT_QUEUE_SIZE
+#define HSPI_DMA0_MASK (1 << 0)
+#define HSPI_DMA1_MASK (1 << 1)
 
 void _default_hspi_rx_callback(uint8_t* buffer, uint16_t size,
 							   uint16_t custom_register);
@@ -54,23 +53,284 @@ typedef enum HSPI_CURRENT_DMA
 	HSPI_DMA_1
 } hspi_scheduled_current_dma_t;
 
-typedef struct __attribute__((packed)) HSPI_TASK
+/*
+ * Arguments of the _hspi_send and _hspi_rx_callback tasks, copied in the task
+ * itself (hydra_interrupt_queue_set_next_task_inline)
+ */
+typedef struct HSPI_TASK_ARGS
 {
-	bool in_use;
-	struct
-	{
-		uint8_t* buffer;
-		uint16_t size;
-		uint16_t custom_register;
-	} args;
+	uint8_t* base; // ramx_pool allocation holding the data, freed on cleanup
+	uint16_t offset; // of the data from base
+	uint16_t size;
+	uint16_t custom_register;
+	bool deferred; // counted in hspi_sends_deferred until its cleanup
 } hspi_args_t;
 
-HYDRA_POOL_DEF(hspi_arg_pool, hspi_args_t, HSPI_MAX_SCHEDULED);
+// fails to compile if hspi_args_t does not fit in a task
+typedef char hspi_args_fit_in_task[sizeof(hspi_args_t) <= INTERRUPT_QUEUE_INLINE_ARGS_SIZE ? 1 : -1];
+
 uint16_t hspi_packet_size = 0;
 volatile bool hspi_transmission_finished = true;
+// size of the RX buffers : a whole burst with HSPI_BURST_LEN, a frame otherwise
+static uint16_t hspi_rx_buffer_size = 0;
+
+#ifdef HSPI_BURST_LEN
+/**
+ * @brief Number of frames of hspi_packet_size bytes of a burst of size bytes,
+ * at least one
+ */
+__attribute__((always_inline)) static inline uint16_t _hspi_frames(uint16_t size)
+{
+	if (size <= hspi_packet_size)
+		return 1;
+	return (uint16_t)((size + hspi_packet_size - 1) / hspi_packet_size);
+}
+
+__attribute__((always_inline)) static inline uint16_t _hspi_burst_cfg(uint16_t frames)
+{
+	return (uint16_t)((frames << 8) & RB_HSPI_BURST_LEN) | RB_HSPI_BURST_EN;
+}
+#endif
+
+#ifdef HSPI_COALESCE
+// header of each message of a coalesced frame : size, then custom register,
+// little endian
+#define HSPI_MSG_HEADER_SIZE 4
+
+// frame of the messages of hspi_sendv not sent yet, NULL if there is none
+static uint8_t* hspi_coalesce_frame = NULL;
+static uint16_t hspi_coalesce_fill = 0;
+// HYDRA_INTERRUPT_QUEUE_TICKS at which the frame must be sent
+static uint64_t hspi_coalesce_deadline = 0;
+// incremented with each frame, so that a linger task does not send a newer
+// frame early
+static uint32_t hspi_coalesce_generation = 0;
+static uint32_t hspi_coalesce_linger_us = HSPI_COALESCE_LINGER_US;
+
+/**
+ * @brief Drop the frame being coalesced
+ * @param release free it, false if ramx_pool has been reset
+ */
+__attribute__((always_inline)) static inline void _hspi_coalesce_reset(bool release)
+{
+	if (release && hspi_coalesce_frame != NULL)
+		ramx_pool_free(hspi_coalesce_frame);
+	hspi_coalesce_frame = NULL;
+	hspi_coalesce_fill = 0;
+	hspi_coalesce_generation++;
+}
+
+/**
+ * @brief Size of a message of size bytes in a coalesced frame : its header,
+ * and its data padded to 4 bytes so that the next one is aligned
+ */
+__attribute__((always_inline)) static inline uint32_t _hspi_msg_footprint(uint32_t size)
+{
+	return HSPI_MSG_HEADER_SIZE + ((size + 3) & ~3u);
+}
+#endif
+
+#ifdef HSPI_RELIABLE
+/*
+ * Custom register of the frames : HSPI_RELIABLE_CTRL for ACK and NACK frames,
+ * the sequence number in bits 8 to 11, and the custom register given to
+ * hspi_send (data frames) or the type (control frames) in bits 0 to 7
+ */
+#define HSPI_RELIABLE_CTRL 0x1000
+#define HSPI_RELIABLE_SEQ_SHIFT 8
+#define HSPI_RELIABLE_SEQ_MASK 0x0f
+#define HSPI_RELIABLE_ACK 1 // every frame before seq has been received
+#define HSPI_RELIABLE_NACK 2 // same as ACK, and frame seq is missing
+#define HSPI_RELIABLE_CTRL_SIZE 4
+
+// sequence number of the oldest frame not acknowledged, and of the next one
+static uint8_t hspi_rel_tx_base = 0;
+static uint8_t hspi_rel_tx_next = 0;
+// frames sent and not acknowledged yet, holding a reference on their buffer,
+// by sequence number modulo HSPI_RELIABLE_WINDOW
+static hspi_args_t hspi_rel_tx_window[HSPI_RELIABLE_WINDOW];
+// HYDRA_INTERRUPT_QUEUE_TICKS at which the oldest frame is sent again
+static uint64_t hspi_rel_tx_deadline = 0;
+
+// sequence number of the next frame to deliver
+static uint8_t hspi_rel_rx_expected = 0;
+// frames received after a missing one, waiting for it
+static hspi_args_t hspi_rel_rx_held[HSPI_RELIABLE_WINDOW];
+static uint32_t hspi_rel_rx_held_mask = 0;
+// a NACK has been sent for hspi_rel_rx_expected, by the interrupt handler too
+static volatile bool hspi_rel_rx_nacked = false;
+
+// control frame to send, set by the interrupt handler on CRC errors too
+static volatile bool hspi_rel_ack_pending = false;
+static volatile bool hspi_rel_nack_pending = false;
+static volatile bool hspi_rel_ctrl_scheduled = false;
+// data of the control frames, shared by all of them
+static uint8_t* hspi_rel_ctrl_buffer = NULL;
+static hspi_reliable_stats_t hspi_rel_stats;
+
+/**
+ * @brief Forget the frames of both windows
+ * @param release release their buffers, false if ramx_pool has been reset
+ */
+__attribute__((always_inline)) static inline void _hspi_rel_reset(bool release)
+{
+	if (release)
+	{
+		for (uint8_t seq = hspi_rel_tx_base; seq != hspi_rel_tx_next;
+			 seq = (seq + 1) & HSPI_RELIABLE_SEQ_MASK)
+			ramx_pool_free(hspi_rel_tx_window[seq % HSPI_RELIABLE_WINDOW].base);
+		for (uint32_t i = 0; i < HSPI_RELIABLE_WINDOW; ++i)
+		{
+			if (hspi_rel_rx_held_mask & (1u << i))
+				ramx_pool_free(hspi_rel_rx_held[i].base);
+		}
+		if (hspi_rel_ctrl_buffer != NULL)
+			ramx_pool_free(hspi_rel_ctrl_buffer);
+	}
+	hspi_rel_tx_base = 0;
+	hspi_rel_tx_next = 0;
+	hspi_rel_rx_expected = 0;
+	hspi_rel_rx_held_mask = 0;
+	hspi_rel_rx_nacked = false;
+	hspi_rel_ack_pending = false;
+	hspi_rel_nack_pending = false;
+	hspi_rel_ctrl_scheduled = false;
+	hspi_rel_ctrl_buffer = NULL;
+	memset(&hspi_rel_stats, 0, sizeof(hspi_rel_stats));
+}
+#endif
+
+#ifdef HSPI_ERROR_INJECTION
+// one received data frame in hspi_inject_one_in is corrupted, 0 for none
+static volatile uint16_t hspi_inject_one_in = 0;
+static uint32_t hspi_inject_seed = 1;
+static volatile uint32_t hspi_inject_count = 0;
+#endif
 
-void hspi_init_args_pool(void);
-void hspi_init_args_pool(void) { hydra_pool_clean(&hspi_arg_pool); }
+#ifdef HSPI_TX_PIPELINED
+/*
+ * Transmissions waiting for a DMA, pushed by hspi_send (main loop) and popped
+ * by HSPI_IRQHandler, both in a critical section.
+ */
+HYDRA_TYPED_FIFO(hspi_tx_ring, hspi_args_t, HSPI_TX_RING_LOG2_SIZE);
+// transmission of each DMA, valid if its bit is set in hspi_tx_loaded_mask
+static hspi_args_t hspi_tx_loaded[2];
+static volatile uint8_t hspi_tx_loaded_mask = 0;
+// DMA of the next transmission, the other one is on the wire if
+// hspi_tx_on_wire is set
+static volatile hspi_scheduled_current_dma_t hspi_tx_next_dma = HSPI_DMA_0;
+static volatile bool hspi_tx_on_wire = false;
+#ifdef HSPI_FLOW_CONTROL
+/*
+ * Credits are cumulative frame counts, modulo HSPI_CREDIT_MASK + 1 : data frames
+ * are sent as long as hspi_tx_credit_used has not reached hspi_tx_credit_limit,
+ * the count last advertised by the other side. This side advertises the data
+ * frames it received plus the buffers left in its RX ring.
+ */
+#define HSPI_CREDIT_MASK 0x0fff
+// credit frame asking the other side to advertise its credits
+#define HSPI_CREDIT_REQUEST 0x1000
+static volatile uint16_t hspi_tx_credit_limit = 0;
+static volatile uint16_t hspi_tx_credit_used = 0;
+static volatile uint16_t hspi_rx_frames = 0;
+static volatile uint16_t hspi_rx_credit_advertised = 0;
+// a credit frame is sent as soon as a TX DMA is free
+static volatile bool hspi_credit_pending = false;
+static volatile bool hspi_credit_request = false;
+
+static void _hspi_rx_credit_advertise(bool request);
+#endif
+#elif defined(INTERRUPT_QUEUE_TIMER)
+// HYDRA_INTERRUPT_QUEUE_TICKS from which the next transmission can start
+static uint64_t hspi_next_send_at = 0;
+// transmissions deferred until hspi_next_send_at, the next ones wait behind them
+static uint16_t hspi_sends_deferred = 0;
+#endif
+
+/*
+ * RX buffers allocated in advance by the main loop (producer), so that
+ * HSPI_IRQHandler (consumer) re-arms the DMA in constant time.
+ */
+typedef uint8_t* hspi_rx_buffer_t;
+HYDRA_TYPED_FIFO(hspi_rx_ring, hspi_rx_buffer_t, HSPI_RX_RING_LOG2_SIZE);
+static uint16_t hspi_rx_ring_low_watermark = HSPI_RX_RING_LOW_WATERMARK;
+static volatile bool hspi_rx_ring_refill_scheduled = false;
+static volatile hspi_rx_state_t hspi_rx_state = HSPI_RX_STATE_RUNNING;
+static volatile uint32_t hspi_rx_dropped = 0;
+#ifdef HSPI_BURST_LEN
+// RB_HSPI_RX_TOG after the last received burst : it flips with each burst
+static volatile bool hspi_rx_tog = false;
+#endif
+
+/**
+ * @brief Allocate RX buffers until the ring is full or ramx_pool is empty.
+ * Only called from the main loop (or before the HSPI interrupt is enabled).
+ */
+void _hspi_rx_ring_fill(void);
+void _hspi_rx_ring_fill(void)
+{
+	while (hspi_rx_ring_count() < (1 << HSPI_RX_RING_LOG2_SIZE))
+	{
+		hspi_rx_buffer_t buffer = ramx_pool_alloc_bytes(hspi_rx_buffer_size);
+		if (buffer == NULL)
+			break;
+		hspi_rx_ring_push(&buffer);
+	}
+}
+
+void _hspi_rx_ring_init(void);
+void _hspi_rx_ring_init(void)
+{
+	hspi_rx_ring_clean();
+	hspi_rx_ring_refill_scheduled = false;
+	hspi_rx_state = HSPI_RX_STATE_RUNNING;
+	hspi_rx_dropped = 0;
+	_hspi_rx_ring_fill();
+}
+
+#ifdef HSPI_TX_PIPELINED
+/**
+ * @brief Drop the transmissions waiting in the TX ring and in the DMAs
+ */
+void _hspi_tx_ring_init(hspi_scheduled_current_dma_t next_dma);
+void _hspi_tx_ring_init(hspi_scheduled_current_dma_t next_dma)
+{
+	BSP_ENTER_CRITICAL();
+	hspi_tx_ring_clean();
+	hspi_tx_loaded_mask = 0;
+	hspi_tx_next_dma = next_dma;
+	hspi_tx_on_wire = false;
+#ifdef HSPI_FLOW_CONTROL
+	hspi_tx_credit_limit = 0;
+	hspi_tx_credit_used = 0;
+	hspi_rx_frames = 0;
+	hspi_rx_credit_advertised = 0;
+	hspi_credit_pending = false;
+	hspi_credit_request = false;
+#endif
+	BSP_EXIT_CRITICAL();
+}
+#endif
+
+/**
+ * @brief Allocate the RX and TX buffers of both DMAs at once : either all of
+ * them are allocated, or none is.
+ */
+void _hspi_alloc_buffers(void);
+void _hspi_alloc_buffers(void)
+{
+	const uint32_t sizes[4] = { hspi_rx_buffer_size, hspi_rx_buffer_size,
+								hspi_packet_size, hspi_packet_size };
+	uint8_t* buffers[4];
+
+	if (!ramx_pool_alloc_many(4, sizes, buffers))
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "not enough memory for the HSPI buffers\r\n");
+	hspi_rx_buffer_0 = buffers[0];
+	hspi_rx_buffer_1 = buffers[1];
+	hspi_tx_buffer_0 = buffers[2];
+	hspi_tx_buffer_1 = buffers[3];
+}
 
 void hspi_doubledma_init(HSPI_ModeTypeDef mode_type, uint8_t mode_data,
 						 uint8_t* DMA0_addr, uint8_t* DMA1_addr,
@@ -98,9 +358,14 @@ void hspi_doubledma_init(HSPI_ModeTypeDef mode_type, uint8_t mode_data,
 	// Data size (8/16 or 32bits)
 	R8_HSPI_CFG |= mode_data;
 
+#ifdef HSPI_BURST_LEN
+	// the frames of a burst are answered by the hardware
+	R8_HSPI_CFG |= RB_HSPI_HW_ACK;
+#else
 	// ACk mode 0 (Hardware auto-answer mode is used in burst mode, not in normal
 	// mode)
 	R8_HSPI_CFG &= ~RB_HSPI_HW_ACK;
+#endif
 
 	R8_HSPI_CFG |= RB_HSPI_TX_TOG_EN;
 	R8_HSPI_CFG |= RB_HSPI_RX_TOG_EN;
@@ -114,22 +379,39 @@ void hspi_doubledma_init(HSPI_ModeTypeDef mode_type, uint8_t mode_data,
 	// TX sampling edge
 	R8_HSPI_AUX |= RB_HSPI_TCK_MOD; // falling edge sampling
 
+#ifdef HSPI_BURST_LEN
+	// Hardware auto ack timing
+	R8_HSPI_AUX &= ~(RB_HSPI_ACK_TX_MOD | RB_HSPI_ACK_CNT_SEL);
+	if (HSPI_BURST_ACK_TX_MOD)
+		R8_HSPI_AUX |= RB_HSPI_ACK_TX_MOD;
+	R8_HSPI_AUX |= (HSPI_BURST_ACK_CNT_SEL << 2) & RB_HSPI_ACK_CNT_SEL;
+#else
 	// Hardware Auto ack time disabled
 	R8_HSPI_AUX &= ~RB_HSPI_ACK_TX_MOD;
 
 	// Delay time
 	R8_HSPI_AUX &= ~RB_HSPI_ACK_CNT_SEL; //  Delay 2T
+#endif
 
 	// clear ALL_CLR  TRX_RST  (reset)
 	R8_HSPI_CTRL &= ~(RB_HSPI_ALL_CLR | RB_HSPI_TRX_RST);
 
 	// Enable Interrupt
-	//  R8_HSPI_INT_EN |= RB_HSPI_IE_T_DONE;  // Single packet sending completed
+#ifdef HSPI_BURST_LEN
+	// one interrupt per burst, sent or received
+	R8_HSPI_INT_EN &= ~(RB_HSPI_IE_T_DONE | RB_HSPI_IE_R_DONE);
+	R8_HSPI_INT_EN |= RB_HSPI_IE_B_DONE; // Burst sequence completed
+	R8_HSPI_INT_EN |= RB_HSPI_IE_FIFO_OV;
+#else
+#ifdef HSPI_TX_PIPELINED
+	R8_HSPI_INT_EN |= RB_HSPI_IE_T_DONE; // Single packet sending completed
+#endif
 	R8_HSPI_INT_EN |= RB_HSPI_IE_FIFO_OV;
 
 	// HSPI_DEVICE
 	R8_HSPI_INT_EN |= RB_HSPI_IE_R_DONE; // Single packet reception completed
 	R8_HSPI_INT_EN |= RB_HSPI_IE_FIFO_OV;
+#endif
 
 	// reset packet number check
 	if ((R8_HSPI_RX_SC & RB_HSPI_RX_TOG) == RB_HSPI_RX_TOG)
@@ -166,8 +448,13 @@ void hspi_doubledma_init(HSPI_ModeTypeDef mode_type, uint8_t mode_data,
 	// addr1 RX DMA len
 	R16_HSPI_RX_LEN1 = DMA_addr_len; // 0 means max size 4096 bytes
 
+#ifdef HSPI_BURST_LEN
+	// the number of frames is programmed before each transmission
+	R16_HSPI_BURST_CFG = _hspi_burst_cfg(1);
+#else
 	// Burst Disabled
 	R16_HSPI_BURST_CFG = 0x0000;
+#endif
 
 	// Enable HSPI DMA
 	R8_HSPI_CTRL |= RB_HSPI_ENABLE | RB_HSPI_DMA_EN;
@@ -178,28 +465,74 @@ void hspi_doubledma_init(HSPI_ModeTypeDef mode_type, uint8_t mode_data,
 void hspi_reinit_buffers(void)
 {
 	hspi_transmission_finished = true;
-	hspi_init_args_pool();
-	hspi_rx_buffer_0 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_rx_buffer_1 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_tx_buffer_0 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_tx_buffer_1 = ramx_pool_alloc_bytes(hspi_packet_size);
+#ifdef HSPI_TX_PIPELINED
+	_hspi_tx_ring_init((R8_HSPI_TX_SC & RB_HSPI_TX_TOG) ? HSPI_DMA_1 : HSPI_DMA_0);
+#elif defined(INTERRUPT_QUEUE_TIMER)
+	hspi_next_send_at = HYDRA_INTERRUPT_QUEUE_TICKS();
+	hspi_sends_deferred = 0;
+#endif
+#ifdef HSPI_COALESCE
+	_hspi_coalesce_reset(true);
+#endif
+#ifdef HSPI_RELIABLE
+	_hspi_rel_reset(true);
+#endif
+	_hspi_alloc_buffers();
+	_hspi_rx_ring_init();
+#ifdef HSPI_RELIABLE
+	hspi_rel_ctrl_buffer = ramx_pool_alloc_bytes(HSPI_RELIABLE_CTRL_SIZE);
+#endif
+#ifdef HSPI_BURST_LEN
+	hspi_rx_tog = (R8_HSPI_RX_SC & RB_HSPI_RX_TOG) != 0;
+#endif
 	// addr0 DMA TX RX addr
 	R32_HSPI_TX_ADDR0 = 0;
 	R32_HSPI_RX_ADDR0 = (vuint32_t)hspi_rx_buffer_0;
 	// addr1 DMA TX RX addr
 	R32_HSPI_TX_ADDR1 = 0;
 	R32_HSPI_RX_ADDR1 = (vuint32_t)hspi_rx_buffer_1;
+#ifdef HSPI_FLOW_CONTROL
+	// the other side starts without credits, and so does this one
+	_hspi_rx_credit_advertise(true);
+#endif
 }
 
 void hspi_init(HSPI_TYPE type, HSPI_DATASIZE datasize, uint16_t size)
 {
 	hspi_transmission_finished = true;
-	hspi_init_args_pool();
+#ifdef HSPI_TX_PIPELINED
+	// hspi_doubledma_init resets the toggle bit : DMA 0 sends first
+	_hspi_tx_ring_init(HSPI_DMA_0);
+#elif defined(INTERRUPT_QUEUE_TIMER)
+	hspi_next_send_at = HYDRA_INTERRUPT_QUEUE_TICKS();
+	hspi_sends_deferred = 0;
+#endif
+#ifdef HSPI_COALESCE
+	_hspi_coalesce_reset(false);
+#endif
+#ifdef HSPI_RELIABLE
+	_hspi_rel_reset(false);
+#endif
+#ifdef HSPI_ERROR_INJECTION
+	hspi_inject_count = 0;
+#endif
 	hspi_packet_size = size;
-	hspi_rx_buffer_0 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_rx_buffer_1 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_tx_buffer_0 = ramx_pool_alloc_bytes(hspi_packet_size);
-	hspi_tx_buffer_1 = ramx_pool_alloc_bytes(hspi_packet_size);
+#ifdef HSPI_BURST_LEN
+	// bursts are at most HSPI_BURST_LEN frames, and less than 64KiB
+	uint32_t burst_frames = size == 0 ? 1 : UINT16_MAX / size;
+	if (burst_frames > HSPI_BURST_LEN)
+		burst_frames = HSPI_BURST_LEN;
+	hspi_rx_buffer_size = (uint16_t)(burst_frames * size);
+	// hspi_doubledma_init resets the toggle bit
+	hspi_rx_tog = false;
+#else
+	hspi_rx_buffer_size = size;
+#endif
+	_hspi_alloc_buffers();
+	_hspi_rx_ring_init();
+#ifdef HSPI_RELIABLE
+	hspi_rel_ctrl_buffer = ramx_pool_alloc_bytes(HSPI_RELIABLE_CTRL_SIZE);
+#endif
 
 	switch (datasize)
 	{
@@ -222,29 +555,396 @@ void hspi_init(HSPI_TYPE type, HSPI_DATASIZE datasize, uint16_t size)
 		return;
 		break;
 	}
+#ifdef HSPI_FLOW_CONTROL
+	// the other side starts without credits, and so does this one
+	_hspi_rx_credit_advertise(true);
+#endif
 }
 
 void _hspi_cleanup(uint8_t* data);
 void _hspi_cleanup(uint8_t* data)
 {
 	hspi_args_t* hspi_task_args = (hspi_args_t*)data;
-	ramx_pool_free(hspi_task_args->args.buffer);
-	hydra_pool_free(&hspi_arg_pool, hspi_task_args);
+	ramx_pool_free(hspi_task_args->base);
+}
+
+/**
+ * @brief Hand size bytes at offset in the received buffer base over to
+ * hspi_rx_buf_callback or hspi_rx_callback
+ */
+__attribute__((always_inline)) static inline void _hspi_rx_deliver(uint8_t* base, uint16_t offset,
+																   uint16_t size, uint16_t custom_register)
+{
+	if (hspi_scheduled_user_handled.hspi_rx_buf_callback != NULL)
+	{
+		hydra_buf_t buf = { .base = base, .offset = offset, .length = size };
+		hspi_scheduled_user_handled.hspi_rx_buf_callback(&buf, custom_register);
+		return;
+	}
+	hspi_scheduled_user_handled.hspi_rx_callback(base + offset, size,
+												 custom_register);
 }
 
+#ifdef HSPI_COALESCE
+/**
+ * @brief Hand the messages of a coalesced frame over one by one. They share
+ * the reference of the frame, released once the last callback has returned.
+ */
+__attribute__((always_inline)) static inline void _hspi_rx_split(const hspi_args_t* frame)
+{
+	uint32_t offset = 0;
+
+	while (offset + HSPI_MSG_HEADER_SIZE <= frame->size)
+	{
+		const uint8_t* msg = frame->base + frame->offset + offset;
+		uint16_t size = (uint16_t)(msg[0] | (msg[1] << 8));
+		uint16_t custom_register = (uint16_t)(msg[2] | (msg[3] << 8));
+
+		if (offset + HSPI_MSG_HEADER_SIZE + size > frame->size)
+		{
+			LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+				   "coalesced frame of %d bytes : message of %d bytes at %d\r\n",
+				   frame->size, size, offset);
+			return;
+		}
+		_hspi_rx_deliver(frame->base,
+						 (uint16_t)(frame->offset + offset + HSPI_MSG_HEADER_SIZE),
+						 size, custom_register);
+		offset += _hspi_msg_footprint(size);
+	}
+}
+#endif
+
+/**
+ * @brief Hand a received frame over to the user callbacks
+ */
+__attribute__((always_inline)) static inline void _hspi_rx_dispatch(const hspi_args_t* frame)
+{
+#ifdef HSPI_COALESCE
+	if (frame->custom_register == HSPI_COALESCED)
+	{
+		_hspi_rx_split(frame);
+		return;
+	}
+#endif
+	_hspi_rx_deliver(frame->base, frame->offset, frame->size,
+					 frame->custom_register);
+}
+
+#ifdef HSPI_RELIABLE
+void _hspi_rel_rx(const hspi_args_t* frame);
+#endif
+
 bool _hspi_rx_callback(uint8_t* data);
 bool _hspi_rx_callback(uint8_t* data)
 {
 	hspi_args_t* hspi_task_args = (hspi_args_t*)data;
 	if (hspi_task_args == NULL)
 		return false;
-	hspi_scheduled_user_handled.hspi_rx_callback(
-		hspi_task_args->args.buffer, hspi_task_args->args.size,
-		hspi_task_args->args.custom_register);
+#ifdef HSPI_RELIABLE
+	_hspi_rel_rx(hspi_task_args);
+#else
+	_hspi_rx_dispatch(hspi_task_args);
+#endif
 	return true;
 }
 
+/**
+ * @brief Program the address of a transmission in TX DMA dma
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_load_addr(hspi_scheduled_current_dma_t dma,
+																	 const hspi_args_t* hspi_task_args)
+{
+	vuint32_t addr = (vuint32_t)(hspi_task_args->base + hspi_task_args->offset);
+	if (dma == HSPI_DMA_1)
+		R32_HSPI_TX_ADDR1 = addr;
+	else
+		R32_HSPI_TX_ADDR0 = addr;
+}
+
+/**
+ * @brief Program the header (size and custom register) of a transmission in TX
+ * DMA dma. R32_HSPI_UDF0/1 also hold the headers of the received packets, so
+ * this is done right before the transmission starts.
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_load_header(hspi_scheduled_current_dma_t dma,
+																	   const hspi_args_t* hspi_task_args)
+{
+	uint16_t size = hspi_task_args->size;
+#ifdef HSPI_BURST_LEN
+	// the size of the last frame : the other side counts the frames of the burst
+	if (hspi_task_args->base != NULL)
+		size = (uint16_t)(size - (_hspi_frames(size) - 1) * hspi_packet_size);
+#endif
+	vuint32_t udf = ((size & HSPI_SERDES_TX_SIZE_MASK) |
+					 ((hspi_task_args->custom_register << 13) &
+					  ~HSPI_SERDES_TX_SIZE_MASK)) &
+					HSPI_USER_DEFINED_MASK;
+	if (dma == HSPI_DMA_1)
+		R32_HSPI_UDF1 = udf;
+	else
+		R32_HSPI_UDF0 = udf;
+}
+
+#ifdef HSPI_TX_PIPELINED
+
+__attribute__((always_inline)) static inline uint8_t _hspi_dma_mask(hspi_scheduled_current_dma_t dma)
+{
+	return dma == HSPI_DMA_1 ? HSPI_DMA1_MASK : HSPI_DMA0_MASK;
+}
+
+#ifdef HSPI_FLOW_CONTROL
+/**
+ * @brief Program the length of the next transmission of TX DMA dma : credit
+ * frames are shorter than data frames
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_load_len(hspi_scheduled_current_dma_t dma,
+																	uint16_t len)
+{
+	if (dma == HSPI_DMA_1)
+		R16_HSPI_DMA_LEN1 = len - 1;
+	else
+		R16_HSPI_DMA_LEN0 = len - 1;
+}
+
+__attribute__((always_inline)) static inline uint16_t _hspi_tx_credits(void)
+{
+	return (hspi_tx_credit_limit - hspi_tx_credit_used) & HSPI_CREDIT_MASK;
+}
+
+__attribute__((always_inline)) static inline uint16_t _hspi_rx_credit_limit(void)
+{
+	return (hspi_rx_frames + hspi_rx_ring_count()) & HSPI_CREDIT_MASK;
+}
+
+/**
+ * @brief Load a credit frame in DMA dma. Credit frames do not use credits : the
+ * other side handles them in its interrupt handler, without an RX buffer. Its
+ * header is written when it starts, with the latest count.
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_load_credit(hspi_scheduled_current_dma_t dma)
+{
+	hspi_args_t* credit = &hspi_tx_loaded[dma];
+
+	hspi_credit_pending = false;
+	credit->base = NULL;
+	credit->offset = 0;
+	credit->size = HSPI_ACK;
+	credit->deferred = false;
+	// the data sent does not matter
+	if (dma == HSPI_DMA_1)
+		R32_HSPI_TX_ADDR1 = (vuint32_t)hspi_tx_buffer_1;
+	else
+		R32_HSPI_TX_ADDR0 = (vuint32_t)hspi_tx_buffer_0;
+	_hspi_tx_load_len(dma, HSPI_ACK_FRAME_SIZE);
+}
+#endif
+
+/**
+ * @brief Load the next transmission of the ring in DMA dma, if it is free
+ * @return false if dma is free and the ring is empty
+ */
+__attribute__((always_inline)) static inline bool _hspi_tx_fill(hspi_scheduled_current_dma_t dma)
+{
+	if (hspi_tx_loaded_mask & _hspi_dma_mask(dma))
+		return true;
+#ifdef HSPI_FLOW_CONTROL
+	if (hspi_credit_pending)
+	{
+		_hspi_tx_load_credit(dma);
+		hspi_tx_loaded_mask |= _hspi_dma_mask(dma);
+		return true;
+	}
+	if (_hspi_tx_credits() == 0)
+		return false;
+#endif
+	if (!hspi_tx_ring_pop(&hspi_tx_loaded[dma]))
+		return false;
+	_hspi_tx_load_addr(dma, &hspi_tx_loaded[dma]);
+#ifdef HSPI_FLOW_CONTROL
+	_hspi_tx_load_len(dma, hspi_packet_size);
+	hspi_tx_credit_used = (hspi_tx_credit_used + 1) & HSPI_CREDIT_MASK;
+#endif
+	hspi_tx_loaded_mask |= _hspi_dma_mask(dma);
+	return true;
+}
+
+/**
+ * @brief Start the next transmission if the link is idle, and load the one
+ * after it in the other DMA while it is on the wire. Called with interrupts
+ * disabled.
+ */
+static void _hspi_tx_kick(void)
+{
+	hspi_scheduled_current_dma_t dma = hspi_tx_next_dma;
+	hspi_scheduled_current_dma_t other = dma == HSPI_DMA_0 ? HSPI_DMA_1 : HSPI_DMA_0;
+
+	if (hspi_tx_on_wire)
+	{
+		_hspi_tx_fill(dma);
+		return;
+	}
+	if (!_hspi_tx_fill(dma))
+	{
+		hspi_transmission_finished = true;
+		return;
+	}
+#ifdef HSPI_FLOW_CONTROL
+	if (hspi_tx_loaded[dma].base == NULL)
+	{
+		hspi_rx_credit_advertised = _hspi_rx_credit_limit();
+		hspi_tx_loaded[dma].custom_register =
+			hspi_rx_credit_advertised |
+			(hspi_credit_request ? HSPI_CREDIT_REQUEST : 0);
+		hspi_credit_request = false;
+	}
+#endif
+	_hspi_tx_load_header(dma, &hspi_tx_loaded[dma]);
+#ifdef HSPI_BURST_LEN
+	R16_HSPI_BURST_CFG = _hspi_burst_cfg(
+		hspi_tx_loaded[dma].base == NULL ? 1 : _hspi_frames(hspi_tx_loaded[dma].size));
+#endif
+	hspi_tx_on_wire = true;
+	hspi_transmission_finished = false;
+	hspi_tx_next_dma = other;
+	HSPI_DMA_Tx();
+	_hspi_tx_fill(other);
+}
+
+bool _hspi_tx_done(uint8_t* data);
+bool _hspi_tx_done(uint8_t* data)
+{
+	hspi_args_t* hspi_task_args = (hspi_args_t*)data;
+#ifdef HSPI_RELIABLE
+	if (hspi_task_args->custom_register & HSPI_RELIABLE_CTRL)
+		return true;
+	if (hspi_scheduled_user_handled.hspi_tx_done_callback != NULL)
+		hspi_scheduled_user_handled.hspi_tx_done_callback(
+			hspi_task_args->custom_register & HSPI_RELIABLE_CUSTOM_MASK);
+#else
+	if (hspi_scheduled_user_handled.hspi_tx_done_callback != NULL)
+		hspi_scheduled_user_handled.hspi_tx_done_callback(
+			hspi_task_args->custom_register);
+#endif
+	return true;
+}
+
+/**
+ * @brief Called by HSPI_IRQHandler when a transmission is done : start the
+ * next one, then hand the finished one over to the interrupt queue, which
+ * releases its buffer.
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_done_irq(void)
+{
+	hspi_scheduled_current_dma_t done;
+	hspi_args_t hspi_task_args;
+
+	BSP_ENTER_CRITICAL();
+	if (!hspi_tx_on_wire)
+	{
+		BSP_EXIT_CRITICAL();
+		return;
+	}
+	done = hspi_tx_next_dma == HSPI_DMA_0 ? HSPI_DMA_1 : HSPI_DMA_0;
+	hspi_task_args = hspi_tx_loaded[done];
+	hspi_tx_loaded_mask &= (uint8_t)~_hspi_dma_mask(done);
+	hspi_tx_on_wire = false;
+	_hspi_tx_kick();
+	BSP_EXIT_CRITICAL();
+
+#ifdef HSPI_FLOW_CONTROL
+	if (hspi_task_args.base == NULL) // credit frame
+		return;
+#endif
+	if (!hydra_interrupt_queue_set_next_task_inline(
+			_hspi_tx_done, &hspi_task_args, sizeof(hspi_task_args), _hspi_cleanup))
+		ramx_pool_free(hspi_task_args.base);
+}
+
+uint16_t hspi_tx_pending(void)
+{
+	BSP_ENTER_CRITICAL();
+	uint16_t pending = hspi_tx_ring_count();
+	if ((hspi_tx_loaded_mask & HSPI_DMA0_MASK) && hspi_tx_loaded[HSPI_DMA_0].base != NULL)
+		pending++;
+	if ((hspi_tx_loaded_mask & HSPI_DMA1_MASK) && hspi_tx_loaded[HSPI_DMA_1].base != NULL)
+		pending++;
+	BSP_EXIT_CRITICAL();
+	return pending;
+}
+
+#ifdef HSPI_FLOW_CONTROL
+/**
+ * @brief Send a credit frame as soon as a TX DMA is free. Several calls before
+ * it starts send a single frame, with the latest count.
+ * @param request ask the other side to advertise its credits as well
+ */
+static void _hspi_rx_credit_advertise(bool request)
+{
+	BSP_ENTER_CRITICAL();
+	hspi_credit_pending = true;
+	hspi_credit_request = hspi_credit_request || request;
+	_hspi_tx_kick();
+	BSP_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Called by HSPI_IRQHandler when a credit frame is received
+ */
+__attribute__((always_inline)) static inline void _hspi_tx_credit_received(uint16_t custom_register)
+{
+	BSP_ENTER_CRITICAL();
+	hspi_tx_credit_limit = custom_register & HSPI_CREDIT_MASK;
+	if (custom_register & HSPI_CREDIT_REQUEST)
+		hspi_credit_pending = true;
+	_hspi_tx_kick();
+	BSP_EXIT_CRITICAL();
+}
+
+uint16_t hspi_tx_credits(void)
+{
+	BSP_ENTER_CRITICAL();
+	uint16_t credits = _hspi_tx_credits();
+	BSP_EXIT_CRITICAL();
+	return credits;
+}
+#endif
+
+#else
+
 bool _hspi_send(uint8_t* data);
+
+#ifdef INTERRUPT_QUEUE_TIMER
+void _hspi_deferred_cleanup(uint8_t* data);
+void _hspi_deferred_cleanup(uint8_t* data)
+{
+	hspi_sends_deferred--;
+	_hspi_cleanup(data);
+}
+
+/**
+ * @brief Run the transmission again at hspi_next_send_at. The new task takes
+ * its own reference on the buffer, released by its cleanup function.
+ * @return false if there is no timer left
+ */
+__attribute__((always_inline)) static inline bool _hspi_send_defer(const hspi_args_t* hspi_task_args)
+{
+	hspi_args_t deferred = *hspi_task_args;
+
+	deferred.deferred = true;
+	ramx_take_ownership(deferred.base);
+	if (!hydra_interrupt_queue_set_task_at(
+			hspi_next_send_at, HYDRA_INTERRUPT_QUEUE_HIGH_PRIO, _hspi_send,
+			&deferred, sizeof(deferred), _hspi_deferred_cleanup))
+	{
+		ramx_pool_free(deferred.base);
+		return false;
+	}
+	hspi_sends_deferred++;
+	return true;
+}
+#endif
+
 bool _hspi_send(uint8_t* data)
 {
 	hspi_args_t* hspi_task_args = (hspi_args_t*)data;
@@ -252,31 +952,27 @@ bool _hspi_send(uint8_t* data)
 	if (hspi_task_args == NULL)
 		return false;
 
-	BSP_ENTER_CRITICAL();
-	if (R8_HSPI_TX_SC & RB_HSPI_TX_TOG)
-	{
-		R32_HSPI_TX_ADDR1 = (vuint32_t)hspi_task_args->args.buffer;
-		R32_HSPI_UDF1 = ((hspi_task_args->args.size & HSPI_SERDES_TX_SIZE_MASK) |
-						 ((hspi_task_args->args.custom_register << 13) &
-						  ~HSPI_SERDES_TX_SIZE_MASK)) &
-						HSPI_USER_DEFINED_MASK;
-		// uint8_t* tx0_addr = hspi_task_args->args.buffer;
-		// LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI, "R32_HSPI_TX_ADDR1 DMA1 addr %x size
-		// %d %d %d %d %d %d\r\n", tx0_addr, hspi_task_args->args.size, tx0_addr[0],
-		// tx0_addr[1], tx0_addr[2], tx0_addr[3], tx0_addr[4]);
-	}
-	else
+#ifdef INTERRUPT_QUEUE_TIMER
+	// too early after the previous transmission, or behind deferred ones. The
+	// deferred transmissions run in order, the first one is this one.
+	if (HYDRA_INTERRUPT_QUEUE_TICKS() > hspi_next_send_at ||
+		(!hspi_task_args->deferred && hspi_sends_deferred != 0))
 	{
-		R32_HSPI_TX_ADDR0 = (vuint32_t)hspi_task_args->args.buffer;
-		R32_HSPI_UDF0 = ((hspi_task_args->args.size & HSPI_SERDES_TX_SIZE_MASK) |
-						 ((hspi_task_args->args.custom_register << 13) &
-						  ~HSPI_SERDES_TX_SIZE_MASK)) &
-						HSPI_USER_DEFINED_MASK;
-		// uint8_t* tx1_addr = hspi_task_args->args.buffer;
-		// LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI, "R32_HSPI_TX_ADDR0 DMA0 addr %x size
-		// %d %d %d %d %d %d\r\n", tx1_addr, hspi_task_args->args.size, tx1_addr[0],
-		// tx1_addr[1], tx1_addr[2], tx1_addr[3], tx1_addr[4]);
+		if (_hspi_send_defer(hspi_task_args))
+			return true;
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "no timer left to defer _hspi_send, waiting\r\n");
+		while (HYDRA_INTERRUPT_QUEUE_TICKS() > hspi_next_send_at)
+		{
+		}
 	}
+#endif
+
+	hspi_scheduled_current_dma_t dma =
+		(R8_HSPI_TX_SC & RB_HSPI_TX_TOG) ? HSPI_DMA_1 : HSPI_DMA_0;
+	BSP_ENTER_CRITICAL();
+	_hspi_tx_load_addr(dma, hspi_task_args);
+	_hspi_tx_load_header(dma, hspi_task_args);
 	hspi_transmission_finished = false;
 	BSP_EXIT_CRITICAL();
 
@@ -287,7 +983,7 @@ bool _hspi_send(uint8_t* data)
 	}
 
 	R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE;
-	hydra_interrupt_queue_task_t task;
+	hspi_transmission_finished = true;
 
 	// if transmissions happen too fast, the other side could still be in an
 	// interrupt and miss this transmission. this adds a high-enough delay to try
@@ -295,46 +991,753 @@ bool _hspi_send(uint8_t* data)
 	// HTRDY line to check if the receiving side is ready ... this must be done on
 	// hardware to prevent the DMA from shifting registers too fast (at least in
 	// some mode)
-	if (hydra_interrupt_queue_peek_next_task_prio0(&task))
+#ifdef INTERRUPT_QUEUE_TIMER
+	hspi_next_send_at = HYDRA_INTERRUPT_QUEUE_TICKS() -
+						(uint64_t)HSPI_SEND_GAP_US * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+#else
+	hydra_interrupt_queue_task_t task;
+	if (hydra_interrupt_queue_peek_next_task(&task))
 	{
 		if (task.task == _hspi_send)
 		{
 			LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI,
 				   "adding delay because of consecutive _hspi_send\r\n");
-			bsp_wait_us_delay(
-				500); // hope this is enough to prevent any miss on reception end
+			bsp_wait_us_delay(HSPI_SEND_GAP_US); // hope this is enough to prevent
+												 // any miss on reception end
 		}
 	}
+#endif
 
 	return true;
 }
 
+#endif
+
+/**
+ * @brief Queue a transmission, which holds a reference on its buffer until it
+ * is done
+ * @return false if it cannot be queued, the caller then releases the reference
+ */
+__attribute__((always_inline)) static inline bool _hspi_tx_queue(const hspi_args_t* hspi_task_args)
+{
+#ifdef HSPI_TX_PIPELINED
+	BSP_ENTER_CRITICAL();
+	bool queued = hspi_tx_ring_push(hspi_task_args);
+	if (queued)
+		_hspi_tx_kick();
+	BSP_EXIT_CRITICAL();
+	return queued;
+#else
+	return hydra_interrupt_queue_set_next_task_inline(
+		_hspi_send, hspi_task_args, sizeof(*hspi_task_args), _hspi_cleanup);
+#endif
+}
+
+#ifdef HSPI_RELIABLE
+__attribute__((always_inline)) static inline uint8_t _hspi_rel_tx_unacked(void)
+{
+	return (hspi_rel_tx_next - hspi_rel_tx_base) & HSPI_RELIABLE_SEQ_MASK;
+}
+
+__attribute__((always_inline)) static inline void _hspi_rel_tx_restart_timer(void)
+{
+	hspi_rel_tx_deadline =
+		HYDRA_INTERRUPT_QUEUE_TICKS() -
+		(uint64_t)HSPI_RELIABLE_TIMEOUT_US * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+}
+
+/**
+ * @brief Send frame seq of the window again, with a new reference on its
+ * buffer
+ */
+__attribute__((always_inline)) static inline void _hspi_rel_retransmit(uint8_t seq)
+{
+	const hspi_args_t* frame = &hspi_rel_tx_window[seq % HSPI_RELIABLE_WINDOW];
+
+	// hspi_send and hspi_send_buf may change the window from an interrupt
+	// handler
+	BSP_ENTER_CRITICAL();
+	ramx_take_ownership(frame->base);
+	if (_hspi_tx_queue(frame))
+	{
+		hspi_rel_stats.retransmits++;
+		_hspi_rel_tx_restart_timer();
+	}
+	else
+	{
+		// the TX path is full, the timer tries again
+		ramx_pool_free(frame->base);
+	}
+	BSP_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Release the frames before seq, received by the other side
+ */
+__attribute__((always_inline)) static inline void _hspi_rel_acked(uint8_t seq)
+{
+	BSP_ENTER_CRITICAL();
+	uint8_t acked = (seq - hspi_rel_tx_base) & HSPI_RELIABLE_SEQ_MASK;
+
+	// unless it is an old control frame
+	if (acked != 0 && acked <= _hspi_rel_tx_unacked())
+	{
+		for (; hspi_rel_tx_base != seq;
+			 hspi_rel_tx_base = (hspi_rel_tx_base + 1) & HSPI_RELIABLE_SEQ_MASK)
+			ramx_pool_free(hspi_rel_tx_window[hspi_rel_tx_base % HSPI_RELIABLE_WINDOW].base);
+		_hspi_rel_tx_restart_timer();
+	}
+	BSP_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Send a control frame of type HSPI_RELIABLE_ACK or HSPI_RELIABLE_NACK,
+ * outside of the window
+ * @return false if it cannot be sent yet
+ */
+__attribute__((always_inline)) static inline bool _hspi_rel_send_ctrl(uint8_t type, uint8_t seq)
+{
+	hspi_args_t hspi_task_args = {
+		.base = hspi_rel_ctrl_buffer,
+		.offset = 0,
+		.size = HSPI_RELIABLE_CTRL_SIZE,
+		.custom_register = (uint16_t)(HSPI_RELIABLE_CTRL |
+									  (seq << HSPI_RELIABLE_SEQ_SHIFT) | type)
+	};
+
+	if (hspi_rel_ctrl_buffer == NULL)
+		return false;
+	ramx_take_ownership(hspi_rel_ctrl_buffer);
+	if (!_hspi_tx_queue(&hspi_task_args))
+	{
+		ramx_pool_free(hspi_rel_ctrl_buffer);
+		return false;
+	}
+	return true;
+}
+
+bool _hspi_rel_ctrl(uint8_t* data);
+bool _hspi_rel_ctrl(uint8_t* data)
+{
+	(void)data;
+	BSP_ENTER_CRITICAL();
+	// the interrupt handler can schedule it again from now on
+	hspi_rel_ctrl_scheduled = false;
+	bool nack = hspi_rel_nack_pending;
+	bool ack = hspi_rel_ack_pending;
+	hspi_rel_nack_pending = false;
+	hspi_rel_ack_pending = false;
+	BSP_EXIT_CRITICAL();
+
+	if (!nack && !ack)
+		return true;
+	// a NACK acknowledges the frames before the missing one as well
+	if (_hspi_rel_send_ctrl(nack ? HSPI_RELIABLE_NACK : HSPI_RELIABLE_ACK,
+							hspi_rel_rx_expected))
+	{
+		if (nack)
+			hspi_rel_stats.nacks_sent++;
+		else
+			hspi_rel_stats.acks_sent++;
+		return true;
+	}
+	// sent again by hspi_reliable_poll
+	BSP_ENTER_CRITICAL();
+	hspi_rel_nack_pending = hspi_rel_nack_pending || nack;
+	hspi_rel_ack_pending = hspi_rel_ack_pending || ack;
+	BSP_EXIT_CRITICAL();
+	return true;
+}
+
+/**
+ * @brief Send an ACK, or a NACK, once the received frames already in the
+ * interrupt queue have been handled. Can be called from the interrupt handler.
+ */
+__attribute__((always_inline)) static inline void _hspi_rel_ctrl_schedule(bool nack)
+{
+	BSP_ENTER_CRITICAL();
+	if (nack)
+		hspi_rel_nack_pending = true;
+	else
+		hspi_rel_ack_pending = true;
+	// otherwise hspi_reliable_poll schedules it
+	if (!hspi_rel_ctrl_scheduled)
+		hspi_rel_ctrl_scheduled = hydra_interrupt_queue_set_next_task_prio(
+			HSPI_RX_TASK_PRIO, _hspi_rel_ctrl, NULL, NULL);
+	BSP_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Number the transmission and keep it in the window until the other
+ * side has acknowledged it. Can be called from the interrupt handler.
+ */
+__attribute__((always_inline)) static inline bool _hspi_tx_submit(const hspi_args_t* hspi_task_args)
+{
+	hspi_args_t frame = *hspi_task_args;
+	bool queued = false;
+
+	// the sequence number is taken once the frame is in the window
+	BSP_ENTER_CRITICAL();
+	if (_hspi_rel_tx_unacked() < HSPI_RELIABLE_WINDOW)
+	{
+		frame.custom_register =
+			(uint16_t)((hspi_rel_tx_next << HSPI_RELIABLE_SEQ_SHIFT) |
+					   (frame.custom_register & HSPI_RELIABLE_CUSTOM_MASK));
+		// the reference of the window
+		ramx_take_ownership(frame.base);
+		queued = _hspi_tx_queue(&frame);
+		if (queued)
+		{
+			if (_hspi_rel_tx_unacked() == 0)
+				_hspi_rel_tx_restart_timer();
+			hspi_rel_tx_window[hspi_rel_tx_next % HSPI_RELIABLE_WINDOW] = frame;
+			hspi_rel_tx_next = (hspi_rel_tx_next + 1) & HSPI_RELIABLE_SEQ_MASK;
+		}
+		else
+		{
+			ramx_pool_free(frame.base);
+		}
+	}
+	BSP_EXIT_CRITICAL();
+	return queued;
+}
+
+void _hspi_rel_rx(const hspi_args_t* frame)
+{
+	uint16_t custom_register = frame->custom_register;
+	uint8_t seq = (custom_register >> HSPI_RELIABLE_SEQ_SHIFT) & HSPI_RELIABLE_SEQ_MASK;
+
+	if (custom_register & HSPI_RELIABLE_CTRL)
+	{
+		BSP_ENTER_CRITICAL();
+		_hspi_rel_acked(seq);
+		// frame seq is the oldest one left, unless the NACK is an old one
+		if ((custom_register & HSPI_RELIABLE_CUSTOM_MASK) == HSPI_RELIABLE_NACK &&
+			seq == hspi_rel_tx_base && seq != hspi_rel_tx_next)
+			_hspi_rel_retransmit(seq);
+		BSP_EXIT_CRITICAL();
+		return;
+	}
+
+	hspi_args_t data = *frame;
+	uint8_t ahead = (seq - hspi_rel_rx_expected) & HSPI_RELIABLE_SEQ_MASK;
+	data.custom_register = custom_register & HSPI_RELIABLE_CUSTOM_MASK;
+
+	if (ahead >= HSPI_RELIABLE_WINDOW)
+	{
+		// delivered already, the ACK may have been lost
+		hspi_rel_stats.duplicates++;
+		_hspi_rel_ctrl_schedule(false);
+		return;
+	}
+	if (ahead != 0)
+	{
+		// held until the missing frames arrive, NACK the first one
+		uint32_t slot = seq % HSPI_RELIABLE_WINDOW;
+		if (!(hspi_rel_rx_held_mask & (1u << slot)))
+		{
+			ramx_take_ownership(data.base);
+			hspi_rel_rx_held[slot] = data;
+			hspi_rel_rx_held_mask |= 1u << slot;
+		}
+		if (!hspi_rel_rx_nacked)
+		{
+			hspi_rel_rx_nacked = true;
+			_hspi_rel_ctrl_schedule(true);
+		}
+		return;
+	}
+
+	_hspi_rx_dispatch(&data);
+	hspi_rel_rx_expected = (hspi_rel_rx_expected + 1) & HSPI_RELIABLE_SEQ_MASK;
+	hspi_rel_rx_nacked = false;
+	for (uint32_t slot = hspi_rel_rx_expected % HSPI_RELIABLE_WINDOW;
+		 hspi_rel_rx_held_mask & (1u << slot);
+		 slot = hspi_rel_rx_expected % HSPI_RELIABLE_WINDOW)
+	{
+		hspi_rel_rx_held_mask &= ~(1u << slot);
+		_hspi_rx_dispatch(&hspi_rel_rx_held[slot]);
+		ramx_pool_free(hspi_rel_rx_held[slot].base);
+		hspi_rel_rx_expected = (hspi_rel_rx_expected + 1) & HSPI_RELIABLE_SEQ_MASK;
+	}
+	_hspi_rel_ctrl_schedule(false);
+}
+
+bool hspi_reliable_poll(void)
+{
+	BSP_ENTER_CRITICAL();
+	if ((hspi_rel_ack_pending || hspi_rel_nack_pending) && !hspi_rel_ctrl_scheduled)
+		hspi_rel_ctrl_scheduled = hydra_interrupt_queue_set_next_task_prio(
+			HSPI_RX_TASK_PRIO, _hspi_rel_ctrl, NULL, NULL);
+	bool retransmit = _hspi_rel_tx_unacked() != 0 &&
+					  HYDRA_INTERRUPT_QUEUE_TICKS() <= hspi_rel_tx_deadline;
+	if (retransmit)
+	{
+		_hspi_rel_retransmit(hspi_rel_tx_base);
+		// try again later if the TX path is full
+		_hspi_rel_tx_restart_timer();
+	}
+	BSP_EXIT_CRITICAL();
+	return retransmit;
+}
+
+uint16_t hspi_reliable_unacked(void) { return _hspi_rel_tx_unacked(); }
+
+void hspi_reliable_get_stats(hspi_reliable_stats_t* stats)
+{
+	*stats = hspi_rel_stats;
+}
+#else
+__attribute__((always_inline)) static inline bool _hspi_tx_submit(const hspi_args_t* hspi_task_args)
+{
+	return _hspi_tx_queue(hspi_task_args);
+}
+#endif
+
+/**
+ * @brief Check the custom register given to hspi_send or hspi_send_buf
+ */
+__attribute__((always_inline)) static inline bool _hspi_custom_register_valid(uint16_t custom_register)
+{
+#ifdef HSPI_RELIABLE
+	// the other bits hold the sequence number
+	if (custom_register > HSPI_RELIABLE_CUSTOM_MASK)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "custom register %x does not fit in HSPI_RELIABLE_CUSTOM_MASK\r\n",
+			   custom_register);
+		return false;
+	}
+#endif
+#ifdef HSPI_COALESCE
+	if (custom_register == HSPI_COALESCED)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "custom register %x is kept for the coalesced frames\r\n",
+			   custom_register);
+		return false;
+	}
+#endif
+	(void)custom_register;
+	return true;
+}
+
 bool hspi_send(uint8_t* buffer, uint16_t size, uint16_t custom_register)
 {
-	hspi_args_t* hspi_task_args = hydra_pool_get(&hspi_arg_pool);
-	if (hspi_task_args == NULL)
+	hspi_args_t hspi_task_args;
+
+	if (!_hspi_custom_register_valid(custom_register))
+		return false;
+#ifdef HSPI_COALESCE
+	// after the messages coalesced so far
+	if (!hspi_coalesce_flush())
 		return false;
+#endif
+
+#ifdef HSPI_BURST_LEN
+	if (size > hspi_rx_buffer_size)
+		return false;
+	// the DMA reads whole frames
+	uint16_t buffer_size = (uint16_t)(_hspi_frames(size) * hspi_packet_size);
+#else
+	uint16_t buffer_size = hspi_packet_size;
+#endif
 
 	// only copy to a new buffer if buffer is not in ramx_pool already
 	if (!ramx_address_in_pool(buffer))
 	{
-		uint8_t* new_buffer = ramx_pool_alloc_bytes(hspi_packet_size);
+		uint8_t* new_buffer = ramx_pool_alloc_bytes(buffer_size);
 		if (new_buffer == NULL)
 			return false;
 		memcpy(new_buffer, buffer, size);
-		hspi_task_args->args.buffer = new_buffer;
+		buffer = new_buffer;
 	}
 	else
 	{
 		ramx_take_ownership(buffer);
-		hspi_task_args->args.buffer = buffer;
 	}
-	hspi_task_args->args.size = size;
-	hspi_task_args->args.custom_register = custom_register;
-	hydra_interrupt_queue_set_next_task(_hspi_send, (uint8_t*)hspi_task_args,
-										_hspi_cleanup);
+	hspi_task_args.base = buffer;
+	hspi_task_args.offset = 0;
+	hspi_task_args.size = size;
+	hspi_task_args.custom_register = custom_register;
+	hspi_task_args.deferred = false;
+	if (!_hspi_tx_submit(&hspi_task_args))
+	{
+		ramx_pool_free(buffer);
+		return false;
+	}
+	return true;
+}
+
+bool hspi_send_buf(const hydra_buf_t* buf, uint16_t custom_register)
+{
+	if (!_hspi_custom_register_valid(custom_register))
+		return false;
+	const uint8_t* data = buf_data(buf);
+
+	// the DMA reads whole words
+	if (((uintptr_t)data & 3) != 0)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "hspi_send_buf data %x is not aligned\r\n", data);
+		return false;
+	}
+#ifdef HSPI_BURST_LEN
+	if (buf->length > hspi_rx_buffer_size)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "hspi_send_buf %d bytes do not fit in a burst\r\n", buf->length);
+		return false;
+	}
+#endif
+#ifdef HSPI_COALESCE
+	// after the messages coalesced so far
+	if (!hspi_coalesce_flush())
+		return false;
+#endif
+
+	hspi_args_t hspi_task_args = { .base = buf->base,
+								   .offset = buf->offset,
+								   .size = buf->length,
+								   .custom_register = custom_register };
+
+	buf_ref(buf);
+	if (!_hspi_tx_submit(&hspi_task_args))
+	{
+		buf_unref(buf);
+		return false;
+	}
+	return true;
+}
+
+#ifdef HSPI_COALESCE
+bool hspi_coalesce_flush(void)
+{
+	bool sent = true;
+
+	// hspi_send and hspi_send_buf may flush from an interrupt handler
+	BSP_ENTER_CRITICAL();
+	if (hspi_coalesce_frame != NULL)
+	{
+		hspi_args_t hspi_task_args = { .base = hspi_coalesce_frame,
+									   .offset = 0,
+									   .size = hspi_coalesce_fill,
+									   .custom_register = HSPI_COALESCED };
+
+		// the reference on the frame is handed over to the transmission
+		sent = _hspi_tx_submit(&hspi_task_args);
+		if (sent)
+		{
+			hspi_coalesce_frame = NULL;
+			hspi_coalesce_fill = 0;
+			hspi_coalesce_generation++;
+		}
+	}
+	BSP_EXIT_CRITICAL();
+	return sent;
+}
+
+bool hspi_coalesce_poll(void)
+{
+	bool sent = false;
+
+	BSP_ENTER_CRITICAL();
+	if (hspi_coalesce_frame != NULL &&
+		HYDRA_INTERRUPT_QUEUE_TICKS() <= hspi_coalesce_deadline)
+		sent = hspi_coalesce_flush();
+	BSP_EXIT_CRITICAL();
+	return sent;
+}
+
+void hspi_coalesce_set_linger_us(uint32_t linger_us)
+{
+	hspi_coalesce_linger_us = linger_us;
+}
+
+#ifdef INTERRUPT_QUEUE_TIMER
+bool _hspi_coalesce_linger(uint8_t* data);
+
+/**
+ * @brief Send the frame of generation hspi_coalesce_generation delay_us from
+ * now, unless it has been sent by then
+ */
+__attribute__((always_inline)) static inline void _hspi_coalesce_schedule(uint32_t delay_us)
+{
+	uint32_t generation = hspi_coalesce_generation;
+
+	if (!hydra_interrupt_queue_set_task_after(
+			delay_us, HYDRA_INTERRUPT_QUEUE_HIGH_PRIO, _hspi_coalesce_linger,
+			&generation, sizeof(generation), NULL))
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "no timer left for the coalesced frame, see hspi_coalesce_poll\r\n");
+}
+
+bool _hspi_coalesce_linger(uint8_t* data)
+{
+	uint32_t generation = *(uint32_t*)data;
+
+	BSP_ENTER_CRITICAL();
+	// the TX path is full, try again
+	if (generation == hspi_coalesce_generation && !hspi_coalesce_flush())
+		_hspi_coalesce_schedule(INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+	BSP_EXIT_CRITICAL();
+	return true;
+}
+#endif
+
+bool hspi_sendv(const hspi_iovec_t* parts, uint8_t n, uint16_t custom_register)
+{
+	uint32_t size = 0;
+	bool first = false;
+
+	for (uint8_t i = 0; i < n; ++i)
+		size += parts[i].size;
+	uint32_t footprint = _hspi_msg_footprint(size);
+	if (footprint > hspi_rx_buffer_size)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_HSPI,
+			   "hspi_sendv %d bytes do not fit in a frame\r\n", size);
+		return false;
+	}
+	// hspi_send and hspi_send_buf may flush the frame from an interrupt handler
+	BSP_ENTER_CRITICAL();
+	if (hspi_coalesce_frame != NULL &&
+		hspi_coalesce_fill + footprint > hspi_rx_buffer_size &&
+		!hspi_coalesce_flush())
+	{
+		BSP_EXIT_CRITICAL();
+		return false;
+	}
+	if (hspi_coalesce_frame == NULL)
+	{
+		hspi_coalesce_frame = ramx_pool_alloc_bytes(hspi_rx_buffer_size);
+		if (hspi_coalesce_frame == NULL)
+		{
+			BSP_EXIT_CRITICAL();
+			return false;
+		}
+		hspi_coalesce_deadline =
+			HYDRA_INTERRUPT_QUEUE_TICKS() -
+			(uint64_t)hspi_coalesce_linger_us * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+		first = true;
+	}
+
+	uint8_t* msg = hspi_coalesce_frame + hspi_coalesce_fill;
+	uint32_t offset = HSPI_MSG_HEADER_SIZE;
+	msg[0] = (uint8_t)size;
+	msg[1] = (uint8_t)(size >> 8);
+	msg[2] = (uint8_t)custom_register;
+	msg[3] = (uint8_t)(custom_register >> 8);
+	for (uint8_t i = 0; i < n; ++i)
+	{
+		memcpy(msg + offset, parts[i].data, parts[i].size);
+		offset += parts[i].size;
+	}
+	memset(msg + offset, 0, footprint - offset);
+	hspi_coalesce_fill = (uint16_t)(hspi_coalesce_fill + footprint);
+
+	// once full, or without linger time. If the TX path is full, the frame is
+	// sent by the linger task or hspi_coalesce_poll.
+	bool sent = (hspi_coalesce_linger_us == 0 ||
+				 hspi_coalesce_fill + HSPI_MSG_HEADER_SIZE > hspi_rx_buffer_size) &&
+				hspi_coalesce_flush();
+#ifdef INTERRUPT_QUEUE_TIMER
+	if (!sent && first)
+		_hspi_coalesce_schedule(hspi_coalesce_linger_us);
+#else
+	(void)first;
+	(void)sent;
+#endif
+	BSP_EXIT_CRITICAL();
+	return true;
+}
+#endif
+
+bool _hspi_rx_ring_refill(uint8_t* data);
+bool _hspi_rx_ring_refill(uint8_t* data)
+{
+	(void)data;
+	// cleared first, so that the interrupt handler can schedule a new refill
+	// while this one runs
+	hspi_rx_ring_refill_scheduled = false;
+	if (hspi_scheduled_user_handled.hspi_rx_ring_low_callback != NULL)
+		hspi_scheduled_user_handled.hspi_rx_ring_low_callback(
+			hspi_rx_ring_count(), hspi_rx_state);
+	_hspi_rx_ring_fill();
+#ifdef HSPI_FLOW_CONTROL
+	if (_hspi_rx_credit_limit() != hspi_rx_credit_advertised)
+		_hspi_rx_credit_advertise(false);
+#endif
+	return true;
+}
+
+__attribute__((always_inline)) static inline void _hspi_rx_ring_schedule_refill(void)
+{
+	if (hspi_rx_ring_count() > hspi_rx_ring_low_watermark ||
+		hspi_rx_ring_refill_scheduled)
+		return;
+	hspi_rx_ring_refill_scheduled =
+		hydra_interrupt_queue_set_next_task(_hspi_rx_ring_refill, NULL, NULL);
+}
+
+/**
+ * @brief Hand the buffer filled by the DMA over to the interrupt queue and
+ * return the buffer to re-arm the DMA with, taken from the RX ring. If the
+ * packet cannot be handed over, it is dropped and the filled buffer is re-armed.
+ */
+__attribute__((always_inline)) static inline uint8_t* _hspi_rx_rearm(uint8_t* filled, uint32_t udf,
+																	uint16_t frames)
+{
+	hspi_rx_buffer_t next = filled;
+	hspi_args_t hspi_task_args;
+
+#ifdef HSPI_FLOW_CONTROL
+	if ((udf & HSPI_SERDES_TX_SIZE_MASK) == HSPI_ACK)
+	{
+		_hspi_tx_credit_received((udf & HSPI_USER_DEFINED_MASK) >> 13);
+		return filled;
+	}
+	hspi_rx_frames = (hspi_rx_frames + 1) & HSPI_CREDIT_MASK;
+#endif
+
+	// the interrupt handler is the only consumer of the ring : if it is not
+	// empty now, the pop below cannot fail
+	if (hspi_rx_ring_count() == 0)
+	{
+		hspi_rx_state = HSPI_RX_STATE_BACKPRESSURE;
+		hspi_rx_dropped++;
+		_hspi_rx_ring_schedule_refill();
+		return filled;
+	}
+
+	hspi_task_args.base = filled;
+	hspi_task_args.offset = 0;
+	// the header holds the size of the last frame
+	hspi_task_args.size =
+		(uint16_t)((frames - 1) * hspi_packet_size +
+				   ((udf & HSPI_USER_DEFINED_MASK) & HSPI_SERDES_TX_SIZE_MASK));
+	hspi_task_args.custom_register = (udf & HSPI_USER_DEFINED_MASK) >> 13;
+	hspi_task_args.deferred = false;
+	if (!hydra_interrupt_queue_set_next_task_inline_prio(
+			HSPI_RX_TASK_PRIO, _hspi_rx_callback, &hspi_task_args,
+			sizeof(hspi_task_args), _hspi_cleanup))
+	{
+		hspi_rx_dropped++;
+#ifdef HSPI_FLOW_CONTROL
+		// the RX buffer was not used, its credit is given back
+		_hspi_rx_credit_advertise(false);
+#endif
+		return filled;
+	}
+
+	hspi_rx_ring_pop(&next);
+	hspi_rx_state = HSPI_RX_STATE_RUNNING;
+	_hspi_rx_ring_schedule_refill();
+	return next;
+}
+
+void hspi_rx_ring_set_low_watermark(uint16_t low_watermark)
+{
+	hspi_rx_ring_low_watermark = low_watermark;
+}
+
+hspi_rx_state_t hspi_rx_get_state(void) { return hspi_rx_state; }
+
+uint32_t hspi_rx_dropped_packets(void) { return hspi_rx_dropped; }
+
+#ifdef HSPI_ERROR_INJECTION
+void hspi_inject_rx_errors(uint16_t one_in)
+{
+	hspi_inject_one_in = one_in;
+}
+
+uint32_t hspi_injected_rx_errors(void) { return hspi_inject_count; }
+
+/**
+ * @brief Whether the received frame with header udf is to be handled as if
+ * its CRC was wrong. Credit frames are left alone.
+ */
+__attribute__((always_inline)) static inline bool _hspi_inject_error(uint32_t udf)
+{
+	if (hspi_inject_one_in == 0 || (udf & HSPI_SERDES_TX_SIZE_MASK) == HSPI_ACK)
+		return false;
+	hspi_inject_seed = hspi_inject_seed * 1103515245 + 12345;
+	if ((hspi_inject_seed >> 16) % hspi_inject_one_in != 0)
+		return false;
+	hspi_inject_count++;
 	return true;
 }
+#endif
+
+/**
+ * @brief Hand over the frames received by the DMA selected by the toggle bit
+ * (a single frame, or a whole burst with HSPI_BURST_LEN) and re-arm it
+ */
+__attribute__((always_inline)) static inline void _hspi_rx_done(uint16_t frames)
+{
+	vuint32_t udf0 = R32_HSPI_UDF0;
+	vuint32_t udf1 = R32_HSPI_UDF1;
+	bool valid = (R8_HSPI_RTX_STATUS & (RB_HSPI_CRC_ERR | RB_HSPI_NUM_MIS)) == 0;
+
+#ifdef HSPI_ERROR_INJECTION
+	if (valid && _hspi_inject_error((R8_HSPI_RX_SC & RB_HSPI_RX_TOG) ? udf0 : udf1))
+		valid = false;
+#endif
+	if (valid)
+	{
+		if (R8_HSPI_RX_SC & RB_HSPI_RX_TOG)
+		{
+			hspi_rx_buffer_0 = _hspi_rx_rearm(hspi_rx_buffer_0, udf0, frames);
+			R32_HSPI_RX_ADDR0 = (vuint32_t)hspi_rx_buffer_0;
+		}
+		else
+		{
+			hspi_rx_buffer_1 = _hspi_rx_rearm(hspi_rx_buffer_1, udf1, frames);
+			R32_HSPI_RX_ADDR1 = (vuint32_t)hspi_rx_buffer_1;
+		}
+	}
+	else
+	{
+		LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI,
+			   "ERROR : either CRC or NUM toggle mismatch \r\n");
+		hspi_scheduled_user_handled.hspi_err_crc_num_mismatch_callback();
+#ifdef HSPI_RELIABLE
+		// the frame is sent again once the other side gets the NACK
+		if (!hspi_rel_rx_nacked)
+		{
+			hspi_rel_rx_nacked = true;
+			_hspi_rel_ctrl_schedule(true);
+		}
+#endif
+#ifdef HSPI_FLOW_CONTROL
+		// most likely a data frame, counted so that its credit is not
+		// lost. If it was a credit frame, the other side sends it again.
+		hspi_rx_frames = (hspi_rx_frames + 1) & HSPI_CREDIT_MASK;
+		_hspi_rx_credit_advertise(true);
+#endif
+	}
+}
+
+#ifdef HSPI_BURST_LEN
+/**
+ * @brief Called by HSPI_IRQHandler when a burst is done. The same flag is
+ * raised for the bursts sent and received, the toggle bits tell them apart.
+ */
+__attribute__((always_inline)) static inline void _hspi_burst_done_irq(void)
+{
+	bool rx_tog = (R8_HSPI_RX_SC & RB_HSPI_RX_TOG) != 0;
+
+	if (rx_tog != hspi_rx_tog)
+	{
+		hspi_rx_tog = rx_tog;
+		uint16_t frames = R8_HSPI_BURST_CNT;
+		_hspi_rx_done(frames == 0 ? 1 : frames);
+	}
+	// the TX toggle bit selects hspi_tx_next_dma once the burst is sent
+	if (((R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0) == (hspi_tx_next_dma == HSPI_DMA_1))
+		_hspi_tx_done_irq();
+}
+#endif
 
 __attribute__((interrupt("WCH-Interrupt-fast"))) void HSPI_IRQHandler(void);
 __attribute__((interrupt("WCH-Interrupt-fast"))) void HSPI_IRQHandler(void)
@@ -343,67 +1746,21 @@ __attribute__((interrupt("WCH-Interrupt-fast"))) void HSPI_IRQHandler(void)
 	// HSPI_RX_LEN0 %d HSPI_RX_LEN1 %d \r\n", HSPI_RX_SC & RB_HSPI_RX_NUM,
 	// HSPI_TX_SC & RB_HSPI_TX_NUM, R16_HSPI_DMA_LEN0, R16_HSPI_DMA_LEN1);
 
+#ifndef HSPI_BURST_LEN
 	if (R8_HSPI_INT_FLAG & RB_HSPI_IF_R_DONE)
 	{
 		R8_HSPI_INT_FLAG = RB_HSPI_IF_R_DONE; // Clear Interrupt
+		_hspi_rx_done(1);
+	}
 
-		vuint32_t udf0 = R32_HSPI_UDF0;
-		vuint32_t udf1 = R32_HSPI_UDF1;
-
-		if ((R8_HSPI_RTX_STATUS & (RB_HSPI_CRC_ERR | RB_HSPI_NUM_MIS)) == 0)
-		{
-			if (R8_HSPI_RX_SC & RB_HSPI_RX_TOG)
-			{
-				hspi_args_t* hspi_task_args = hydra_pool_get(&hspi_arg_pool);
-				if (hspi_task_args != NULL)
-				{
-					// LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI, "R8_HSPI_RX_SC DMA0 addr %x %d
-					// %d %d %d %d / DMA1 %x %d %d %d %d %d\r\n", hspi_rx_buffer_0,
-					// hspi_rx_buffer_0[0], hspi_rx_buffer_0[1], hspi_rx_buffer_0[2],
-					// hspi_rx_buffer_0[3], hspi_rx_buffer_0[4], hspi_rx_buffer_1,
-					// hspi_rx_buffer_1[0], hspi_rx_buffer_1[1], hspi_rx_buffer_1[2],
-					// hspi_rx_buffer_1[3], hspi_rx_buffer_1[4]);
-					hspi_task_args->args.buffer = hspi_rx_buffer_0;
-					hspi_task_args->args.size =
-						(udf0 & HSPI_USER_DEFINED_MASK) & HSPI_SERDES_TX_SIZE_MASK;
-					hspi_task_args->args.custom_register =
-						(udf0 & HSPI_USER_DEFINED_MASK) >> 13;
-					hydra_interrupt_queue_set_next_task(
-						_hspi_rx_callback, (uint8_t*)hspi_task_args, _hspi_cleanup);
-				}
-				hspi_rx_buffer_0 = ramx_pool_alloc_bytes(hspi_packet_size);
-				R32_HSPI_RX_ADDR0 = (vuint32_t)hspi_rx_buffer_0;
-			}
-			else
-			{
-				hspi_args_t* hspi_task_args = hydra_pool_get(&hspi_arg_pool);
-				if (hspi_task_args != NULL)
-				{
-					// LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI, "R8_HSPI_RX_SC DMA1 addr %x %d
-					// %d %d %d %d / DMA0 %x %d %d %d %d %d\r\n", hspi_rx_buffer_1,
-					// hspi_rx_buffer_1[0], hspi_rx_buffer_1[1], hspi_rx_buffer_1[2],
-					// hspi_rx_buffer_1[3], hspi_rx_buffer_1[4], hspi_rx_buffer_0,
-					// hspi_rx_buffer_0[0], hspi_rx_buffer_0[1], hspi_rx_buffer_0[2],
-					// hspi_rx_buffer_0[3], hspi_rx_buffer_0[4]);
-					hspi_task_args->args.buffer = hspi_rx_buffer_1;
-					hspi_task_args->args.size =
-						(udf1 & HSPI_USER_DEFINED_MASK) & HSPI_SERDES_TX_SIZE_MASK;
-					hspi_task_args->args.custom_register =
-						(udf1 & HSPI_USER_DEFINED_MASK) >> 13;
-					hydra_interrupt_queue_set_next_task(
-						_hspi_rx_callback, (uint8_t*)hspi_task_args, _hspi_cleanup);
-				}
-				hspi_rx_buffer_1 = ramx_pool_alloc_bytes(hspi_packet_size);
-				R32_HSPI_RX_ADDR1 = (vuint32_t)hspi_rx_buffer_1;
-			}
-		}
-		else
-		{
-			LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI,
-				   "ERROR : either CRC or NUM toggle mismatch \r\n");
-			hspi_scheduled_user_handled.hspi_err_crc_num_mismatch_callback();
-		}
+#ifdef HSPI_TX_PIPELINED
+	if (R8_HSPI_INT_FLAG & RB_HSPI_IF_T_DONE)
+	{
+		R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE; // Clear Interrupt
+		_hspi_tx_done_irq();
 	}
+#endif
+#endif
 
 	if (R8_HSPI_INT_FLAG & RB_HSPI_IF_FIFO_OV)
 	{
@@ -413,7 +1770,14 @@ __attribute__((interrupt("WCH-Interrupt-fast"))) void HSPI_IRQHandler(void)
 
 	if (R8_HSPI_INT_FLAG & RB_HSPI_IF_B_DONE)
 	{
+#ifdef HSPI_BURST_LEN
+		// the frames of the burst raised R_DONE or T_DONE as well, not enabled
+		R8_HSPI_INT_FLAG = RB_HSPI_IF_B_DONE | RB_HSPI_IF_R_DONE |
+						   RB_HSPI_IF_T_DONE; // Clear Interrupt
+		_hspi_burst_done_irq();
+#else
 		LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_HSPI, "RB_HSPI_IF_B_DONE \r\n");
 		R8_HSPI_INT_FLAG = RB_HSPI_IF_B_DONE; // Clear Interrupt
+#endif
 	}
 }
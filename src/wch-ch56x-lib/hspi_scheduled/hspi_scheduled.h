@@ -37,6 +37,7 @@ function is scheduled.
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "wch-ch56x-lib/memory/buf.h"
 #include "wch-ch56x-lib/memory/ramx_alloc.h"
 
 #ifdef __cplusplus
@@ -63,6 +64,170 @@ typedef enum HSPI_TYPE
 
 #define HSPI_USER_DEFINED_MASK 0x03ffffff
 
+/**
+ * Received packets are handed over to the interrupt queue, and the DMA is
+ * re-armed with a buffer allocated in advance, taken from a ring of
+ * 2^HSPI_RX_RING_LOG2_SIZE buffers. The ring is refilled by a task of the
+ * interrupt queue once it holds HSPI_RX_RING_LOW_WATERMARK buffers or less.
+ */
+#ifndef HSPI_RX_RING_LOG2_SIZE
+#define HSPI_RX_RING_LOG2_SIZE 2
+#endif
+
+#ifndef HSPI_RX_RING_LOW_WATERMARK
+#define HSPI_RX_RING_LOW_WATERMARK 1
+#endif
+
+/**
+ * Priority of the interrupt queue tasks calling hspi_rx_callback. By default,
+ * the lowest one, so that a burst of received packets does not delay the
+ * other tasks (e.g. USB control requests). The ring refills and the
+ * transmissions use HYDRA_INTERRUPT_QUEUE_HIGH_PRIO.
+ */
+#ifndef HSPI_RX_TASK_PRIO
+#define HSPI_RX_TASK_PRIO HYDRA_INTERRUPT_QUEUE_LOW_PRIO
+#endif
+
+/**
+ * Minimum time between the end of a transmission and the start of the next
+ * one, so that the other side has left its interrupt handler. With
+ * INTERRUPT_QUEUE_TIMER, a transmission coming too early is deferred with
+ * hydra_interrupt_queue_set_task_at and the main loop runs the other tasks
+ * meanwhile. Otherwise, _hspi_send busy-waits this long when the next task is
+ * another transmission.
+ */
+#ifndef HSPI_SEND_GAP_US
+#define HSPI_SEND_GAP_US 500
+#endif
+
+/**
+ * With HSPI_TX_PIPELINED, hspi_send and hspi_send_buf push the transmission to
+ * a ring of 2^HSPI_TX_RING_LOG2_SIZE transmissions instead of the interrupt
+ * queue. The transmit done interrupt starts the next transmission, and loads
+ * the one after it in the idle TX DMA while the other one is on the wire : the
+ * main loop never waits for a transmission, and there is no gap between them
+ * (HSPI_SEND_GAP_US is not used). The other side must re-arm its RX DMA from
+ * its interrupt handler, like hspi_scheduled does with its RX ring.
+ */
+#ifndef HSPI_TX_RING_LOG2_SIZE
+#define HSPI_TX_RING_LOG2_SIZE 3
+#endif
+
+/**
+ * With HSPI_FLOW_CONTROL (on top of HSPI_TX_PIPELINED), data frames are only
+ * sent while the other side has credits left : the number of RX buffers it
+ * advertised in its last credit frame, minus the data frames sent since. A
+ * credit frame is a transmission of HSPI_ACK_FRAME_SIZE bytes whose header holds
+ * HSPI_ACK as size and the credit count as custom register. It is sent when the
+ * RX ring has been refilled, and is handled by the interrupt handler of the
+ * other side, without using an RX buffer. Both sides must use this option.
+ */
+#ifndef HSPI_ACK_FRAME_SIZE
+#define HSPI_ACK_FRAME_SIZE 4
+#endif
+
+#if defined(HSPI_FLOW_CONTROL) && !defined(HSPI_TX_PIPELINED)
+#error "HSPI_FLOW_CONTROL requires HSPI_TX_PIPELINED"
+#endif
+
+#if defined(HSPI_FLOW_CONTROL) && HSPI_RX_RING_LOG2_SIZE > 11
+#error "HSPI_FLOW_CONTROL counts credits on 12 bits"
+#endif
+
+/**
+ * With HSPI_BURST_LEN (on top of HSPI_TX_PIPELINED), hspi_send and
+ * hspi_send_buf accept up to HSPI_BURST_LEN * size bytes (less than 64KiB), sent
+ * as a burst of frames of size bytes answered by the hardware : there is one
+ * interrupt per burst on both sides (RB_HSPI_IF_B_DONE) instead of one per
+ * frame. The RX buffers hold a whole burst, and the header of a burst holds the
+ * size of its last frame. HSPI_BURST_ACK_TX_MOD and HSPI_BURST_ACK_CNT_SEL are
+ * the values of RB_HSPI_ACK_TX_MOD and RB_HSPI_ACK_CNT_SEL, the timing of the
+ * hardware acknowledgements (0 is a delay of 2T). Both sides must use the same
+ * options.
+ */
+#ifndef HSPI_BURST_ACK_TX_MOD
+#define HSPI_BURST_ACK_TX_MOD 0
+#endif
+
+#ifndef HSPI_BURST_ACK_CNT_SEL
+#define HSPI_BURST_ACK_CNT_SEL 0
+#endif
+
+#if defined(HSPI_BURST_LEN) && !defined(HSPI_TX_PIPELINED)
+#error "HSPI_BURST_LEN requires HSPI_TX_PIPELINED"
+#endif
+
+#if defined(HSPI_BURST_LEN) && (HSPI_BURST_LEN < 1 || HSPI_BURST_LEN > 255)
+#error "HSPI_BURST_LEN must be between 1 and 255"
+#endif
+
+#if HSPI_BURST_ACK_CNT_SEL < 0 || HSPI_BURST_ACK_CNT_SEL > 3
+#error "HSPI_BURST_ACK_CNT_SEL must be between 0 and 3"
+#endif
+
+/**
+ * With HSPI_COALESCE, the messages sent with hspi_sendv are packed in frames of
+ * up to the size given to hspi_init (a whole burst with HSPI_BURST_LEN), sent
+ * with HSPI_COALESCED as custom register. Each message is prefixed with its
+ * size and custom register (4 bytes) and padded to 4 bytes, and the other side
+ * calls hspi_rx_callback (or hspi_rx_buf_callback) once per message. A frame is
+ * sent once it is full, once its first message has waited the linger time, and
+ * before the transmissions of hspi_send and hspi_send_buf, to keep the order.
+ * The linger time (HSPI_COALESCE_LINGER_US by default) trades latency for
+ * fewer frames : 0 sends each hspi_sendv call in its own frame. It is enforced
+ * by a timed task with INTERRUPT_QUEUE_TIMER, by hspi_coalesce_poll otherwise.
+ * The frame is only changed in critical sections, so hspi_send and
+ * hspi_send_buf can be called from interrupt handlers while hspi_sendv runs.
+ * HSPI_COALESCED cannot be given to them. Both sides must use this option.
+ */
+#ifndef HSPI_COALESCE_LINGER_US
+#define HSPI_COALESCE_LINGER_US 100
+#endif
+
+/**
+ * With HSPI_RELIABLE, frames lost or received with a CRC error are sent again.
+ * Bits 8 to 11 of the custom register hold a sequence number, so hspi_send
+ * and hspi_send_buf return false for a custom register above
+ * HSPI_RELIABLE_CUSTOM_MASK. Up to HSPI_RELIABLE_WINDOW frames are sent
+ * without being acknowledged, each holding a reference on its buffer : hspi_send
+ * and hspi_send_buf return false once the window is full. The receiver hands
+ * the frames over in order, and answers with small control frames, not given to
+ * the callbacks : a cumulative ACK once the received frames have been handled,
+ * or a NACK of the first missing frame, which is the only one sent again. If
+ * no ACK arrives within HSPI_RELIABLE_TIMEOUT_US, hspi_reliable_poll, called
+ * from the main loop, sends the oldest frame again. Both sides must use this
+ * option. HSPI_ERROR_INJECTION adds hspi_inject_rx_errors, to test it.
+ */
+#ifndef HSPI_RELIABLE_WINDOW
+#define HSPI_RELIABLE_WINDOW 8
+#endif
+
+#ifndef HSPI_RELIABLE_TIMEOUT_US
+#define HSPI_RELIABLE_TIMEOUT_US 1000
+#endif
+
+#define HSPI_RELIABLE_CUSTOM_MASK 0xff
+
+#if defined(HSPI_RELIABLE) && \
+	(HSPI_RELIABLE_WINDOW < 1 || HSPI_RELIABLE_WINDOW > 8)
+#error "HSPI_RELIABLE_WINDOW must be between 1 and 8"
+#endif
+
+// custom register of the coalesced frames, not to be used by hspi_send
+#ifdef HSPI_RELIABLE
+#define HSPI_COALESCED HSPI_RELIABLE_CUSTOM_MASK
+#else
+#define HSPI_COALESCED 0x1fff
+#endif
+
+typedef enum HSPI_RX_STATE
+{
+	HSPI_RX_STATE_RUNNING,
+	/* The RX ring was empty : received packets are dropped, and the DMA keeps
+	 * its buffer, until the ring has been refilled */
+	HSPI_RX_STATE_BACKPRESSURE,
+} hspi_rx_state_t;
+
 typedef struct hspi_scheduled_user_handled_t
 {
 	/**
@@ -77,11 +242,37 @@ typedef struct hspi_scheduled_user_handled_t
 	void (*hspi_rx_callback)(uint8_t* buffer, uint16_t size,
 							 uint16_t custom_register);
 
+	/**
+   * @brief Optional, called instead of hspi_rx_callback if set. buf holds a
+   * reference on the received buffer until the callback returns : call
+   * buf_ref to keep it, or forward it with hspi_send_buf or endp_tx_set_new_buf
+   * which take their own reference.
+   * @param custom_register only the first 26bits are valid
+   */
+	void (*hspi_rx_buf_callback)(hydra_buf_t* buf, uint16_t custom_register);
+
 	/**
    * @brief Called when a CRC or NUM mismatch happens
    * @param
    */
 	void (*hspi_err_crc_num_mismatch_callback)(void);
+
+	/**
+   * @brief Optional, programmed on interrupt_queue when the RX ring holds
+   * low_watermark buffers or less, before refilling it.
+   * @param available number of buffers left in the ring
+   * @param state HSPI_RX_STATE_BACKPRESSURE if packets have been dropped
+   * because the ring was empty
+   */
+	void (*hspi_rx_ring_low_callback)(uint16_t available, hspi_rx_state_t state);
+
+	/**
+   * @brief Optional, HSPI_TX_PIPELINED only, programmed on interrupt_queue
+   * when a transmission is done. Its buffer is released once the callback
+   * returns.
+   * @param custom_register the one given to hspi_send or hspi_send_buf
+   */
+	void (*hspi_tx_done_callback)(uint16_t custom_register);
 } hspi_scheduled_user_handled_t;
 
 extern hspi_scheduled_user_handled_t hspi_scheduled_user_handled;
@@ -129,13 +320,137 @@ void hspi_init(HSPI_TYPE type, HSPI_DATASIZE datasize, uint16_t size);
 void hspi_reinit_buffers(void);
 
 /**
- * @brief Set the new buffer to be sent, will schedule it using interrupt_queue.
+ * @brief Set the new buffer to be sent, will schedule it using interrupt_queue
+ * (or the TX ring with HSPI_TX_PIPELINED).
  * If buffer is in ramx_pool already, no copy will happen and hspi_send will
  * take a reference an free the buffer when finished.
- * @param custom_register Must be 26bits max
+ * @param custom_register Must be 26bits max (HSPI_RELIABLE_CUSTOM_MASK with
+ * HSPI_RELIABLE), not HSPI_COALESCED with HSPI_COALESCE
  */
 bool hspi_send(uint8_t* buffer, uint16_t size, uint16_t custom_register);
 
+/**
+ * @brief Same as hspi_send, without any copy : takes a reference on buf until
+ * it has been sent. The data of buf must be 4-byte aligned.
+ * @param custom_register Must be 26bits max (HSPI_RELIABLE_CUSTOM_MASK with
+ * HSPI_RELIABLE), not HSPI_COALESCED with HSPI_COALESCE
+ */
+bool hspi_send_buf(const hydra_buf_t* buf, uint16_t custom_register);
+
+#ifdef HSPI_TX_PIPELINED
+/**
+ * @brief Number of transmissions sent with hspi_send or hspi_send_buf and not
+ * done yet, at most 2^HSPI_TX_RING_LOG2_SIZE + 2 (one on the wire, one loaded)
+ */
+uint16_t hspi_tx_pending(void);
+#endif
+
+#ifdef HSPI_COALESCE
+typedef struct hspi_iovec_t
+{
+	const uint8_t* data;
+	uint16_t size;
+} hspi_iovec_t;
+
+/**
+ * @brief Gather the n parts in one message and add it to the frame being
+ * coalesced, which is sent later (see HSPI_COALESCE). Not to be called from
+ * interrupt handlers.
+ * @param custom_register given to hspi_rx_callback on the other side
+ * @return false if the message does not fit in a frame, or the frame is full
+ * and cannot be sent yet, or there is no memory left : the message is not sent
+ */
+bool hspi_sendv(const hspi_iovec_t* parts, uint8_t n, uint16_t custom_register);
+
+/**
+ * @brief Send the frame being coalesced now. hspi_tx_done_callback is called
+ * with HSPI_COALESCED once it is done.
+ * @return false if it cannot be sent yet
+ */
+bool hspi_coalesce_flush(void);
+
+/**
+ * @brief Send the frame being coalesced if it has waited the linger time, to
+ * be called from the main loop without INTERRUPT_QUEUE_TIMER
+ * @return true if a frame was sent
+ */
+bool hspi_coalesce_poll(void);
+
+/**
+ * @brief Set the time the first message of a frame waits for others,
+ * HSPI_COALESCE_LINGER_US by default. Applies from the next frame.
+ */
+void hspi_coalesce_set_linger_us(uint32_t linger_us);
+#endif
+
+#ifdef HSPI_RELIABLE
+typedef struct hspi_reliable_stats_t
+{
+	uint32_t retransmits; // frames sent again, after a NACK or a timeout
+	uint32_t acks_sent;
+	uint32_t nacks_sent;
+	uint32_t duplicates; // frames received twice, and dropped
+} hspi_reliable_stats_t;
+
+/**
+ * @brief Send the oldest frame not acknowledged again once
+ * HSPI_RELIABLE_TIMEOUT_US have elapsed without ACK, and the ACK or NACK that
+ * could not be sent yet. To be called from the main loop.
+ * @return true if a frame was sent again
+ */
+bool hspi_reliable_poll(void);
+
+/**
+ * @brief Number of frames sent and not acknowledged yet, at most
+ * HSPI_RELIABLE_WINDOW
+ */
+uint16_t hspi_reliable_unacked(void);
+
+/**
+ * @brief Counters since hspi_init
+ */
+void hspi_reliable_get_stats(hspi_reliable_stats_t* stats);
+#endif
+
+#ifdef HSPI_ERROR_INJECTION
+/**
+ * @brief Handle one received data frame in one_in, picked at random, as if its
+ * CRC was wrong. 0 (the default) disables it.
+ */
+void hspi_inject_rx_errors(uint16_t one_in);
+
+/**
+ * @brief Number of frames corrupted by hspi_inject_rx_errors since hspi_init
+ */
+uint32_t hspi_injected_rx_errors(void);
+#endif
+
+#ifdef HSPI_FLOW_CONTROL
+/**
+ * @brief Number of data frames the other side can receive now, not counting
+ * those loaded in a TX DMA already
+ */
+uint16_t hspi_tx_credits(void);
+#endif
+
+/**
+ * @brief Set the number of buffers left in the RX ring at which it is refilled,
+ * HSPI_RX_RING_LOW_WATERMARK by default
+ */
+void hspi_rx_ring_set_low_watermark(uint16_t low_watermark);
+
+/**
+ * @brief HSPI_RX_STATE_BACKPRESSURE if the last packet was dropped because the
+ * RX ring was empty, HSPI_RX_STATE_RUNNING otherwise
+ */
+hspi_rx_state_t hspi_rx_get_state(void);
+
+/**
+ * @brief Number of received packets dropped since hspi_init, because the RX
+ * ring was empty, or the arguments pool or the interrupt queue was full
+ */
+uint32_t hspi_rx_dropped_packets(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,14 +15,206 @@ limitations under the License.
 
 *******************************************************************************/
 
+#include <string.h>
+
 #include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+#include "wch-ch56x-lib/logging/logging.h"
 
 HYDRA_FIFO_DEF(task_queue, hydra_interrupt_queue_task_t,
 			   INTERRUPT_QUEUE_SIZE);
+#if INTERRUPT_QUEUE_PRIORITIES > 1
+HYDRA_FIFO_DEF(task_queue_prio1, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 2
+HYDRA_FIFO_DEF(task_queue_prio2, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 3
+HYDRA_FIFO_DEF(task_queue_prio3, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 4
+HYDRA_FIFO_DEF(task_queue_prio4, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 5
+HYDRA_FIFO_DEF(task_queue_prio5, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 6
+HYDRA_FIFO_DEF(task_queue_prio6, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 7
+HYDRA_FIFO_DEF(task_queue_prio7, hydra_interrupt_queue_task_t,
+			   INTERRUPT_QUEUE_SIZE);
+#endif
+
+hydra_fifo_t* const task_queues[INTERRUPT_QUEUE_PRIORITIES] = {
+	&task_queue,
+#if INTERRUPT_QUEUE_PRIORITIES > 1
+	&task_queue_prio1,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 2
+	&task_queue_prio2,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 3
+	&task_queue_prio3,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 4
+	&task_queue_prio4,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 5
+	&task_queue_prio5,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 6
+	&task_queue_prio6,
+#endif
+#if INTERRUPT_QUEUE_PRIORITIES > 7
+	&task_queue_prio7,
+#endif
+};
+
+volatile uint32_t hydra_interrupt_queue_ready;
+
+hydra_interrupt_queue_stats_t hydra_interrupt_queue_stats[INTERRUPT_QUEUE_PRIORITIES];
 
-hydra_fifo_t* task_queues[] = { &task_queue };
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+hydra_interrupt_queue_telemetry_t hydra_interrupt_queue_telemetry;
+#endif
 
 void hydra_interrupt_queue_init(void)
 {
-	fifo_clean(&task_queue);
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	for (uint32_t prio = 0; prio < INTERRUPT_QUEUE_PRIORITIES; ++prio)
+		fifo_clean(task_queues[prio]);
+	hydra_interrupt_queue_ready = 0;
+	memset(hydra_interrupt_queue_stats, 0, sizeof(hydra_interrupt_queue_stats));
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+	memset(&hydra_interrupt_queue_telemetry, 0,
+		   sizeof(hydra_interrupt_queue_telemetry));
+	hydra_interrupt_queue_telemetry.last_dump = HYDRA_INTERRUPT_QUEUE_TICKS();
+#endif
+#ifdef INTERRUPT_QUEUE_TIMER
+	hydra_interrupt_queue_timer_init();
+#endif
+}
+
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+
+static uint8_t hydra_interrupt_queue_telemetry_bucket(uint32_t us)
+{
+	if (us <= 1)
+		return 0;
+	uint8_t bucket = (uint8_t)(32 - __builtin_clz(us - 1));
+	return bucket < HYDRA_INTERRUPT_QUEUE_TELEMETRY_BUCKETS
+			   ? bucket
+			   : HYDRA_INTERRUPT_QUEUE_TELEMETRY_BUCKETS - 1;
+}
+
+static hydra_interrupt_queue_func_telemetry_t* hydra_interrupt_queue_telemetry_find(bool (*func)(uint8_t*),
+																					 bool add)
+{
+	hydra_interrupt_queue_telemetry_t* telemetry = &hydra_interrupt_queue_telemetry;
+
+	for (uint8_t i = 0; i < telemetry->funcs_count; ++i)
+	{
+		if (telemetry->funcs[i].task == func)
+			return &telemetry->funcs[i];
+	}
+	if (!add)
+		return NULL;
+	if (telemetry->funcs_count == INTERRUPT_QUEUE_TELEMETRY_FUNCS)
+		return &telemetry->others;
+	telemetry->funcs[telemetry->funcs_count].task = func;
+	return &telemetry->funcs[telemetry->funcs_count++];
+}
+
+void hydra_interrupt_queue_telemetry_record(const hydra_interrupt_queue_task_t* task,
+											uint32_t started, uint32_t finished)
+{
+	hydra_interrupt_queue_func_telemetry_t* func =
+		hydra_interrupt_queue_telemetry_find(task->task, true);
+	uint32_t ticks_per_us = HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+	// the ticks count down
+	uint32_t wait_us = (task->enqueued - started) / ticks_per_us;
+	uint32_t run_us = (started - finished) / ticks_per_us;
+
+	func->runs++;
+	func->wait_histogram[hydra_interrupt_queue_telemetry_bucket(wait_us)]++;
+	func->run_histogram[hydra_interrupt_queue_telemetry_bucket(run_us)]++;
+	if (wait_us > func->max_wait_us)
+		func->max_wait_us = wait_us;
+	if (run_us > func->max_run_us)
+		func->max_run_us = run_us;
+}
+
+const hydra_interrupt_queue_func_telemetry_t* hydra_interrupt_queue_get_func_telemetry(bool (*func)(uint8_t*))
+{
+	return hydra_interrupt_queue_telemetry_find(func, false);
+}
+
+void hydra_interrupt_queue_telemetry_reset(void)
+{
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	memset(hydra_interrupt_queue_stats, 0, sizeof(hydra_interrupt_queue_stats));
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+	memset(hydra_interrupt_queue_telemetry.funcs, 0,
+		   sizeof(hydra_interrupt_queue_telemetry.funcs));
+	memset(&hydra_interrupt_queue_telemetry.others, 0,
+		   sizeof(hydra_interrupt_queue_telemetry.others));
+	hydra_interrupt_queue_telemetry.funcs_count = 0;
+}
+
+static void hydra_interrupt_queue_telemetry_dump_histogram(const char* title,
+														   const uint32_t* histogram)
+{
+	(void)title; // unused if logging is disabled
+	(void)histogram;
+	LOG("  %s (us): 1:%d 2:%d 3-4:%d 5-8:%d 9-16:%d 17-32:%d 33-64:%d "
+		"65-128:%d 129-256:%d 257-512:%d 513-1024:%d >1024:%d\r\n",
+		title, histogram[0], histogram[1], histogram[2], histogram[3],
+		histogram[4], histogram[5], histogram[6], histogram[7], histogram[8],
+		histogram[9], histogram[10], histogram[11]);
 }
+
+static void hydra_interrupt_queue_telemetry_dump_func(const hydra_interrupt_queue_func_telemetry_t* func)
+{
+	if (func->runs == 0)
+		return;
+	// task NULL for the other tasks
+	LOG("interrupt queue task %x: %d runs, max wait %d us, max run %d us\r\n",
+		func->task, func->runs, func->max_wait_us, func->max_run_us);
+	hydra_interrupt_queue_telemetry_dump_histogram("wait", func->wait_histogram);
+	hydra_interrupt_queue_telemetry_dump_histogram("run", func->run_histogram);
+}
+
+void hydra_interrupt_queue_telemetry_dump(void)
+{
+	for (uint8_t prio = 0; prio < INTERRUPT_QUEUE_PRIORITIES; ++prio)
+	{
+		const hydra_interrupt_queue_stats_t* stats = &hydra_interrupt_queue_stats[prio];
+		(void)stats; // unused if logging is disabled
+		LOG("interrupt queue prio %d: %d scheduled, %d refused (full), depth "
+			"%d, max depth %d/%d\r\n",
+			prio, stats->scheduled, stats->full, fifo_count(task_queues[prio]),
+			stats->max_depth, INTERRUPT_QUEUE_SIZE);
+	}
+	for (uint8_t i = 0; i < hydra_interrupt_queue_telemetry.funcs_count; ++i)
+		hydra_interrupt_queue_telemetry_dump_func(&hydra_interrupt_queue_telemetry.funcs[i]);
+	hydra_interrupt_queue_telemetry_dump_func(&hydra_interrupt_queue_telemetry.others);
+}
+
+bool hydra_interrupt_queue_telemetry_periodic_dump(uint32_t period)
+{
+	uint64_t now = HYDRA_INTERRUPT_QUEUE_TICKS();
+	if ((uint32_t)(hydra_interrupt_queue_telemetry.last_dump - now) < period)
+		return false;
+	hydra_interrupt_queue_telemetry.last_dump = now;
+	hydra_interrupt_queue_telemetry_dump();
+	return true;
+}
+
+#endif
@@ -31,6 +31,7 @@ limitations under the License.
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "wch-ch56x-lib/logging/logging.h"
 #include "wch-ch56x-lib/memory/fifo.h"
@@ -39,16 +40,281 @@ limitations under the License.
 extern "C" {
 #endif
 
+/**
+You must pass the following define to your compiler
+#define INTERRUPT_QUEUE_SIZE size // maximum number of waiting tasks, per priority
+
+Optionally
+#define INTERRUPT_QUEUE_PRIORITIES n // number of priority levels, 1 to 8
+(default 1). Each level has its own queue of INTERRUPT_QUEUE_SIZE tasks, 0 is
+the highest priority.
+#define INTERRUPT_QUEUE_INLINE_ARGS_SIZE bytes // arguments copied in each task
+by hydra_interrupt_queue_set_next_task_inline, multiple of 4 (default 16). Every
+task of every queue takes this space.
+#define INTERRUPT_QUEUE_TELEMETRY 1 // time spent by the tasks waiting in the
+queues and running, by task function, see hydra_interrupt_queue_telemetry_dump
+#define INTERRUPT_QUEUE_TELEMETRY_FUNCS n // number of task functions followed
+by the telemetry (default 8), the others are counted together
+#define INTERRUPT_QUEUE_TIMER n // hardware timer TMRn (0 to 2) driving the tasks
+added with hydra_interrupt_queue_set_task_at, see interrupt_queue_timer.c. The
+library then defines TMRn_IRQHandler.
+#define INTERRUPT_QUEUE_TIMER_RESOLUTION_US us // period of the timer interrupt
+while timed tasks are waiting (default 20)
+#define INTERRUPT_QUEUE_TIMER_SLOTS n // slots of the timer wheel, a power of two
+(default 32)
+#define INTERRUPT_QUEUE_TIMERS n // maximum number of waiting timed tasks, up to
+254 (default INTERRUPT_QUEUE_SIZE)
+*/
+
+#ifndef INTERRUPT_QUEUE_PRIORITIES
+#define INTERRUPT_QUEUE_PRIORITIES 1
+#endif
+
+#if INTERRUPT_QUEUE_PRIORITIES < 1 || INTERRUPT_QUEUE_PRIORITIES > 8
+#error "INTERRUPT_QUEUE_PRIORITIES must be between 1 and 8"
+#endif
+
+#ifndef INTERRUPT_QUEUE_INLINE_ARGS_SIZE
+#define INTERRUPT_QUEUE_INLINE_ARGS_SIZE 16
+#endif
+
+#if INTERRUPT_QUEUE_INLINE_ARGS_SIZE < 4 || INTERRUPT_QUEUE_INLINE_ARGS_SIZE % 4 != 0
+#error "INTERRUPT_QUEUE_INLINE_ARGS_SIZE must be a multiple of 4"
+#endif
+
+/* Clock of the budget of hydra_interrupt_queue_run_budget, counting down */
+#ifndef HYDRA_INTERRUPT_QUEUE_TICKS
+#define HYDRA_INTERRUPT_QUEUE_TICKS() bsp_get_SysTickCNT()
+#endif
+
+/* Ticks of HYDRA_INTERRUPT_QUEUE_TICKS per microsecond, for the telemetry */
+#ifndef HYDRA_INTERRUPT_QUEUE_TICKS_PER_US
+#define HYDRA_INTERRUPT_QUEUE_TICKS_PER_US() bsp_get_nbtick_1us()
+#endif
+
+#ifndef INTERRUPT_QUEUE_TELEMETRY_FUNCS
+#define INTERRUPT_QUEUE_TELEMETRY_FUNCS 8
+#endif
+
+#ifdef INTERRUPT_QUEUE_TIMER
+#if INTERRUPT_QUEUE_TIMER < 0 || INTERRUPT_QUEUE_TIMER > 2
+#error "INTERRUPT_QUEUE_TIMER must be 0, 1 or 2"
+#endif
+
+#ifndef INTERRUPT_QUEUE_TIMER_RESOLUTION_US
+#define INTERRUPT_QUEUE_TIMER_RESOLUTION_US 20
+#endif
+
+#ifndef INTERRUPT_QUEUE_TIMER_SLOTS
+#define INTERRUPT_QUEUE_TIMER_SLOTS 32
+#endif
+
+#if (INTERRUPT_QUEUE_TIMER_SLOTS & (INTERRUPT_QUEUE_TIMER_SLOTS - 1)) != 0
+#error "INTERRUPT_QUEUE_TIMER_SLOTS must be a power of two"
+#endif
+
+#ifndef INTERRUPT_QUEUE_TIMERS
+#define INTERRUPT_QUEUE_TIMERS INTERRUPT_QUEUE_SIZE
+#endif
+
+#if INTERRUPT_QUEUE_TIMERS > 254
+#error "INTERRUPT_QUEUE_TIMERS must be at most 254"
+#endif
+#endif
+
+#define HYDRA_INTERRUPT_QUEUE_HIGH_PRIO 0
+#define HYDRA_INTERRUPT_QUEUE_LOW_PRIO (INTERRUPT_QUEUE_PRIORITIES - 1)
+
 typedef struct HYDRA_INTERRUPT_QUEUE_TASK
 {
 	bool in_use;
 	bool (*task)(uint8_t*);
+	bool has_inline_args; // args are in inline_args, not pointed to by args
 	uint8_t* args;
 	void (*cleanup)(uint8_t*);
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+	uint32_t enqueued; // HYDRA_INTERRUPT_QUEUE_TICKS when the task was added
+#endif
+	// aligned so that the arguments can hold pointers
+	uint32_t inline_args[INTERRUPT_QUEUE_INLINE_ARGS_SIZE / 4] __attribute__((aligned(sizeof(void*))));
 } hydra_interrupt_queue_task_t;
 
+#ifndef HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL
+#define HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL() BSP_ENTER_CRITICAL()
+#endif
+
+#ifndef HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL
+#define HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL() BSP_EXIT_CRITICAL()
+#endif
+
+typedef struct hydra_interrupt_queue_stats_t
+{
+	uint32_t scheduled; // tasks added to the queue
+	uint32_t full; // tasks refused because the queue was full
+	uint16_t max_depth; // highest number of waiting tasks
+} hydra_interrupt_queue_stats_t;
+
+// queue of priority 0, task_queues[prio] for the others
 HYDRA_FIFO_DECLR(task_queue, hydra_interrupt_queue_task_t,
 				 INTERRUPT_QUEUE_SIZE);
+extern hydra_fifo_t* const task_queues[INTERRUPT_QUEUE_PRIORITIES];
+
+// bit prio is set when task_queues[prio] is not empty
+extern volatile uint32_t hydra_interrupt_queue_ready;
+
+extern hydra_interrupt_queue_stats_t hydra_interrupt_queue_stats[INTERRUPT_QUEUE_PRIORITIES];
+
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+
+/**
+Durations are counted in microseconds, in power-of-two buckets : 1, 2, 3-4,
+5-8, 9-16, 17-32, 33-64, 65-128, 129-256, 257-512, 513-1024 and more than 1024.
+*/
+#define HYDRA_INTERRUPT_QUEUE_TELEMETRY_BUCKETS 12
+
+typedef struct hydra_interrupt_queue_func_telemetry_t
+{
+	bool (*task)(uint8_t*); // NULL for the tasks of the other functions
+	uint32_t runs;
+	uint32_t max_wait_us; // longest time between adding a task and running it
+	uint32_t max_run_us; // longest run of the task and its cleanup function
+	uint32_t wait_histogram[HYDRA_INTERRUPT_QUEUE_TELEMETRY_BUCKETS];
+	uint32_t run_histogram[HYDRA_INTERRUPT_QUEUE_TELEMETRY_BUCKETS];
+} hydra_interrupt_queue_func_telemetry_t;
+
+typedef struct hydra_interrupt_queue_telemetry_t
+{
+	// in the order of the first run of each function
+	hydra_interrupt_queue_func_telemetry_t funcs[INTERRUPT_QUEUE_TELEMETRY_FUNCS];
+	uint8_t funcs_count;
+	// tasks of the functions run once funcs was full
+	hydra_interrupt_queue_func_telemetry_t others;
+	uint64_t last_dump; // HYDRA_INTERRUPT_QUEUE_TICKS of the last periodic dump
+} hydra_interrupt_queue_telemetry_t;
+
+extern hydra_interrupt_queue_telemetry_t hydra_interrupt_queue_telemetry;
+
+/**
+ * @brief Record the run of task. Only called from the main loop.
+ * @param started HYDRA_INTERRUPT_QUEUE_TICKS before running the task
+ * @param finished HYDRA_INTERRUPT_QUEUE_TICKS after running the task and its
+ * cleanup function
+ */
+void hydra_interrupt_queue_telemetry_record(const hydra_interrupt_queue_task_t* task,
+											uint32_t started, uint32_t finished);
+
+/**
+ * @brief Telemetry of the tasks of func, NULL if none has run since
+ * hydra_interrupt_queue_init or hydra_interrupt_queue_telemetry_reset
+ */
+const hydra_interrupt_queue_func_telemetry_t* hydra_interrupt_queue_get_func_telemetry(bool (*func)(uint8_t*));
+
+/**
+ * @brief Clear the telemetry and the statistics of the queues
+ */
+void hydra_interrupt_queue_telemetry_reset(void);
+
+/**
+ * @brief Print the statistics of the queues and the telemetry of each task
+ * function with LOG
+ */
+void hydra_interrupt_queue_telemetry_dump(void);
+
+/**
+ * @brief Call hydra_interrupt_queue_telemetry_dump if period ticks of
+ * HYDRA_INTERRUPT_QUEUE_TICKS have elapsed since the last time it did. To be
+ * called from the main loop.
+ * @return true if the telemetry was dumped
+ */
+bool hydra_interrupt_queue_telemetry_periodic_dump(uint32_t period);
+
+#endif
+
+#ifdef INTERRUPT_QUEUE_TIMER
+
+/**
+ * @brief Reset the timer wheel and stop its timer, called by
+ * hydra_interrupt_queue_init. The waiting timed tasks are dropped, without
+ * calling their cleanup function.
+ */
+void hydra_interrupt_queue_timer_init(void);
+
+/**
+ * @brief Add a task to the queue of priority prio once HYDRA_INTERRUPT_QUEUE_TICKS
+ * reaches at (the ticks count down : not before HYDRA_INTERRUPT_QUEUE_TICKS() <=
+ * at), at most INTERRUPT_QUEUE_TIMER_RESOLUTION_US later. Tasks with the same
+ * deadline are added in order. Can be called from interrupt handlers.
+ * @param at deadline, in ticks of HYDRA_INTERRUPT_QUEUE_TICKS. If it is already
+ * reached, the task is added to the queue right away, unless tasks with the same
+ * deadline are still waiting.
+ * @param prio Priority, see hydra_interrupt_queue_set_next_task_prio
+ * @param func The task to be executed
+ * @param args Pointer passed to func if size is 0, otherwise arguments copied
+ * in the task, see hydra_interrupt_queue_set_next_task_inline_prio
+ * @param size 0, or size of the arguments to copy
+ * @param cleanup Called after func has been executed or when freeing all tasks.
+ * Can be NULL.
+ * @return false if INTERRUPT_QUEUE_TIMERS tasks are already waiting, or the
+ * task cannot be added to the queue right away, or prio or size are invalid
+ */
+bool hydra_interrupt_queue_set_task_at(uint64_t at, uint8_t prio,
+									   bool (*func)(uint8_t*), const void* args,
+									   uint16_t size, void (*cleanup)(uint8_t*));
+
+/**
+ * @brief Same as hydra_interrupt_queue_set_task_at, delay_us microseconds from
+ * now
+ */
+bool hydra_interrupt_queue_set_task_after(uint32_t delay_us, uint8_t prio,
+										  bool (*func)(uint8_t*), const void* args,
+										  uint16_t size, void (*cleanup)(uint8_t*));
+
+/**
+ * @brief Number of timed tasks waiting for their deadline
+ */
+uint16_t hydra_interrupt_queue_timer_pending(void);
+
+/**
+ * @brief Drop the timed tasks waiting for their deadline and call their cleanup
+ * function, called by hydra_interrupt_queue_free_all
+ */
+void hydra_interrupt_queue_timer_free_all(void);
+
+/**
+ * @brief Move the timed tasks whose deadline is reached to their queue. Called
+ * by the timer interrupt handler, exposed for tests.
+ */
+void hydra_interrupt_queue_timer_irq(void);
+
+#endif
+
+/**
+ * @brief Pointer passed to the task and cleanup functions of task. Inline
+ * arguments are passed from the copy of the task made by the caller, the slot
+ * of the queue may be reused while the task runs.
+ */
+__attribute__((always_inline)) static inline uint8_t* _hydra_interrupt_queue_task_args(hydra_interrupt_queue_task_t* task)
+{
+	return task->has_inline_args ? (uint8_t*)task->inline_args : task->args;
+}
+
+/**
+ * @brief Run task with its arguments, then its cleanup function
+ */
+__attribute__((always_inline)) static inline void _hydra_interrupt_queue_run_task(hydra_interrupt_queue_task_t* task)
+{
+	uint8_t* args = _hydra_interrupt_queue_task_args(task);
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+	uint32_t started = (uint32_t)HYDRA_INTERRUPT_QUEUE_TICKS();
+#endif
+	task->task(args);
+	if (task->cleanup)
+		task->cleanup(args);
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+	hydra_interrupt_queue_telemetry_record(task, started,
+										   (uint32_t)HYDRA_INTERRUPT_QUEUE_TICKS());
+#endif
+}
 
 /**
  * @brief Initialize (or reset) internal state of interrupt_queue.
@@ -58,68 +324,265 @@ void hydra_interrupt_queue_init(void);
 
 /**
  * @brief Run next task if there are any. Starts with
- * HYDRA_INTERRUPT_QUEUE_HIGH_PRIO queue, then INTERRUPT_QUEUE_LOW_PRIO.
+ * HYDRA_INTERRUPT_QUEUE_HIGH_PRIO queue, then the lower priorities down to
+ * HYDRA_INTERRUPT_QUEUE_LOW_PRIO : the first non-empty queue is the lowest bit
+ * set in hydra_interrupt_queue_ready.
  * @param
  */
 __attribute__((always_inline)) static inline void hydra_interrupt_queue_run(void)
 {
-	hydra_interrupt_queue_task_t task;
+	hydra_fifo_span_t spans[2];
 	LOG_IF(LOG_LEVEL_TRACE, LOG_ID_INTERRUPT_QUEUE,
 		   "hydra_interrupt_queue_run \r\n");
-	if (fifo_read_n(&task_queue, &task, 1))
+	uint32_t ready = hydra_interrupt_queue_ready;
+	if (ready == 0)
+		return;
+	uint32_t prio = (uint32_t)__builtin_ctz(ready);
+	hydra_fifo_t* queue = task_queues[prio];
+
+	// the main loop is the only consumer, read the task in place and free its
+	// slot before running it, so that it can schedule new tasks
+	if (fifo_read_acquire(queue, 1, spans))
 	{
+		hydra_interrupt_queue_task_t task =
+			*(hydra_interrupt_queue_task_t*)spans[0].ptr;
+		// an interrupt handler must not add a task between the emptiness check
+		// and the clearing of the ready bit
+		HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+		fifo_read_release(queue, 1);
+		if (fifo_count(queue) == 0)
+			hydra_interrupt_queue_ready &= ~(1U << prio);
+		HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
 		LOG_IF(LOG_LEVEL_TRACE, LOG_ID_INTERRUPT_QUEUE,
 			   "hydra_interrupt_queue_run executing task\r\n");
-		task.task(task.args);
-		if (task.cleanup)
-			task.cleanup(task.args);
+		_hydra_interrupt_queue_run_task(&task);
 	}
 }
 
+/**
+ * @brief Run tasks until max_tasks tasks have run, or max_ticks SysTick ticks
+ * have elapsed, or there are no more tasks. The tasks of a queue are taken one
+ * by one without a critical section, which is only entered once the queue is
+ * empty. The queues are still checked between tasks, so that a task of higher
+ * priority added meanwhile runs first.
+ * @param max_tasks maximum number of tasks to run, 0 for no limit
+ * @param max_ticks time budget in ticks of HYDRA_INTERRUPT_QUEUE_TICKS, 0 for
+ * no limit. It is checked after each task : the last task may exceed it.
+ * @param remaining if not NULL, receives the number of tasks still waiting, at
+ * all priorities
+ * @return number of tasks run
+ */
+__attribute__((always_inline)) static inline uint16_t hydra_interrupt_queue_run_budget(uint16_t max_tasks, uint32_t max_ticks,
+																					   uint16_t* remaining)
+{
+	uint64_t start = max_ticks != 0 ? HYDRA_INTERRUPT_QUEUE_TICKS() : 0;
+	uint16_t ran = 0;
+	bool budget_left = true;
+
+	while (budget_left)
+	{
+		uint32_t ready = hydra_interrupt_queue_ready;
+		if (ready == 0)
+			break;
+		uint32_t prio = (uint32_t)__builtin_ctz(ready);
+		hydra_fifo_t* queue = task_queues[prio];
+		hydra_fifo_span_t spans[2];
+
+		// one task at a time, like hydra_interrupt_queue_run : a task may empty
+		// the queues with hydra_interrupt_queue_free_all
+		while (fifo_read_acquire(queue, 1, spans) != 0)
+		{
+			hydra_interrupt_queue_task_t task =
+				*(hydra_interrupt_queue_task_t*)spans[0].ptr;
+			// the main loop is the only consumer : the slot can be freed without
+			// a critical section, before running the task so that it can
+			// schedule new tasks
+			fifo_read_release(queue, 1);
+			_hydra_interrupt_queue_run_task(&task);
+			ran++;
+
+			if ((max_tasks != 0 && ran >= max_tasks) ||
+				(max_ticks != 0 &&
+				 (uint32_t)(start - HYDRA_INTERRUPT_QUEUE_TICKS()) >= max_ticks))
+			{
+				budget_left = false;
+				break;
+			}
+			// a task of higher priority was added
+			if (hydra_interrupt_queue_ready & ((1U << prio) - 1))
+				break;
+		}
+
+		HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+		if (fifo_count(queue) == 0)
+			hydra_interrupt_queue_ready &= ~(1U << prio);
+		HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+	}
+
+	if (remaining != NULL)
+	{
+		uint16_t waiting = 0;
+		for (uint32_t prio = 0; prio < INTERRUPT_QUEUE_PRIORITIES; ++prio)
+			waiting += fifo_count(task_queues[prio]);
+		*remaining = waiting;
+	}
+	return ran;
+}
+
 /**
  * @brief Free all task from interrupt_queue and call their cleanup task.
  */
 __attribute__((always_inline)) static inline void hydra_interrupt_queue_free_all(void)
 {
 	hydra_interrupt_queue_task_t task;
-	while (fifo_read_n(&task_queue, &task, 1))
+#ifdef INTERRUPT_QUEUE_TIMER
+	hydra_interrupt_queue_timer_free_all();
+#endif
+	for (uint32_t prio = 0; prio < INTERRUPT_QUEUE_PRIORITIES; ++prio)
+	{
+		while (fifo_read_n(task_queues[prio], &task, 1))
+		{
+			if (task.cleanup)
+				task.cleanup(_hydra_interrupt_queue_task_args(&task));
+		}
+	}
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	for (uint32_t prio = 0; prio < INTERRUPT_QUEUE_PRIORITIES; ++prio)
+	{
+		if (fifo_count(task_queues[prio]) == 0)
+			hydra_interrupt_queue_ready &= ~(1U << prio);
+	}
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Add a task to the queue of priority prio. If inline_size is not 0,
+ * the inline_size bytes at args are copied in the task.
+ */
+__attribute__((always_inline)) static inline bool _hydra_interrupt_queue_add_task(uint8_t prio, bool (*func)(uint8_t*), const void* args,
+																				  uint16_t inline_size, void (*cleanup)(uint8_t*))
+{
+	hydra_fifo_span_t spans[2];
+
+	if (prio >= INTERRUPT_QUEUE_PRIORITIES)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_INTERRUPT_QUEUE,
+			   "Invalid interrupt queue priority %d\r\n", prio);
+		return false;
+	}
+
+	hydra_fifo_t* queue = task_queues[prio];
+	hydra_interrupt_queue_stats_t* stats = &hydra_interrupt_queue_stats[prio];
+
+	// tasks may be set from several interrupt handlers, build the task in place
+	// in a single critical section
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	if (fifo_write_reserve(queue, 1, spans) == 0)
+	{
+		stats->full++;
+		HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+		LOG_IF_LEVEL(LOG_LEVEL_CRITICAL, "Interrupt queue is full\r\n");
+		return false;
+	}
+
+	hydra_interrupt_queue_task_t* task = (hydra_interrupt_queue_task_t*)spans[0].ptr;
+	task->in_use = true;
+	task->task = func;
+	task->cleanup = cleanup;
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+	task->enqueued = (uint32_t)HYDRA_INTERRUPT_QUEUE_TICKS();
+#endif
+	if (inline_size != 0)
+	{
+		task->has_inline_args = true;
+		task->args = NULL;
+		memcpy(task->inline_args, args, inline_size);
+	}
+	else
 	{
-		if (task.cleanup)
-			task.cleanup(task.args);
+		task->has_inline_args = false;
+		task->args = (uint8_t*)args;
 	}
+	fifo_write_commit(queue, 1);
+	hydra_interrupt_queue_ready |= 1U << prio;
+	stats->scheduled++;
+	uint16_t depth = fifo_count(queue);
+	if (depth > stats->max_depth)
+		stats->max_depth = depth;
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+
+	return true;
 }
 
 /**
- * @brief Set next task
+ * @brief Set next task of priority prio
+ * @param prio Priority, from HYDRA_INTERRUPT_QUEUE_HIGH_PRIO (0) to
+ * HYDRA_INTERRUPT_QUEUE_LOW_PRIO. Tasks of the same priority run in order.
  * @param func The task to be executed, will be passed "args" pointer when
  * called, to pass any required data
  * @param args Pointer to data to be passed to func. Should live as long as func
  * is scheduled
  * @param cleanup Functions called after func has been executed or when freeing
  * all tasks. Allows cleaning up args for instance.
- * @return
+ * @return false if the queue of this priority is full, or prio is invalid
  */
-__attribute__((always_inline)) static inline bool hydra_interrupt_queue_set_next_task(bool (*func)(uint8_t*), uint8_t* args,
-																					  void (*cleanup)(uint8_t*))
+__attribute__((always_inline)) static inline bool hydra_interrupt_queue_set_next_task_prio(uint8_t prio, bool (*func)(uint8_t*), uint8_t* args,
+																						   void (*cleanup)(uint8_t*))
 {
 	LOG_IF(LOG_LEVEL_TRACE, LOG_ID_INTERRUPT_QUEUE,
-		   "hydra_interrupt_queue_set_next_task %d\r\n");
-	hydra_interrupt_queue_task_t task;
-	task.task = func;
-	task.args = args;
-	task.cleanup = cleanup;
-
-	uint16_t written = 0;
+		   "hydra_interrupt_queue_set_next_task_prio %d\r\n", prio);
+	return _hydra_interrupt_queue_add_task(prio, func, args, 0, cleanup);
+}
 
-	written = fifo_write(&task_queue, &task, 1);
+/**
+ * @brief Set next task, with the highest priority
+ * (HYDRA_INTERRUPT_QUEUE_HIGH_PRIO), see hydra_interrupt_queue_set_next_task_prio
+ */
+__attribute__((always_inline)) static inline bool hydra_interrupt_queue_set_next_task(bool (*func)(uint8_t*), uint8_t* args,
+																					  void (*cleanup)(uint8_t*))
+{
+	return hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_HIGH_PRIO,
+													func, args, cleanup);
+}
 
-	if (written == 0)
+/**
+ * @brief Set next task of priority prio, with its arguments copied in the task
+ * : no allocation is needed to hold them, and args can be a local variable.
+ * func and cleanup receive a pointer to the copy, aligned for pointers and
+ * 32-bit integers, valid until cleanup returns.
+ * @param prio Priority, see hydra_interrupt_queue_set_next_task_prio
+ * @param func The task to be executed
+ * @param args Arguments to copy
+ * @param size Size of args, from 1 to INTERRUPT_QUEUE_INLINE_ARGS_SIZE
+ * @param cleanup Called after func has been executed or when freeing all tasks,
+ * to release what the arguments point to for instance. Can be NULL.
+ * @return false if the queue of this priority is full, prio is invalid or
+ * size is too large
+ */
+__attribute__((always_inline)) static inline bool hydra_interrupt_queue_set_next_task_inline_prio(uint8_t prio, bool (*func)(uint8_t*), const void* args,
+																								  uint16_t size, void (*cleanup)(uint8_t*))
+{
+	LOG_IF(LOG_LEVEL_TRACE, LOG_ID_INTERRUPT_QUEUE,
+		   "hydra_interrupt_queue_set_next_task_inline_prio %d\r\n", prio);
+	if (size == 0 || size > INTERRUPT_QUEUE_INLINE_ARGS_SIZE)
 	{
-		LOG_IF_LEVEL(LOG_LEVEL_CRITICAL, "Interrupt queue is full\r\n");
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_INTERRUPT_QUEUE,
+			   "Invalid interrupt queue inline arguments size %d\r\n", size);
 		return false;
 	}
+	return _hydra_interrupt_queue_add_task(prio, func, args, size, cleanup);
+}
 
-	return true;
+/**
+ * @brief Set next task with inline arguments, with the highest priority
+ * (HYDRA_INTERRUPT_QUEUE_HIGH_PRIO), see
+ * hydra_interrupt_queue_set_next_task_inline_prio
+ */
+__attribute__((always_inline)) static inline bool hydra_interrupt_queue_set_next_task_inline(bool (*func)(uint8_t*), const void* args,
+																							 uint16_t size, void (*cleanup)(uint8_t*))
+{
+	return hydra_interrupt_queue_set_next_task_inline_prio(
+		HYDRA_INTERRUPT_QUEUE_HIGH_PRIO, func, args, size, cleanup);
 }
 
 /**
@@ -135,6 +598,38 @@ __attribute__((always_inline)) static inline bool hydra_interrupt_queue_peek_nex
 	return read > 0 ? true : false;
 }
 
+/**
+ * @brief Peek the task hydra_interrupt_queue_run would run next, whatever its
+ * priority.
+ * @param task task address where the next task will be copied
+ * @return false if there are no tasks
+ */
+__attribute__((always_inline)) static inline bool hydra_interrupt_queue_peek_next_task(
+	hydra_interrupt_queue_task_t* task)
+{
+	uint32_t ready = hydra_interrupt_queue_ready;
+	if (ready == 0)
+		return false;
+	return fifo_peek_n(task_queues[__builtin_ctz(ready)], task, 1) > 0;
+}
+
+/**
+ * @brief Number of tasks waiting in the queue of priority prio
+ */
+__attribute__((always_inline)) static inline uint16_t hydra_interrupt_queue_depth(uint8_t prio)
+{
+	return fifo_count(task_queues[prio]);
+}
+
+/**
+ * @brief Statistics of the queue of priority prio, since
+ * hydra_interrupt_queue_init
+ */
+__attribute__((always_inline)) static inline const hydra_interrupt_queue_stats_t* hydra_interrupt_queue_get_stats(uint8_t prio)
+{
+	return &hydra_interrupt_queue_stats[prio];
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,281 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Timed tasks of the interrupt queue, on a timer wheel : the time is cut in
+ * slots of INTERRUPT_QUEUE_TIMER_RESOLUTION_US, a task waits in the list of the
+ * slot of its deadline, modulo INTERRUPT_QUEUE_TIMER_SLOTS. While tasks are
+ * waiting, the timer interrupt fires at the end of each slot and moves the due
+ * tasks of the slots that ended to the interrupt queue. Deadlines more than
+ * INTERRUPT_QUEUE_TIMER_SLOTS slots away stay in their list until a later turn
+ * of the wheel. The timer is stopped when no task is waiting. If the interrupt
+ * was masked for more than a turn of the wheel, each slot is seen once, from
+ * the oldest one : the due tasks of different slots may then be moved out of
+ * deadline order.
+ *
+ * The deadlines are in ticks of HYDRA_INTERRUPT_QUEUE_TICKS (SysTick), which
+ * count down : ~ticks counts up, and is the time used to find the slots.
+ */
+
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#ifdef INTERRUPT_QUEUE_TIMER
+
+#define _HYDRA_INTERRUPT_QUEUE_CAT3(_a, _b, _c) _a##_b##_c
+#define _HYDRA_INTERRUPT_QUEUE_XCAT3(_a, _b, _c) \
+	_HYDRA_INTERRUPT_QUEUE_CAT3(_a, _b, _c)
+#define HYDRA_INTERRUPT_QUEUE_TMR(_prefix, _suffix) \
+	_HYDRA_INTERRUPT_QUEUE_XCAT3(_prefix, INTERRUPT_QUEUE_TIMER, _suffix)
+
+#define HYDRA_INTERRUPT_QUEUE_TMR_CTRL_MOD HYDRA_INTERRUPT_QUEUE_TMR(R8_TMR, _CTRL_MOD)
+#define HYDRA_INTERRUPT_QUEUE_TMR_INTER_EN HYDRA_INTERRUPT_QUEUE_TMR(R8_TMR, _INTER_EN)
+#define HYDRA_INTERRUPT_QUEUE_TMR_INT_FLAG HYDRA_INTERRUPT_QUEUE_TMR(R8_TMR, _INT_FLAG)
+#define HYDRA_INTERRUPT_QUEUE_TMR_CNT_END HYDRA_INTERRUPT_QUEUE_TMR(R32_TMR, _CNT_END)
+#define HYDRA_INTERRUPT_QUEUE_TMR_IRQN HYDRA_INTERRUPT_QUEUE_TMR(TMR, _IRQn)
+#define HYDRA_INTERRUPT_QUEUE_TMR_IRQHANDLER HYDRA_INTERRUPT_QUEUE_TMR(TMR, _IRQHandler)
+
+#define HYDRA_INTERRUPT_QUEUE_TIMER_NONE 0xFF
+
+typedef struct hydra_interrupt_queue_timer_t
+{
+	hydra_interrupt_queue_task_t task;
+	uint64_t at; // deadline, in ticks of HYDRA_INTERRUPT_QUEUE_TICKS
+	uint8_t prio;
+	uint8_t next; // next timer of the same slot, or of the free list
+} hydra_interrupt_queue_timer_t;
+
+static hydra_interrupt_queue_timer_t timers[INTERRUPT_QUEUE_TIMERS];
+static uint8_t timers_free;
+// lists of timers of each slot, in the order they were added
+static uint8_t slot_head[INTERRUPT_QUEUE_TIMER_SLOTS];
+static uint8_t slot_tail[INTERRUPT_QUEUE_TIMER_SLOTS];
+static uint16_t timers_pending;
+static uint64_t next_slot; // first slot not processed by the interrupt handler
+static uint32_t slot_ticks;
+
+__attribute__((always_inline)) static inline uint64_t _timer_slot(uint64_t ticks)
+{
+	return ~ticks / slot_ticks;
+}
+
+__attribute__((always_inline)) static inline void _timer_start(void)
+{
+	HYDRA_INTERRUPT_QUEUE_TMR_CTRL_MOD = RB_TMR_ALL_CLEAR;
+	HYDRA_INTERRUPT_QUEUE_TMR_CNT_END = slot_ticks;
+	HYDRA_INTERRUPT_QUEUE_TMR_INT_FLAG = RB_TMR_IF_CYC_END;
+	HYDRA_INTERRUPT_QUEUE_TMR_INTER_EN = RB_TMR_IE_CYC_END;
+	HYDRA_INTERRUPT_QUEUE_TMR_CTRL_MOD = RB_TMR_COUNT_EN;
+}
+
+__attribute__((always_inline)) static inline void _timer_stop(void)
+{
+	HYDRA_INTERRUPT_QUEUE_TMR_CTRL_MOD = RB_TMR_ALL_CLEAR;
+	HYDRA_INTERRUPT_QUEUE_TMR_INTER_EN = 0;
+	HYDRA_INTERRUPT_QUEUE_TMR_INT_FLAG = RB_TMR_IF_CYC_END;
+}
+
+__attribute__((always_inline)) static inline bool _timer_add_to_queue(hydra_interrupt_queue_timer_t* timer)
+{
+	hydra_interrupt_queue_task_t* task = &timer->task;
+	if (task->has_inline_args)
+		return _hydra_interrupt_queue_add_task(timer->prio, task->task,
+											   task->inline_args,
+											   INTERRUPT_QUEUE_INLINE_ARGS_SIZE,
+											   task->cleanup);
+	return _hydra_interrupt_queue_add_task(timer->prio, task->task, task->args, 0,
+										   task->cleanup);
+}
+
+void hydra_interrupt_queue_timer_init(void)
+{
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	_timer_stop();
+	for (uint8_t i = 0; i < INTERRUPT_QUEUE_TIMERS; ++i)
+		timers[i].next = i + 1 < INTERRUPT_QUEUE_TIMERS ? i + 1 : HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+	timers_free = 0;
+	for (uint32_t i = 0; i < INTERRUPT_QUEUE_TIMER_SLOTS; ++i)
+	{
+		slot_head[i] = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+		slot_tail[i] = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+	}
+	timers_pending = 0;
+	slot_ticks = INTERRUPT_QUEUE_TIMER_RESOLUTION_US * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+	PFIC_EnableIRQ(HYDRA_INTERRUPT_QUEUE_TMR_IRQN);
+}
+
+bool hydra_interrupt_queue_set_task_at(uint64_t at, uint8_t prio,
+									   bool (*func)(uint8_t*), const void* args,
+									   uint16_t size, void (*cleanup)(uint8_t*))
+{
+	if (prio >= INTERRUPT_QUEUE_PRIORITIES || size > INTERRUPT_QUEUE_INLINE_ARGS_SIZE)
+	{
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_INTERRUPT_QUEUE,
+			   "Invalid timed task priority %d or size %d\r\n", prio, size);
+		return false;
+	}
+
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	uint64_t now = HYDRA_INTERRUPT_QUEUE_TICKS();
+	// a reached deadline goes through the wheel if its slot is not processed
+	// yet : it may hold tasks with the same deadline, to run before this one
+	if (now <= at && (timers_pending == 0 || _timer_slot(at) < next_slot))
+	{
+		HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+		return _hydra_interrupt_queue_add_task(prio, func, args, size, cleanup);
+	}
+	if (timers_free == HYDRA_INTERRUPT_QUEUE_TIMER_NONE)
+	{
+		HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+		LOG_IF_LEVEL(LOG_LEVEL_CRITICAL, "Interrupt queue timers are full\r\n");
+		return false;
+	}
+
+	uint8_t index = timers_free;
+	hydra_interrupt_queue_timer_t* timer = &timers[index];
+	timers_free = timer->next;
+
+	timer->task.in_use = true;
+	timer->task.task = func;
+	timer->task.cleanup = cleanup;
+	timer->task.has_inline_args = size != 0;
+	timer->task.args = size != 0 ? NULL : (uint8_t*)args;
+	if (size != 0)
+		memcpy(timer->task.inline_args, args, size);
+	timer->at = at;
+	timer->prio = prio;
+	timer->next = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+
+	uint32_t slot = (uint32_t)(_timer_slot(at) % INTERRUPT_QUEUE_TIMER_SLOTS);
+	if (slot_tail[slot] == HYDRA_INTERRUPT_QUEUE_TIMER_NONE)
+		slot_head[slot] = index;
+	else
+		timers[slot_tail[slot]].next = index;
+	slot_tail[slot] = index;
+
+	if (timers_pending++ == 0)
+	{
+		next_slot = _timer_slot(now);
+		_timer_start();
+	}
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+	return true;
+}
+
+bool hydra_interrupt_queue_set_task_after(uint32_t delay_us, uint8_t prio,
+										  bool (*func)(uint8_t*), const void* args,
+										  uint16_t size, void (*cleanup)(uint8_t*))
+{
+	uint64_t at = HYDRA_INTERRUPT_QUEUE_TICKS() -
+				  (uint64_t)delay_us * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+	return hydra_interrupt_queue_set_task_at(at, prio, func, args, size, cleanup);
+}
+
+uint16_t hydra_interrupt_queue_timer_pending(void) { return timers_pending; }
+
+/**
+ * @brief Move the due timers of slot to the interrupt queue.
+ * @return false if the interrupt queue of a due timer is full : the following
+ * timers are left in the slot, to keep them in order.
+ */
+static bool _timer_run_slot(uint32_t slot, uint64_t now)
+{
+	uint8_t previous = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+	uint8_t index = slot_head[slot];
+
+	while (index != HYDRA_INTERRUPT_QUEUE_TIMER_NONE)
+	{
+		hydra_interrupt_queue_timer_t* timer = &timers[index];
+		uint8_t next = timer->next;
+
+		// a later turn of the wheel
+		if (now > timer->at)
+		{
+			previous = index;
+			index = next;
+			continue;
+		}
+		if (!_timer_add_to_queue(timer))
+			return false;
+
+		if (previous == HYDRA_INTERRUPT_QUEUE_TIMER_NONE)
+			slot_head[slot] = next;
+		else
+			timers[previous].next = next;
+		if (slot_tail[slot] == index)
+			slot_tail[slot] = previous;
+		timer->next = timers_free;
+		timers_free = index;
+		timers_pending--;
+		index = next;
+	}
+	return true;
+}
+
+void hydra_interrupt_queue_timer_irq(void)
+{
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	HYDRA_INTERRUPT_QUEUE_TMR_INT_FLAG = RB_TMR_IF_CYC_END;
+	uint64_t now = HYDRA_INTERRUPT_QUEUE_TICKS();
+	uint64_t current = _timer_slot(now);
+
+	// after a long interrupt masking, each slot only needs to be seen once
+	if (current - next_slot > INTERRUPT_QUEUE_TIMER_SLOTS)
+		next_slot = current - INTERRUPT_QUEUE_TIMER_SLOTS;
+	// only the slots that ended : all their timers are due
+	while (next_slot < current && timers_pending != 0)
+	{
+		if (!_timer_run_slot((uint32_t)(next_slot % INTERRUPT_QUEUE_TIMER_SLOTS), now))
+			break; // the queue is full, retried on the next interrupt
+		next_slot++;
+	}
+	if (timers_pending == 0)
+		_timer_stop();
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+}
+
+void hydra_interrupt_queue_timer_free_all(void)
+{
+	HYDRA_INTERRUPT_QUEUE_ENTER_CRITICAL();
+	_timer_stop();
+	for (uint32_t slot = 0; slot < INTERRUPT_QUEUE_TIMER_SLOTS; ++slot)
+	{
+		uint8_t index = slot_head[slot];
+		while (index != HYDRA_INTERRUPT_QUEUE_TIMER_NONE)
+		{
+			hydra_interrupt_queue_timer_t* timer = &timers[index];
+			uint8_t next = timer->next;
+			if (timer->task.cleanup)
+				timer->task.cleanup(_hydra_interrupt_queue_task_args(&timer->task));
+			timer->next = timers_free;
+			timers_free = index;
+			index = next;
+		}
+		slot_head[slot] = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+		slot_tail[slot] = HYDRA_INTERRUPT_QUEUE_TIMER_NONE;
+	}
+	timers_pending = 0;
+	HYDRA_INTERRUPT_QUEUE_EXIT_CRITICAL();
+}
+
+__attribute__((interrupt("WCH-Interrupt-fast"))) void HYDRA_INTERRUPT_QUEUE_TMR_IRQHANDLER(void);
+__attribute__((interrupt("WCH-Interrupt-fast"))) void HYDRA_INTERRUPT_QUEUE_TMR_IRQHANDLER(void)
+{
+	hydra_interrupt_queue_timer_irq();
+}
+
+#endif
@@ -30,7 +30,7 @@ static pool_t ram_pool;
  */
 /*
  * This function initiates the pool allocator.
- * The number of blocks must be lower than 256
+ * The number of blocks must fit in pool_index_t, see pool_index.h
  */
 void pool_init(void)
 {
@@ -41,10 +41,16 @@ void pool_init(void)
 	ram_pool.blocks_used = 0;
 	ram_pool.pool = pool_buf;
 
-	for (i = 0; i < sizeof(ram_pool.blocks); i++)
+	for (i = 0; i < POOL_BLOCK_NUM; i++)
 	{
 		ram_pool.blocks[i] = 0;
 	}
+#ifdef RAM_ALLOC_NEXT_FIT
+	ram_pool.cursor = 0;
+#endif
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_reset(&ram_pool.telemetry);
+#endif
 	RAM_ALLOC_EXIT_CRITICAL();
 }
 
@@ -57,10 +63,12 @@ void pool_init(void)
  * This function tries to allocate contiguous blocks by looking at the free
  * blocks list.
  * If found, it will mark the blocks as used (number of allocated blocks).
+ * With RAM_ALLOC_NEXT_FIT, the search starts after the last allocation and
+ * wraps around to block 0.
  */
-void* pool_alloc_blocks(uint8_t num_blocks)
+void* pool_alloc_blocks(pool_index_t num_blocks)
 {
-	uint32_t i, j;
+	uint32_t i, j, n, num_starts;
 	uint8_t space_found;
 	void* ret = NULL;
 
@@ -72,17 +80,28 @@ void* pool_alloc_blocks(uint8_t num_blocks)
 	}
 	if (num_blocks > POOL_BLOCK_NUM)
 	{
+#ifdef ALLOC_TELEMETRY
+		alloc_telemetry_record(&ram_pool.telemetry, num_blocks, false, ram_pool.blocks_used);
+#endif
 		RAM_ALLOC_EXIT_CRITICAL();
 		return 0;
 	}
 
+	num_starts = (uint32_t)POOL_BLOCK_NUM - num_blocks + 1;
+#ifdef RAM_ALLOC_NEXT_FIT
+	i = ram_pool.cursor < num_starts ? ram_pool.cursor : 0;
+#else
+	i = 0;
+#endif
 	space_found = 1;
-	for (i = 0; i <= (uint32_t)POOL_BLOCK_NUM - num_blocks; i++)
+	for (n = 0; n < num_starts; n++, i = i + 1 == num_starts ? 0 : i + 1)
 	{
+		ALLOC_TELEMETRY_COUNT_SCAN(&ram_pool.telemetry, 1);
 		if (ram_pool.blocks[i] == 0)
 		{
 			for (j = 1; j < num_blocks; j++)
 			{
+				ALLOC_TELEMETRY_COUNT_SCAN(&ram_pool.telemetry, 1);
 				if (ram_pool.blocks[i + j] != 0)
 				{
 					// i += j ?
@@ -101,12 +120,21 @@ void* pool_alloc_blocks(uint8_t num_blocks)
 					ram_pool.blocks[i + j] = num_blocks;
 				}
 				ram_pool.blocks_used += num_blocks;
+#ifdef RAM_ALLOC_NEXT_FIT
+				ram_pool.cursor = i + num_blocks;
+#endif
+#ifdef ALLOC_TELEMETRY
+				alloc_telemetry_record(&ram_pool.telemetry, num_blocks, true, ram_pool.blocks_used);
+#endif
 				ret = ram_pool.pool + (ram_pool.block_size * i);
 				RAM_ALLOC_EXIT_CRITICAL();
 				return ret;
 			}
 		}
 	}
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_record(&ram_pool.telemetry, num_blocks, false, ram_pool.blocks_used);
+#endif
 	RAM_ALLOC_EXIT_CRITICAL();
 	return 0;
 }
@@ -123,7 +151,16 @@ void* pool_alloc_blocks(uint8_t num_blocks)
 void* pool_alloc_bytes(uint32_t num_bytes)
 {
 	uint32_t blocks_needed = DIV_ROUND_UP(num_bytes, POOL_BLOCK_SIZE);
-	return pool_alloc_blocks(blocks_needed);
+	if (blocks_needed > POOL_BLOCK_NUM)
+	{
+#ifdef ALLOC_TELEMETRY
+		RAM_ALLOC_ENTER_CRITICAL();
+		alloc_telemetry_record(&ram_pool.telemetry, blocks_needed, false, ram_pool.blocks_used);
+		RAM_ALLOC_EXIT_CRITICAL();
+#endif
+		return 0;
+	}
+	return pool_alloc_blocks((pool_index_t)blocks_needed);
 }
 
 /**
@@ -137,7 +174,8 @@ void* pool_alloc_bytes(uint32_t num_bytes)
  */
 void pool_free(void* ptr)
 {
-	uint8_t block_index, num_blocks, i;
+	uint32_t block_index, i;
+	pool_index_t num_blocks;
 
 	RAM_ALLOC_ENTER_CRITICAL();
 	if (ptr == 0)
@@ -146,7 +184,7 @@ void pool_free(void* ptr)
 		return;
 	}
 
-	block_index = ((int)ptr - (int)ram_pool.pool) / ram_pool.block_size;
+	block_index = ((uint32_t)ptr - (uint32_t)ram_pool.pool) / ram_pool.block_size;
 	num_blocks = ram_pool.blocks[block_index];
 
 	for (i = 0; i < num_blocks; i++)
@@ -157,8 +195,38 @@ void pool_free(void* ptr)
 	RAM_ALLOC_EXIT_CRITICAL();
 }
 
-uint8_t pool_stats_free() { return ram_pool.pool_size - ram_pool.blocks_used; }
+pool_index_t pool_stats_free() { return ram_pool.pool_size - ram_pool.blocks_used; }
+
+pool_index_t pool_stats_used() { return ram_pool.blocks_used; }
+
+pool_index_t* pool_stats_blocks() { return ram_pool.blocks; }
+
+/**
+ * @brief Size of the largest run of free blocks, i.e. the biggest allocation
+ * that would currently succeed
+ */
+pool_index_t pool_stats_largest_free_run(void)
+{
+	pool_index_t largest = 0;
+	pool_index_t run = 0;
+
+	RAM_ALLOC_ENTER_CRITICAL();
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+	{
+		run = ram_pool.blocks[i] == 0 ? (pool_index_t)(run + 1) : 0;
+		if (run > largest)
+			largest = run;
+	}
+	RAM_ALLOC_EXIT_CRITICAL();
+	return largest;
+}
 
-uint8_t pool_stats_used() { return ram_pool.blocks_used; }
+#ifdef ALLOC_TELEMETRY
+const alloc_telemetry_t* pool_stats_telemetry(void) { return &ram_pool.telemetry; }
 
-uint8_t* pool_stats_blocks() { return ram_pool.blocks; }
+void pool_telemetry_dump(void)
+{
+	alloc_telemetry_dump("ram_pool", &ram_pool.telemetry, POOL_BLOCK_NUM,
+						 pool_stats_used(), pool_stats_largest_free_run());
+}
+#endif
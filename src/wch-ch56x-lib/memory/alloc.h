@@ -19,6 +19,8 @@ limitations under the License.
 #ifndef _ALLOC_H_
 #define _ALLOC_H_
 
+#include "wch-ch56x-lib/memory/alloc_telemetry.h"
+#include "wch-ch56x-lib/memory/pool_index.h"
 #include "wch-ch56x-lib/utils/critical_section.h"
 #include <stdint.h>
 
@@ -26,6 +28,12 @@ limitations under the License.
 You must pass the following defines to your compiler
 #define POOL_BLOCK_SIZE size
 #define POOL_BLOCK_NUM num
+
+Optionally
+#define POOL_INDEX_BITS 8 or 16 // width of block indexes, see pool_index.h
+#define ALLOC_TELEMETRY 1 // keep ram_pool telemetry, see alloc_telemetry.h
+#define RAM_ALLOC_NEXT_FIT 1 // start each search after the last allocation
+instead of block 0 (next fit)
 */
 #define POOL_BUFFER_SIZE (POOL_BLOCK_SIZE * POOL_BLOCK_NUM)
 
@@ -45,19 +53,31 @@ typedef struct pool
 {
 	uint8_t* pool;
 	uint32_t block_size; // Block size in bytes
-	uint8_t pool_size; // Total number of blocks
-	uint8_t blocks_used; // Number of used blocks
-	uint8_t blocks[POOL_BLOCK_NUM]; // Blocks status
+	pool_index_t pool_size; // Total number of blocks
+	pool_index_t blocks_used; // Number of used blocks
+	pool_index_t blocks[POOL_BLOCK_NUM]; // Blocks status
+#ifdef RAM_ALLOC_NEXT_FIT
+	uint32_t cursor; // block after the last allocation, where the next search starts
+#endif
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_t telemetry;
+#endif
 } pool_t;
 
 void pool_init(void);
 void* pool_alloc_bytes(uint32_t bytes);
-void* pool_alloc_blocks(uint8_t num_blocks);
+void* pool_alloc_blocks(pool_index_t num_blocks);
 void pool_free(void* ptr);
 
-uint8_t pool_stats_free(void);
-uint8_t pool_stats_used(void);
-uint8_t* pool_stats_blocks(void);
+pool_index_t pool_stats_free(void);
+pool_index_t pool_stats_used(void);
+pool_index_t* pool_stats_blocks(void);
+pool_index_t pool_stats_largest_free_run(void);
+
+#ifdef ALLOC_TELEMETRY
+const alloc_telemetry_t* pool_stats_telemetry(void);
+void pool_telemetry_dump(void);
+#endif
 
 #ifdef __cplusplus
 }
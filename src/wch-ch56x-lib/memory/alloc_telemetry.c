@@ -0,0 +1,61 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#include <stdbool.h>
+
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/alloc_telemetry.h"
+
+#ifdef ALLOC_TELEMETRY
+
+static void alloc_telemetry_dump_histogram(const char* name, const char* title,
+										   const uint32_t* histogram)
+{
+	(void)name; // unused if logging is disabled
+	(void)title;
+	(void)histogram;
+	LOG("%s %s: 1:%d 2:%d 3-4:%d 5-8:%d 9-16:%d 17-32:%d 33-64:%d >64:%d\r\n",
+		name, title, histogram[0], histogram[1], histogram[2], histogram[3],
+		histogram[4], histogram[5], histogram[6], histogram[7]);
+}
+
+void alloc_telemetry_dump(const char* name, const alloc_telemetry_t* telemetry,
+						  uint32_t capacity, uint32_t used,
+						  uint32_t largest_free_run)
+{
+	(void)capacity; // unused if logging is disabled
+	(void)used;
+	(void)largest_free_run;
+	LOG("%s: used %d/%d, peak %d, largest free run %d, failures %d\r\n", name,
+		used, capacity, telemetry->peak_used, largest_free_run,
+		telemetry->failures);
+	if (telemetry->blocks_scanned > 0)
+	{
+		uint32_t searches = telemetry->failures;
+		for (int i = 0; i < ALLOC_TELEMETRY_BUCKETS; ++i)
+			searches += telemetry->size_histogram[i];
+		(void)searches; // unused if logging is disabled
+		LOG("%s: %d blocks scanned, %d per allocation\r\n", name,
+			telemetry->blocks_scanned, telemetry->blocks_scanned / searches);
+	}
+	alloc_telemetry_dump_histogram(name, "allocations by size",
+								   telemetry->size_histogram);
+	alloc_telemetry_dump_histogram(name, "failures by size",
+								   telemetry->failure_histogram);
+}
+
+#endif
@@ -0,0 +1,115 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef ALLOC_TELEMETRY_H
+#define ALLOC_TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+Allocator telemetry, shared by ramx_pool, ram_pool and hydra_pool_t. It is
+only compiled in when ALLOC_TELEMETRY is defined, so it costs nothing
+otherwise.
+
+Sizes are counted in blocks for ramx_pool and ram_pool, and in members for
+hydra_pool_t (always 1). They are grouped in power-of-two buckets : 1, 2, 3-4,
+5-8, 9-16, 17-32, 33-64 and more than 64.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ALLOC_TELEMETRY_BUCKETS 8
+
+typedef struct alloc_telemetry
+{
+	uint16_t peak_used; // highest number of blocks used at the same time
+	uint32_t failures; // number of failed allocations
+	uint32_t size_histogram[ALLOC_TELEMETRY_BUCKETS]; // successful allocations by size
+	uint32_t failure_histogram[ALLOC_TELEMETRY_BUCKETS]; // failed allocations by size
+	uint32_t blocks_scanned; // block states read by the first fit searches
+} alloc_telemetry_t;
+
+/* Count n block states read by a search, nothing without ALLOC_TELEMETRY */
+#ifdef ALLOC_TELEMETRY
+#define ALLOC_TELEMETRY_COUNT_SCAN(_telemetry, _n) ((_telemetry)->blocks_scanned += (_n))
+#else
+#define ALLOC_TELEMETRY_COUNT_SCAN(_telemetry, _n) \
+	do                                             \
+	{                                              \
+	} while (0)
+#endif
+
+/**
+ * @brief Histogram bucket of an allocation of size blocks
+ */
+__attribute__((always_inline)) static inline uint8_t alloc_telemetry_bucket(uint32_t size)
+{
+	if (size <= 1)
+		return 0;
+	uint8_t bucket = (uint8_t)(32 - __builtin_clz(size - 1));
+	return bucket < ALLOC_TELEMETRY_BUCKETS ? bucket : ALLOC_TELEMETRY_BUCKETS - 1;
+}
+
+/**
+ * @brief Record an allocation. Must be called with the allocator locked.
+ * @param size size requested, in blocks
+ * @param success whether the allocation succeeded
+ * @param used number of blocks used after the allocation
+ */
+__attribute__((always_inline)) static inline void alloc_telemetry_record(alloc_telemetry_t* telemetry,
+																		 uint32_t size, bool success,
+																		 uint16_t used)
+{
+	uint8_t bucket = alloc_telemetry_bucket(size);
+	if (success)
+	{
+		telemetry->size_histogram[bucket]++;
+		if (used > telemetry->peak_used)
+			telemetry->peak_used = used;
+	}
+	else
+	{
+		telemetry->failures++;
+		telemetry->failure_histogram[bucket]++;
+	}
+}
+
+__attribute__((always_inline)) static inline void alloc_telemetry_reset(alloc_telemetry_t* telemetry)
+{
+	memset(telemetry, 0, sizeof(alloc_telemetry_t));
+}
+
+/**
+ * @brief Print the telemetry with LOG
+ * @param name name of the allocator
+ * @param capacity total number of blocks
+ * @param used number of blocks currently used
+ * @param largest_free_run biggest allocation that would currently succeed
+ */
+void alloc_telemetry_dump(const char* name, const alloc_telemetry_t* telemetry,
+						  uint32_t capacity, uint32_t used,
+						  uint32_t largest_free_run);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
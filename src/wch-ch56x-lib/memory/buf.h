@@ -0,0 +1,126 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef HYDRA_BUF_H
+#define HYDRA_BUF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Buffer descriptors:
+    A hydra_buf_t describes length bytes at offset in an allocation of
+ramx_pool. The reference counter is the one of the allocation (see
+ramx_take_ownership), so that a descriptor and all its slices share it : each
+holder of a descriptor owns one reference, and the allocation is freed when the
+last holder calls buf_unref.
+
+    This allows forwarding data between peripherals without copies, e.g. a USB
+OUT packet can be sent on HSPI with hspi_send_buf after removing a header with
+buf_slice, then received and sent on a USB IN endpoint with endp_tx_set_new_buf.
+
+    The descriptor itself is small and passed by value or copied freely : only
+buf_ref and buf_unref change the reference counter.
+*/
+
+typedef struct hydra_buf_t
+{
+	uint8_t* base; // start of the ramx_pool allocation, used for refcounting
+	uint16_t offset; // offset of the data from base
+	uint16_t length; // length of the data in bytes
+} hydra_buf_t;
+
+/**
+ * @brief Make a descriptor for a buffer returned by ramx_pool_alloc_bytes or
+ * ramx_pool_alloc_blocks. The reference of the caller is transferred to the
+ * descriptor, the reference counter is not changed.
+ */
+__attribute__((always_inline)) static inline hydra_buf_t buf_from_ramx(uint8_t* base, uint16_t length)
+{
+	hydra_buf_t buf = { .base = base, .offset = 0, .length = length };
+	return buf;
+}
+
+/**
+ * @brief Allocate a new buffer of length bytes in ramx_pool.
+ * @return false if there is no memory left, buf is then left untouched
+ */
+__attribute__((always_inline)) static inline bool buf_alloc(hydra_buf_t* buf, uint16_t length)
+{
+	uint8_t* base = ramx_pool_alloc_bytes(length);
+	if (base == NULL)
+		return false;
+	*buf = buf_from_ramx(base, length);
+	return true;
+}
+
+/**
+ * @brief Pointer to the first byte of the data described by buf
+ */
+__attribute__((always_inline)) static inline uint8_t* buf_data(const hydra_buf_t* buf)
+{
+	return buf->base + buf->offset;
+}
+
+/**
+ * @brief Take one more reference on the allocation of buf. buf_unref must be
+ * called once the data is not needed anymore.
+ */
+__attribute__((always_inline)) static inline void buf_ref(const hydra_buf_t* buf)
+{
+	ramx_take_ownership(buf->base);
+}
+
+/**
+ * @brief Release one reference on the allocation of buf, and free it if this
+ * was the last one.
+ */
+__attribute__((always_inline)) static inline void buf_unref(const hydra_buf_t* buf)
+{
+	ramx_pool_free(buf->base);
+}
+
+/**
+ * @brief Describe length bytes starting at offset in buf, e.g. to strip a
+ * header. The slice takes its own reference, which must be released with
+ * buf_unref.
+ * @param offset from the start of the data of buf
+ * @return false if the slice does not fit in buf, slice is then left untouched
+ */
+__attribute__((always_inline)) static inline bool buf_slice(const hydra_buf_t* buf, uint16_t offset,
+															 uint16_t length, hydra_buf_t* slice)
+{
+	if ((uint32_t)offset + length > buf->length)
+		return false;
+	buf_ref(buf);
+	slice->base = buf->base;
+	slice->offset = (uint16_t)(buf->offset + offset);
+	slice->length = length;
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
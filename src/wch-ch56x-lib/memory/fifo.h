@@ -67,6 +67,22 @@ interrupts, do not read in an interrupt handler. otherwise, the interrupt could
 preempt your code while its reading which would put the FIFO in a bad state.
     -> single-core
 
+SPSC mode:
+    A FIFO defined with HYDRA_FIFO_DEF_SPSC never disables interrupts. It must
+have exactly one producer and one consumer, e.g. an interrupt handler writing
+and the main loop reading. Each side only stores its own index, after copying
+the elements (and loads the other index before copying), so the other side
+sees either the old or the new index, never a partial state. fifo_clean is not
+safe in this mode while the other side may run.
+
+Zero-copy:
+    fifo_write_reserve/fifo_write_commit and fifo_read_acquire/fifo_read_release
+give access to the elements inside the buffer, as up to two linear spans (the
+second one when the elements wrap around the end of the buffer). Elements can
+be built or parsed in place, then published or freed. Between reserve and
+commit (or acquire and release), no other producer (or consumer) may access the
+FIFO : protect the whole sequence if there are several of them.
+
 Got some inspiration from https://github.com/hathach/tinyusb
 */
 
@@ -77,8 +93,15 @@ typedef struct hydra_fifo_t
 	size_t type_size;
 	volatile uint16_t rd_idx;
 	volatile uint16_t wr_idx;
+	bool spsc; // single-producer/single-consumer, no critical sections
 } hydra_fifo_t;
 
+typedef struct hydra_fifo_span_t
+{
+	void* ptr; // first element of the span
+	uint16_t count; // number of elements in the span
+} hydra_fifo_span_t;
+
 #define HYDRA_FIFO_DECLR(_name, _type, _size)                   \
 	extern uint8_t _name##_buffer[(_size + 1) * sizeof(_type)]; \
 	extern hydra_fifo_t _name
@@ -89,7 +112,21 @@ typedef struct hydra_fifo_t
 						   .size = _size + 1,            \
 						   .type_size = sizeof(_type),   \
 						   .rd_idx = 0,                  \
-						   .wr_idx = 0 }
+						   .wr_idx = 0,                  \
+						   .spsc = false }
+
+/**
+ * @brief Define a single-producer/single-consumer FIFO, which does not disable
+ * interrupts. Use HYDRA_FIFO_DECLR to declare it.
+ */
+#define HYDRA_FIFO_DEF_SPSC(_name, _type, _size)         \
+	uint8_t _name##_buffer[(_size + 1) * sizeof(_type)]; \
+	hydra_fifo_t _name = { .buffer = _name##_buffer,     \
+						   .size = _size + 1,            \
+						   .type_size = sizeof(_type),   \
+						   .rd_idx = 0,                  \
+						   .wr_idx = 0,                  \
+						   .spsc = true }
 
 #ifndef HYDRA_FIFO_ENTER_CRITICAL
 #define HYDRA_FIFO_ENTER_CRITICAL() BSP_ENTER_CRITICAL()
@@ -99,9 +136,31 @@ typedef struct hydra_fifo_t
 #define HYDRA_FIFO_EXIT_CRITICAL() BSP_EXIT_CRITICAL()
 #endif
 
+/* Keep the compiler from moving buffer accesses across index loads/stores */
+#define HYDRA_FIFO_BARRIER() __asm__ volatile("" ::: "memory")
+
 #define ABS(x) x < 0 ? -x : x
 #define MIN(x, y) x < y ? x : y
 
+__attribute__((always_inline)) static inline void
+_fifo_enter_critical(hydra_fifo_t* fifo);
+__attribute__((always_inline)) static inline void
+_fifo_enter_critical(hydra_fifo_t* fifo)
+{
+	if (!fifo->spsc)
+		HYDRA_FIFO_ENTER_CRITICAL();
+	HYDRA_FIFO_BARRIER();
+}
+
+__attribute__((always_inline)) static inline void
+_fifo_exit_critical(hydra_fifo_t* fifo);
+__attribute__((always_inline)) static inline void
+_fifo_exit_critical(hydra_fifo_t* fifo)
+{
+	if (!fifo->spsc)
+		HYDRA_FIFO_EXIT_CRITICAL();
+}
+
 __attribute__((always_inline)) static inline uint16_t
 _fifo_get_count(uint16_t rd_idx, uint16_t wr_idx, uint16_t size);
 __attribute__((always_inline)) static inline uint16_t
@@ -226,7 +285,8 @@ _fifo_advance_read(hydra_fifo_t* fifo, uint16_t rd_idx, uint16_t offset);
 __attribute__((always_inline)) static inline void
 _fifo_advance_read(hydra_fifo_t* fifo, uint16_t rd_idx, uint16_t offset)
 {
-	fifo->rd_idx = (fifo->rd_idx + offset) % fifo->size;
+	HYDRA_FIFO_BARRIER();
+	fifo->rd_idx = (rd_idx + offset) % fifo->size;
 }
 
 __attribute__((always_inline)) static inline void
@@ -234,7 +294,23 @@ _fifo_advance_write(hydra_fifo_t* fifo, uint16_t wr_idx, uint16_t offset);
 __attribute__((always_inline)) static inline void
 _fifo_advance_write(hydra_fifo_t* fifo, uint16_t wr_idx, uint16_t offset)
 {
-	fifo->wr_idx = (fifo->wr_idx + offset) % fifo->size;
+	HYDRA_FIFO_BARRIER();
+	fifo->wr_idx = (wr_idx + offset) % fifo->size;
+}
+
+__attribute__((always_inline)) static inline void
+_fifo_get_spans(hydra_fifo_t* fifo, uint16_t idx, uint16_t count,
+				hydra_fifo_span_t spans[2]);
+__attribute__((always_inline)) static inline void
+_fifo_get_spans(hydra_fifo_t* fifo, uint16_t idx, uint16_t count,
+				hydra_fifo_span_t spans[2])
+{
+	uint16_t first = (idx + 1) % fifo->size;
+	uint16_t linear_count = MIN(count, fifo->size - first);
+	spans[0].ptr = fifo->buffer + first * fifo->type_size;
+	spans[0].count = linear_count;
+	spans[1].ptr = fifo->buffer;
+	spans[1].count = count - linear_count;
 }
 
 /**
@@ -246,14 +322,14 @@ _fifo_advance_write(hydra_fifo_t* fifo, uint16_t wr_idx, uint16_t offset)
 __attribute__((always_inline)) static inline uint16_t
 fifo_read(hydra_fifo_t* fifo, void* buffer)
 {
-	HYDRA_FIFO_ENTER_CRITICAL();
+	_fifo_enter_critical(fifo);
 	uint16_t rd_idx = fifo->rd_idx;
 	uint16_t wr_idx = fifo->wr_idx;
 	uint16_t count_read =
 		_fifo_read_n(fifo, buffer, _fifo_get_count(rd_idx, wr_idx, fifo->size),
 					 rd_idx, wr_idx);
 	_fifo_advance_read(fifo, rd_idx, count_read);
-	HYDRA_FIFO_EXIT_CRITICAL();
+	_fifo_exit_critical(fifo);
 	return count_read;
 }
 
@@ -268,12 +344,12 @@ fifo_read(hydra_fifo_t* fifo, void* buffer)
 __attribute__((always_inline)) static inline uint16_t
 fifo_read_n(hydra_fifo_t* fifo, void* buffer, uint16_t n)
 {
-	HYDRA_FIFO_ENTER_CRITICAL();
+	_fifo_enter_critical(fifo);
 	uint16_t rd_idx = fifo->rd_idx;
 	uint16_t wr_idx = fifo->wr_idx;
 	uint16_t count_read = _fifo_read_n(fifo, buffer, n, rd_idx, wr_idx);
 	_fifo_advance_read(fifo, rd_idx, count_read);
-	HYDRA_FIFO_EXIT_CRITICAL();
+	_fifo_exit_critical(fifo);
 	return count_read;
 }
 
@@ -289,11 +365,11 @@ fifo_read_n(hydra_fifo_t* fifo, void* buffer, uint16_t n)
 __attribute__((always_inline)) static inline uint16_t
 fifo_peek_n(hydra_fifo_t* fifo, void* buffer, uint16_t n)
 {
-	HYDRA_FIFO_ENTER_CRITICAL();
+	_fifo_enter_critical(fifo);
 	uint16_t rd_idx = fifo->rd_idx;
 	uint16_t wr_idx = fifo->wr_idx;
 	uint16_t count_read = _fifo_read_n(fifo, buffer, n, rd_idx, wr_idx);
-	HYDRA_FIFO_EXIT_CRITICAL();
+	_fifo_exit_critical(fifo);
 	return count_read;
 }
 
@@ -308,15 +384,81 @@ fifo_peek_n(hydra_fifo_t* fifo, void* buffer, uint16_t n)
 __attribute__((always_inline)) static inline uint16_t
 fifo_write(hydra_fifo_t* fifo, void* buffer, uint16_t n)
 {
-	HYDRA_FIFO_ENTER_CRITICAL();
+	_fifo_enter_critical(fifo);
 	uint16_t rd_idx = fifo->rd_idx;
 	uint16_t wr_idx = fifo->wr_idx;
 	uint16_t count_written = _fifo_write_n(fifo, buffer, n, rd_idx, wr_idx);
 	_fifo_advance_write(fifo, wr_idx, count_written);
-	HYDRA_FIFO_EXIT_CRITICAL();
+	_fifo_exit_critical(fifo);
 	return count_written;
 }
 
+/**
+ * @brief Reserve up to n free elements to be written in place. They are only
+ * visible to the consumer after fifo_write_commit.
+ * @param fifo pointer to the fifo
+ * @param n number of elements to reserve
+ * @param spans filled with the reserved elements, spans[1].count is 0 if they
+ * do not wrap around
+ * @return number of elements reserved, less than n if there is not enough free
+ * space
+ */
+__attribute__((always_inline)) static inline uint16_t
+fifo_write_reserve(hydra_fifo_t* fifo, uint16_t n, hydra_fifo_span_t spans[2])
+{
+	uint16_t rd_idx = fifo->rd_idx;
+	uint16_t wr_idx = fifo->wr_idx;
+	uint16_t free_space = _fifo_get_free_space(rd_idx, wr_idx, fifo->size);
+	uint16_t count = MIN(n, free_space);
+	HYDRA_FIFO_BARRIER();
+	_fifo_get_spans(fifo, wr_idx, count, spans);
+	return count;
+}
+
+/**
+ * @brief Publish n elements previously reserved with fifo_write_reserve
+ * @param fifo pointer to the fifo
+ * @param n number of elements written, at most the number reserved
+ */
+__attribute__((always_inline)) static inline void
+fifo_write_commit(hydra_fifo_t* fifo, uint16_t n)
+{
+	_fifo_advance_write(fifo, fifo->wr_idx, n);
+}
+
+/**
+ * @brief Get up to n elements to be read in place. They stay in the FIFO until
+ * fifo_read_release.
+ * @param fifo pointer to the fifo
+ * @param n number of elements to acquire
+ * @param spans filled with the acquired elements, spans[1].count is 0 if they
+ * do not wrap around
+ * @return number of elements acquired, less than n if there are less elements
+ * in the FIFO
+ */
+__attribute__((always_inline)) static inline uint16_t
+fifo_read_acquire(hydra_fifo_t* fifo, uint16_t n, hydra_fifo_span_t spans[2])
+{
+	uint16_t rd_idx = fifo->rd_idx;
+	uint16_t wr_idx = fifo->wr_idx;
+	uint16_t available = _fifo_get_count(rd_idx, wr_idx, fifo->size);
+	uint16_t count = MIN(n, available);
+	HYDRA_FIFO_BARRIER();
+	_fifo_get_spans(fifo, rd_idx, count, spans);
+	return count;
+}
+
+/**
+ * @brief Remove n elements previously acquired with fifo_read_acquire
+ * @param fifo pointer to the fifo
+ * @param n number of elements consumed, at most the number acquired
+ */
+__attribute__((always_inline)) static inline void
+fifo_read_release(hydra_fifo_t* fifo, uint16_t n)
+{
+	_fifo_advance_read(fifo, fifo->rd_idx, n);
+}
+
 /**
  * @brief Get the number of elements in the queue
  * @param fifo pointer to the fifo
@@ -329,7 +471,8 @@ fifo_count(hydra_fifo_t* fifo)
 }
 
 /**
- * @brief Remove all elements in the queue and set to 0
+ * @brief Remove all elements in the queue and set to 0. For an SPSC FIFO, only
+ * call it when neither side can access the FIFO.
  * @param fifo pointer to the fifo
  */
 __attribute__((always_inline)) static inline void
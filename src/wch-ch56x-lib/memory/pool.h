@@ -30,6 +30,8 @@ limitations under the License.
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/alloc_telemetry.h"
 #include "wch-ch56x-lib/utils/critical_section.h"
 #include <stdbool.h>
 #include <stdint.h>
@@ -46,14 +48,40 @@ Pool requirements:
     -> safe for use with interrupts : this is achieved by disabling interrupts
     -> wch569 is single-core so no need for concurrent access protections
     -> fast : this might depend on the context
+
+By default, hydra_pool_get scans pool_manager for a free member. Pools defined
+with HYDRA_POOL_DEF_FREE_LIST instead keep the free members in a singly-linked
+list, the index of the next free member being stored in the first two bytes of
+each unused member, so get and free take constant time. Members that were never
+used are not in the list, they are taken in order with free_list_next_unused.
+pool_manager is still used to detect double frees.
+
+With ALLOC_TELEMETRY, each pool counts its used members and keeps an
+alloc_telemetry_t (peak usage, failures), see hydra_pool_telemetry_dump.
+
+With ALLOC_DEBUG, hydra_pool_free logs and counts in debug_errors the pointers
+that are not a member of the pool and the double frees, which are otherwise
+ignored silently.
 */
 
+#define HYDRA_POOL_FREE_LIST_END 0xffff
+
 typedef struct hydra_pool_t
 {
 	uint8_t* pool_members;
 	bool* pool_manager;
 	uint16_t size;
 	size_t type_size;
+	bool free_list;
+	uint16_t free_list_head; // last freed member, HYDRA_POOL_FREE_LIST_END if none
+	uint16_t free_list_next_unused; // members from this index were never used
+#ifdef ALLOC_TELEMETRY
+	uint16_t used; // number of members in use
+	alloc_telemetry_t telemetry;
+#endif
+#ifdef ALLOC_DEBUG
+	uint32_t debug_errors; // invalid pointers and double frees
+#endif
 } hydra_pool_t;
 
 #define HYDRA_POOL_DEF(_name, _type, _size)                      \
@@ -64,6 +92,18 @@ typedef struct hydra_pool_t
 						   .size = _size,                        \
 						   .type_size = sizeof(_type) }
 
+#define HYDRA_POOL_DEF_FREE_LIST(_name, _type, _size)                                 \
+	typedef char _name##_type_fits_index[sizeof(_type) >= sizeof(uint16_t) ? 1 : -1]; \
+	uint8_t _name##_pool_members[_size * sizeof(_type)];                              \
+	bool _name##_pool_manager[_size];                                                 \
+	hydra_pool_t _name = { .pool_members = _name##_pool_members,                      \
+						   .pool_manager = _name##_pool_manager,                      \
+						   .size = _size,                                             \
+						   .type_size = sizeof(_type),                                \
+						   .free_list = true,                                         \
+						   .free_list_head = HYDRA_POOL_FREE_LIST_END,                \
+						   .free_list_next_unused = 0 }
+
 #define HYDRA_POOL_DECLR(_name) \
 	extern hydra_pool_t _name
 
@@ -76,16 +116,52 @@ __attribute__((always_inline)) static inline void*
 hydra_pool_get(hydra_pool_t* pool)
 {
 	BSP_ENTER_CRITICAL();
+	if (pool->free_list)
+	{
+		uint16_t i = pool->free_list_head;
+		if (i != HYDRA_POOL_FREE_LIST_END)
+		{
+			memcpy(&pool->free_list_head, pool->pool_members + i * pool->type_size,
+				   sizeof(uint16_t));
+		}
+		else if (pool->free_list_next_unused < pool->size)
+		{
+			i = pool->free_list_next_unused++;
+		}
+
+		if (i != HYDRA_POOL_FREE_LIST_END)
+		{
+			pool->pool_manager[i] = true;
+#ifdef ALLOC_TELEMETRY
+			alloc_telemetry_record(&pool->telemetry, 1, true, ++pool->used);
+#endif
+			BSP_EXIT_CRITICAL();
+			return (void*)(pool->pool_members + i * pool->type_size);
+		}
+		LOG_IF_LEVEL(LOG_LEVEL_CRITICAL, "Pool %x is full\r\n", pool);
+#ifdef ALLOC_TELEMETRY
+		alloc_telemetry_record(&pool->telemetry, 1, false, pool->used);
+#endif
+		BSP_EXIT_CRITICAL();
+		return NULL;
+	}
+
 	for (uint16_t i = 0; i < pool->size; ++i)
 	{
 		if (!pool->pool_manager[i])
 		{
 			pool->pool_manager[i] = true;
+#ifdef ALLOC_TELEMETRY
+			alloc_telemetry_record(&pool->telemetry, 1, true, ++pool->used);
+#endif
 			BSP_EXIT_CRITICAL();
 			return (void*)(pool->pool_members + i * pool->type_size);
 		}
 	}
 	LOG_IF_LEVEL(LOG_LEVEL_CRITICAL, "Pool %x is full\r\n", pool);
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_record(&pool->telemetry, 1, false, pool->used);
+#endif
 	BSP_EXIT_CRITICAL();
 	return NULL;
 }
@@ -100,12 +176,35 @@ hydra_pool_free(hydra_pool_t* pool, void* ptr)
 {
 	uint16_t i = ((uint8_t*)(ptr)-pool->pool_members) / pool->type_size;
 	BSP_ENTER_CRITICAL();
+#ifdef ALLOC_DEBUG
+	if ((uint8_t*)ptr < pool->pool_members ||
+		(uint8_t*)ptr >= pool->pool_members + pool->size * pool->type_size ||
+		((uint8_t*)ptr - pool->pool_members) % pool->type_size != 0 ||
+		!pool->pool_manager[i])
+	{
+		pool->debug_errors++;
+		BSP_EXIT_CRITICAL();
+		LOG_IF_LEVEL(LOG_LEVEL_ERROR,
+					 "hydra_pool_free ptr %x not a member of the pool or already free\r\n",
+					 ptr);
+		return;
+	}
+#endif
 	if (i >= pool->size || !pool->pool_manager[i])
 	{
 		BSP_EXIT_CRITICAL();
 		return;
 	}
 	pool->pool_manager[i] = false;
+#ifdef ALLOC_TELEMETRY
+	pool->used--;
+#endif
+	if (pool->free_list)
+	{
+		memcpy(pool->pool_members + i * pool->type_size, &pool->free_list_head,
+			   sizeof(uint16_t));
+		pool->free_list_head = i;
+	}
 	BSP_EXIT_CRITICAL();
 }
 
@@ -121,10 +220,31 @@ hydra_pool_clean(hydra_pool_t* pool)
 	{
 		pool->pool_manager[i] = false;
 	}
+	pool->free_list_head = HYDRA_POOL_FREE_LIST_END;
+	pool->free_list_next_unused = 0;
+#ifdef ALLOC_TELEMETRY
+	pool->used = 0;
+	alloc_telemetry_reset(&pool->telemetry);
+#endif
 	memset(pool->pool_members, 0, pool->size * pool->type_size);
 	BSP_EXIT_CRITICAL();
 }
 
+#ifdef ALLOC_TELEMETRY
+/**
+ * @brief Print the telemetry of a pool with LOG. Any free member can be
+ * allocated, so the largest free run is the number of free members.
+ * @param pool pointer to the pool
+ * @param name name printed in the logs
+ */
+__attribute__((always_inline)) static inline void
+hydra_pool_telemetry_dump(hydra_pool_t* pool, const char* name)
+{
+	alloc_telemetry_dump(name, &pool->telemetry, pool->size, pool->used,
+						 pool->size - pool->used);
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,55 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef POOL_INDEX_H
+#define POOL_INDEX_H
+
+#include <stdint.h>
+
+/**
+Width of the block indexes and counters of ramx_pool and ram_pool.
+
+#define POOL_INDEX_BITS 8 // up to 255 blocks, one byte of state per block
+#define POOL_INDEX_BITS 16 // up to 65535 blocks, two bytes of state per block
+
+If POOL_INDEX_BITS is not defined, the smallest width that can hold
+POOL_BLOCK_NUM is used. 16 bits allow small blocks over the whole RAMX (e.g.
+1024 blocks of 64 bytes), at the cost of twice the memory for the block states
+and of scanning more blocks.
+*/
+
+#ifndef POOL_INDEX_BITS
+#if POOL_BLOCK_NUM > 255
+#define POOL_INDEX_BITS 16
+#else
+#define POOL_INDEX_BITS 8
+#endif
+#endif
+
+#if POOL_INDEX_BITS == 8
+typedef uint8_t pool_index_t;
+#define POOL_INDEX_MAX UINT8_MAX
+#elif POOL_INDEX_BITS == 16
+typedef uint16_t pool_index_t;
+#define POOL_INDEX_MAX UINT16_MAX
+#else
+#error "POOL_INDEX_BITS must be 8 or 16"
+#endif
+
+typedef char pool_block_num_fits_index[POOL_BLOCK_NUM <= POOL_INDEX_MAX ? 1 : -1];
+
+#endif
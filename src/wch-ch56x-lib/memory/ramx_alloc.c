@@ -28,7 +28,7 @@ pool_t ramx_pool;
  */
 /*
  * This function initiates the pool allocator.
- * The number of blocks must be lower than 256
+ * The number of blocks must fit in pool_index_t, see pool_index.h
  */
 void ramx_pool_init(void)
 {
@@ -40,9 +40,80 @@ void ramx_pool_init(void)
 	ramx_pool.pool = ramx_pool_buf;
 	ramx_pool.end_pool = ramx_pool_buf + POOL_BLOCK_NUM * POOL_BLOCK_SIZE;
 
-	for (i = 0; i < sizeof(ramx_pool.blocks); i++)
+	for (i = 0; i < POOL_BLOCK_NUM; i++)
 	{
 		ramx_pool.blocks[i] = 0;
-		ramx_pool.blocks_reference_counter[i] = 0;
+		ramx_pool.headers[i].reference_counter = 0;
+		ramx_pool.headers[i].num_blocks = 0;
 	}
+#ifdef RAMX_ALLOC_NEXT_FIT
+	ramx_pool.cursor = 0;
+#endif
+#ifdef ALLOC_DEBUG
+	memset(ramx_pool_buf, RAMX_ALLOC_POISON, sizeof(ramx_pool_buf));
+	memset(ramx_pool.headers, 0, sizeof(ramx_pool.headers));
+	ramx_pool.debug_errors = 0;
+#endif
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_reset(&ramx_pool.telemetry);
+#endif
+#ifdef RAMX_ALLOC_BITMAP
+	memset(ramx_pool.free_bitmap, 0, sizeof(ramx_pool.free_bitmap));
+	_ramx_bitmap_set_range(0, POOL_BLOCK_NUM, true);
+#endif
+#ifdef RAMX_ALLOC_BUDDY
+	ramx_pool.buddy_free_orders = 0;
+	for (i = 0; i < RAMX_BUDDY_ORDERS; i++)
+		ramx_pool.buddy_free_head[i] = RAMX_BUDDY_NONE;
+	memset(ramx_pool.buddy_free_order, 0, sizeof(ramx_pool.buddy_free_order));
+	// split the pool in aligned runs of decreasing powers of two
+	i = 0;
+	while (i < POOL_BLOCK_NUM)
+	{
+		uint32_t order = 31 - (uint32_t)__builtin_clz(POOL_BLOCK_NUM - i);
+		_ramx_buddy_push(i, order);
+		i += 1U << order;
+	}
+#endif
+}
+
+void ramx_pool_dump(void)
+{
+	char line[64 + 1];
+	uint32_t i, j;
+
+	(void)line; // unused if logging is disabled
+	LOG("ramx_pool: %d/%d blocks used, %d bytes per block\r\n",
+		ramx_pool.blocks_used, ramx_pool.pool_size, ramx_pool.block_size);
+	RAMX_ALLOC_ENTER_CRITICAL();
+	for (i = 0; i < POOL_BLOCK_NUM; i += 64)
+	{
+		for (j = 0; j < 64 && i + j < POOL_BLOCK_NUM; j++)
+		{
+			if (ramx_pool.blocks[i + j] == 0)
+				line[j] = '.';
+			else if (ramx_pool.headers[i + j].reference_counter != 0)
+				line[j] = '[';
+			else
+				line[j] = '=';
+		}
+		line[j] = '\0';
+		LOG("%4d %s\r\n", i, line);
+	}
+	for (i = 0; i < POOL_BLOCK_NUM; i++)
+	{
+		ramx_alloc_header_t* header = &ramx_pool.headers[i];
+		(void)header;
+		if (ramx_pool.blocks[i] == 0 || header->reference_counter == 0)
+			continue;
+#ifdef ALLOC_DEBUG
+		LOG("block %d: %d blocks, %d owners, %d bytes, from %s:%d\r\n", i,
+			header->num_blocks, header->reference_counter, header->size,
+			header->owner_file ? header->owner_file : "?", header->owner_line);
+#else
+		LOG("block %d: %d blocks, %d owners\r\n", i, header->num_blocks,
+			header->reference_counter);
+#endif
+	}
+	RAMX_ALLOC_EXIT_CRITICAL();
 }
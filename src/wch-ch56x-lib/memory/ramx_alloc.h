@@ -21,14 +21,32 @@ limitations under the License.
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/alloc_telemetry.h"
+#include "wch-ch56x-lib/memory/pool_index.h"
 #include "wch-ch56x-lib/utils/critical_section.h"
 
 /**
 You must pass the following defines to your compiler
 #define POOL_BLOCK_SIZE size // the size of each individual block
-#define POOL_BLOCK_NUM num // number of blocks to be allocated, no more than 256
+#define POOL_BLOCK_NUM num // number of blocks to be allocated
+
+Optionally
+#define POOL_INDEX_BITS 8 or 16 // width of block indexes, see pool_index.h
+#define RAMX_ALLOC_BITMAP 1 // search free blocks in a packed bitmap (32 blocks
+per word) instead of scanning blocks[] one by one
+#define RAMX_ALLOC_BUDDY 1 // binary buddy allocator : allocations are rounded up
+to a power of two blocks, taken from per-size free lists and coalesced on free
+#define RAMX_ALLOC_NEXT_FIT 1 // with the default backend, start each search
+after the last allocation instead of block 0 (next fit)
+#define RAMX_ALLOC_TRACE 1 // call ramx_alloc_trace_alloc/ramx_alloc_trace_free,
+implemented by the application, to record allocation traces
+#define ALLOC_TELEMETRY 1 // keep ramx_pool.telemetry, see alloc_telemetry.h
+#define ALLOC_DEBUG 1 // check the pointers given to ramx_pool_free, put a guard
+word after each ramx_pool_alloc_bytes buffer, poison freed blocks and tag each
+allocation with the file and line of its caller, see ramx_pool_dump
 */
 #define POOL_BUFFER_SIZE (POOL_BLOCK_SIZE * POOL_BLOCK_NUM)
 
@@ -47,15 +65,97 @@ extern "C" {
 /* Taken from linux kernel */
 #define DIV_ROUND_UP(n, d) (((n) + (d)-1) / (d))
 
+#define RAMX_BITMAP_WORDS DIV_ROUND_UP(POOL_BLOCK_NUM, 32)
+
+#if defined(RAMX_ALLOC_BITMAP) && defined(RAMX_ALLOC_BUDDY)
+#error "RAMX_ALLOC_BITMAP and RAMX_ALLOC_BUDDY are exclusive"
+#endif
+
+#if defined(RAMX_ALLOC_NEXT_FIT) && (defined(RAMX_ALLOC_BITMAP) || defined(RAMX_ALLOC_BUDDY))
+#error "RAMX_ALLOC_NEXT_FIT only applies to the first fit backend"
+#endif
+
+#ifdef RAMX_ALLOC_TRACE
+/* Called with the allocator locked, after each allocation and each free that
+ * releases the blocks */
+void ramx_alloc_trace_alloc(void* ptr, uint32_t num_blocks);
+void ramx_alloc_trace_free(void* ptr);
+#define RAMX_ALLOC_TRACE_ALLOC(_ptr, _num_blocks) ramx_alloc_trace_alloc(_ptr, _num_blocks)
+#define RAMX_ALLOC_TRACE_FREE(_ptr) ramx_alloc_trace_free(_ptr)
+#else
+#define RAMX_ALLOC_TRACE_ALLOC(_ptr, _num_blocks) \
+	do                                            \
+	{                                             \
+	} while (0)
+#define RAMX_ALLOC_TRACE_FREE(_ptr) \
+	do                              \
+	{                               \
+	} while (0)
+#endif
+
+#ifdef ALLOC_DEBUG
+#define RAMX_ALLOC_GUARD 0xCAFEF00Du // written after the requested bytes
+#define RAMX_ALLOC_GUARD_SIZE 4
+#define RAMX_ALLOC_POISON 0xA5 // fills free blocks
+#define RAMX_ALLOC_DEBUG_ALLOC(_ptr, _num_blocks) _ramx_debug_on_alloc(_ptr, _num_blocks)
+#define RAMX_ALLOC_BLOCKS_FOR_BYTES(_num_bytes) \
+	DIV_ROUND_UP((_num_bytes) + RAMX_ALLOC_GUARD_SIZE, POOL_BLOCK_SIZE)
+#else
+#define RAMX_ALLOC_DEBUG_ALLOC(_ptr, _num_blocks) \
+	do                                            \
+	{                                             \
+	} while (0)
+#define RAMX_ALLOC_BLOCKS_FOR_BYTES(_num_bytes) DIV_ROUND_UP(_num_bytes, POOL_BLOCK_SIZE)
+#endif
+
+/* Free runs of 2^0 to 2^(POOL_INDEX_BITS - 1) blocks, the largest that fits in
+ * POOL_BLOCK_NUM */
+#define RAMX_BUDDY_ORDERS POOL_INDEX_BITS
+#define RAMX_BUDDY_NONE POOL_INDEX_MAX
+
+/**
+ * Allocation header, stored for the first block of each allocation only.
+ * Kept out of the buffer so that allocations stay aligned for DMA.
+ */
+typedef struct ramx_alloc_header
+{
+	uint16_t reference_counter; // Number of owners, 0 if not allocated
+	pool_index_t num_blocks; // Number of blocks of the allocation
+#ifdef ALLOC_DEBUG
+	uint32_t size; // requested bytes, followed by the guard word if there is room
+	const char* owner_file; // caller of the allocation, NULL if unknown
+	uint32_t owner_line;
+#endif
+} ramx_alloc_header_t;
+
 typedef struct pool
 {
 	uint8_t* pool;
 	uint8_t* end_pool;
 	uint32_t block_size; // Block size in bytes
-	uint8_t pool_size; // Total number of blocks
-	uint8_t blocks_used; // Number of used blocks
-	uint8_t blocks[POOL_BLOCK_NUM]; // Blocks status
-	uint8_t blocks_reference_counter[POOL_BLOCK_NUM]; // Blocks status
+	pool_index_t pool_size; // Total number of blocks
+	pool_index_t blocks_used; // Number of used blocks
+	pool_index_t blocks[POOL_BLOCK_NUM]; // Blocks status
+	ramx_alloc_header_t headers[POOL_BLOCK_NUM]; // Allocation headers, by first block
+#ifdef RAMX_ALLOC_BITMAP
+	uint32_t free_bitmap[RAMX_BITMAP_WORDS]; // 1 bit per block, 1 = free
+#endif
+#ifdef RAMX_ALLOC_BUDDY
+	uint32_t buddy_free_orders; // bit n set if there is a free run of 2^n blocks
+	pool_index_t buddy_free_head[RAMX_BUDDY_ORDERS]; // free runs of 2^n blocks, by first block
+	pool_index_t buddy_next[POOL_BLOCK_NUM]; // free list links, by first block
+	pool_index_t buddy_prev[POOL_BLOCK_NUM];
+	uint8_t buddy_free_order[POOL_BLOCK_NUM]; // n + 1 if the block starts a free run of 2^n blocks, 0 otherwise
+#endif
+#ifdef RAMX_ALLOC_NEXT_FIT
+	uint32_t cursor; // block after the last allocation, where the next search starts
+#endif
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_t telemetry;
+#endif
+#ifdef ALLOC_DEBUG
+	uint32_t debug_errors; // invalid frees, overwritten guards and poison
+#endif
 } pool_t;
 
 extern pool_t ramx_pool;
@@ -65,32 +165,410 @@ extern pool_t ramx_pool;
  */
 void ramx_pool_init(void);
 
+/**
+ * @brief Print the block map of ramx_pool with LOG : one character per block,
+ * '[' for the first block of an allocation, '=' for the following ones and '.'
+ * for free blocks, then the allocations with their owners (ALLOC_DEBUG).
+ */
+void ramx_pool_dump(void);
+
 __attribute__((always_inline)) static inline bool ramx_address_in_pool(void* ptr)
 {
 	return (uint8_t*)ptr < ramx_pool.end_pool &&
 		   (uint8_t*)ptr >= ramx_pool.pool;
 }
 
-__attribute__((always_inline)) static inline uint8_t ramx_pool_stats_free()
+__attribute__((always_inline)) static inline pool_index_t ramx_pool_stats_free()
 {
 	return ramx_pool.pool_size - ramx_pool.blocks_used;
 }
 
-__attribute__((always_inline)) static inline uint8_t ramx_pool_stats_used() { return ramx_pool.blocks_used; }
+__attribute__((always_inline)) static inline pool_index_t ramx_pool_stats_used() { return ramx_pool.blocks_used; }
+
+__attribute__((always_inline)) static inline pool_index_t* ramx_pool_stats_blocks() { return ramx_pool.blocks; }
 
-__attribute__((always_inline)) static inline uint8_t* ramx_pool_stats_blocks() { return ramx_pool.blocks; }
+/**
+ * @brief Size of the largest run of free blocks, i.e. the biggest allocation
+ * that would currently succeed
+ */
+__attribute__((always_inline)) static inline pool_index_t ramx_pool_stats_largest_free_run(void)
+{
+#ifdef RAMX_ALLOC_BUDDY
+	// only aligned runs of 2^n blocks can be allocated
+	uint32_t orders = ramx_pool.buddy_free_orders;
+	return orders == 0 ? 0 : (pool_index_t)(1U << (31 - __builtin_clz(orders)));
+#else
+	pool_index_t largest = 0;
+	pool_index_t run = 0;
+
+	RAMX_ALLOC_ENTER_CRITICAL();
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+	{
+		run = ramx_pool.blocks[i] == 0 ? (pool_index_t)(run + 1) : 0;
+		if (run > largest)
+			largest = run;
+	}
+	RAMX_ALLOC_EXIT_CRITICAL();
+	return largest;
+#endif
+}
 
+/**
+ * @brief Number of blocks actually used by an allocation of num_blocks blocks :
+ * num_blocks rounded up to a power of two with RAMX_ALLOC_BUDDY, num_blocks
+ * otherwise
+ */
+__attribute__((always_inline)) static inline uint32_t ramx_pool_blocks_for(uint32_t num_blocks)
+{
+#ifdef RAMX_ALLOC_BUDDY
+	return num_blocks <= 1 ? num_blocks : 1U << (32 - __builtin_clz(num_blocks - 1));
+#else
+	return num_blocks;
+#endif
+}
+
+#ifdef ALLOC_DEBUG
+__attribute__((always_inline)) static inline void _ramx_debug_error(const char* what, void* ptr)
+{
+	(void)what; // unused if logging is disabled
+	(void)ptr;
+	ramx_pool.debug_errors++;
+	LOG_IF(LOG_LEVEL_ERROR, LOG_ID_RAMX_ALLOC, "ramx_pool %s ptr %x\r\n", what, ptr);
+}
+
+/**
+ * @brief Check that ptr is the start of a block of ramx_pool, log it otherwise
+ */
+__attribute__((always_inline)) static inline bool _ramx_debug_check_ptr(const char* what, void* ptr)
+{
+	if (!ramx_address_in_pool(ptr) ||
+		((uint32_t)ptr - (uint32_t)ramx_pool.pool) % ramx_pool.block_size != 0)
+	{
+		_ramx_debug_error(what, ptr);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Check that the blocks of a new allocation were not written since they
+ * were freed, and reset its debug header. Called with the allocator locked.
+ */
+__attribute__((always_inline)) static inline void _ramx_debug_on_alloc(void* ptr, uint32_t num_blocks)
+{
+	uint32_t block_index =
+		((uint32_t)ptr - (uint32_t)ramx_pool.pool) / ramx_pool.block_size;
+	uint32_t size = num_blocks * ramx_pool.block_size;
+
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		if (((uint8_t*)ptr)[i] != RAMX_ALLOC_POISON)
+		{
+			_ramx_debug_error("written after free", (uint8_t*)ptr + i);
+			break;
+		}
+	}
+	ramx_pool.headers[block_index].size = size;
+	ramx_pool.headers[block_index].owner_file = NULL;
+	ramx_pool.headers[block_index].owner_line = 0;
+}
+
+/**
+ * @brief Check the guard word of an allocation being freed, and poison its
+ * blocks. Called with the allocator locked.
+ */
+__attribute__((always_inline)) static inline void _ramx_debug_on_free(void* ptr, uint32_t block_index, uint32_t num_blocks)
+{
+	ramx_alloc_header_t* header = &ramx_pool.headers[block_index];
+	uint32_t size = num_blocks * ramx_pool.block_size;
+	uint32_t guard;
+
+	if (header->size + RAMX_ALLOC_GUARD_SIZE <= size)
+	{
+		memcpy(&guard, (uint8_t*)ptr + header->size, RAMX_ALLOC_GUARD_SIZE);
+		if (guard != RAMX_ALLOC_GUARD)
+		{
+			_ramx_debug_error("guard overwritten", ptr);
+			LOG_IF(LOG_LEVEL_ERROR, LOG_ID_RAMX_ALLOC,
+				   "ramx_pool %d bytes allocated at %s:%d\r\n", header->size,
+				   header->owner_file ? header->owner_file : "?",
+				   header->owner_line);
+		}
+	}
+	memset(ptr, RAMX_ALLOC_POISON, size);
+	header->owner_file = NULL;
+}
+
+/**
+ * @brief Record the requested size of a new ramx_pool_alloc_bytes buffer and
+ * write the guard word after it
+ */
+__attribute__((always_inline)) static inline void _ramx_debug_set_size(uint8_t* ptr, uint32_t num_bytes)
+{
+	uint32_t guard = RAMX_ALLOC_GUARD;
+
+	ramx_pool.headers[(uint32_t)(ptr - ramx_pool.pool) / ramx_pool.block_size].size = num_bytes;
+	memcpy(ptr + num_bytes, &guard, RAMX_ALLOC_GUARD_SIZE);
+}
+#endif
+
+#ifdef RAMX_ALLOC_BITMAP
+/**
+ * @brief Set (free) or clear (used) num_blocks bits of the free bitmap starting
+ * at block start, one word at a time.
+ */
+__attribute__((always_inline)) static inline void _ramx_bitmap_set_range(uint32_t start, uint32_t num_blocks, bool free)
+{
+	while (num_blocks > 0)
+	{
+		uint32_t word = start >> 5;
+		uint32_t offset = start & 31;
+		uint32_t count = 32 - offset < num_blocks ? 32 - offset : num_blocks;
+		uint32_t mask = (count == 32 ? 0xffffffff : ((1U << count) - 1)) << offset;
+		if (free)
+			ramx_pool.free_bitmap[word] |= mask;
+		else
+			ramx_pool.free_bitmap[word] &= ~mask;
+		start += count;
+		num_blocks -= count;
+	}
+}
+
+/**
+ * @brief Find the index of the next block at or after start whose state is
+ * free (or used), using ctz on whole words.
+ * @return index of the block, or POOL_BLOCK_NUM if there is none
+ */
+__attribute__((always_inline)) static inline uint32_t _ramx_bitmap_next(uint32_t start, bool free)
+{
+	uint32_t word_index = start >> 5;
+	if (word_index >= RAMX_BITMAP_WORDS)
+		return POOL_BLOCK_NUM;
+	uint32_t word = free ? ramx_pool.free_bitmap[word_index]
+						 : ~ramx_pool.free_bitmap[word_index];
+	word &= 0xffffffff << (start & 31);
+	while (word == 0)
+	{
+		if (++word_index >= RAMX_BITMAP_WORDS)
+			return POOL_BLOCK_NUM;
+		word = free ? ramx_pool.free_bitmap[word_index]
+					: ~ramx_pool.free_bitmap[word_index];
+	}
+	uint32_t index = (word_index << 5) + (uint32_t)__builtin_ctz(word);
+	return index < POOL_BLOCK_NUM ? index : POOL_BLOCK_NUM;
+}
+
+/**
+ * @brief Find the first run of num_blocks free blocks in the bitmap.
+ * Runs of up to 32 blocks are found by AND-ing a 64-bit window (current word and
+ * the next one) with shifted copies of itself : a bit that survives starts a
+ * run long enough. Longer runs are found by skipping from one free run to the
+ * next with ctz.
+ * @return index of the first block of the run, or POOL_BLOCK_NUM if there is
+ * none
+ */
+__attribute__((always_inline)) static inline uint32_t _ramx_bitmap_find_run(uint32_t num_blocks)
+{
+	if (num_blocks == 1)
+		return _ramx_bitmap_next(0, true);
+
+	if (num_blocks <= 32)
+	{
+		for (uint32_t i = 0; i < RAMX_BITMAP_WORDS; ++i)
+		{
+			if (ramx_pool.free_bitmap[i] == 0)
+				continue;
+			uint64_t starts = ramx_pool.free_bitmap[i];
+			if (i + 1 < RAMX_BITMAP_WORDS)
+				starts |= (uint64_t)ramx_pool.free_bitmap[i + 1] << 32;
+			uint32_t run = 1;
+			while (run < num_blocks)
+			{
+				uint32_t shift = run < num_blocks - run ? run : num_blocks - run;
+				starts &= starts >> shift;
+				run += shift;
+			}
+			if ((uint32_t)starts != 0)
+				return (i << 5) + (uint32_t)__builtin_ctz((uint32_t)starts);
+		}
+		return POOL_BLOCK_NUM;
+	}
+
+	uint32_t start = _ramx_bitmap_next(0, true);
+	while (start < POOL_BLOCK_NUM)
+	{
+		uint32_t end = _ramx_bitmap_next(start, false);
+		if (end - start >= num_blocks)
+			return start;
+		start = _ramx_bitmap_next(end, true);
+	}
+	return POOL_BLOCK_NUM;
+}
+
+/**
+ * @brief Allocates a number of contiguous blocks, looking for free blocks in
+ * the free bitmap
+ * @param  num_blocks: number of contiguous blocks to allocate
+ * @retval Pointer to the starting buffer, 0 if requested size is not available
+ */
+__attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(pool_index_t num_blocks)
+{
+	uint32_t i;
+	void* ret = NULL;
+
+	if (num_blocks == 0)
+		return 0;
+
+	RAMX_ALLOC_ENTER_CRITICAL();
+	i = num_blocks > POOL_BLOCK_NUM ? POOL_BLOCK_NUM : _ramx_bitmap_find_run(num_blocks);
+	if (i >= POOL_BLOCK_NUM)
+	{
+#ifdef ALLOC_TELEMETRY
+		alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, false, ramx_pool.blocks_used);
+#endif
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return 0;
+	}
+	_ramx_bitmap_set_range(i, num_blocks, false);
+#if POOL_INDEX_BITS == 8
+	memset(&ramx_pool.blocks[i], num_blocks, num_blocks);
+#else
+	for (uint32_t j = 0; j < num_blocks; j++)
+		ramx_pool.blocks[i + j] = num_blocks;
+#endif
+	ramx_pool.headers[i].reference_counter = 1;
+	ramx_pool.headers[i].num_blocks = num_blocks;
+	ramx_pool.blocks_used += num_blocks;
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, true, ramx_pool.blocks_used);
+#endif
+	ret = ramx_pool.pool + (ramx_pool.block_size * i);
+	RAMX_ALLOC_DEBUG_ALLOC(ret, num_blocks);
+	RAMX_ALLOC_TRACE_ALLOC(ret, num_blocks);
+	RAMX_ALLOC_EXIT_CRITICAL();
+	return ret;
+}
+#elif defined(RAMX_ALLOC_BUDDY)
+__attribute__((always_inline)) static inline void _ramx_buddy_push(uint32_t index, uint32_t order)
+{
+	pool_index_t head = ramx_pool.buddy_free_head[order];
+
+	ramx_pool.buddy_next[index] = head;
+	ramx_pool.buddy_prev[index] = RAMX_BUDDY_NONE;
+	if (head != RAMX_BUDDY_NONE)
+		ramx_pool.buddy_prev[head] = (pool_index_t)index;
+	ramx_pool.buddy_free_head[order] = (pool_index_t)index;
+	ramx_pool.buddy_free_order[index] = (uint8_t)(order + 1);
+	ramx_pool.buddy_free_orders |= 1U << order;
+}
+
+__attribute__((always_inline)) static inline void _ramx_buddy_remove(uint32_t index, uint32_t order)
+{
+	pool_index_t next = ramx_pool.buddy_next[index];
+	pool_index_t prev = ramx_pool.buddy_prev[index];
+
+	if (prev != RAMX_BUDDY_NONE)
+		ramx_pool.buddy_next[prev] = next;
+	else
+		ramx_pool.buddy_free_head[order] = next;
+	if (next != RAMX_BUDDY_NONE)
+		ramx_pool.buddy_prev[next] = prev;
+	ramx_pool.buddy_free_order[index] = 0;
+	if (ramx_pool.buddy_free_head[order] == RAMX_BUDDY_NONE)
+		ramx_pool.buddy_free_orders &= ~(1U << order);
+}
+
+/**
+ * @brief Give a run of num_blocks (a power of two) blocks back to the free
+ * lists, merging it with its buddy as long as the buddy is free
+ */
+__attribute__((always_inline)) static inline void _ramx_buddy_free_run(uint32_t index, uint32_t num_blocks)
+{
+	uint32_t order = (uint32_t)__builtin_ctz(num_blocks);
+
+	while (order + 1 < RAMX_BUDDY_ORDERS)
+	{
+		uint32_t buddy = index ^ (1U << order);
+		// a buddy partly out of the pool is never free at this order
+		if (buddy >= POOL_BLOCK_NUM || ramx_pool.buddy_free_order[buddy] != order + 1)
+			break;
+		_ramx_buddy_remove(buddy, order);
+		index &= ~(1U << order);
+		order++;
+	}
+	_ramx_buddy_push(index, order);
+}
+
+/**
+ * @brief Allocates a run of num_blocks rounded up to a power of two blocks,
+ * splitting the smallest free run big enough. Constant time for the search,
+ * O(log(POOL_BLOCK_NUM)) for the split.
+ * @param  num_blocks: number of contiguous blocks to allocate
+ * @retval Pointer to the starting buffer, 0 if requested size is not available
+ */
+__attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(pool_index_t num_blocks)
+{
+	uint32_t order, found, i, size;
+	uint32_t candidates = 0;
+	void* ret = NULL;
+
+	if (num_blocks == 0)
+		return 0;
+
+	order = num_blocks <= 1 ? 0 : 32 - (uint32_t)__builtin_clz(num_blocks - 1U);
+	RAMX_ALLOC_ENTER_CRITICAL();
+	if (order < RAMX_BUDDY_ORDERS)
+		candidates = ramx_pool.buddy_free_orders & (0xffffffff << order);
+	if (candidates == 0)
+	{
+#ifdef ALLOC_TELEMETRY
+		alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, false, ramx_pool.blocks_used);
+#endif
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return 0;
+	}
+	found = (uint32_t)__builtin_ctz(candidates);
+	i = ramx_pool.buddy_free_head[found];
+	_ramx_buddy_remove(i, found);
+	// keep the lower half, give the upper half back. The upper half always
+	// lies in the pool, the check lets the compiler know.
+	while (found > order)
+	{
+		found--;
+		if (i + (1U << found) < POOL_BLOCK_NUM)
+			_ramx_buddy_push(i + (1U << found), found);
+	}
+
+	size = 1U << order;
+	for (uint32_t j = 0; j < size; j++)
+		ramx_pool.blocks[i + j] = (pool_index_t)size;
+	ramx_pool.headers[i].reference_counter = 1;
+	ramx_pool.headers[i].num_blocks = (pool_index_t)size;
+	ramx_pool.blocks_used += (pool_index_t)size;
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, true, ramx_pool.blocks_used);
+#endif
+	ret = ramx_pool.pool + (ramx_pool.block_size * i);
+	RAMX_ALLOC_DEBUG_ALLOC(ret, size);
+	RAMX_ALLOC_TRACE_ALLOC(ret, num_blocks);
+	RAMX_ALLOC_EXIT_CRITICAL();
+	return ret;
+}
+#else
 /**
  * This function tries to allocate contiguous blocks by looking at the free
  * blocks list.
  * If found, it will mark the blocks as used (number of allocated blocks).
+ * With RAMX_ALLOC_NEXT_FIT, the search starts after the last allocation and
+ * wraps around to block 0, so that blocks held for a long time at the start of
+ * the pool are not scanned again for every allocation.
  * @brief Allocates a number of contiguous blocks
  * @param  num_blocks: number of contiguous blocks to allocate
  * @retval Pointer to the starting buffer, 0 if requested size is not available
  */
-__attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(uint8_t num_blocks)
+__attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(pool_index_t num_blocks)
 {
-	uint32_t i, j;
+	uint32_t i, j, n, num_starts;
 	uint8_t space_found;
 	void* ret = NULL;
 
@@ -102,17 +580,28 @@ __attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(uint8_
 	}
 	if (num_blocks > POOL_BLOCK_NUM)
 	{
+#ifdef ALLOC_TELEMETRY
+		alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, false, ramx_pool.blocks_used);
+#endif
 		RAMX_ALLOC_EXIT_CRITICAL();
 		return 0;
 	}
 
+	num_starts = (uint32_t)POOL_BLOCK_NUM - num_blocks + 1;
+#ifdef RAMX_ALLOC_NEXT_FIT
+	i = ramx_pool.cursor < num_starts ? ramx_pool.cursor : 0;
+#else
+	i = 0;
+#endif
 	space_found = 1;
-	for (i = 0; i <= (uint32_t)POOL_BLOCK_NUM - num_blocks; i++)
+	for (n = 0; n < num_starts; n++, i = i + 1 == num_starts ? 0 : i + 1)
 	{
+		ALLOC_TELEMETRY_COUNT_SCAN(&ramx_pool.telemetry, 1);
 		if (ramx_pool.blocks[i] == 0)
 		{
 			for (j = 1; j < num_blocks; j++)
 			{
+				ALLOC_TELEMETRY_COUNT_SCAN(&ramx_pool.telemetry, 1);
 				if (ramx_pool.blocks[i + j] != 0)
 				{
 					// i += j ?
@@ -129,39 +618,72 @@ __attribute__((always_inline)) static inline void* ramx_pool_alloc_blocks(uint8_
 				for (j = 0; j < num_blocks; j++)
 				{
 					ramx_pool.blocks[i + j] = num_blocks;
-					ramx_pool.blocks_reference_counter[i + j] = 1;
 				}
+				ramx_pool.headers[i].reference_counter = 1;
+				ramx_pool.headers[i].num_blocks = num_blocks;
 				ramx_pool.blocks_used += num_blocks;
+#ifdef RAMX_ALLOC_NEXT_FIT
+				ramx_pool.cursor = i + num_blocks;
+#endif
+#ifdef ALLOC_TELEMETRY
+				alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, true, ramx_pool.blocks_used);
+#endif
 				ret = ramx_pool.pool + (ramx_pool.block_size * i);
+				RAMX_ALLOC_DEBUG_ALLOC(ret, num_blocks);
+				RAMX_ALLOC_TRACE_ALLOC(ret, num_blocks);
 				RAMX_ALLOC_EXIT_CRITICAL();
 				return ret;
 			}
 		}
 	}
+#ifdef ALLOC_TELEMETRY
+	alloc_telemetry_record(&ramx_pool.telemetry, num_blocks, false, ramx_pool.blocks_used);
+#endif
 	RAMX_ALLOC_EXIT_CRITICAL();
 	return 0;
 }
+#endif
 
 /**
  * @brief  Helper function to allocate a buffer of at least n bytes
+ * With ALLOC_DEBUG, room is left for a guard word after the n bytes, checked
+ * when the buffer is freed.
  * @param  bytes: Number of bytes requested
  * @retval Pointer to the starting buffer, 0 if requested size is not available
  */
 __attribute__((always_inline)) static inline void* ramx_pool_alloc_bytes(uint32_t num_bytes)
 {
 	LOG_IF_LEVEL(LOG_LEVEL_DEBUG, "ramx_pool_alloc_bytes num_bytes %d free %d used %d \r\n", num_bytes, ramx_pool_stats_free(), ramx_pool_stats_used());
-	uint8_t blocks_needed = DIV_ROUND_UP(num_bytes, POOL_BLOCK_SIZE);
-	return ramx_pool_alloc_blocks(blocks_needed);
+	uint32_t blocks_needed = RAMX_ALLOC_BLOCKS_FOR_BYTES(num_bytes);
+	if (blocks_needed > POOL_BLOCK_NUM)
+	{
+#ifdef ALLOC_TELEMETRY
+		RAMX_ALLOC_ENTER_CRITICAL();
+		alloc_telemetry_record(&ramx_pool.telemetry, blocks_needed, false, ramx_pool.blocks_used);
+		RAMX_ALLOC_EXIT_CRITICAL();
+#endif
+		return 0;
+	}
+#ifdef ALLOC_DEBUG
+	uint8_t* ret = ramx_pool_alloc_blocks((pool_index_t)blocks_needed);
+	if (ret != NULL)
+		_ramx_debug_set_size(ret, num_bytes);
+	return ret;
+#else
+	return ramx_pool_alloc_blocks((pool_index_t)blocks_needed);
+#endif
 }
 
 /**
  * @brief Takes ownership of the blocks referenced by the pointer.
  * ramx_pool_free must be called to release ownership and free the blocks if
  * possible.
+ * @param  ptr: pointer returned by ramx_pool_alloc_blocks or
+ * ramx_pool_alloc_bytes
  */
 __attribute__((always_inline)) static inline void ramx_take_ownership(void* ptr)
 {
-	uint8_t block_index, num_blocks, i;
+	uint32_t block_index;
 	RAMX_ALLOC_ENTER_CRITICAL();
 	LOG_IF_LEVEL(LOG_LEVEL_DEBUG, "ramx_take_ownership ptr %x free %d used %d \r\n", ptr, ramx_pool_stats_free(), ramx_pool_stats_used());
 
@@ -170,18 +692,42 @@ __attribute__((always_inline)) static inline void ramx_take_ownership(void* ptr)
 		RAMX_ALLOC_EXIT_CRITICAL();
 		return;
 	}
+#ifdef ALLOC_DEBUG
+	if (!_ramx_debug_check_ptr("take ownership of invalid", ptr))
+	{
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return;
+	}
+#endif
 
 	block_index =
 		((uint32_t)ptr - (uint32_t)ramx_pool.pool) / ramx_pool.block_size;
-	num_blocks = ramx_pool.blocks[block_index];
 
-	for (i = 0; i < num_blocks; i++)
+	if (ramx_pool.headers[block_index].reference_counter == 0 ||
+		ramx_pool.headers[block_index].reference_counter == UINT16_MAX)
 	{
-		ramx_pool.blocks_reference_counter[block_index + i] += 1;
+		RAMX_ALLOC_EXIT_CRITICAL();
+		LOG_IF(LOG_LEVEL_ERROR, LOG_ID_RAMX_ALLOC,
+			   "ramx_take_ownership ptr %x not allocated or too many owners\r\n", ptr);
+		return;
 	}
+	ramx_pool.headers[block_index].reference_counter += 1;
 	RAMX_ALLOC_EXIT_CRITICAL();
 }
 
+/**
+ * @brief Number of owners of the blocks referenced by the pointer, 0 if they
+ * are not allocated
+ * @param  ptr: pointer returned by ramx_pool_alloc_blocks or
+ * ramx_pool_alloc_bytes
+ */
+__attribute__((always_inline)) static inline uint16_t ramx_pool_owners(void* ptr)
+{
+	uint32_t block_index =
+		((uint32_t)ptr - (uint32_t)ramx_pool.pool) / ramx_pool.block_size;
+	return ramx_pool.headers[block_index].reference_counter;
+}
+
 /**
  * @brief  Free owner from it's ownership on the blocks. Free the blocks if
  * there are no more owners.
@@ -190,8 +736,8 @@ __attribute__((always_inline)) static inline void ramx_take_ownership(void* ptr)
  */
 __attribute__((always_inline)) static inline void ramx_pool_free(void* ptr)
 {
-	uint8_t block_index, num_blocks, i;
-	uint8_t num_freed = 0;
+	uint32_t block_index;
+	pool_index_t num_blocks;
 
 	RAMX_ALLOC_ENTER_CRITICAL();
 
@@ -201,27 +747,208 @@ __attribute__((always_inline)) static inline void ramx_pool_free(void* ptr)
 		RAMX_ALLOC_EXIT_CRITICAL();
 		return;
 	}
+#ifdef ALLOC_DEBUG
+	if (!_ramx_debug_check_ptr("free of invalid", ptr))
+	{
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return;
+	}
+#endif
 
 	block_index =
 		((uint32_t)ptr - (uint32_t)ramx_pool.pool) / ramx_pool.block_size;
-	num_blocks = ramx_pool.blocks[block_index];
 
-	for (i = 0; i < num_blocks; i++)
+	if (ramx_pool.headers[block_index].reference_counter == 0)
 	{
-		if (ramx_pool.blocks_reference_counter[block_index + i] <= 1)
-		{
-			ramx_pool.blocks[block_index + i] = 0;
-			num_freed += 1;
-		}
-		else
+#ifdef ALLOC_DEBUG
+		_ramx_debug_error("double free or free of unallocated", ptr);
+#endif
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return;
+	}
+	if (ramx_pool.headers[block_index].reference_counter > 1)
+	{
+		ramx_pool.headers[block_index].reference_counter -= 1;
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return;
+	}
+
+	num_blocks = ramx_pool.headers[block_index].num_blocks;
+	ramx_pool.headers[block_index].reference_counter = 0;
+#ifdef ALLOC_DEBUG
+	_ramx_debug_on_free(ptr, block_index, num_blocks);
+#endif
+	memset(&ramx_pool.blocks[block_index], 0, num_blocks * sizeof(pool_index_t));
+#ifdef RAMX_ALLOC_BITMAP
+	_ramx_bitmap_set_range(block_index, num_blocks, true);
+#endif
+#ifdef RAMX_ALLOC_BUDDY
+	_ramx_buddy_free_run(block_index, num_blocks);
+#endif
+	ramx_pool.blocks_used -= num_blocks;
+	RAMX_ALLOC_TRACE_FREE(ptr);
+	RAMX_ALLOC_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Release the ownership on count buffers in one critical section, and
+ * set the pointers to NULL. NULL pointers are skipped.
+ * @param  count: number of buffers
+ * @param  ptrs: buffers returned by ramx_pool_alloc_many, ramx_pool_alloc_blocks
+ * or ramx_pool_alloc_bytes
+ */
+__attribute__((always_inline)) static inline void ramx_pool_free_many(uint32_t count, uint8_t** ptrs)
+{
+	RAMX_ALLOC_ENTER_CRITICAL();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		ramx_pool_free(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+	RAMX_ALLOC_EXIT_CRITICAL();
+}
+
+#if !defined(RAMX_ALLOC_BITMAP) && !defined(RAMX_ALLOC_BUDDY)
+/**
+ * @brief Look for the buffers one after the other in a single scan of blocks[],
+ * each one after the previous one. Must be called with the allocator locked.
+ * @return number of buffers allocated, in out, before the scan reached the end
+ * of the pool
+ */
+__attribute__((always_inline)) static inline uint32_t _ramx_pool_alloc_one_pass(uint32_t count, const uint32_t* sizes, uint8_t** out)
+{
+	uint32_t block = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t num_blocks = RAMX_ALLOC_BLOCKS_FOR_BYTES(sizes[i]);
+		uint32_t run = 0;
+
+		if (num_blocks == 0 || num_blocks > POOL_BLOCK_NUM)
+			return i;
+		while (block < POOL_BLOCK_NUM && run < num_blocks)
 		{
-			ramx_pool.blocks_reference_counter[block_index + i] -= 1;
+			run = ramx_pool.blocks[block] == 0 ? run + 1 : 0;
+			block++;
 		}
+		if (run < num_blocks)
+			return i;
+
+		uint32_t start = block - num_blocks;
+		for (uint32_t j = start; j < block; j++)
+			ramx_pool.blocks[j] = (pool_index_t)num_blocks;
+		ramx_pool.headers[start].reference_counter = 1;
+		ramx_pool.headers[start].num_blocks = (pool_index_t)num_blocks;
+		ramx_pool.blocks_used += (pool_index_t)num_blocks;
+		out[i] = ramx_pool.pool + (ramx_pool.block_size * start);
+		RAMX_ALLOC_DEBUG_ALLOC(out[i], num_blocks);
+#ifdef ALLOC_DEBUG
+		_ramx_debug_set_size(out[i], sizes[i]);
+#endif
+		RAMX_ALLOC_TRACE_ALLOC(out[i], num_blocks);
+	}
+	return count;
+}
+#endif
+
+/**
+ * @brief Allocate count buffers of sizes[i] bytes in one critical section.
+ * Either all the buffers are allocated, or none is.
+ * With the first fit backend, the buffers are first looked for in a single scan
+ * of the pool. If the scan fails, they are looked for one by one from the start
+ * of the pool, so that ramx_pool_alloc_many succeeds whenever successive
+ * ramx_pool_alloc_bytes calls would.
+ * @param  count: number of buffers
+ * @param  sizes: size of each buffer in bytes
+ * @param  out: receives the buffers, all NULL on failure
+ * @retval true if all the buffers were allocated
+ */
+__attribute__((always_inline)) static inline bool ramx_pool_alloc_many(uint32_t count, const uint32_t* sizes, uint8_t** out)
+{
+	uint32_t done;
+
+	RAMX_ALLOC_ENTER_CRITICAL();
+#if !defined(RAMX_ALLOC_BITMAP) && !defined(RAMX_ALLOC_BUDDY)
+	done = _ramx_pool_alloc_one_pass(count, sizes, out);
+	if (done == count)
+	{
+#ifdef ALLOC_TELEMETRY
+		for (uint32_t i = 0; i < count; ++i)
+			alloc_telemetry_record(&ramx_pool.telemetry,
+								   RAMX_ALLOC_BLOCKS_FOR_BYTES(sizes[i]), true,
+								   ramx_pool.blocks_used);
+#endif
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return true;
+	}
+	ramx_pool_free_many(done, out);
+#endif
+
+	for (done = 0; done < count; ++done)
+	{
+		out[done] = ramx_pool_alloc_bytes(sizes[done]);
+		if (out[done] == NULL)
+			break;
+	}
+	if (done < count)
+	{
+		ramx_pool_free_many(done, out);
+		for (uint32_t i = done; i < count; ++i)
+			out[i] = NULL;
+		RAMX_ALLOC_EXIT_CRITICAL();
+		return false;
 	}
-	ramx_pool.blocks_used -= num_freed;
 	RAMX_ALLOC_EXIT_CRITICAL();
+	return true;
 }
 
+#ifdef ALLOC_TELEMETRY
+/**
+ * @brief Print ramx_pool telemetry with LOG
+ */
+__attribute__((always_inline)) static inline void ramx_pool_telemetry_dump(void)
+{
+	alloc_telemetry_dump("ramx_pool", &ramx_pool.telemetry, POOL_BLOCK_NUM,
+						 ramx_pool_stats_used(), ramx_pool_stats_largest_free_run());
+}
+#endif
+
+#ifdef ALLOC_DEBUG
+/**
+ * @brief Tag the allocation starting at ptr with the caller of the allocation
+ * function, shown by ramx_pool_dump and in guard errors
+ */
+__attribute__((always_inline)) static inline void* _ramx_debug_set_owner(void* ptr, const char* file, uint32_t line)
+{
+	if (ptr != NULL)
+	{
+		uint32_t block_index =
+			((uint32_t)ptr - (uint32_t)ramx_pool.pool) / ramx_pool.block_size;
+		ramx_pool.headers[block_index].owner_file = file;
+		ramx_pool.headers[block_index].owner_line = line;
+	}
+	return ptr;
+}
+
+__attribute__((always_inline)) static inline bool _ramx_debug_set_owner_many(bool ok, uint32_t count, uint8_t** out, const char* file, uint32_t line)
+{
+	for (uint32_t i = 0; ok && i < count; ++i)
+		_ramx_debug_set_owner(out[i], file, line);
+	return ok;
+}
+
+/* From here on, the allocation functions record their caller. A function-like
+ * macro is not expanded again in its own expansion, so these call the
+ * functions above. */
+#define ramx_pool_alloc_blocks(_num_blocks) \
+	_ramx_debug_set_owner(ramx_pool_alloc_blocks(_num_blocks), __FILE__, __LINE__)
+#define ramx_pool_alloc_bytes(_num_bytes) \
+	_ramx_debug_set_owner(ramx_pool_alloc_bytes(_num_bytes), __FILE__, __LINE__)
+#define ramx_pool_alloc_many(_count, _sizes, _out)                          \
+	_ramx_debug_set_owner_many(ramx_pool_alloc_many(_count, _sizes, _out), \
+							   _count, _out, __FILE__, __LINE__)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
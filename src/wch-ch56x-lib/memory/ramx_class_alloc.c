@@ -0,0 +1,92 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#include "wch-ch56x-lib/memory/ramx_class_alloc.h"
+
+#ifdef RAMX_CLASS_0_NUM
+
+#include <string.h>
+
+#define RAMX_CLASS_VALID_SIZE(size) \
+	((size) == 0 || ((size) >= 16 && ((size) & ((size)-1)) == 0))
+
+typedef char ramx_class_sizes_are_powers_of_two
+	[RAMX_CLASS_VALID_SIZE(RAMX_CLASS_0_SIZE) &&
+			 RAMX_CLASS_VALID_SIZE(RAMX_CLASS_1_SIZE) &&
+			 RAMX_CLASS_VALID_SIZE(RAMX_CLASS_2_SIZE) &&
+			 RAMX_CLASS_VALID_SIZE(RAMX_CLASS_3_SIZE)
+		 ? 1
+		 : -1];
+
+typedef char ramx_class_sizes_are_ascending
+	[(RAMX_CLASS_1_NUM == 0 || RAMX_CLASS_1_SIZE > RAMX_CLASS_0_SIZE) &&
+			 (RAMX_CLASS_2_NUM == 0 || RAMX_CLASS_2_SIZE > RAMX_CLASS_1_SIZE) &&
+			 (RAMX_CLASS_3_NUM == 0 || RAMX_CLASS_3_SIZE > RAMX_CLASS_2_SIZE)
+		 ? 1
+		 : -1];
+
+__attribute__((aligned(16))) static uint8_t
+	ramx_class_pool_buf[RAMX_CLASS_BUFFER_SIZE]
+	__attribute__((section(".DMADATA")));
+static uint32_t ramx_class_pool_bitmap[RAMX_CLASS_BITMAP_SIZE];
+ramx_class_pool_t ramx_class_pool;
+
+void ramx_class_pool_init(void)
+{
+	const uint32_t sizes[RAMX_CLASS_MAX] = { RAMX_CLASS_0_SIZE, RAMX_CLASS_1_SIZE,
+											 RAMX_CLASS_2_SIZE, RAMX_CLASS_3_SIZE };
+	const uint16_t nums[RAMX_CLASS_MAX] = { RAMX_CLASS_0_NUM, RAMX_CLASS_1_NUM,
+											RAMX_CLASS_2_NUM, RAMX_CLASS_3_NUM };
+	uint8_t* start = ramx_class_pool_buf;
+	uint32_t* bitmap = ramx_class_pool_bitmap;
+	uint16_t first_slot = 0;
+
+	RAMX_CLASS_ALLOC_ENTER_CRITICAL();
+	ramx_class_pool.pool = ramx_class_pool_buf;
+	ramx_class_pool.end_pool = ramx_class_pool_buf + RAMX_CLASS_BUFFER_SIZE;
+	ramx_class_pool.num_classes = 0;
+	memset(ramx_class_pool.reference_counter, 0,
+		   sizeof(ramx_class_pool.reference_counter));
+	memset(ramx_class_pool_bitmap, 0, sizeof(ramx_class_pool_bitmap));
+
+	for (uint8_t i = 0; i < RAMX_CLASS_MAX; ++i)
+	{
+		if (nums[i] == 0)
+			continue;
+
+		ramx_class_t* size_class =
+			&ramx_class_pool.classes[ramx_class_pool.num_classes++];
+		size_class->start = start;
+		size_class->end = start + sizes[i] * nums[i];
+		size_class->slot_size = sizes[i];
+		size_class->slot_shift = (uint8_t)__builtin_ctz(sizes[i]);
+		size_class->num_slots = nums[i];
+		size_class->slots_used = 0;
+		size_class->first_slot = first_slot;
+		size_class->free_bitmap = bitmap;
+
+		for (uint16_t slot = 0; slot < nums[i]; ++slot)
+			bitmap[slot >> 5] |= 1U << (slot & 31);
+
+		start = size_class->end;
+		bitmap += RAMX_CLASS_BITMAP_WORDS(nums[i]);
+		first_slot += nums[i];
+	}
+	RAMX_CLASS_ALLOC_EXIT_CRITICAL();
+}
+
+#endif
@@ -0,0 +1,264 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef RAMX_CLASS_ALLOC_H
+#define RAMX_CLASS_ALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/utils/critical_section.h"
+
+/**
+Size-class allocator for RAMX : several pools of fixed-size slots, each
+allocation taking exactly one slot of the smallest class that fits. A small
+control buffer does not take the same room as a full HSPI frame anymore.
+
+To use it, pass at least the first class to your compiler, up to 4 classes
+#define RAMX_CLASS_0_SIZE size // slot size in bytes, power of two, at least 16
+#define RAMX_CLASS_0_NUM num // number of slots, no more than 65535
+#define RAMX_CLASS_1_SIZE size // must be bigger than RAMX_CLASS_0_SIZE
+#define RAMX_CLASS_1_NUM num
+...
+#define RAMX_CLASS_3_NUM num
+
+Like ramx_pool, each allocation has a reference counter : ramx_alloc gives a
+buffer with one owner, ramx_alloc_take_ownership adds one and ramx_free
+removes one, the slot being freed when there are no more owners.
+*/
+
+#ifdef RAMX_CLASS_0_NUM
+
+#ifndef RAMX_CLASS_1_NUM
+#define RAMX_CLASS_1_SIZE 0
+#define RAMX_CLASS_1_NUM 0
+#endif
+
+#ifndef RAMX_CLASS_2_NUM
+#define RAMX_CLASS_2_SIZE 0
+#define RAMX_CLASS_2_NUM 0
+#endif
+
+#ifndef RAMX_CLASS_3_NUM
+#define RAMX_CLASS_3_SIZE 0
+#define RAMX_CLASS_3_NUM 0
+#endif
+
+#define RAMX_CLASS_MAX 4
+
+#define RAMX_CLASS_BUFFER_SIZE              \
+	(RAMX_CLASS_0_SIZE * RAMX_CLASS_0_NUM + \
+	 RAMX_CLASS_1_SIZE * RAMX_CLASS_1_NUM + \
+	 RAMX_CLASS_2_SIZE * RAMX_CLASS_2_NUM + \
+	 RAMX_CLASS_3_SIZE * RAMX_CLASS_3_NUM)
+
+#define RAMX_CLASS_SLOTS                                                        \
+	(RAMX_CLASS_0_NUM + RAMX_CLASS_1_NUM + RAMX_CLASS_2_NUM + RAMX_CLASS_3_NUM)
+
+#define RAMX_CLASS_BITMAP_WORDS(num) (((num) + 31) / 32)
+
+#define RAMX_CLASS_BITMAP_SIZE                   \
+	(RAMX_CLASS_BITMAP_WORDS(RAMX_CLASS_0_NUM) + \
+	 RAMX_CLASS_BITMAP_WORDS(RAMX_CLASS_1_NUM) + \
+	 RAMX_CLASS_BITMAP_WORDS(RAMX_CLASS_2_NUM) + \
+	 RAMX_CLASS_BITMAP_WORDS(RAMX_CLASS_3_NUM))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef RAMX_CLASS_ALLOC_ENTER_CRITICAL
+#define RAMX_CLASS_ALLOC_ENTER_CRITICAL() BSP_ENTER_CRITICAL()
+#endif
+
+#ifndef RAMX_CLASS_ALLOC_EXIT_CRITICAL
+#define RAMX_CLASS_ALLOC_EXIT_CRITICAL() BSP_EXIT_CRITICAL()
+#endif
+
+typedef struct ramx_class
+{
+	uint8_t* start; // first slot
+	uint8_t* end; // after the last slot
+	uint32_t slot_size; // in bytes
+	uint8_t slot_shift; // log2(slot_size)
+	uint16_t num_slots;
+	uint16_t slots_used;
+	uint16_t first_slot; // index of the first slot in reference_counter
+	uint32_t* free_bitmap; // 1 bit per slot, 1 = free
+} ramx_class_t;
+
+typedef struct ramx_class_pool
+{
+	uint8_t* pool;
+	uint8_t* end_pool;
+	uint8_t num_classes; // classes with at least one slot
+	ramx_class_t classes[RAMX_CLASS_MAX]; // sorted by slot size
+	uint16_t reference_counter[RAMX_CLASS_SLOTS];
+} ramx_class_pool_t;
+
+extern ramx_class_pool_t ramx_class_pool;
+
+/**
+ * @brief Reset the state of all the classes.
+ */
+void ramx_class_pool_init(void);
+
+/**
+ * @brief Check if ptr belongs to the size-class allocator
+ */
+__attribute__((always_inline)) static inline bool ramx_alloc_address_in_pool(void* ptr)
+{
+	return (uint8_t*)ptr < ramx_class_pool.end_pool &&
+		   (uint8_t*)ptr >= ramx_class_pool.pool;
+}
+
+/**
+ * @brief Find the class ptr belongs to
+ * @return the class, or NULL if ptr is not in the size-class allocator
+ */
+__attribute__((always_inline)) static inline ramx_class_t* _ramx_alloc_get_class(void* ptr)
+{
+	for (uint8_t i = 0; i < ramx_class_pool.num_classes; ++i)
+	{
+		ramx_class_t* size_class = &ramx_class_pool.classes[i];
+		if ((uint8_t*)ptr >= size_class->start && (uint8_t*)ptr < size_class->end)
+			return size_class;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Allocate a buffer of at least size bytes, in the smallest class that
+ * fits and still has a free slot.
+ * @return pointer to the buffer, NULL if no class can hold size bytes
+ */
+__attribute__((always_inline)) static inline void* ramx_alloc(uint32_t size)
+{
+	if (size == 0)
+		return NULL;
+
+	RAMX_CLASS_ALLOC_ENTER_CRITICAL();
+	for (uint8_t i = 0; i < ramx_class_pool.num_classes; ++i)
+	{
+		ramx_class_t* size_class = &ramx_class_pool.classes[i];
+		if (size_class->slot_size < size || size_class->slots_used == size_class->num_slots)
+			continue;
+
+		uint16_t word = 0;
+		while (size_class->free_bitmap[word] == 0)
+			++word;
+		uint16_t slot =
+			(uint16_t)((word << 5) + (uint16_t)__builtin_ctz(size_class->free_bitmap[word]));
+		size_class->free_bitmap[word] &= ~(1U << (slot & 31));
+		size_class->slots_used++;
+		ramx_class_pool.reference_counter[size_class->first_slot + slot] = 1;
+		RAMX_CLASS_ALLOC_EXIT_CRITICAL();
+		return size_class->start + ((uint32_t)slot << size_class->slot_shift);
+	}
+	RAMX_CLASS_ALLOC_EXIT_CRITICAL();
+	LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_RAMX_ALLOC, "ramx_alloc no slot for %d bytes\r\n",
+		   size);
+	return NULL;
+}
+
+/**
+ * @brief Takes ownership of the buffer. ramx_free must be called to release
+ * ownership and free the slot if possible.
+ */
+__attribute__((always_inline)) static inline void ramx_alloc_take_ownership(void* ptr)
+{
+	ramx_class_t* size_class = _ramx_alloc_get_class(ptr);
+	if (size_class == NULL)
+		return;
+
+	uint16_t slot =
+		(uint16_t)(((uint32_t)((uint8_t*)ptr - size_class->start)) >> size_class->slot_shift);
+	RAMX_CLASS_ALLOC_ENTER_CRITICAL();
+	if (ramx_class_pool.reference_counter[size_class->first_slot + slot] != 0)
+		ramx_class_pool.reference_counter[size_class->first_slot + slot]++;
+	RAMX_CLASS_ALLOC_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Free owner from its ownership on the buffer. Free the slot if there
+ * are no more owners.
+ */
+__attribute__((always_inline)) static inline void ramx_free(void* ptr)
+{
+	ramx_class_t* size_class = _ramx_alloc_get_class(ptr);
+	if (size_class == NULL)
+		return;
+
+	uint16_t slot =
+		(uint16_t)(((uint32_t)((uint8_t*)ptr - size_class->start)) >> size_class->slot_shift);
+	uint16_t* reference_counter =
+		&ramx_class_pool.reference_counter[size_class->first_slot + slot];
+	RAMX_CLASS_ALLOC_ENTER_CRITICAL();
+	if (*reference_counter > 1)
+	{
+		(*reference_counter)--;
+	}
+	else if (*reference_counter == 1)
+	{
+		*reference_counter = 0;
+		size_class->free_bitmap[slot >> 5] |= 1U << (slot & 31);
+		size_class->slots_used--;
+	}
+	RAMX_CLASS_ALLOC_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Number of classes with at least one slot
+ */
+__attribute__((always_inline)) static inline uint8_t ramx_alloc_stats_num_classes(void)
+{
+	return ramx_class_pool.num_classes;
+}
+
+/**
+ * @brief Slot size of a class, in bytes
+ */
+__attribute__((always_inline)) static inline uint32_t ramx_alloc_stats_slot_size(uint8_t class_index)
+{
+	return ramx_class_pool.classes[class_index].slot_size;
+}
+
+/**
+ * @brief Number of used slots in a class
+ */
+__attribute__((always_inline)) static inline uint16_t ramx_alloc_stats_used(uint8_t class_index)
+{
+	return ramx_class_pool.classes[class_index].slots_used;
+}
+
+/**
+ * @brief Number of free slots in a class
+ */
+__attribute__((always_inline)) static inline uint16_t ramx_alloc_stats_free(uint8_t class_index)
+{
+	return ramx_class_pool.classes[class_index].num_slots -
+		   ramx_class_pool.classes[class_index].slots_used;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAMX_CLASS_0_NUM */
+
+#endif /* RAMX_CLASS_ALLOC_H */
@@ -0,0 +1,121 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef HYDRA_TYPED_FIFO_H
+#define HYDRA_TYPED_FIFO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Typed FIFO:
+    hydra_fifo_t keeps the element size and the capacity at runtime, so each
+access needs a memcpy of a runtime length and a modulo, which is a slow divide
+on the rv32imac core. HYDRA_TYPED_FIFO generates a FIFO for one type, with a
+capacity of 2^log2_capacity elements (at most 2^15), and the following
+functions, using struct assignment and masked indexes :
+
+    bool name_push(const type* element) // false if the FIFO is full
+    bool name_pop(type* element) // false if the FIFO is empty
+    bool name_peek(type* element) // same as pop, without removing the element
+    uint16_t name_count(void)
+    void name_clean(void)
+
+    rd_idx and wr_idx are free-running counters, the FIFO holds wr_idx - rd_idx
+elements, so all the slots can be used. Like a FIFO defined with
+HYDRA_FIFO_DEF_SPSC, the functions never disable interrupts : they are safe
+with one producer and one consumer (e.g. an interrupt handler and the main
+loop). With several producers or consumers, protect the calls with a critical
+section.
+
+    HYDRA_TYPED_FIFO defines the FIFO and its functions in one translation unit.
+To share a FIFO, use HYDRA_TYPED_FIFO_DECLR in a header and HYDRA_TYPED_FIFO_DEF
+in one source file.
+*/
+
+/* Keep the compiler from moving element accesses across index loads/stores */
+#define HYDRA_TYPED_FIFO_BARRIER() __asm__ volatile("" ::: "memory")
+
+#define HYDRA_TYPED_FIFO_DECLR(_name, _type, _log2_capacity)                             \
+	typedef struct _name##_t                                                             \
+	{                                                                                    \
+		_type elements[1 << (_log2_capacity)];                                           \
+		volatile uint16_t rd_idx;                                                        \
+		volatile uint16_t wr_idx;                                                        \
+	} _name##_t;                                                                         \
+	extern _name##_t _name;                                                              \
+                                                                                         \
+	__attribute__((always_inline)) static inline uint16_t _name##_count(void)            \
+	{                                                                                    \
+		return (uint16_t)(_name.wr_idx - _name.rd_idx);                                  \
+	}                                                                                    \
+                                                                                         \
+	__attribute__((always_inline)) static inline bool _name##_push(const _type* element) \
+	{                                                                                    \
+		uint16_t wr_idx = _name.wr_idx;                                                  \
+		if ((uint16_t)(wr_idx - _name.rd_idx) == (1 << (_log2_capacity)))                \
+			return false;                                                                \
+		HYDRA_TYPED_FIFO_BARRIER();                                                      \
+		_name.elements[wr_idx & ((1 << (_log2_capacity)) - 1)] = *element;               \
+		HYDRA_TYPED_FIFO_BARRIER();                                                      \
+		_name.wr_idx = (uint16_t)(wr_idx + 1);                                           \
+		return true;                                                                     \
+	}                                                                                    \
+                                                                                         \
+	__attribute__((always_inline)) static inline bool _name##_peek(_type* element)       \
+	{                                                                                    \
+		uint16_t rd_idx = _name.rd_idx;                                                  \
+		if (rd_idx == _name.wr_idx)                                                      \
+			return false;                                                                \
+		HYDRA_TYPED_FIFO_BARRIER();                                                      \
+		*element = _name.elements[rd_idx & ((1 << (_log2_capacity)) - 1)];               \
+		return true;                                                                     \
+	}                                                                                    \
+                                                                                         \
+	__attribute__((always_inline)) static inline bool _name##_pop(_type* element)        \
+	{                                                                                    \
+		if (!_name##_peek(element))                                                      \
+			return false;                                                                \
+		HYDRA_TYPED_FIFO_BARRIER();                                                      \
+		_name.rd_idx = (uint16_t)(_name.rd_idx + 1);                                     \
+		return true;                                                                     \
+	}                                                                                    \
+                                                                                         \
+	__attribute__((always_inline)) static inline void _name##_clean(void)                \
+	{                                                                                    \
+		_name.rd_idx = 0;                                                                \
+		_name.wr_idx = 0;                                                                \
+	}                                                                                    \
+	/* last, so that the ; of the caller ends a declaration */                           \
+	typedef char _name##_capacity_fits_index[(_log2_capacity) <= 15 ? 1 : -1]
+
+#define HYDRA_TYPED_FIFO_DEF(_name, _type, _log2_capacity) \
+	_name##_t _name = { .rd_idx = 0, .wr_idx = 0 }
+
+#define HYDRA_TYPED_FIFO(_name, _type, _log2_capacity)    \
+	HYDRA_TYPED_FIFO_DECLR(_name, _type, _log2_capacity); \
+	HYDRA_TYPED_FIFO_DEF(_name, _type, _log2_capacity)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
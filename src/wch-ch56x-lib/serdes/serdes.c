@@ -27,7 +27,10 @@ __attribute__((aligned(16))) uint8_t RX_DMA_0[DMA_SIZE]
 __attribute__((aligned(16))) uint8_t RX_DMA_1[DMA_SIZE]
 	__attribute__((section(".DMADATA")));
 
-uint8_t* current_rx_dma = RX_DMA_0;
+// reception buffers given to the DMA, RX_DMA_0 and RX_DMA_1 unless
+// serdes_rx_buf_callback is set
+uint8_t* rx_dma[2] = { RX_DMA_0, RX_DMA_1 };
+uint8_t current_rx_dma = 0;
 uint16_t serdes_max_packet_size = 0;
 
 void _default_serdes_rx_callback(uint8_t* buffer, uint16_t size,
@@ -36,12 +39,38 @@ void _default_serdes_rx_callback(uint8_t* buffer, uint16_t size,
 								 uint16_t custom_register) {}
 
 serdes_user_handled_t serdes_user_handled = { .serdes_rx_callback =
-												  _default_serdes_rx_callback };
+												  _default_serdes_rx_callback,
+											  .serdes_rx_buf_callback = NULL };
+
+/**
+ * @brief Give the reception buffers of a previous serdes_init back to
+ * ramx_pool, and allocate new ones there if serdes_rx_buf_callback is set
+ */
+__attribute__((always_inline)) static inline void _serdes_rx_dma_init(uint16_t max_packet_size)
+{
+	uint8_t* const static_dma[2] = { RX_DMA_0, RX_DMA_1 };
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		if (ramx_address_in_pool(rx_dma[i]))
+			ramx_pool_free(rx_dma[i]);
+		rx_dma[i] = static_dma[i];
+		if (serdes_user_handled.serdes_rx_buf_callback == NULL)
+			continue;
+
+		uint8_t* buffer = ramx_pool_alloc_bytes(max_packet_size);
+		if (buffer != NULL)
+			rx_dma[i] = buffer;
+		else
+			LOG_IF(LOG_LEVEL_ERROR, LOG_ID_SERDES,
+				   "no RX buffer left in ramx_pool, using serdes_rx_callback\r\n");
+	}
+	current_rx_dma = 0;
+}
 
 void serdes_init(SERDES_TYPE type, uint16_t max_packet_size)
 {
 	// setup SerDes
-	current_rx_dma = RX_DMA_0;
 	serdes_max_packet_size = max_packet_size;
 
 	if (type == SERDES_TYPE_HOST)
@@ -50,9 +79,10 @@ void serdes_init(SERDES_TYPE type, uint16_t max_packet_size)
 	}
 	else if (type == SERDES_TYPE_DEVICE)
 	{
+		_serdes_rx_dma_init(max_packet_size);
 		PFIC_EnableIRQ(INT_ID_SERDES);
 		SerDes_Rx_Init(SERDES_TX_RX_SPEED);
-		SerDes_DoubleDMA_Rx_CFG((vuint32_t)RX_DMA_0, (vuint32_t)RX_DMA_1);
+		SerDes_DoubleDMA_Rx_CFG((vuint32_t)rx_dma[0], (vuint32_t)rx_dma[1]);
 		SerDes_EnableIT(SDS_RX_INT_EN | SDS_RX_ERR_EN | SDS_FIFO_OV_EN);
 		SerDes_ClearIT(ALL_INT_TYPE);
 	}
@@ -68,6 +98,52 @@ void serdes_send(uint8_t* buffer, uint16_t size, uint16_t custom_register)
 	SerDes_Wait_Txdone();
 }
 
+void serdes_send_buf(const hydra_buf_t* buf, uint16_t custom_register)
+{
+	serdes_send(buf_data(buf), buf->length, custom_register);
+}
+
+/**
+ * @brief Hand the reception buffer rx_dma[index] over to
+ * serdes_rx_buf_callback or serdes_rx_callback. If serdes_rx_buf_callback
+ * kept a reference on it, the DMA is given a new buffer. Without memory left,
+ * the DMA keeps the buffer and the next packet overwrites it.
+ */
+__attribute__((always_inline)) static inline void _serdes_rx_deliver(uint8_t index, uint32_t data)
+{
+	uint8_t* const ptr = rx_dma[index];
+	uint16_t size = data & HSPI_SERDES_TX_SIZE_MASK;
+	uint16_t custom_register = data >> 13;
+
+	if (serdes_user_handled.serdes_rx_buf_callback == NULL ||
+		!ramx_address_in_pool(ptr))
+	{
+		serdes_user_handled.serdes_rx_callback(ptr, size, custom_register);
+		return;
+	}
+
+	hydra_buf_t buf = buf_from_ramx(ptr, size);
+	// the reference of buf during the call, next to the one of the DMA
+	buf_ref(&buf);
+	serdes_user_handled.serdes_rx_buf_callback(&buf, custom_register);
+	if (ramx_pool_owners(ptr) > 2)
+	{
+		uint8_t* fresh = ramx_pool_alloc_bytes(serdes_max_packet_size);
+		if (fresh != NULL)
+		{
+			rx_dma[index] = fresh;
+			ramx_pool_free(ptr);
+			SerDes_DoubleDMA_Rx_CFG((vuint32_t)rx_dma[0], (vuint32_t)rx_dma[1]);
+		}
+		else
+		{
+			LOG_IF(LOG_LEVEL_ERROR, LOG_ID_SERDES,
+				   "no RX buffer left, the kept buffer will be overwritten\r\n");
+		}
+	}
+	buf_unref(&buf);
+}
+
 __attribute__((interrupt("WCH-Interrupt-fast"))) void SERDES_IRQHandler(void);
 __attribute__((interrupt("WCH-Interrupt-fast"))) void SERDES_IRQHandler(void)
 {
@@ -79,19 +155,15 @@ __attribute__((interrupt("WCH-Interrupt-fast"))) void SERDES_IRQHandler(void)
 		SDS_RX_LEN1 = SDS->SDS_RX_LEN1;
 
 		// switch between DMA buffers, new data will be put in those alternatively
-		if (current_rx_dma == RX_DMA_0)
+		if (current_rx_dma == 0)
 		{
-			serdes_user_handled.serdes_rx_callback(
-				current_rx_dma, SDS->SDS_DATA0 & HSPI_SERDES_TX_SIZE_MASK,
-				SDS->SDS_DATA0 >> 13);
-			current_rx_dma = RX_DMA_1;
+			_serdes_rx_deliver(0, SDS->SDS_DATA0);
+			current_rx_dma = 1;
 		}
 		else
 		{
-			serdes_user_handled.serdes_rx_callback(
-				current_rx_dma, SDS->SDS_DATA1 & HSPI_SERDES_TX_SIZE_MASK,
-				SDS->SDS_DATA1 >> 13);
-			current_rx_dma = RX_DMA_0;
+			_serdes_rx_deliver(1, SDS->SDS_DATA1);
+			current_rx_dma = 0;
 		}
 	}
 
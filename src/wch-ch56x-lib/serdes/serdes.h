@@ -32,6 +32,8 @@ limitations under the License.
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "wch-ch56x-lib/memory/buf.h"
+
 #define DMA_SIZE 4096
 #ifndef HSPI_SERDES_TX_SIZE_MASK
 #define HSPI_SERDES_TX_SIZE_MASK 0x00001fff
@@ -51,6 +53,18 @@ typedef struct serdes_user_handled_t
    */
 	void (*serdes_rx_callback)(uint8_t* buffer, uint16_t size,
 							   uint16_t custom_register);
+
+	/**
+   * @brief Optional, called instead of serdes_rx_callback if set when
+   * serdes_init is called : the two reception buffers of max_packet_size bytes
+   * are then allocated in ramx_pool. buf holds a reference on the buffer until the callback returns
+   * : call buf_ref to keep it, or forward it with hspi_send_buf or
+   * endp_tx_set_new_buf which take their own reference. The reception buffer
+   * is then replaced by a new one, so the next packet does not overwrite the
+   * data kept. Called from the SerDes interrupt handler.
+   * @param custom_register custom value, 15bits max
+   */
+	void (*serdes_rx_buf_callback)(hydra_buf_t* buf, uint16_t custom_register);
 } serdes_user_handled_t;
 
 extern serdes_user_handled_t serdes_user_handled;
@@ -79,6 +93,13 @@ void serdes_init(SERDES_TYPE type, uint16_t size);
  */
 void serdes_send(uint8_t* buffer, uint16_t size, uint16_t custom_register);
 
+/**
+ * @brief Send the data described by buf. The transmission is over when this
+ * returns, the reference of the caller covers it.
+ * @param buf Descriptor of a buffer in RAMX, e.g. in ramx_pool
+ */
+void serdes_send_buf(const hydra_buf_t* buf, uint16_t custom_register);
+
 #ifdef __cplusplus
 }
 #endif
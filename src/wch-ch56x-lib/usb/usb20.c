@@ -114,6 +114,7 @@ void usb2_device_deinit(void)
 	LOG_IF(LOG_LEVEL_DEBUG, LOG_ID_USB2, "Disabling USB2 \r\n");
 	PFIC_DisableIRQ(USBHS_IRQn);
 	R8_USB_CTRL = RB_USB_CLR_ALL | RB_USB_RESET_SIE;
+	_endp_tx_buf_release_all(usb2_backend_current_device);
 }
 
 void usb2_setup_endpoints_in_mask(uint32_t mask)
@@ -442,7 +443,12 @@ void usb2_setup_endpoints(void)
 	usb2_setup_endpoints_in_mask(usb2_backend_current_device->endpoint_mask);
 }
 
-void usb2_reset_endpoints(void) { usb2_setup_endpoints(); }
+void usb2_reset_endpoints(void)
+{
+	// the pending transfers are dropped
+	_endp_tx_buf_release_all(usb2_backend_current_device);
+	usb2_setup_endpoints();
+}
 
 void usb2_ep0_passthrough_enabled(bool enable)
 {
@@ -846,6 +852,7 @@ usb2_in_transfer_handler(uint8_t endp_num)
 
 			_TX_CTRL = (_TX_CTRL & ~RB_UEP_TRES_MASK) | UEP_T_RES_NAK;
 			*TX_CTRL = _TX_CTRL;
+			_endp_tx_buf_release(usb2_backend_current_device, endp_num);
 			usb2_backend_current_device->endpoints.tx_complete[endp_num](Ack);
 
 			if (endp_num != 0)
@@ -890,7 +897,7 @@ usb2_out_transfer_handler(uint8_t endp_num, uint16_t num_bytes_received)
 			usb_setup_req_data_size += num_bytes_received;
 		}
 
-		endp->state = usb2_backend_current_device->endpoints.rx_callback[endp_num](endp->buffer, num_bytes_received);
+		endp->state = _endp_rx_callback(usb2_backend_current_device, endp_num, num_bytes_received);
 		*usb2_get_rx_endpoint_addr_reg(endp_num) = (uint32_t)endp->buffer;
 
 		if (endp_num == 0 && (usb_setup_req.bRequestType & USB_REQ_TYP_IN))
@@ -26,7 +26,8 @@ limitations under the License.
 #define ENDP0_MAX_PACKET_SIZE 512
 
 usb3_endpoints_backend_handled_t usb3_endpoints_backend_handled = {
-	.usb3_endp_tx_ready = usb3_endp_tx_ready
+	.usb3_endp_tx_ready = usb3_endp_tx_ready,
+	.usb3_endp_rx_set_state_callback = usb3_endp_rx_set_state_callback
 };
 
 // the default device is a regular USB3 with the mandatory USB2 compatibility.
@@ -131,6 +132,7 @@ void usb30_device_deinit(void)
 	USBSS->LINK_CTRL = GO_DISABLED | POWER_MODE_3;
 	USBSS->LINK_INT_CTRL = 0;
 	USBSS->USB_CONTROL = USB_FORCE_RST | USB_ALL_CLR;
+	_endp_tx_buf_release_all(usb3_backend_current_device);
 }
 
 /*******************************************************************************
@@ -284,6 +286,8 @@ void usb30_init_endpoints(void)
 
 void usb30_reinit_endpoints(void)
 {
+	// the pending transfers are dropped
+	_endp_tx_buf_release_all(usb3_backend_current_device);
 	usb30_in_clear_interrupt_all(ENDP_1);
 	usb30_out_clear_interrupt_all(ENDP_1);
 	usb30_in_clear_interrupt_all(ENDP_2);
@@ -560,6 +564,7 @@ usb30_ep_in_handler(uint8_t endp_num)
 
 		usb30_in_clear_interrupt(
 			endp_num); // Clear endpoint state Keep only packet sequence number
+		_endp_tx_buf_release(usb3_backend_current_device, endp_num);
 		usb3_backend_current_device->endpoints.tx_complete[endp_num](Ack); // set new data before we're ready for more
 		if (usb30_in_nump(endp_num) ==
 			0)
@@ -660,9 +665,10 @@ usb30_ep_out_handler(uint8_t endp_num)
 
 		usb30_out_set(endp_num, NRDY, 0);
 
-		usb3_backend_current_device->endpoints.rx_callback[endp_num](endp->buffer,
-																	 *usb30_get_rx_endpoint_total_length(
-																		 endp_num)); // process data before receiving more
+		endp->state = _endp_rx_callback(
+			usb3_backend_current_device, endp_num,
+			*usb30_get_rx_endpoint_total_length(
+				endp_num)); // process data before receiving more
 
 		// Prepare for next packets
 		usb30_out_clear_interrupt(endp_num); // Clear all state of the endpoint Keep
@@ -676,12 +682,21 @@ usb30_ep_out_handler(uint8_t endp_num)
 		*rx_ep_previously_set_max_burst = endp->max_burst;
 		*usb30_get_rx_endpoint_total_length(endp_num) = 0;
 
-		// Set the endpoint as ready
-		usb30_out_set(endp_num, ACK,
-					  endp->max_burst); // Able to send endp_rx.max_burst packets
-		usb30_send_erdy(
-			endp_num | OUT,
-			endp->max_burst); // Notify the host to take endp_rx.max_burst packets
+		// On NAK (e.g. no RX buffer left), stay NRDY without ERDY : the host waits
+		// until endp_rx_set_state re-arms the endpoint
+		if (endp->state == ENDP_STATE_STALL)
+		{
+			usb30_out_set(endp_num, STALL, 0);
+		}
+		else if (endp->state == ENDP_STATE_ACK)
+		{
+			// Set the endpoint as ready
+			usb30_out_set(endp_num, ACK,
+						  endp->max_burst); // Able to send endp_rx.max_burst packets
+			usb30_send_erdy(
+				endp_num | OUT,
+				endp->max_burst); // Notify the host to take endp_rx.max_burst packets
+		}
 	}
 	else
 	{
@@ -747,6 +762,27 @@ void usb3_endp_tx_ready(uint8_t endp_num, uint16_t size)
 	// ready for burst transfer
 }
 
+void usb3_endp_rx_set_state_callback(uint8_t endp_num)
+{
+	volatile USB_ENDPOINT* endp = &usb3_backend_current_device->endpoints.rx[endp_num];
+
+	usb30_out_clear_interrupt(endp_num); // keep only the packet sequence
+	if (endp->state == ENDP_STATE_ACK)
+	{
+		*usb30_get_rx_endpoint_prev_set_max_burst(endp_num) = endp->max_burst;
+		usb30_out_set(endp_num, ACK, endp->max_burst);
+		usb30_send_erdy(endp_num | OUT, endp->max_burst);
+	}
+	else if (endp->state == ENDP_STATE_STALL)
+	{
+		usb30_out_set(endp_num, STALL, 0);
+	}
+	else
+	{
+		usb30_out_set(endp_num, NRDY, 0);
+	}
+}
+
 /*******************************************************************************
  * @fn     LINK_IRQHandler
  *
@@ -368,6 +368,13 @@ void usb30_itp_callback(uint32_t ITPCounter);
  */
 void usb3_endp_tx_ready(uint8_t endp_num, uint16_t size);
 
+/**
+ * @brief Called by the USB abstraction layer when the state of the RX endpoint
+ * changed. ENDP_STATE_ACK re-arms the endpoint and notifies the host with an
+ * ERDY, ENDP_STATE_NAK keeps it NRDY and ENDP_STATE_STALL stalls it.
+ */
+void usb3_endp_rx_set_state_callback(uint8_t endp_num);
+
 __attribute__((interrupt("WCH-Interrupt-fast"))) void LINK_IRQHandler(void);
 __attribute__((interrupt("WCH-Interrupt-fast"))) void USBSS_IRQHandler(void);
 #ifdef __cplusplus
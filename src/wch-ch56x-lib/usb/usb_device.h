@@ -124,12 +124,6 @@ void usb_device_set_string_descriptors(usb_device_t* usb_device,
  */
 void usb_device_set_endpoint_mask(usb_device_t* usb_device, uint32_t endpoint_mask);
 
-/**
- * @brief Set new RAMX buffer that contains next data to be sent. The buffer
- * must remain valid until it has been transmitted (after endp*_tx_complete)
- * @arg ptr pointer to the buffer to be sent by this endpoint
- * @arg size size of the buffer to be sent
- */
 /**
  * @brief Set new RAMX buffer that contains next data to be sent. The buffer
  * must remain valid until it has been transmitted (after endp*_tx_complete)
@@ -163,6 +157,109 @@ endp_tx_set_new_buffer(usb_device_t* usb_device, uint8_t endp_num, uint8_t* cons
 	return true;
 }
 
+/**
+ * @brief Same as endp_tx_set_new_buffer, with a reference taken on buf until
+ * it has been transmitted, so that the buffer does not need to be kept by the
+ * caller. The reference is released just before tx_complete[endp_num] is
+ * called, so a new buffer can be set from there.
+ * @return false if the previous buffer set with endp_tx_set_new_buf has not
+ * been transmitted yet, or if endp_tx_set_new_buffer fails
+ */
+__attribute__((always_inline)) inline static bool
+endp_tx_set_new_buf(usb_device_t* usb_device, uint8_t endp_num, const hydra_buf_t* buf)
+{
+	// EP0 data is copied by endp_tx_set_new_buffer
+	if (endp_num == 0)
+		return endp_tx_set_new_buffer(usb_device, endp_num, buf_data(buf), buf->length);
+
+	BSP_ENTER_CRITICAL();
+	if (usb_device->endpoints.tx_buf_base[endp_num] != NULL)
+	{
+		BSP_EXIT_CRITICAL();
+		return false;
+	}
+	buf_ref(buf);
+	usb_device->endpoints.tx_buf_base[endp_num] = buf->base;
+	if (!endp_tx_set_new_buffer(usb_device, endp_num, buf_data(buf), buf->length))
+	{
+		usb_device->endpoints.tx_buf_base[endp_num] = NULL;
+		BSP_EXIT_CRITICAL();
+		buf_unref(buf);
+		return false;
+	}
+	BSP_EXIT_CRITICAL();
+	return true;
+}
+
+/**
+ * @brief Called by the backends when a transfer is complete, before
+ * tx_complete[endp_num].
+ */
+__attribute__((always_inline)) inline static void
+_endp_tx_buf_release(usb_device_t* usb_device, uint8_t endp_num)
+{
+	uint8_t* base = usb_device->endpoints.tx_buf_base[endp_num];
+	if (base != NULL)
+	{
+		usb_device->endpoints.tx_buf_base[endp_num] = NULL;
+		ramx_pool_free(base);
+	}
+}
+
+/**
+ * @brief Called by the backends when the endpoints are reset or disabled :
+ * the transfers set with endp_tx_set_new_buf will not complete, their
+ * references are released.
+ */
+__attribute__((always_inline)) inline static void
+_endp_tx_buf_release_all(usb_device_t* usb_device)
+{
+	for (uint8_t endp_num = 0; endp_num < 16; ++endp_num)
+		_endp_tx_buf_release(usb_device, endp_num);
+}
+
+/**
+ * @brief Called by the backends when data has been received, calls
+ * rx_buf_callback[endp_num] or rx_callback[endp_num]. If rx_buf_callback
+ * kept a reference on the buffer, the endpoint is given a new one of
+ * max_packet_size_with_burst bytes and releases its own reference, so that the
+ * next packet does not overwrite the data kept. Without memory left, the
+ * endpoint keeps its buffer and answers NAK.
+ */
+__attribute__((always_inline)) inline static uint8_t
+_endp_rx_callback(usb_device_t* usb_device, uint8_t endp_num, uint16_t size)
+{
+	volatile USB_ENDPOINT* endp = &usb_device->endpoints.rx[endp_num];
+	uint8_t* const ptr = endp->buffer;
+
+	if (usb_device->endpoints.rx_buf_callback[endp_num] != NULL &&
+		ramx_address_in_pool(ptr))
+	{
+		hydra_buf_t buf = buf_from_ramx(ptr, size);
+		// the reference of buf during the call, next to the one of the endpoint
+		buf_ref(&buf);
+		uint8_t state = usb_device->endpoints.rx_buf_callback[endp_num](&buf);
+		if (ramx_pool_owners(ptr) > 2)
+		{
+			uint8_t* fresh = ramx_pool_alloc_bytes(endp->max_packet_size_with_burst);
+			if (fresh != NULL)
+			{
+				endp->buffer = fresh;
+				ramx_pool_free(ptr);
+			}
+			else
+			{
+				LOG_IF_LEVEL(LOG_LEVEL_ERROR,
+							 "endpoint %d: no RX buffer left, NAK\r\n", endp_num);
+				state = ENDP_STATE_NAK;
+			}
+		}
+		buf_unref(&buf);
+		return state;
+	}
+	return usb_device->endpoints.rx_callback[endp_num](ptr, size);
+}
+
 /**
  * @brief Set the current state of the RX endpoint. This will affect the next
  * received OUT request.
@@ -22,6 +22,7 @@ limitations under the License.
 #include <stdint.h>
 #include <string.h>
 
+#include "wch-ch56x-lib/memory/buf.h"
 #include "wch-ch56x-lib/usb/usb_types.h"
 
 #ifdef __cplusplus
@@ -80,6 +81,25 @@ typedef struct usb_endpoints_t
    */
 	uint8_t (*rx_callback[16])(uint8_t* const ptr, uint16_t size);
 
+	/**
+   * @brief Optional, called instead of rx_callback[endp_num] if set and if
+   * the RX buffer of the endpoint is in ramx_pool, the endpoint owning one
+   * reference on it. buf holds a reference on the buffer until the callback
+   * returns : call buf_ref to keep it, or forward it with hspi_send_buf or
+   * endp_tx_set_new_buf which take their own reference. The backend then gives
+   * the endpoint a new RX buffer of max_packet_size_with_burst bytes, so the
+   * next packet does not overwrite the data kept. Called from the USB
+   * interrupt handler.
+   * @return new state of endpoint response (ACK 0x00, NAK 0X02, STALL 0X03).
+   */
+	uint8_t (*rx_buf_callback[16])(hydra_buf_t* buf);
+
+	/**
+   * @brief Allocation referenced by endp_tx_set_new_buf for each TX endpoint,
+   * released by the backend when the transfer is complete.
+   */
+	uint8_t* tx_buf_base[16];
+
 	void (*nak_callback)(uint8_t ep_num);
 
 } usb_endpoints_t;
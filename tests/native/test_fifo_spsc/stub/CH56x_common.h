@@ -0,0 +1,19 @@
+/*
+ * Host stub of the BSP, enough to compile the header-only parts of
+ * wch-ch56x-lib natively. Interrupts are simulated by the test itself.
+ */
+#ifndef CH56X_COMMON_STUB_H
+#define CH56X_COMMON_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef volatile uint32_t vuint32_t;
+
+extern volatile uint32_t bsp_disable_interrupt_count;
+
+static inline void bsp_disable_interrupt(void) { bsp_disable_interrupt_count++; }
+static inline void bsp_enable_interrupt(void) {}
+
+#endif
@@ -0,0 +1,295 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Randomized interleaving test of HYDRA_FIFO_DEF_SPSC.
+ *
+ * One side of the FIFO runs in the "main loop", the other one in a signal
+ * handler standing for the interrupt handler. On x86, the main loop runs with
+ * the trap flag set : a SIGTRAP is raised after each of its instructions, and
+ * the handler randomly decides to run its side of the FIFO there. Like a real
+ * interrupt, the handler is never preempted by the main loop.
+ *
+ * Both sides randomly use the copying API (fifo_write/fifo_read_n) or the
+ * in-place one (fifo_write_reserve/commit, fifo_read_acquire/release).
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "wch-ch56x-lib/memory/fifo.h"
+
+#define FIFO_SIZE 5
+#define MAX_BATCH 4
+#define DEFAULT_ELEMENTS 5000
+// the interrupt handler runs after 1 instruction out of IRQ_PERIOD on average
+#define IRQ_PERIOD 16
+
+#if defined(__x86_64__)
+#define SINGLE_STEP 1
+#endif
+
+size_t bsp_critical_nesting;
+volatile uint32_t bsp_disable_interrupt_count;
+
+typedef struct element_t
+{
+	uint32_t seq;
+	uint16_t check;
+	uint8_t pad[6]; // an odd size, so memcpy is not a single word access
+} element_t;
+
+HYDRA_FIFO_DEF_SPSC(fifo, element_t, FIFO_SIZE);
+
+typedef struct side_t
+{
+	uint32_t next_seq;
+	uint32_t rng;
+} side_t;
+
+static side_t producer;
+static side_t consumer;
+static volatile bool irq_is_producer;
+static volatile bool irq_enabled;
+static volatile uint32_t errors;
+static volatile uint64_t irq_count;
+static uint32_t irq_rng;
+
+static uint32_t xorshift32(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static uint16_t element_check(uint32_t seq)
+{
+	return (uint16_t)(~seq * 2654435761U >> 16);
+}
+
+static void element_fill(element_t* element, uint32_t seq)
+{
+	element->seq = seq;
+	element->check = element_check(seq);
+	memset(element->pad, (int)seq, sizeof(element->pad));
+}
+
+static bool element_valid(element_t* element, uint32_t seq)
+{
+	uint8_t pad[sizeof(element->pad)];
+	memset(pad, (int)seq, sizeof(pad));
+	return element->seq == seq && element->check == element_check(seq) &&
+		   memcmp(pad, element->pad, sizeof(pad)) == 0;
+}
+
+static void produce_in_place(uint16_t n)
+{
+	hydra_fifo_span_t spans[2];
+	uint16_t reserved = fifo_write_reserve(&fifo, n, spans);
+	uint32_t seq = producer.next_seq;
+
+	for (int s = 0; s < 2; ++s)
+		for (uint16_t i = 0; i < spans[s].count; ++i)
+			element_fill((element_t*)spans[s].ptr + i, seq++);
+	fifo_write_commit(&fifo, reserved);
+	producer.next_seq += reserved;
+}
+
+static void consume_in_place(uint16_t n)
+{
+	hydra_fifo_span_t spans[2];
+	uint16_t acquired = fifo_read_acquire(&fifo, n, spans);
+
+	for (int s = 0; s < 2; ++s)
+	{
+		for (uint16_t i = 0; i < spans[s].count; ++i)
+		{
+			if (!element_valid((element_t*)spans[s].ptr + i, consumer.next_seq))
+			{
+				if (errors == 0)
+					fprintf(stderr, "in place: expected %u, got %u\n",
+							consumer.next_seq, ((element_t*)spans[s].ptr + i)->seq);
+				errors++;
+			}
+			consumer.next_seq++;
+		}
+	}
+	fifo_read_release(&fifo, acquired);
+}
+
+static void produce(void)
+{
+	element_t elements[MAX_BATCH];
+	uint32_t rng = xorshift32(&producer.rng);
+	uint16_t n = (uint16_t)(rng % MAX_BATCH + 1);
+
+	if (rng & 0x100)
+	{
+		produce_in_place(n);
+		return;
+	}
+
+	for (uint16_t i = 0; i < n; ++i)
+	{
+		element_fill(&elements[i], producer.next_seq + i);
+	}
+	uint16_t written = fifo_write(&fifo, elements, n);
+	if (written != 0 && written != n)
+		errors++;
+	producer.next_seq += written;
+}
+
+static void consume(void)
+{
+	element_t elements[FIFO_SIZE + 1];
+	uint32_t rng = xorshift32(&consumer.rng);
+	uint16_t n = (uint16_t)(rng % MAX_BATCH + 1);
+	uint16_t read;
+
+	if (rng & 0x100)
+	{
+		consume_in_place(n);
+		return;
+	}
+
+	// also exercise the read-all path
+	if (n == MAX_BATCH)
+		read = fifo_read(&fifo, elements);
+	else
+		read = fifo_read_n(&fifo, elements, n);
+
+	for (uint16_t i = 0; i < read; ++i)
+	{
+		if (!element_valid(&elements[i], consumer.next_seq))
+		{
+			if (errors == 0)
+				fprintf(stderr, "expected %u, got %u\n", consumer.next_seq,
+						elements[i].seq);
+			errors++;
+		}
+		consumer.next_seq = elements[i].seq + 1;
+	}
+}
+
+static void irq_handler(int sig)
+{
+	(void)sig;
+	if (!irq_enabled || xorshift32(&irq_rng) % IRQ_PERIOD != 0)
+		return;
+
+	irq_count++;
+	if (irq_is_producer)
+		produce();
+	else
+		consume();
+}
+
+#ifdef SINGLE_STEP
+static void preemption_start(void)
+{
+	__asm__ volatile("pushfq\n\torq $0x100, (%%rsp)\n\tpopfq" ::: "memory", "cc");
+}
+
+static void preemption_stop(void)
+{
+	__asm__ volatile("pushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq" ::: "memory", "cc");
+}
+#else
+static void preemption_start(void)
+{
+	struct itimerval timer = { .it_interval = { 0, 20 }, .it_value = { 0, 20 } };
+	setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+static void preemption_stop(void)
+{
+	struct itimerval timer = { 0 };
+	setitimer(ITIMER_REAL, &timer, NULL);
+}
+#endif
+
+static bool run(bool irq_producer, uint32_t num_elements, uint32_t seed)
+{
+	fifo_clean(&fifo);
+	producer = (side_t){ .next_seq = 0, .rng = seed };
+	consumer = (side_t){ .next_seq = 0, .rng = seed * 7 + 1 };
+	irq_rng = seed * 13 + 3;
+	irq_is_producer = irq_producer;
+	errors = 0;
+	irq_count = 0;
+	bsp_disable_interrupt_count = 0;
+
+	irq_enabled = true;
+	preemption_start();
+	if (irq_producer)
+	{
+		while (consumer.next_seq < num_elements && errors == 0)
+			consume();
+	}
+	else
+	{
+		while (producer.next_seq < num_elements && errors == 0)
+			produce();
+	}
+	preemption_stop();
+	irq_enabled = false;
+
+	// drain what is left
+	while (consumer.next_seq < producer.next_seq && errors == 0)
+		consume();
+
+	printf("%s: %u elements, %llu interrupts, %u errors, %u critical sections\n",
+		   irq_producer ? "irq producer" : "irq consumer", consumer.next_seq,
+		   (unsigned long long)irq_count, errors, bsp_disable_interrupt_count);
+
+	return errors == 0 && consumer.next_seq == producer.next_seq &&
+		   consumer.next_seq >= num_elements && fifo_count(&fifo) == 0 &&
+		   bsp_disable_interrupt_count == 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t num_elements = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : DEFAULT_ELEMENTS;
+	uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x12345678;
+	struct sigaction sa;
+
+	if (seed == 0)
+		seed = 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = irq_handler;
+	sigemptyset(&sa.sa_mask);
+#ifdef SINGLE_STEP
+	sigaction(SIGTRAP, &sa, NULL);
+#else
+	sigaction(SIGALRM, &sa, NULL);
+#endif
+
+	bool ok = run(true, num_elements, seed);
+	ok = run(false, num_elements, seed) && ok;
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
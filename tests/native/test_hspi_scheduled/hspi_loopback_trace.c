@@ -0,0 +1,141 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Record the ramx_pool allocations of hspi_scheduled forwarding packets like
+ * a Hydradancer board does : packets received from the USB host are copied and
+ * sent on HSPI, packets received on HSPI are held by a USB endpoint until the
+ * host reads them, a few packets later. The trace is written to the file given
+ * as argument (or stdout), in the format of
+ * tests/native/test_ramx_alloc/ramx_alloc_trace.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 1024
+#define PACKETS 20000
+#define USB_DEPTH_MAX 4 // packets held by the USB endpoint
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+void HSPI_DMA_Tx(void) { R8_HSPI_INT_FLAG |= RB_HSPI_IF_T_DONE; }
+
+static FILE* trace;
+
+void ramx_alloc_trace_alloc(void* ptr, uint32_t num_blocks)
+{
+	fprintf(trace, "a %u %u\n", (uint32_t)((uint8_t*)ptr - ramx_pool.pool),
+			num_blocks * POOL_BLOCK_SIZE);
+}
+
+void ramx_alloc_trace_free(void* ptr)
+{
+	fprintf(trace, "f %u\n", (uint32_t)((uint8_t*)ptr - ramx_pool.pool));
+}
+
+static uint32_t seed = 1;
+
+static uint32_t rand_next(uint32_t max)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % max;
+}
+
+static hydra_buf_t usb_held[USB_DEPTH_MAX];
+static uint32_t usb_held_count;
+
+// the USB endpoint keeps the buffer until the host reads it
+static void rx_buf_callback(hydra_buf_t* buf, uint16_t custom_register)
+{
+	(void)custom_register;
+	if (usb_held_count == USB_DEPTH_MAX)
+	{
+		buf_unref(&usb_held[0]);
+		for (uint32_t i = 1; i < USB_DEPTH_MAX; ++i)
+			usb_held[i - 1] = usb_held[i];
+		usb_held_count--;
+	}
+	buf_ref(buf);
+	usb_held[usb_held_count++] = *buf;
+}
+
+static void usb_host_read(void)
+{
+	if (usb_held_count == 0)
+		return;
+	buf_unref(&usb_held[0]);
+	for (uint32_t i = 1; i < usb_held_count; ++i)
+		usb_held[i - 1] = usb_held[i];
+	usb_held_count--;
+}
+
+static bool rx_toggle;
+
+static void receive_packet(void)
+{
+	R32_HSPI_UDF0 = PACKET_SIZE;
+	R32_HSPI_UDF1 = PACKET_SIZE;
+	R8_HSPI_RX_SC = rx_toggle ? RB_HSPI_RX_TOG : 0;
+	R8_HSPI_RTX_STATUS = 0;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_R_DONE;
+	HSPI_IRQHandler();
+	rx_toggle = !rx_toggle;
+}
+
+int main(int argc, char** argv)
+{
+	static uint8_t usb_rx_buffer[PACKET_SIZE];
+
+	trace = argc > 1 ? fopen(argv[1], "w") : stdout;
+	if (trace == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	fprintf(trace, "# hspi_scheduled loopback, %d packets of %d bytes\n",
+			PACKETS, PACKET_SIZE);
+
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	hspi_scheduled_user_handled.hspi_rx_buf_callback = rx_buf_callback;
+	hspi_init(HSPI_TYPE_DEVICE, HSPI_DATASIZE_32, PACKET_SIZE);
+
+	for (uint32_t i = 0; i < PACKETS; ++i)
+	{
+		if (rand_next(2) == 0)
+			receive_packet();
+		if (rand_next(2) == 0)
+			hspi_send(usb_rx_buffer, PACKET_SIZE, 0);
+		if (rand_next(3) != 0)
+			usb_host_read();
+		for (int j = 0; j < INTERRUPT_QUEUE_SIZE; ++j)
+			hydra_interrupt_queue_run();
+	}
+	while (usb_held_count > 0)
+		usb_host_read();
+
+	if (trace != stdout)
+		fclose(trace);
+	return 0;
+}
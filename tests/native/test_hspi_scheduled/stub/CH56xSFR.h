@@ -0,0 +1,7 @@
+/*
+ * Host stub, see CH56x_common.h
+ */
+#ifndef CH56XSFR_STUB_H
+#define CH56XSFR_STUB_H
+
+#endif
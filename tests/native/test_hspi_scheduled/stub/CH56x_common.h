@@ -0,0 +1,114 @@
+/*
+ * Host stub of the BSP, enough to compile hspi_scheduled natively. The HSPI
+ * registers are plain variables (see hspi_regs.c), the test plays the role of
+ * the peripheral and calls HSPI_IRQHandler itself. The same goes for SysTick
+ * and TMR0, used by the timed tasks of the interrupt queue.
+ */
+#ifndef CH56X_COMMON_STUB_H
+#define CH56X_COMMON_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef volatile uint8_t vuint8_t;
+typedef volatile uint16_t vuint16_t;
+typedef volatile uint32_t vuint32_t;
+
+/* An interrupt raised by the test runs at once, or once the critical section
+ * in progress ends, like a real one */
+void stub_raise_irq(void (*irq)(void));
+void stub_run_pending_irq(void);
+static inline void bsp_disable_interrupt(void) {}
+static inline void bsp_enable_interrupt(void) { stub_run_pending_irq(); }
+/* SysTick counts down, it only moves when the test advances it */
+#define STUB_TICKS_PER_US 120
+extern uint64_t stub_systick;
+static inline void bsp_wait_us_delay(uint32_t us)
+{
+	stub_systick -= (uint64_t)us * STUB_TICKS_PER_US;
+}
+static inline uint64_t bsp_get_SysTickCNT(void) { return stub_systick; }
+static inline uint32_t bsp_get_nbtick_1us(void) { return STUB_TICKS_PER_US; }
+
+typedef enum
+{
+	HSPI_HOST,
+	HSPI_DEVICE
+} HSPI_ModeTypeDef;
+
+#define HSPI_IRQn 0
+#define TMR0_IRQn 1
+static inline void PFIC_EnableIRQ(int irq) { (void)irq; }
+
+/* Start a transmission, implemented by the test */
+void HSPI_DMA_Tx(void);
+
+extern vuint8_t R8_HSPI_CFG;
+extern vuint8_t R8_HSPI_AUX;
+extern vuint8_t R8_HSPI_CTRL;
+extern vuint8_t R8_HSPI_INT_EN;
+extern vuint8_t R8_HSPI_INT_FLAG;
+extern vuint8_t R8_HSPI_RTX_STATUS;
+extern vuint8_t R8_HSPI_RX_SC;
+extern vuint8_t R8_HSPI_TX_SC;
+extern vuint16_t R16_HSPI_DMA_LEN0;
+extern vuint16_t R16_HSPI_DMA_LEN1;
+extern vuint16_t R16_HSPI_RX_LEN0;
+extern vuint16_t R16_HSPI_RX_LEN1;
+extern vuint16_t R16_HSPI_BURST_CFG;
+extern vuint8_t R8_HSPI_BURST_CNT;
+extern vuint32_t R32_HSPI_TX_ADDR0;
+extern vuint32_t R32_HSPI_TX_ADDR1;
+extern vuint32_t R32_HSPI_RX_ADDR0;
+extern vuint32_t R32_HSPI_RX_ADDR1;
+extern vuint32_t R32_HSPI_UDF0;
+extern vuint32_t R32_HSPI_UDF1;
+extern vuint32_t R32_PA_DIR;
+extern vuint32_t R32_PA_DRV;
+extern vuint8_t R8_TMR0_CTRL_MOD;
+extern vuint8_t R8_TMR0_INTER_EN;
+extern vuint8_t R8_TMR0_INT_FLAG;
+extern vuint32_t R32_TMR0_CNT_END;
+
+#define RB_HSPI_MODE 0x01
+#define RB_HSPI_DUALDMA 0x02
+#define RB_HSPI_MSK_SIZE 0x0C
+#define RB_HSPI_DAT8_MOD 0x00
+#define RB_HSPI_DAT16_MOD 0x04
+#define RB_HSPI_DAT32_MOD 0x08
+#define RB_HSPI_TX_TOG_EN 0x10
+#define RB_HSPI_RX_TOG_EN 0x20
+#define RB_HSPI_HW_ACK 0x40
+#define RB_HSPI_ENABLE 0x01
+#define RB_HSPI_DMA_EN 0x02
+#define RB_HSPI_ALL_CLR 0x04
+#define RB_HSPI_TRX_RST 0x08
+#define RB_HSPI_IE_T_DONE 0x01
+#define RB_HSPI_IE_R_DONE 0x02
+#define RB_HSPI_IE_FIFO_OV 0x04
+#define RB_HSPI_IE_B_DONE 0x08
+#define RB_HSPI_IF_T_DONE 0x01
+#define RB_HSPI_IF_R_DONE 0x02
+#define RB_HSPI_IF_FIFO_OV 0x04
+#define RB_HSPI_IF_B_DONE 0x08
+#define RB_HSPI_CRC_ERR 0x10
+#define RB_HSPI_NUM_MIS 0x20
+#define RB_HSPI_TX_NUM 0x0F
+#define RB_HSPI_TX_TOG 0x10
+#define RB_HSPI_RX_NUM 0x0F
+#define RB_HSPI_RX_TOG 0x10
+#define RB_HSPI_TCK_MOD 0x01
+#define RB_HSPI_ACK_TX_MOD 0x02
+#define RB_HSPI_ACK_CNT_SEL 0x0C
+#define RB_HSPI_REQ_FT 0x10
+#define RB_HSPI_BURST_EN 0x0001
+#define RB_HSPI_BURST_LEN 0xFF00
+#define RB_TMR_MODE_IN 0x01
+#define RB_TMR_ALL_CLEAR 0x02
+#define RB_TMR_COUNT_EN 0x04
+#define RB_TMR_OUT_EN 0x08
+#define RB_TMR_IE_CYC_END 0x01
+#define RB_TMR_IF_CYC_END 0x01
+
+#endif
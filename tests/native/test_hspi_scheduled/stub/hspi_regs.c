@@ -0,0 +1,53 @@
+/*
+ * HSPI and timer registers of the host stub, see CH56x_common.h
+ */
+#include "CH56x_common.h"
+
+vuint8_t R8_HSPI_CFG;
+vuint8_t R8_HSPI_AUX;
+vuint8_t R8_HSPI_CTRL;
+vuint8_t R8_HSPI_INT_EN;
+vuint8_t R8_HSPI_INT_FLAG;
+vuint8_t R8_HSPI_RTX_STATUS;
+vuint8_t R8_HSPI_RX_SC;
+vuint8_t R8_HSPI_TX_SC;
+vuint16_t R16_HSPI_DMA_LEN0;
+vuint16_t R16_HSPI_DMA_LEN1;
+vuint16_t R16_HSPI_RX_LEN0;
+vuint16_t R16_HSPI_RX_LEN1;
+vuint16_t R16_HSPI_BURST_CFG;
+vuint8_t R8_HSPI_BURST_CNT;
+vuint32_t R32_HSPI_TX_ADDR0;
+vuint32_t R32_HSPI_TX_ADDR1;
+vuint32_t R32_HSPI_RX_ADDR0;
+vuint32_t R32_HSPI_RX_ADDR1;
+vuint32_t R32_HSPI_UDF0;
+vuint32_t R32_HSPI_UDF1;
+vuint32_t R32_PA_DIR;
+vuint32_t R32_PA_DRV;
+vuint8_t R8_TMR0_CTRL_MOD;
+vuint8_t R8_TMR0_INTER_EN;
+vuint8_t R8_TMR0_INT_FLAG;
+vuint32_t R32_TMR0_CNT_END;
+
+uint64_t stub_systick = 1ull << 40;
+
+extern size_t bsp_critical_nesting;
+static void (*stub_pending_irq)(void);
+
+void stub_raise_irq(void (*irq)(void))
+{
+	if (bsp_critical_nesting == 0)
+		irq();
+	else
+		stub_pending_irq = irq;
+}
+
+void stub_run_pending_irq(void)
+{
+	void (*irq)(void) = stub_pending_irq;
+
+	stub_pending_irq = NULL;
+	if (irq != NULL)
+		irq();
+}
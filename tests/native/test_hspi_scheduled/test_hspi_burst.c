@@ -0,0 +1,258 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the burst mode of hspi_scheduled (HSPI_BURST_LEN). The test plays the
+ * HSPI peripheral : HSPI_DMA_Tx records the burst programmed in the DMA
+ * selected by the toggle bit, and the test ends bursts, sent or received, by
+ * flipping the toggle bits and calling HSPI_IRQHandler with
+ * RB_HSPI_IF_B_DONE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define BURST_SIZE (HSPI_BURST_LEN * PACKET_SIZE)
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+static uint32_t errors;
+static bool on_wire;
+static uint32_t started;
+static uint16_t started_cfg;
+static uint32_t started_udf;
+static uint32_t done_count;
+static uint32_t received_count;
+static uint16_t received_size;
+static uint16_t received_custom;
+static bool received_ok;
+
+void HSPI_DMA_Tx(void)
+{
+	bool tog = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0;
+	uint8_t* buffer =
+		(uint8_t*)(uintptr_t)(tog ? R32_HSPI_TX_ADDR1 : R32_HSPI_TX_ADDR0);
+
+	if (on_wire || buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("burst %u: started with %p, on wire %d\n", started,
+			   (void*)buffer, on_wire);
+		errors++;
+		return;
+	}
+	started_cfg = R16_HSPI_BURST_CFG;
+	started_udf = tog ? R32_HSPI_UDF1 : R32_HSPI_UDF0;
+	started++;
+	on_wire = true;
+}
+
+/*
+ * End the burst on the wire, like the peripheral does
+ */
+static bool end_burst(void)
+{
+	if (!on_wire)
+		return false;
+	on_wire = false;
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_B_DONE | RB_HSPI_IF_T_DONE;
+	HSPI_IRQHandler();
+	return true;
+}
+
+/*
+ * Receive a burst of frames frames on the DMA selected by the RX toggle bit,
+ * the last one of last_size bytes
+ */
+static bool receive_burst(uint8_t frames, uint16_t last_size, uint16_t custom)
+{
+	bool dma = (R8_HSPI_RX_SC & RB_HSPI_RX_TOG) != 0;
+	uint8_t* buffer =
+		(uint8_t*)(uintptr_t)(dma ? R32_HSPI_RX_ADDR1 : R32_HSPI_RX_ADDR0);
+	uint32_t size = (uint32_t)(frames - 1) * PACKET_SIZE + last_size;
+
+	if (buffer == NULL || !ramx_address_in_pool(buffer))
+		return false;
+	// the DMA address advances frame after frame
+	for (uint32_t i = 0; i < size; ++i)
+		buffer[i] = (uint8_t)(i / PACKET_SIZE + i);
+	uint32_t udf = (uint32_t)last_size | ((uint32_t)custom << 13);
+	if (dma)
+		R32_HSPI_UDF1 = udf;
+	else
+		R32_HSPI_UDF0 = udf;
+	// the toggle bit is set once DMA 0 has been filled
+	R8_HSPI_RX_SC = dma ? 0 : RB_HSPI_RX_TOG;
+	R8_HSPI_BURST_CNT = frames;
+	R8_HSPI_RTX_STATUS = 0;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_B_DONE | RB_HSPI_IF_R_DONE;
+	HSPI_IRQHandler();
+	return (dma ? R32_HSPI_RX_ADDR1 : R32_HSPI_RX_ADDR0) != (uintptr_t)buffer;
+}
+
+static void tx_done_callback(uint16_t custom_register)
+{
+	(void)custom_register;
+	done_count++;
+}
+
+static void rx_callback(uint8_t* buffer, uint16_t size, uint16_t custom_register)
+{
+	received_count++;
+	received_size = size;
+	received_custom = custom_register;
+	received_ok = true;
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		if (buffer[i] != (uint8_t)(i / PACKET_SIZE + i))
+		{
+			received_ok = false;
+			break;
+		}
+	}
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	R8_HSPI_TX_SC = 0;
+	R8_HSPI_RX_SC = 0;
+	hspi_init(HSPI_TYPE_HOST, HSPI_DATASIZE_32, PACKET_SIZE);
+	errors = 0;
+	on_wire = false;
+	started = 0;
+	done_count = 0;
+	received_count = 0;
+}
+
+static bool test_burst_init(void)
+{
+	reset();
+	// one interrupt per burst, the frames are acknowledged by the hardware
+	return (R8_HSPI_CFG & RB_HSPI_HW_ACK) &&
+		   (R8_HSPI_INT_EN & RB_HSPI_IE_B_DONE) &&
+		   !(R8_HSPI_INT_EN & (RB_HSPI_IE_R_DONE | RB_HSPI_IE_T_DONE)) &&
+		   (R16_HSPI_BURST_CFG & RB_HSPI_BURST_EN);
+}
+
+static bool test_burst_send(void)
+{
+	static uint8_t payload[3 * PACKET_SIZE - 100];
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!hspi_send(payload, sizeof(payload), 7) || started != 1)
+		return false;
+	// three frames, the header holds the size of the last one
+	if (started_cfg != ((3 << 8) | RB_HSPI_BURST_EN) ||
+		(started_udf & HSPI_SERDES_TX_SIZE_MASK) != PACKET_SIZE - 100 ||
+		(started_udf >> 13) != 7)
+		return false;
+
+	// a single frame
+	if (!hspi_send(payload, 10, 8) || !end_burst() || started != 2 ||
+		started_cfg != ((1 << 8) | RB_HSPI_BURST_EN) || !end_burst())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	return errors == 0 && done_count == 2 && received_count == 0 &&
+		   hspi_tx_pending() == 0 && ramx_pool_stats_used() == used;
+}
+
+static bool test_burst_receive(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	// a whole burst, then a shorter one on the other DMA
+	if (!receive_burst(HSPI_BURST_LEN, PACKET_SIZE, 5))
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	if (received_count != 1 || received_size != BURST_SIZE ||
+		received_custom != 5 || !received_ok)
+		return false;
+
+	if (!receive_burst(2, 100, 6))
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	// the buffers handed over have been freed, the ring is not refilled yet
+	return received_count == 2 && received_size == PACKET_SIZE + 100 &&
+		   received_custom == 6 && received_ok &&
+		   hspi_rx_dropped_packets() == 0 && done_count == 0 &&
+		   ramx_pool_stats_used() == used - 2 * BURST_SIZE / POOL_BLOCK_SIZE;
+}
+
+static bool test_burst_oversize(void)
+{
+	static uint8_t payload[BURST_SIZE + 1];
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+	hydra_buf_t buf = { .base = ramx_pool_alloc_bytes(PACKET_SIZE),
+						.offset = 0,
+						.length = BURST_SIZE + 1 };
+	if (buf.base == NULL)
+		return false;
+
+	// larger than the RX buffers of the other side
+	bool refused = !hspi_send(payload, sizeof(payload), 1) &&
+				   !hspi_send_buf(&buf, 1);
+	buf_unref(&buf);
+	return refused && started == 0 && ramx_pool_stats_used() == used;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_burst_init),
+	TEST(test_burst_send),
+	TEST(test_burst_receive),
+	TEST(test_burst_oversize),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	hspi_scheduled_user_handled.hspi_tx_done_callback = tx_done_callback;
+	hspi_scheduled_user_handled.hspi_rx_callback = rx_callback;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
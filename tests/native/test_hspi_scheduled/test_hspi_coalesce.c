@@ -0,0 +1,354 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the coalescing of hspi_sendv (HSPI_COALESCE), with the linger time
+ * enforced by the timed tasks of the interrupt queue on a stubbed SysTick. The
+ * link is a loopback : HSPI_DMA_Tx puts the frame on the wire, and the test
+ * ends the transmission then receives the frame on the RX DMA armed by the
+ * library, so that the messages come back through hspi_rx_callback.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define LINGER_US 1000
+#define MAX_RECORDS 64
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+static uint32_t errors;
+static bool on_wire;
+static uint32_t started;
+static uint32_t wire_udf;
+static uint8_t wire[PACKET_SIZE];
+static bool rx_toggle;
+static uint32_t received;
+static uint16_t received_size[MAX_RECORDS];
+static uint16_t received_custom[MAX_RECORDS];
+static uint8_t received_first[MAX_RECORDS];
+static uint32_t received_misaligned;
+// raise irq_send when the next transmission starts
+static bool irq_armed;
+static bool irq_sent;
+
+/*
+ * An interrupt handler forwarding a packet, like rx_buf_callback of an USB
+ * endpoint
+ */
+static void irq_send(void)
+{
+	static uint8_t packet[PACKET_SIZE] = { 9 };
+
+	irq_sent = hspi_send(packet, PACKET_SIZE, 9);
+}
+
+void HSPI_DMA_Tx(void)
+{
+	bool tog = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0;
+	uint8_t* buffer =
+		(uint8_t*)(uintptr_t)(tog ? R32_HSPI_TX_ADDR1 : R32_HSPI_TX_ADDR0);
+
+	if (on_wire || buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("transmission %u: started with %p, on wire %d\n", started,
+			   (void*)buffer, on_wire);
+		errors++;
+		return;
+	}
+	wire_udf = tog ? R32_HSPI_UDF1 : R32_HSPI_UDF0;
+	memcpy(wire, buffer, PACKET_SIZE);
+	started++;
+	on_wire = true;
+	if (irq_armed)
+	{
+		irq_armed = false;
+		stub_raise_irq(irq_send);
+	}
+}
+
+/*
+ * End the transmission on the wire, then receive it on the other end of the
+ * loopback
+ */
+static bool end_transmission(void)
+{
+	uint8_t frame[PACKET_SIZE];
+	uint32_t udf = wire_udf;
+
+	if (!on_wire)
+		return false;
+	on_wire = false;
+	// the next transmission starts from the interrupt handler
+	memcpy(frame, wire, PACKET_SIZE);
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE;
+	HSPI_IRQHandler();
+
+	uint8_t* buffer = (uint8_t*)(uintptr_t)(rx_toggle ? R32_HSPI_RX_ADDR1
+													 : R32_HSPI_RX_ADDR0);
+	memcpy(buffer, frame, PACKET_SIZE);
+	R32_HSPI_UDF0 = udf;
+	R32_HSPI_UDF1 = udf;
+	// the toggle bit is set once DMA 0 has been filled
+	R8_HSPI_RX_SC = rx_toggle ? 0 : RB_HSPI_RX_TOG;
+	R8_HSPI_RTX_STATUS = 0;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_R_DONE;
+	HSPI_IRQHandler();
+	rx_toggle = !rx_toggle;
+	return true;
+}
+
+static void advance_us(uint32_t us)
+{
+	stub_systick -= (uint64_t)us * STUB_TICKS_PER_US;
+	hydra_interrupt_queue_timer_irq();
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+}
+
+static void rx_callback(uint8_t* buffer, uint16_t size, uint16_t custom_register)
+{
+	if (((uintptr_t)buffer & 3) != 0)
+		received_misaligned++;
+	if (received < MAX_RECORDS)
+	{
+		received_size[received] = size;
+		received_custom[received] = custom_register;
+		received_first[received] = size != 0 ? buffer[0] : 0;
+	}
+	received++;
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	R8_HSPI_TX_SC = 0;
+	R8_HSPI_RX_SC = 0;
+	hspi_init(HSPI_TYPE_HOST, HSPI_DATASIZE_32, PACKET_SIZE);
+	hspi_coalesce_set_linger_us(LINGER_US);
+	errors = 0;
+	on_wire = false;
+	started = 0;
+	rx_toggle = false;
+	received = 0;
+	received_misaligned = 0;
+	irq_armed = false;
+	irq_sent = false;
+}
+
+static bool send_message(uint8_t first, uint16_t size, uint16_t custom_register)
+{
+	static uint8_t data[PACKET_SIZE];
+	hspi_iovec_t part = { .data = data, .size = size };
+
+	memset(data, first, size);
+	return hspi_sendv(&part, 1, custom_register);
+}
+
+static bool test_coalesce_split(void)
+{
+	static const uint8_t setup[8] = { 0x80, 6, 0, 1, 0, 0, 64, 0 };
+	static const uint8_t header[3] = { 0xa5, 1, 2 };
+	const hspi_iovec_t parts[2] = { { .data = header, .size = sizeof(header) },
+									{ .data = setup, .size = sizeof(setup) } };
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	// a message gathered from two parts, an empty one and an odd-sized one
+	if (!hspi_sendv(parts, 2, 1) || !hspi_sendv(parts, 0, 2) ||
+		!send_message(7, 5, 3))
+		return false;
+	// the first message waits for others
+	advance_us(LINGER_US / 2);
+	if (started != 0)
+		return false;
+	advance_us(LINGER_US / 2 + INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+	if (started != 1 || (wire_udf >> 13) != HSPI_COALESCED)
+		return false;
+	// 4 + 12, 4 + 0 and 4 + 8 bytes
+	if ((wire_udf & HSPI_SERDES_TX_SIZE_MASK) != 32 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+
+	if (received != 3 || received_misaligned != 0 || received_size[0] != 11 ||
+		received_custom[0] != 1 || received_first[0] != 0xa5 ||
+		received_size[1] != 0 || received_custom[1] != 2 ||
+		received_size[2] != 5 || received_custom[2] != 3 ||
+		received_first[2] != 7)
+		return false;
+	// the frame has been released, and so has the RX buffer it was received in,
+	// the RX ring is not refilled yet
+	return errors == 0 && hspi_tx_pending() == 0 &&
+		   ramx_pool_stats_used() == used - 1;
+}
+
+static bool test_coalesce_full(void)
+{
+	reset();
+
+	// 104 bytes each : the fifth one goes to the next frame
+	for (uint8_t i = 0; i < 5; ++i)
+	{
+		if (!send_message(i, 100, i))
+			return false;
+	}
+	if (started != 1 || (wire_udf & HSPI_SERDES_TX_SIZE_MASK) != 4 * 104 ||
+		!end_transmission())
+		return false;
+	advance_us(LINGER_US + INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+	if (started != 2 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	for (uint8_t i = 0; i < 5; ++i)
+	{
+		if (received_custom[i] != i || received_first[i] != i ||
+			received_size[i] != 100)
+			return false;
+	}
+	// larger than a frame
+	return errors == 0 && received == 5 &&
+		   !send_message(0, PACKET_SIZE - 3, 0) && started == 2;
+}
+
+static bool test_coalesce_order(void)
+{
+	static uint8_t packet[PACKET_SIZE] = { 9 };
+
+	reset();
+
+	// the coalesced messages go first
+	if (!send_message(1, 10, 1) || !hspi_send(packet, PACKET_SIZE, 9) ||
+		started != 1 || (wire_udf >> 13) != HSPI_COALESCED ||
+		!end_transmission() || started != 2 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	// the linger task of the frame already sent does nothing
+	advance_us(LINGER_US + INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+	return errors == 0 && started == 2 && received == 2 &&
+		   received_custom[0] == 1 && received_custom[1] == 9 &&
+		   received_size[1] == PACKET_SIZE && received_first[1] == 9;
+}
+
+static bool test_coalesce_no_linger(void)
+{
+	reset();
+	hspi_coalesce_set_linger_us(0);
+
+	// each message in its own frame, at once
+	if (!send_message(1, 10, 1) || started != 1 || !end_transmission() ||
+		!send_message(2, 10, 2) || started != 2 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	return errors == 0 && received == 2 && received_custom[1] == 2;
+}
+
+static bool test_coalesce_poll(void)
+{
+	reset();
+
+	if (!send_message(1, 10, 1))
+		return false;
+	// without the timer interrupt, the main loop sends the frame
+	stub_systick -= (uint64_t)LINGER_US / 2 * STUB_TICKS_PER_US;
+	if (hspi_coalesce_poll() || started != 0)
+		return false;
+	stub_systick -= (uint64_t)LINGER_US / 2 * STUB_TICKS_PER_US;
+	if (!hspi_coalesce_poll() || started != 1 || !end_transmission())
+		return false;
+	advance_us(INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+	return errors == 0 && started == 1 && received == 1;
+}
+
+static bool test_coalesce_send_from_irq(void)
+{
+	reset();
+	hspi_coalesce_set_linger_us(0);
+	uint16_t used = ramx_pool_stats_used();
+
+	// hspi_send called from an interrupt while hspi_sendv sends the frame
+	irq_armed = true;
+	if (!send_message(1, 10, 1) || !irq_sent || started != 1 ||
+		(wire_udf >> 13) != HSPI_COALESCED || !end_transmission() ||
+		started != 2 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	return errors == 0 && started == 2 && received == 2 &&
+		   received_custom[0] == 1 && received_custom[1] == 9 &&
+		   hspi_tx_pending() == 0 && ramx_pool_stats_used() == used - 2;
+}
+
+static bool test_coalesce_reserved_register(void)
+{
+	static uint8_t packet[PACKET_SIZE];
+	hydra_buf_t buf;
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!buf_alloc(&buf, PACKET_SIZE))
+		return false;
+	// the other side would split them as coalesced frames
+	bool rejected = !hspi_send(packet, PACKET_SIZE, HSPI_COALESCED) &&
+					!hspi_send_buf(&buf, HSPI_COALESCED);
+	buf_unref(&buf);
+	return rejected && started == 0 && ramx_pool_stats_used() == used;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_coalesce_split),
+	TEST(test_coalesce_full),
+	TEST(test_coalesce_order),
+	TEST(test_coalesce_no_linger),
+	TEST(test_coalesce_poll),
+	TEST(test_coalesce_send_from_irq),
+	TEST(test_coalesce_reserved_register),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	hspi_scheduled_user_handled.hspi_rx_callback = rx_callback;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
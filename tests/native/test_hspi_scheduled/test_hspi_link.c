@@ -0,0 +1,352 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Simulation of an HSPI link between two boards using HSPI_FLOW_CONTROL. The
+ * library keeps its state in globals, so each endpoint is a process : the
+ * host is the parent, the device a forked child, and the wire is a
+ * SOCK_SEQPACKET socket pair carrying one frame (header, length and data) per
+ * message. Each process plays its own HSPI peripheral : HSPI_DMA_Tx writes the
+ * frame of the DMA selected by the TX toggle bit to the socket, the
+ * transmission ends at the next turn of the loop, and received frames are
+ * written to the RX DMA address armed by the library before calling
+ * HSPI_IRQHandler.
+ *
+ * Both sides send as fast as hspi_send accepts frames, and run their
+ * interrupt queue only every few turns, so that the RX rings run dry. Every
+ * frame must arrive, in order, and none may be dropped.
+ *
+ * Built with HSPI_RELIABLE and HSPI_ERROR_INJECTION, each side also handles
+ * one received data frame in ERROR_ONE_IN as a CRC error : the frames must
+ * still arrive, in order, sent again by the reliable layer. Each turn of the
+ * loop lasts TURN_US on SysTick, and an endpoint waiting for an ACK skips to
+ * the retransmit timeout. The counts printed at the end, compared to those of
+ * the build without HSPI_RELIABLE, are the cost of the reliable layer.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#ifndef FRAMES
+#define FRAMES 20000
+#endif
+#define HOST_LAG 3 // turns of the loop per run of the interrupt queue
+#define DEVICE_LAG 7
+// an endpoint with nothing to do waits this long for a frame before giving up
+#define STALL_TIMEOUT_MS 2000
+
+#ifdef HSPI_RELIABLE
+#define CUSTOM_MASK HSPI_RELIABLE_CUSTOM_MASK
+#ifndef ERROR_ONE_IN
+#define ERROR_ONE_IN 50
+#endif
+#define TURN_US 2
+// an endpoint waiting for an ACK waits this long before the retransmit timeout
+#define ACK_WAIT_MS 10
+// an endpoint done waits this long for the other side to need an ACK again
+#define QUIET_MS 500
+#else
+#define CUSTOM_MASK 0x1fff
+#endif
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+typedef struct frame_t
+{
+	uint32_t udf;
+	uint16_t len;
+	uint8_t data[PACKET_SIZE];
+} frame_t;
+
+static const char* name;
+static int wire = -1;
+static uint32_t errors;
+static bool tx_busy;
+static uint32_t data_frames_sent;
+static uint32_t credit_frames_sent;
+#ifdef HSPI_RELIABLE
+static uint32_t control_frames_sent;
+#endif
+static uint32_t frames_received;
+static uint8_t rx_dma; // DMA of the next received frame
+static uint32_t received;
+
+static uint8_t payload(uint32_t number, uint32_t i)
+{
+	return (uint8_t)(number * 7 + i);
+}
+
+void HSPI_DMA_Tx(void)
+{
+	bool tog = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0;
+	uint8_t* address =
+		(uint8_t*)(uintptr_t)(tog ? R32_HSPI_TX_ADDR1 : R32_HSPI_TX_ADDR0);
+	frame_t frame;
+
+	frame.udf = tog ? R32_HSPI_UDF1 : R32_HSPI_UDF0;
+	frame.len = (uint16_t)((tog ? R16_HSPI_DMA_LEN1 : R16_HSPI_DMA_LEN0) + 1);
+	if (tx_busy || address == NULL || frame.len > PACKET_SIZE)
+	{
+		printf("%s: transmission started with %p (%u bytes), busy %d\n", name,
+			   (void*)address, frame.len, tx_busy);
+		errors++;
+		return;
+	}
+	memcpy(frame.data, address, frame.len);
+	if ((frame.udf & HSPI_SERDES_TX_SIZE_MASK) == HSPI_ACK)
+		credit_frames_sent++;
+#ifdef HSPI_RELIABLE
+	// ACK and NACK of the reliable layer
+	else if ((frame.udf >> 13) & 0x1000)
+		control_frames_sent++;
+#endif
+	else
+		data_frames_sent++;
+	// the other side may be gone once it has received everything
+	send(wire, &frame, offsetof(frame_t, data) + frame.len, MSG_NOSIGNAL);
+	tx_busy = true;
+}
+
+/*
+ * Receive one frame on the DMA selected by the RX toggle bit, like the
+ * peripheral does
+ */
+static void receive_frame(const frame_t* frame)
+{
+	uint8_t dma = rx_dma;
+	uint8_t* buffer =
+		(uint8_t*)(uintptr_t)(dma ? R32_HSPI_RX_ADDR1 : R32_HSPI_RX_ADDR0);
+
+	if (buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("%s: frame received with the DMA armed with %p\n", name,
+			   (void*)buffer);
+		errors++;
+		return;
+	}
+	memcpy(buffer, frame->data, frame->len);
+	if (dma)
+		R32_HSPI_UDF1 = frame->udf;
+	else
+		R32_HSPI_UDF0 = frame->udf;
+	// the toggle bit is set once DMA 0 has been filled
+	R8_HSPI_RX_SC = dma ? 0 : RB_HSPI_RX_TOG;
+	R8_HSPI_RTX_STATUS = 0;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_R_DONE;
+	HSPI_IRQHandler();
+	rx_dma = (uint8_t)!dma;
+	frames_received++;
+}
+
+static bool end_transmission(void)
+{
+	if (!tx_busy)
+		return false;
+	tx_busy = false;
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE;
+	HSPI_IRQHandler();
+	return true;
+}
+
+/*
+ * Wait for the other side, once the interrupt queue has run with nothing new
+ * @return false if nothing came for STALL_TIMEOUT_MS, or the other side is gone
+ */
+static bool wait_frame(int timeout_ms)
+{
+	struct pollfd fd = { .fd = wire, .events = POLLIN };
+
+	return poll(&fd, 1, timeout_ms) > 0 && (fd.revents & POLLIN);
+}
+
+static void rx_callback(uint8_t* buffer, uint16_t size, uint16_t custom_register)
+{
+	if (custom_register != (received & CUSTOM_MASK) || size != PACKET_SIZE)
+	{
+		printf("%s: frame %u of %u bytes received, %u expected\n", name,
+			   custom_register, size, received & CUSTOM_MASK);
+		errors++;
+	}
+	for (uint32_t i = 0; i < PACKET_SIZE; ++i)
+	{
+		if (buffer[i] != payload(received, i))
+		{
+			printf("%s: frame %u corrupted at byte %u\n", name, received, i);
+			errors++;
+			break;
+		}
+	}
+	received++;
+}
+
+static bool run_endpoint(HSPI_TYPE type, uint32_t lag)
+{
+	static uint8_t packet[PACKET_SIZE];
+	static frame_t frame;
+	uint32_t sent = 0;
+	uint32_t turns;
+	uint32_t idle_turns = 0;
+	bool stalled = false;
+#ifdef HSPI_RELIABLE
+	uint32_t timeout_retransmits = 0;
+#endif
+
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	hspi_scheduled_user_handled.hspi_rx_callback = rx_callback;
+	hspi_init(type, HSPI_DATASIZE_32, PACKET_SIZE);
+#ifdef HSPI_ERROR_INJECTION
+	hspi_inject_rx_errors(ERROR_ONE_IN);
+#endif
+
+	for (turns = 0; !stalled; ++turns)
+	{
+#ifdef HSPI_RELIABLE
+		stub_systick -= (uint64_t)TURN_US * STUB_TICKS_PER_US;
+		if (hspi_reliable_poll())
+			timeout_retransmits++;
+#endif
+		bool progress = end_transmission();
+		while (recv(wire, &frame, sizeof(frame), MSG_DONTWAIT) > 0)
+		{
+			receive_frame(&frame);
+			progress = true;
+		}
+
+		while (sent < FRAMES)
+		{
+			for (uint32_t i = 0; i < PACKET_SIZE; ++i)
+				packet[i] = payload(sent, i);
+			if (!hspi_send(packet, PACKET_SIZE, (uint16_t)(sent & CUSTOM_MASK)))
+				break;
+			sent++;
+			progress = true;
+		}
+		if (turns % lag == 0)
+			hydra_interrupt_queue_run_budget(0, 0, NULL);
+
+		bool done = received == FRAMES && sent == FRAMES &&
+					hspi_tx_pending() == 0 && !tx_busy;
+#ifdef HSPI_RELIABLE
+		// the other side may still need ACKs
+		done = done && hspi_reliable_unacked() == 0;
+		idle_turns = progress ? 0 : idle_turns + 1;
+		if (idle_turns <= lag)
+			continue;
+		if (done)
+		{
+			// nothing came, or the other side is gone
+			if (!wait_frame(QUIET_MS) ||
+				recv(wire, &frame, sizeof(frame), MSG_PEEK | MSG_DONTWAIT) == 0)
+				break;
+		}
+		else if (hspi_reliable_unacked() != 0)
+		{
+			// the frame or its ACK may be lost, on to the retransmit timeout
+			if (!wait_frame(ACK_WAIT_MS))
+				stub_systick -=
+					(uint64_t)HSPI_RELIABLE_TIMEOUT_US * STUB_TICKS_PER_US;
+		}
+		else
+			stalled = !wait_frame(STALL_TIMEOUT_MS);
+#else
+		if (done)
+			break;
+		idle_turns = progress ? 0 : idle_turns + 1;
+		if (idle_turns > lag)
+			stalled = !wait_frame(STALL_TIMEOUT_MS);
+#endif
+	}
+	if (stalled)
+		printf("%s: stalled\n", name);
+
+	printf("%s: %u turns, %u data frames and %u credit frames sent, %u frames "
+		   "received, %u dropped\n",
+		   name, turns, data_frames_sent, credit_frames_sent, frames_received,
+		   hspi_rx_dropped_packets());
+#ifdef HSPI_RELIABLE
+	hspi_reliable_stats_t stats;
+	hspi_reliable_get_stats(&stats);
+	printf("%s: %u control frames sent (%u ACK, %u NACK), %u retransmits "
+		   "(%u on timeout), %u duplicates, %u errors injected\n",
+		   name, control_frames_sent, stats.acks_sent, stats.nacks_sent,
+		   stats.retransmits, timeout_retransmits, stats.duplicates,
+		   hspi_injected_rx_errors());
+	// the frames sent again are counted too
+	return errors == 0 && !stalled && received == FRAMES &&
+		   data_frames_sent == FRAMES + stats.retransmits &&
+		   hspi_rx_dropped_packets() == 0;
+#else
+	return errors == 0 && !stalled && received == FRAMES &&
+		   data_frames_sent == FRAMES && hspi_rx_dropped_packets() == 0;
+#endif
+}
+
+int main(void)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+	{
+		perror("socketpair");
+		return 1;
+	}
+	fflush(stdout);
+	pid_t device = fork();
+	if (device < 0)
+	{
+		perror("fork");
+		return 1;
+	}
+	if (device == 0)
+	{
+		name = "device";
+		wire = fds[1];
+		close(fds[0]);
+		bool passed = run_endpoint(HSPI_TYPE_DEVICE, DEVICE_LAG);
+		close(wire);
+		return passed ? 0 : 1;
+	}
+
+	name = "host";
+	wire = fds[0];
+	close(fds[1]);
+	bool ok = run_endpoint(HSPI_TYPE_HOST, HOST_LAG);
+	close(wire);
+
+	int status;
+	if (waitpid(device, &status, 0) != device || !WIFEXITED(status) ||
+		WEXITSTATUS(status) != 0)
+		ok = false;
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
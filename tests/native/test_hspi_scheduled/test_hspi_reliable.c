@@ -0,0 +1,187 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the transmit window of HSPI_RELIABLE. The test plays the HSPI
+ * peripheral like test_hspi_tx_ring, and raises a simulated interrupt handler
+ * calling hspi_send_buf while hspi_send numbers its frame.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define MAX_RECORDS 16
+// layout of the custom register of the frames, see hspi_scheduled.c
+#define SEQ_SHIFT 8
+#define SEQ_MASK 0x0f
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+static uint32_t errors;
+static bool on_wire;
+static uint32_t started;
+static uint16_t started_custom[MAX_RECORDS];
+// raise irq_send when the next transmission starts
+static bool irq_armed;
+static bool irq_sent;
+static hydra_buf_t irq_buf;
+
+/*
+ * An interrupt handler forwarding a buffer, like rx_buf_callback of an USB
+ * endpoint
+ */
+static void irq_send(void) { irq_sent = hspi_send_buf(&irq_buf, 2); }
+
+void HSPI_DMA_Tx(void)
+{
+	bool tog = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0;
+	uint8_t* buffer =
+		(uint8_t*)(uintptr_t)(tog ? R32_HSPI_TX_ADDR1 : R32_HSPI_TX_ADDR0);
+	uint32_t udf = tog ? R32_HSPI_UDF1 : R32_HSPI_UDF0;
+
+	if (on_wire || buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("transmission %u: started with %p, on wire %d\n", started,
+			   (void*)buffer, on_wire);
+		errors++;
+		return;
+	}
+	if (started < MAX_RECORDS)
+		started_custom[started] = (uint16_t)(udf >> 13);
+	started++;
+	on_wire = true;
+	if (irq_armed)
+	{
+		irq_armed = false;
+		stub_raise_irq(irq_send);
+	}
+}
+
+/*
+ * End the transmission on the wire, like the peripheral does
+ */
+static bool end_transmission(void)
+{
+	if (!on_wire)
+		return false;
+	on_wire = false;
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE;
+	HSPI_IRQHandler();
+	return true;
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	R8_HSPI_TX_SC = 0;
+	hspi_init(HSPI_TYPE_HOST, HSPI_DATASIZE_32, PACKET_SIZE);
+	errors = 0;
+	on_wire = false;
+	started = 0;
+	irq_armed = false;
+	irq_sent = false;
+}
+
+static bool test_reliable_send_from_irq(void)
+{
+	static uint8_t packet[PACKET_SIZE];
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!buf_alloc(&irq_buf, PACKET_SIZE))
+		return false;
+	// hspi_send_buf called from an interrupt while hspi_send queues its frame
+	irq_armed = true;
+	if (!hspi_send(packet, PACKET_SIZE, 1) || !irq_sent || started != 1 ||
+		!end_transmission() || started != 2 || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+
+	// one sequence number each, in the order they went out
+	uint8_t seq0 = (started_custom[0] >> SEQ_SHIFT) & SEQ_MASK;
+	uint8_t seq1 = (started_custom[1] >> SEQ_SHIFT) & SEQ_MASK;
+	if (seq0 != 0 || seq1 != 1 ||
+		(started_custom[0] & HSPI_RELIABLE_CUSTOM_MASK) != 1 ||
+		(started_custom[1] & HSPI_RELIABLE_CUSTOM_MASK) != 2 ||
+		hspi_reliable_unacked() != 2)
+		return false;
+	// the window holds one reference on each buffer until they are ACKed
+	buf_unref(&irq_buf);
+	return errors == 0 && ramx_pool_owners(irq_buf.base) == 1 &&
+		   ramx_pool_stats_used() == used + 2;
+}
+
+static bool test_reliable_custom_register(void)
+{
+	static uint8_t packet[PACKET_SIZE];
+	hydra_buf_t buf;
+
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!buf_alloc(&buf, PACKET_SIZE))
+		return false;
+	// the bits above HSPI_RELIABLE_CUSTOM_MASK hold the sequence number
+	bool rejected =
+		!hspi_send(packet, PACKET_SIZE, HSPI_RELIABLE_CUSTOM_MASK + 1) &&
+		!hspi_send_buf(&buf, HSPI_RELIABLE_CUSTOM_MASK + 1);
+	buf_unref(&buf);
+	if (!rejected || started != 0 || hspi_reliable_unacked() != 0 ||
+		ramx_pool_stats_used() != used)
+		return false;
+	return hspi_send(packet, PACKET_SIZE, HSPI_RELIABLE_CUSTOM_MASK) &&
+		   started == 1 &&
+		   (started_custom[0] & HSPI_RELIABLE_CUSTOM_MASK) == HSPI_RELIABLE_CUSTOM_MASK;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_reliable_send_from_irq),
+	TEST(test_reliable_custom_register),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the RX buffer ring of hspi_scheduled. The test plays the HSPI
+ * peripheral : it writes packets to the addresses armed in R32_HSPI_RX_ADDR0/1,
+ * alternating between both DMAs, and calls HSPI_IRQHandler. The main loop
+ * (hydra_interrupt_queue_run) is run less often than packets arrive, so that
+ * the ring runs dry.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define RING_SIZE (1 << HSPI_RX_RING_LOG2_SIZE)
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+void HSPI_DMA_Tx(void) { R8_HSPI_INT_FLAG |= RB_HSPI_IF_T_DONE; }
+
+static uint32_t errors;
+static uint32_t received;
+static uint32_t next_expected;
+static uint32_t low_calls;
+static hspi_rx_state_t low_state;
+static bool rx_toggle;
+static hydra_buf_t held[POOL_BLOCK_NUM];
+static uint32_t held_count;
+
+static void rx_callback(uint8_t* buffer, uint16_t size, uint16_t custom_register)
+{
+	(void)size;
+	// packets are numbered, a dropped packet is a gap, never a reordering
+	if (custom_register < next_expected || buffer[0] != (uint8_t)custom_register)
+	{
+		printf("packet %u received after %u, data %u\n", custom_register,
+			   next_expected, buffer[0]);
+		errors++;
+	}
+	next_expected = custom_register + 1u;
+	received++;
+}
+
+// keeps the buffers, like an application forwarding them slowly
+static void rx_buf_callback(hydra_buf_t* buf, uint16_t custom_register)
+{
+	rx_callback(buf_data(buf), buf->length, custom_register);
+	buf_ref(buf);
+	held[held_count++] = *buf;
+}
+
+static void release_held(void)
+{
+	for (uint32_t i = 0; i < held_count; ++i)
+		buf_unref(&held[i]);
+	held_count = 0;
+}
+
+static void rx_ring_low_callback(uint16_t available, hspi_rx_state_t state)
+{
+	if (available > HSPI_RX_RING_LOW_WATERMARK)
+		errors++;
+	low_calls++;
+	low_state = state;
+}
+
+/*
+ * Receive one packet on the DMA selected by the toggle bit, like the
+ * peripheral does.
+ */
+static bool receive_packet(uint16_t number)
+{
+	uint32_t address = rx_toggle ? R32_HSPI_RX_ADDR0 : R32_HSPI_RX_ADDR1;
+	uint8_t* buffer = (uint8_t*)(uintptr_t)address;
+
+	if (buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("packet %u: DMA armed with %x\n", number, address);
+		return false;
+	}
+	buffer[0] = (uint8_t)number;
+	if (rx_toggle)
+		R32_HSPI_UDF0 = (uint32_t)(number << 13) | PACKET_SIZE;
+	else
+		R32_HSPI_UDF1 = (uint32_t)(number << 13) | PACKET_SIZE;
+	R8_HSPI_RX_SC = rx_toggle ? RB_HSPI_RX_TOG : 0;
+	R8_HSPI_RTX_STATUS = 0;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_R_DONE;
+	HSPI_IRQHandler();
+	rx_toggle = !rx_toggle;
+	return true;
+}
+
+static void run_queue(void)
+{
+	for (int i = 0; i < INTERRUPT_QUEUE_SIZE; ++i)
+		hydra_interrupt_queue_run();
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	hspi_init(HSPI_TYPE_DEVICE, HSPI_DATASIZE_32, PACKET_SIZE);
+	errors = 0;
+	received = 0;
+	next_expected = 0;
+	low_calls = 0;
+	rx_toggle = false;
+	held_count = 0;
+}
+
+static bool test_rx_ring_backpressure(void)
+{
+	reset();
+	// 2 armed RX buffers, 2 TX buffers and the ring
+	if (ramx_pool_stats_used() != 4 + RING_SIZE)
+		return false;
+
+	// without the main loop, the ring empties, then packets are dropped while
+	// the DMA keeps its buffers
+	for (uint16_t i = 0; i < RING_SIZE + 6; ++i)
+	{
+		if (!receive_packet(i))
+			return false;
+	}
+	if (hspi_rx_get_state() != HSPI_RX_STATE_BACKPRESSURE ||
+		hspi_rx_dropped_packets() != 6)
+		return false;
+
+	// the refill task reports the backpressure, then the link recovers
+	run_queue();
+	if (received != RING_SIZE || low_calls != 1 ||
+		low_state != HSPI_RX_STATE_BACKPRESSURE)
+		return false;
+	if (!receive_packet(RING_SIZE + 6) ||
+		hspi_rx_get_state() != HSPI_RX_STATE_RUNNING)
+		return false;
+	run_queue();
+
+	return errors == 0 && received == RING_SIZE + 1;
+}
+
+static bool test_rx_ring_pool_empty(void)
+{
+	reset();
+	hspi_scheduled_user_handled.hspi_rx_buf_callback = rx_buf_callback;
+
+	// the application holds every received buffer and the rest of the memory :
+	// the refill tasks cannot allocate anything
+	uint8_t* hog = ramx_pool_alloc_blocks(ramx_pool_stats_free());
+	for (uint16_t i = 0; i < 3 * RING_SIZE; ++i)
+	{
+		if (!receive_packet(i))
+			return false;
+		run_queue();
+	}
+	if (received != RING_SIZE ||
+		hspi_rx_get_state() != HSPI_RX_STATE_BACKPRESSURE ||
+		hspi_rx_dropped_packets() != 2 * RING_SIZE)
+		return false;
+
+	// once the memory is given back, the next refill task fills the ring
+	release_held();
+	ramx_pool_free(hog);
+	for (uint16_t i = 3 * RING_SIZE; i < 6 * RING_SIZE; ++i)
+	{
+		if (!receive_packet(i))
+			return false;
+		run_queue();
+	}
+	release_held();
+	hspi_scheduled_user_handled.hspi_rx_buf_callback = NULL;
+
+	printf("pool empty: %u received, %u dropped, %u used\n", received,
+		   hspi_rx_dropped_packets(), ramx_pool_stats_used());
+	// the first packet after the release is dropped : the ring is refilled by
+	// the task it schedules. Nothing leaked : only the 4 armed buffers and the
+	// ring, above its low watermark, are left.
+	return errors == 0 && received == 4 * RING_SIZE - 1 &&
+		   hspi_rx_get_state() == HSPI_RX_STATE_RUNNING &&
+		   ramx_pool_stats_used() > 4 + HSPI_RX_RING_LOW_WATERMARK &&
+		   ramx_pool_stats_used() <= 4 + RING_SIZE;
+}
+
+static bool test_rx_ring_steady(void)
+{
+	reset();
+
+	// the main loop runs once every 3 packets : the low watermark is reached
+	// regularly, but the ring never runs dry
+	hspi_rx_ring_set_low_watermark(RING_SIZE - 1);
+	for (uint16_t i = 0; i < 3000; ++i)
+	{
+		if (!receive_packet(i))
+			return false;
+		if (i % 3 == 2)
+			run_queue();
+	}
+	run_queue();
+	hspi_rx_ring_set_low_watermark(HSPI_RX_RING_LOW_WATERMARK);
+
+	printf("steady: %u received, %u dropped, %u refills\n", received,
+		   hspi_rx_dropped_packets(), low_calls);
+	return errors == 0 && received == 3000 && hspi_rx_dropped_packets() == 0;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_rx_ring_backpressure),
+	TEST(test_rx_ring_pool_empty),
+	TEST(test_rx_ring_steady),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	hspi_scheduled_user_handled.hspi_rx_callback = rx_callback;
+	hspi_scheduled_user_handled.hspi_rx_ring_low_callback = rx_ring_low_callback;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,382 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the timed tasks of the interrupt queue (INTERRUPT_QUEUE_TIMER), and
+ * of the gap between HSPI transmissions they implement. The test plays SysTick
+ * and TMR0 : the main loop advances the time by a few microseconds after each
+ * run of the interrupt queue, and calls TMR0_IRQHandler at the end of each
+ * period of the timer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define LOOP_STEP_US 3
+#define MAX_RECORDS 64
+
+size_t bsp_critical_nesting;
+
+void TMR0_IRQHandler(void);
+
+static uint32_t timer_count;
+static uint32_t errors;
+
+static uint64_t sent_at[MAX_RECORDS];
+static uint8_t sent_number[MAX_RECORDS];
+static uint32_t sent_count;
+static uint32_t work_at_send[MAX_RECORDS];
+static uint32_t work_count;
+
+static uint64_t ran_at[MAX_RECORDS];
+static uint32_t ran_number[MAX_RECORDS];
+static uint32_t ran_count;
+static uint32_t cleanups;
+
+// the DMA alternates between both address registers, like the peripheral
+void HSPI_DMA_Tx(void)
+{
+	uint32_t address = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) ? R32_HSPI_TX_ADDR1
+														 : R32_HSPI_TX_ADDR0;
+	if (sent_count < MAX_RECORDS)
+	{
+		sent_at[sent_count] = stub_systick;
+		sent_number[sent_count] = *(uint8_t*)(uintptr_t)address;
+		work_at_send[sent_count] = work_count;
+	}
+	sent_count++;
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG |= RB_HSPI_IF_T_DONE;
+}
+
+/*
+ * Advance SysTick by us, and TMR0 with it. Interrupts are not nested : the
+ * handler is called once per elapsed period, like a late interrupt.
+ */
+static void advance_us(uint32_t us)
+{
+	stub_systick -= (uint64_t)us * STUB_TICKS_PER_US;
+	if (!(R8_TMR0_CTRL_MOD & RB_TMR_COUNT_EN) || R32_TMR0_CNT_END == 0)
+		return;
+	timer_count += us * STUB_TICKS_PER_US;
+	if (timer_count < R32_TMR0_CNT_END)
+		return;
+	timer_count %= R32_TMR0_CNT_END;
+	R8_TMR0_INT_FLAG |= RB_TMR_IF_CYC_END;
+	if (R8_TMR0_INTER_EN & RB_TMR_IE_CYC_END)
+		TMR0_IRQHandler();
+}
+
+static bool work(uint8_t* data)
+{
+	(void)data;
+	work_count++;
+	return true;
+}
+
+static bool record(uint8_t* data)
+{
+	uint32_t number;
+	memcpy(&number, data, sizeof(number));
+	if (ran_count < MAX_RECORDS)
+	{
+		ran_at[ran_count] = stub_systick;
+		ran_number[ran_count] = number;
+	}
+	ran_count++;
+	return true;
+}
+
+static void count_cleanup(uint8_t* data)
+{
+	(void)data;
+	cleanups++;
+}
+
+/*
+ * Main loop : run the interrupt queue, with some other work queued each time,
+ * until nothing is left to do
+ */
+static void run_loop(bool with_work)
+{
+	for (uint32_t i = 0; i < 100000; ++i)
+	{
+		if (with_work)
+			hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_LOW_PRIO,
+													 work, NULL, NULL);
+		hydra_interrupt_queue_run_budget(0, 0, NULL);
+		if (hydra_interrupt_queue_timer_pending() == 0)
+			return;
+		advance_us(LOOP_STEP_US);
+	}
+	errors++;
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	hspi_init(HSPI_TYPE_HOST, HSPI_DATASIZE_32, PACKET_SIZE);
+	timer_count = 0;
+	errors = 0;
+	sent_count = 0;
+	work_count = 0;
+	ran_count = 0;
+	cleanups = 0;
+}
+
+static bool send_numbered(uint8_t number)
+{
+	uint8_t packet[PACKET_SIZE] = { number };
+	return hspi_send(packet, PACKET_SIZE, number);
+}
+
+static bool test_send_gap(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+	const uint64_t gap = (uint64_t)HSPI_SEND_GAP_US * STUB_TICKS_PER_US;
+	const uint64_t late = (uint64_t)(INTERRUPT_QUEUE_TIMER_RESOLUTION_US +
+									 2 * LOOP_STEP_US) *
+						  STUB_TICKS_PER_US;
+
+	// a burst of transmissions, and a few more while the first ones wait
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		if (!send_numbered(i))
+			return false;
+	}
+	hydra_interrupt_queue_run();
+	advance_us(HSPI_SEND_GAP_US / 2);
+	for (uint8_t i = 8; i < 12; ++i)
+	{
+		if (!send_numbered(i))
+			return false;
+	}
+	run_loop(true);
+
+	if (sent_count != 12)
+		return false;
+	for (uint32_t i = 0; i < sent_count; ++i)
+	{
+		if (sent_number[i] != i)
+			return false;
+		if (i == 0)
+			continue;
+		// the ticks count down
+		uint64_t elapsed = sent_at[i - 1] - sent_at[i];
+		if (elapsed < gap || elapsed > gap + late)
+		{
+			printf("transmission %u %llu ticks after the previous one\n", i,
+				   (unsigned long long)elapsed);
+			return false;
+		}
+		// the main loop kept running during the gap
+		if (work_at_send[i] <= work_at_send[i - 1] + 1)
+			return false;
+	}
+
+	printf("send gap: %u transmissions, %u other tasks\n", sent_count,
+		   work_count);
+	// every deferred transmission released its buffer
+	return errors == 0 && ramx_pool_stats_used() == used &&
+		   hydra_interrupt_queue_timer_pending() == 0;
+}
+
+static bool test_timer_order(void)
+{
+	reset();
+	const uint64_t resolution =
+		(uint64_t)INTERRUPT_QUEUE_TIMER_RESOLUTION_US * STUB_TICKS_PER_US;
+	const uint64_t start = stub_systick;
+	uint64_t deadlines[MAX_RECORDS];
+
+	// deadlines over several turns of the wheel, some of them equal
+	for (uint32_t i = 0; i < INTERRUPT_QUEUE_TIMERS; ++i)
+	{
+		uint32_t delay_us = 50 + (i * 7919u) %
+									 (3 * INTERRUPT_QUEUE_TIMER_SLOTS *
+									  INTERRUPT_QUEUE_TIMER_RESOLUTION_US);
+		if (i % 5 == 4)
+			delay_us = 1000;
+		deadlines[i] = start - (uint64_t)delay_us * STUB_TICKS_PER_US;
+		if (!hydra_interrupt_queue_set_task_at(
+				deadlines[i], HYDRA_INTERRUPT_QUEUE_HIGH_PRIO, record, &i,
+				sizeof(i), count_cleanup))
+			return false;
+		advance_us(1);
+	}
+	uint32_t extra = 0;
+	if (hydra_interrupt_queue_set_task_after(10, HYDRA_INTERRUPT_QUEUE_HIGH_PRIO,
+											 record, &extra, sizeof(extra),
+											 NULL))
+		return false; // no timer left
+
+	run_loop(false);
+	if (ran_count != INTERRUPT_QUEUE_TIMERS || cleanups != ran_count)
+		return false;
+
+	uint32_t last_equal = 0;
+	bool seen_equal = false;
+	for (uint32_t i = 0; i < ran_count; ++i)
+	{
+		uint32_t number = ran_number[i];
+		if (ran_at[i] > deadlines[number] ||
+			deadlines[number] - ran_at[i] > resolution + 2 * LOOP_STEP_US * STUB_TICKS_PER_US)
+		{
+			printf("task %u ran %lld ticks after its deadline\n", number,
+				   (long long)(deadlines[number] - ran_at[i]));
+			return false;
+		}
+		// the same deadline, in the order they were added
+		if (number % 5 == 4)
+		{
+			if (seen_equal && number < last_equal)
+				return false;
+			last_equal = number;
+			seen_equal = true;
+		}
+	}
+	return errors == 0;
+}
+
+static bool test_timer_catch_up(void)
+{
+	reset();
+
+	for (uint32_t i = 0; i < 10; ++i)
+	{
+		if (!hydra_interrupt_queue_set_task_after(
+				i * 400, HYDRA_INTERRUPT_QUEUE_LOW_PRIO, record, &i, sizeof(i),
+				NULL))
+			return false;
+	}
+	// the timer interrupt was masked for more than a turn of the wheel : a
+	// single interrupt moves every due task
+	stub_systick -= (uint64_t)4000 * STUB_TICKS_PER_US;
+	hydra_interrupt_queue_timer_irq();
+	if (hydra_interrupt_queue_timer_pending() != 0 ||
+		(R8_TMR0_CTRL_MOD & RB_TMR_COUNT_EN))
+		return false;
+	run_loop(false);
+	uint32_t seen = 0;
+	for (uint32_t i = 0; i < ran_count; ++i)
+		seen |= 1u << ran_number[i];
+	// the slots are seen once, from the oldest one : after a catch-up, only the
+	// tasks of a same slot are sure to keep their order
+	return ran_count == 10 && seen == (1u << 10) - 1;
+}
+
+static bool test_timer_queue_full(void)
+{
+	reset();
+
+	// the queue of the timed tasks is almost full when they are due
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		if (!hydra_interrupt_queue_set_task_after(
+				100, HYDRA_INTERRUPT_QUEUE_HIGH_PRIO, record, &i, sizeof(i), NULL))
+			return false;
+	}
+	for (uint32_t i = 0; i < INTERRUPT_QUEUE_SIZE - 2; ++i)
+		hydra_interrupt_queue_set_next_task(work, NULL, NULL);
+	advance_us(200);
+	if (hydra_interrupt_queue_timer_pending() != 4)
+		return false;
+
+	// the others are moved by the next interrupts, in order
+	run_loop(false);
+	for (uint32_t i = 0; i < ran_count; ++i)
+	{
+		if (ran_number[i] != i)
+			return false;
+	}
+	return errors == 0 && ran_count == 6 &&
+		   work_count == INTERRUPT_QUEUE_SIZE - 2;
+}
+
+static bool test_timer_free_all(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		if (!send_numbered(i))
+			return false;
+	}
+	hydra_interrupt_queue_run();
+	hydra_interrupt_queue_run();
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		if (!hydra_interrupt_queue_set_task_after(
+				100 * i, HYDRA_INTERRUPT_QUEUE_LOW_PRIO, record, &i, sizeof(i),
+				count_cleanup))
+			return false;
+	}
+
+	// the deferred transmissions give their buffers back
+	hydra_interrupt_queue_free_all();
+	if (sent_count != 1 || ran_count != 0 || cleanups != 3 ||
+		hydra_interrupt_queue_timer_pending() != 0 ||
+		ramx_pool_stats_used() != used || (R8_TMR0_CTRL_MOD & RB_TMR_COUNT_EN))
+		return false;
+
+	// and do not hold back the next transmission
+	advance_us(HSPI_SEND_GAP_US);
+	if (!send_numbered(4))
+		return false;
+	hydra_interrupt_queue_run();
+	return sent_count == 2 && sent_number[1] == 4 &&
+		   ramx_pool_stats_used() == used;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_send_gap),
+	TEST(test_timer_order),
+	TEST(test_timer_catch_up),
+	TEST(test_timer_queue_full),
+	TEST(test_timer_free_all),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Test of the pipelined TX path of hspi_scheduled (HSPI_TX_PIPELINED). The test
+ * plays the HSPI peripheral : HSPI_DMA_Tx puts the DMA selected by the toggle
+ * bit on the wire, and the test ends the transmission by flipping the toggle
+ * bit and calling HSPI_IRQHandler with RB_HSPI_IF_T_DONE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+
+#define PACKET_SIZE 512
+#define TX_RING_SIZE (1 << HSPI_TX_RING_LOG2_SIZE)
+#define MAX_RECORDS 64
+
+size_t bsp_critical_nesting;
+
+void HSPI_IRQHandler(void);
+
+static uint32_t errors;
+static bool on_wire;
+static uint32_t started;
+static uint8_t started_number[MAX_RECORDS];
+// address loaded in the idle DMA when each transmission ended
+static uint32_t ended_other[MAX_RECORDS];
+static uint32_t ended;
+static uint32_t done_count;
+static uint16_t done_number[MAX_RECORDS];
+
+void HSPI_DMA_Tx(void)
+{
+	bool tog = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) != 0;
+	uint32_t address = tog ? R32_HSPI_TX_ADDR1 : R32_HSPI_TX_ADDR0;
+	uint32_t udf = tog ? R32_HSPI_UDF1 : R32_HSPI_UDF0;
+	uint8_t* buffer = (uint8_t*)(uintptr_t)address;
+
+	if (on_wire || buffer == NULL || !ramx_address_in_pool(buffer))
+	{
+		printf("transmission %u: started with %x, on wire %d\n", started,
+			   address, on_wire);
+		errors++;
+		return;
+	}
+	// the header is programmed with the address
+	if ((udf & HSPI_SERDES_TX_SIZE_MASK) != PACKET_SIZE ||
+		(udf >> 13) != buffer[0])
+	{
+		printf("transmission %u: header %x for packet %u\n", started, udf,
+			   buffer[0]);
+		errors++;
+	}
+	if (started < MAX_RECORDS)
+	{
+		started_number[started] = buffer[0];
+	}
+	started++;
+	on_wire = true;
+}
+
+/*
+ * End the transmission on the wire, like the peripheral does
+ */
+static bool end_transmission(void)
+{
+	if (!on_wire)
+		return false;
+	on_wire = false;
+	if (ended < MAX_RECORDS)
+		ended_other[ended] = (R8_HSPI_TX_SC & RB_HSPI_TX_TOG) ? R32_HSPI_TX_ADDR0
+															  : R32_HSPI_TX_ADDR1;
+	ended++;
+	R8_HSPI_TX_SC ^= RB_HSPI_TX_TOG;
+	R8_HSPI_INT_FLAG = RB_HSPI_IF_T_DONE;
+	HSPI_IRQHandler();
+	return true;
+}
+
+static void tx_done_callback(uint16_t custom_register)
+{
+	if (done_count < MAX_RECORDS)
+		done_number[done_count] = custom_register;
+	done_count++;
+}
+
+static bool work(uint8_t* data)
+{
+	(void)data;
+	return true;
+}
+
+static void reset(void)
+{
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	R8_HSPI_TX_SC = 0;
+	hspi_init(HSPI_TYPE_HOST, HSPI_DATASIZE_32, PACKET_SIZE);
+	errors = 0;
+	on_wire = false;
+	started = 0;
+	ended = 0;
+	done_count = 0;
+}
+
+static bool send_numbered(uint8_t number)
+{
+	uint8_t packet[PACKET_SIZE] = { number };
+	return hspi_send(packet, PACKET_SIZE, number);
+}
+
+static bool test_tx_ring_pipelined(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!(R8_HSPI_INT_EN & RB_HSPI_IE_T_DONE))
+		return false;
+	for (uint8_t i = 0; i < 6; ++i)
+	{
+		if (!send_numbered(i))
+			return false;
+	}
+	// the first transmission starts at once, the others wait in the ring and
+	// in the other DMA
+	if (started != 1 || hspi_tx_pending() != 6)
+		return false;
+
+	// each transmission starts from the interrupt handler of the previous one,
+	// the main loop does not run
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		if (!end_transmission())
+			return false;
+	}
+	if (started != 6 || on_wire || hspi_tx_pending() != 0)
+		return false;
+	for (uint32_t i = 0; i < started; ++i)
+	{
+		if (started_number[i] != i)
+			return false;
+		// the next transmission was loaded while this one was on the wire
+		uint8_t* other = (uint8_t*)(uintptr_t)ended_other[i];
+		if (i + 1 < started && (other == NULL || other[0] != i + 1))
+			return false;
+	}
+
+	// the completions run on the interrupt queue, and release the buffers
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	for (uint32_t i = 0; i < done_count; ++i)
+	{
+		if (done_number[i] != i)
+			return false;
+	}
+	return errors == 0 && done_count == 6 && ramx_pool_stats_used() == used;
+}
+
+static bool test_tx_ring_full(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	// the link is stalled : the ring and both DMAs fill up
+	uint32_t accepted = 0;
+	while (send_numbered((uint8_t)accepted))
+		accepted++;
+	if (accepted != TX_RING_SIZE + 2 || hspi_tx_pending() != accepted)
+		return false;
+
+	// sending resumes once the link does, and nothing leaked
+	for (uint32_t i = 0; i < accepted; ++i)
+	{
+		if (!end_transmission())
+			return false;
+		hydra_interrupt_queue_run_budget(0, 0, NULL);
+		if (i == 0 && !send_numbered((uint8_t)accepted))
+			return false;
+	}
+	if (!end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	for (uint32_t i = 0; i < started; ++i)
+	{
+		if (started_number[i] != i)
+			return false;
+	}
+	return errors == 0 && started == accepted + 1 && done_count == started &&
+		   ramx_pool_stats_used() == used;
+}
+
+static bool test_tx_ring_queue_full(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	if (!send_numbered(0) || !send_numbered(1))
+		return false;
+	// the completion cannot be handed over to the interrupt queue : the buffer
+	// is released by the interrupt handler, and the next transmission starts
+	while (hydra_interrupt_queue_set_next_task(work, NULL, NULL))
+	{
+	}
+	if (!end_transmission() || started != 2)
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	if (!end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	return errors == 0 && done_count == 1 && done_number[0] == 1 &&
+		   ramx_pool_stats_used() == used;
+}
+
+static bool test_tx_ring_send_buf(void)
+{
+	reset();
+	uint16_t used = ramx_pool_stats_used();
+
+	// the same buffer sent twice, while the application still holds it
+	hydra_buf_t buf = { .base = ramx_pool_alloc_bytes(PACKET_SIZE),
+						.offset = 0,
+						.length = PACKET_SIZE };
+	if (buf.base == NULL)
+		return false;
+	buf.base[0] = 3;
+	if (!hspi_send_buf(&buf, 3) || !hspi_send_buf(&buf, 3))
+		return false;
+	buf_unref(&buf);
+	if (!end_transmission() || !end_transmission())
+		return false;
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	return errors == 0 && started == 2 && done_count == 2 &&
+		   ramx_pool_stats_used() == used;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_tx_ring_pipelined),
+	TEST(test_tx_ring_full),
+	TEST(test_tx_ring_queue_full),
+	TEST(test_tx_ring_send_buf),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	hspi_scheduled_user_handled.hspi_tx_done_callback = tx_done_callback;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
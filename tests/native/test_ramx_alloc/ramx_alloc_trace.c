@@ -0,0 +1,340 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Replay a trace of allocations and frees on ramx_pool, and print the success
+ * rate and the duration of the calls, to compare the backends on the same
+ * trace.
+ *
+ * A trace is a text file, one operation per line :
+ *   a <id> <bytes>   ramx_pool_alloc_bytes(bytes), the result is called id
+ *   f <id>           ramx_pool_free(id)
+ * id is any 32-bit number, e.g. the address returned on the target. Frees of an
+ * id whose allocation failed are skipped.
+ *
+ * Without a trace file, a synthetic trace is replayed : a long session mixing
+ * 64-byte control buffers, some of them kept for a long time, and short-lived
+ * 4KiB bulk buffers. -w <file> writes it, so that it can be edited or compared
+ * to a recorded one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+size_t bsp_critical_nesting;
+
+#define MAX_LIVE 4096 // allocations alive at the same time
+#define SYNTHETIC_STEPS 200000
+
+typedef struct op
+{
+	bool alloc;
+	uint32_t id;
+	uint32_t bytes;
+} op_t;
+
+static op_t* trace;
+static size_t trace_len;
+static size_t trace_cap;
+
+static void trace_add(bool alloc, uint32_t id, uint32_t bytes)
+{
+	if (trace_len == trace_cap)
+	{
+		trace_cap = trace_cap == 0 ? 1024 : trace_cap * 2;
+		trace = realloc(trace, trace_cap * sizeof(op_t));
+		if (trace == NULL)
+		{
+			perror("realloc");
+			exit(1);
+		}
+	}
+	trace[trace_len++] = (op_t){ .alloc = alloc, .id = id, .bytes = bytes };
+}
+
+static bool trace_load(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	char line[128];
+	char kind;
+	unsigned long id, bytes;
+
+	if (file == NULL)
+	{
+		perror(path);
+		return false;
+	}
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, " a %lu %lu", &id, &bytes) == 2)
+			trace_add(true, (uint32_t)id, (uint32_t)bytes);
+		else if (sscanf(line, " f %lu", &id) == 1)
+			trace_add(false, (uint32_t)id, 0);
+		else if (sscanf(line, " %c", &kind) == 1 && kind != '#')
+		{
+			fprintf(stderr, "%s: cannot parse %s", path, line);
+			fclose(file);
+			return false;
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+static uint32_t seed = 1;
+
+static uint32_t rand_next(uint32_t max)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % max;
+}
+
+/*
+ * Synthetic session : about three quarters of the pool is used on average. Control
+ * buffers (64 to 512 bytes) are freed after a few operations, except one in
+ * twenty which is kept for thousands of operations. Bulk buffers (4KiB) are
+ * freed after a few operations.
+ */
+static void trace_generate(void)
+{
+	static uint32_t expiry[MAX_LIVE];
+	static uint32_t live_id[MAX_LIVE];
+	static uint32_t live_bytes[MAX_LIVE];
+	uint32_t live = 0;
+	uint32_t live_total = 0;
+	uint32_t next_id = 1;
+
+	for (uint32_t step = 0; step < SYNTHETIC_STEPS; ++step)
+	{
+		for (uint32_t i = 0; i < live;)
+		{
+			if (expiry[i] <= step)
+			{
+				trace_add(false, live_id[i], 0);
+				live_total -= live_bytes[i];
+				live--;
+				expiry[i] = expiry[live];
+				live_id[i] = live_id[live];
+				live_bytes[i] = live_bytes[live];
+			}
+			else
+				++i;
+		}
+
+		if (live == MAX_LIVE || live_total > POOL_BUFFER_SIZE * 3 / 4)
+			continue;
+
+		uint32_t bytes, lifetime;
+		if (rand_next(100) < 15)
+		{
+			bytes = 4096;
+			lifetime = 1 + rand_next(40);
+		}
+		else
+		{
+			static const uint32_t control_sizes[] = { 64, 64, 64, 128, 512 };
+			bytes = control_sizes[rand_next(5)];
+			lifetime = rand_next(20) == 0 ? 1000 + rand_next(20000)
+										  : 1 + rand_next(40);
+		}
+		trace_add(true, next_id, bytes);
+		expiry[live] = step + lifetime;
+		live_id[live] = next_id++;
+		live_bytes[live++] = bytes;
+		live_total += bytes;
+	}
+	for (uint32_t i = 0; i < live; ++i)
+		trace_add(false, live_id[i], 0);
+}
+
+static bool trace_write(const char* path)
+{
+	FILE* file = fopen(path, "w");
+
+	if (file == NULL)
+	{
+		perror(path);
+		return false;
+	}
+	for (size_t i = 0; i < trace_len; ++i)
+	{
+		if (trace[i].alloc)
+			fprintf(file, "a %u %u\n", trace[i].id, trace[i].bytes);
+		else
+			fprintf(file, "f %u\n", trace[i].id);
+	}
+	fclose(file);
+	return true;
+}
+
+/* ids of the live allocations, open addressing */
+typedef struct live_entry
+{
+	uint32_t id;
+	uint8_t* ptr;
+	bool used;
+} live_entry_t;
+
+static live_entry_t live_table[2 * MAX_LIVE];
+
+static live_entry_t* live_find(uint32_t id, bool insert)
+{
+	uint32_t slot = (id * 2654435761u) % (2 * MAX_LIVE);
+
+	for (uint32_t i = 0; i < 2 * MAX_LIVE; ++i)
+	{
+		live_entry_t* entry = &live_table[(slot + i) % (2 * MAX_LIVE)];
+		if (entry->used && entry->id == id)
+			return entry;
+		if (!entry->used)
+			return insert ? entry : NULL;
+	}
+	return NULL;
+}
+
+static void live_remove(live_entry_t* entry)
+{
+	uint32_t slot = (uint32_t)(entry - live_table);
+
+	// move the following entries of the cluster back, so that lookups still
+	// find them
+	entry->used = false;
+	for (uint32_t i = (slot + 1) % (2 * MAX_LIVE); live_table[i].used;
+		 i = (i + 1) % (2 * MAX_LIVE))
+	{
+		live_entry_t moved = live_table[i];
+		live_table[i].used = false;
+		*live_find(moved.id, true) = moved;
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int replay(void)
+{
+	uint32_t allocs = 0, failures = 0, frees = 0;
+	uint64_t free_blocks_at_failure = 0;
+	uint64_t alloc_ns = 0, alloc_max_ns = 0, free_ns = 0, free_max_ns = 0;
+
+	ramx_pool_init();
+	memset(live_table, 0, sizeof(live_table));
+
+	for (size_t i = 0; i < trace_len; ++i)
+	{
+		if (trace[i].alloc)
+		{
+			live_entry_t* entry = live_find(trace[i].id, true);
+			if (entry == NULL || entry->used)
+			{
+				fprintf(stderr, "op %zu: id %u already allocated or too many live ids\n",
+						i, trace[i].id);
+				return 1;
+			}
+			uint64_t start = now_ns();
+			uint8_t* ptr = ramx_pool_alloc_bytes(trace[i].bytes);
+			uint64_t ns = now_ns() - start;
+			alloc_ns += ns;
+			alloc_max_ns = ns > alloc_max_ns ? ns : alloc_max_ns;
+			allocs++;
+			if (ptr == NULL)
+			{
+				failures++;
+				free_blocks_at_failure += ramx_pool_stats_free();
+				continue;
+			}
+			*entry = (live_entry_t){ .id = trace[i].id, .ptr = ptr, .used = true };
+		}
+		else
+		{
+			live_entry_t* entry = live_find(trace[i].id, false);
+			if (entry == NULL)
+				continue;
+			uint64_t start = now_ns();
+			ramx_pool_free(entry->ptr);
+			uint64_t ns = now_ns() - start;
+			free_ns += ns;
+			free_max_ns = ns > free_max_ns ? ns : free_max_ns;
+			frees++;
+			live_remove(entry);
+		}
+	}
+
+	printf("%u allocations, %u failed (%.2f%% success)", allocs, failures,
+		   allocs ? 100.0 * (allocs - failures) / allocs : 100.0);
+	if (failures > 0)
+		printf(", %.1f blocks free on average when failing",
+			   (double)free_blocks_at_failure / failures);
+	printf("\nalloc %.0f ns average, %llu ns max / free %.0f ns average, %llu ns max\n",
+		   allocs ? (double)alloc_ns / allocs : 0.0, (unsigned long long)alloc_max_ns,
+		   frees ? (double)free_ns / frees : 0.0, (unsigned long long)free_max_ns);
+	// only counted by the first fit search
+	if (ramx_pool.telemetry.blocks_scanned > 0)
+		printf("%.1f blocks scanned per allocation on average\n",
+			   (double)ramx_pool.telemetry.blocks_scanned / allocs);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* write_path = NULL;
+	const char* read_path = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			write_path = argv[++i];
+		else
+			read_path = argv[i];
+	}
+
+	if (read_path != NULL)
+	{
+		if (!trace_load(read_path))
+			return 1;
+	}
+	else
+		trace_generate();
+
+	if (write_path != NULL)
+		return trace_write(write_path) ? 0 : 1;
+
+#ifdef RAMX_ALLOC_BITMAP
+	printf("ramx_pool backend: bitmap, %d blocks of %d bytes, %zu operations\n",
+		   POOL_BLOCK_NUM, POOL_BLOCK_SIZE, trace_len);
+#elif defined(RAMX_ALLOC_BUDDY)
+	printf("ramx_pool backend: buddy, %d blocks of %d bytes, %zu operations\n",
+		   POOL_BLOCK_NUM, POOL_BLOCK_SIZE, trace_len);
+#elif defined(RAMX_ALLOC_NEXT_FIT)
+	printf("ramx_pool backend: next fit, %d blocks of %d bytes, %zu operations\n",
+		   POOL_BLOCK_NUM, POOL_BLOCK_SIZE, trace_len);
+#else
+	printf("ramx_pool backend: first fit, %d blocks of %d bytes, %zu operations\n",
+		   POOL_BLOCK_NUM, POOL_BLOCK_SIZE, trace_len);
+#endif
+	return replay();
+}
@@ -0,0 +1,17 @@
+/*
+ * Host stub of the BSP, enough to compile the allocators natively. The tests
+ * are single-threaded, so critical sections do nothing.
+ */
+#ifndef CH56X_COMMON_STUB_H
+#define CH56X_COMMON_STUB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef volatile uint32_t vuint32_t;
+
+static inline void bsp_disable_interrupt(void) {}
+static inline void bsp_enable_interrupt(void) {}
+
+#endif
@@ -0,0 +1,51 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * ram_pool test, in its own file because alloc.h and ramx_alloc.h both define
+ * pool_t.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wch-ch56x-lib/memory/alloc.h"
+
+bool test_ram_pool_1024(void);
+bool test_ram_pool_1024(void)
+{
+	pool_init();
+
+	uint8_t* first = pool_alloc_blocks(600);
+	uint8_t* second = pool_alloc_bytes((POOL_BLOCK_NUM - 600) * POOL_BLOCK_SIZE);
+	if (first == NULL || second != first + 600 * POOL_BLOCK_SIZE ||
+		pool_stats_free() != 0 || pool_alloc_blocks(1) != NULL)
+		return false;
+
+	pool_free(first);
+	if (pool_stats_used() != POOL_BLOCK_NUM - 600 ||
+		pool_stats_largest_free_run() != 600 || pool_stats_blocks()[1023] != 424)
+		return false;
+	pool_free(second);
+
+	if (pool_alloc_bytes((POOL_BLOCK_NUM + 1) * POOL_BLOCK_SIZE) != NULL ||
+		pool_stats_telemetry()->failures != 2)
+		return false;
+
+	return pool_stats_used() == 0 &&
+		   pool_stats_largest_free_run() == POOL_BLOCK_NUM;
+}
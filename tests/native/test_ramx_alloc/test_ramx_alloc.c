@@ -0,0 +1,353 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Tests of ramx_pool and ram_pool with more blocks than an 8-bit index can
+ * hold. The allocators are compiled with POOL_BLOCK_NUM=1024, so
+ * POOL_INDEX_BITS defaults to 16.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test_memory_allocator.h"
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+size_t bsp_critical_nesting;
+
+typedef char test_pool_index_is_16_bits[sizeof(pool_index_t) == 2 ? 1 : -1];
+
+bool test_ram_pool_1024(void);
+
+static uint8_t* block(uint32_t index)
+{
+	return ramx_pool.pool + index * POOL_BLOCK_SIZE;
+}
+
+#ifndef RAMX_ALLOC_BUDDY
+static bool test_ramx_1024_alloc_all(void)
+{
+	ramx_pool_init();
+
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+	{
+		if (ramx_pool_alloc_blocks(1) != block(i))
+		{
+			printf("block %u not allocated in order\n", i);
+			return false;
+		}
+	}
+	if (ramx_pool_stats_used() != POOL_BLOCK_NUM || ramx_pool_stats_free() != 0 ||
+		ramx_pool_alloc_blocks(1) != NULL)
+		return false;
+
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_free(block(i));
+
+	return ramx_pool_stats_free() == POOL_BLOCK_NUM &&
+		   ramx_pool_stats_largest_free_run() == POOL_BLOCK_NUM;
+}
+
+static bool test_ramx_1024_long_runs(void)
+{
+	ramx_pool_init();
+
+	// runs longer than 255 blocks
+	uint8_t* first = ramx_pool_alloc_blocks(600);
+	if (first != block(0) || ramx_pool.headers[0].num_blocks != 600)
+		return false;
+	if (ramx_pool_alloc_blocks(600) != NULL)
+		return false;
+	uint8_t* second = ramx_pool_alloc_blocks(POOL_BLOCK_NUM - 600);
+	if (second != block(600) || ramx_pool_stats_free() != 0)
+		return false;
+
+	ramx_pool_free(first);
+	if (ramx_pool_stats_used() != POOL_BLOCK_NUM - 600 ||
+		ramx_pool_stats_largest_free_run() != 600)
+		return false;
+	ramx_pool_free(second);
+
+	// the whole pool at once
+	uint8_t* all = ramx_pool_alloc_blocks(POOL_BLOCK_NUM);
+	bool ok = all == block(0) && ramx_pool_stats_free() == 0;
+	ramx_pool_free(all);
+
+	return ok && ramx_pool_stats_used() == 0;
+}
+
+static bool test_ramx_1024_high_indexes(void)
+{
+	ramx_pool_init();
+
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_alloc_blocks(1);
+
+	// the only free run is past index 255 (and 511, 767)
+	for (uint32_t i = 1000; i < 1010; ++i)
+		ramx_pool_free(block(i));
+	uint8_t* mem = ramx_pool_alloc_blocks(10);
+	if (mem != block(1000))
+		return false;
+
+	// reference counting of a block past index 255
+	ramx_take_ownership(mem);
+	ramx_pool_free(mem);
+	if (ramx_pool_stats_free() != 0)
+		return false;
+	ramx_pool_free(mem);
+	if (ramx_pool_stats_free() != 10)
+		return false;
+
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_free(block(i));
+
+	return ramx_pool_stats_used() == 0;
+}
+
+static bool test_ramx_1024_alloc_bytes(void)
+{
+	ramx_pool_init();
+
+	// 300 blocks, truncated to 44 with 8-bit sizes
+	uint8_t* mem = ramx_pool_alloc_bytes(300 * POOL_BLOCK_SIZE);
+	if (mem == NULL || ramx_pool_stats_used() != 300)
+		return false;
+
+	// bigger than the pool
+	if (ramx_pool_alloc_bytes((POOL_BLOCK_NUM + 1) * POOL_BLOCK_SIZE) != NULL ||
+		ramx_pool.telemetry.failures != 1)
+		return false;
+	// wraps to 1 block with 16-bit sizes
+	if (ramx_pool_alloc_bytes((UINT16_MAX + 2) * POOL_BLOCK_SIZE) != NULL ||
+		ramx_pool.telemetry.failures != 2)
+		return false;
+
+	ramx_pool_free(mem);
+	return ramx_pool_stats_used() == 0 && ramx_pool.telemetry.peak_used == 300;
+}
+#else
+static bool test_ramx_buddy_split_merge(void)
+{
+	ramx_pool_init();
+
+	// the pool is split down to the requested size, lower halves first
+	uint8_t* one = ramx_pool_alloc_blocks(1);
+	uint8_t* two = ramx_pool_alloc_blocks(2);
+	uint8_t* other = ramx_pool_alloc_blocks(1);
+	uint8_t* big = ramx_pool_alloc_blocks(300);
+	if (one != block(0) || two != block(2) || other != block(1) ||
+		big != block(512) || ramx_pool_stats_used() != 4 + 512 ||
+		ramx_pool_stats_largest_free_run() != 256)
+		return false;
+
+	// 3 blocks are rounded to 4, merged back once every neighbour is free
+	ramx_pool_free(one);
+	ramx_pool_free(two);
+	if (ramx_pool_stats_largest_free_run() != 256 ||
+		ramx_pool_alloc_blocks(3) != block(4))
+		return false;
+	ramx_pool_free(block(4));
+	ramx_pool_free(other);
+	if (ramx_pool_stats_largest_free_run() != 512)
+		return false;
+	ramx_pool_free(big);
+
+	return ramx_pool_stats_used() == 0 &&
+		   ramx_pool_stats_largest_free_run() == POOL_BLOCK_NUM;
+}
+
+static bool test_ramx_buddy_rounding(void)
+{
+	ramx_pool_init();
+
+	// 600 blocks use the whole pool
+	uint8_t* mem = ramx_pool_alloc_bytes(600 * POOL_BLOCK_SIZE);
+	if (mem != block(0) || ramx_pool_stats_used() != POOL_BLOCK_NUM ||
+		ramx_pool_alloc_blocks(1) != NULL)
+		return false;
+
+	// reference counting is the same as the other backends
+	ramx_take_ownership(mem);
+	ramx_pool_free(mem);
+	if (ramx_pool_stats_used() != POOL_BLOCK_NUM)
+		return false;
+	ramx_pool_free(mem);
+
+	return ramx_pool_stats_used() == 0 && ramx_pool.telemetry.failures == 1 &&
+		   ramx_pool.telemetry.peak_used == POOL_BLOCK_NUM;
+}
+#endif
+
+#ifdef RAMX_ALLOC_NEXT_FIT
+static bool test_ramx_next_fit(void)
+{
+	ramx_pool_init();
+
+	// long-lived buffers at the start of the pool
+	uint8_t* held = ramx_pool_alloc_blocks(512);
+	uint8_t* first = ramx_pool_alloc_blocks(1);
+	ramx_pool_free(first);
+	uint32_t scanned = ramx_pool.telemetry.blocks_scanned;
+
+	// the search starts after the last allocation, not at block 0
+	uint8_t* second = ramx_pool_alloc_blocks(1);
+	if (held != block(0) || first != block(512) || second != block(513) ||
+		ramx_pool.telemetry.blocks_scanned - scanned != 1)
+		return false;
+
+	// and wraps around
+	uint8_t* end = ramx_pool_alloc_blocks(POOL_BLOCK_NUM - 514);
+	ramx_pool_free(held);
+	uint8_t* wrapped = ramx_pool_alloc_blocks(2);
+	if (end != block(514) || wrapped != block(0))
+		return false;
+
+	ramx_pool_free(second);
+	ramx_pool_free(end);
+	ramx_pool_free(wrapped);
+	return ramx_pool_stats_used() == 0;
+}
+#endif
+
+/*
+ * Random allocations and frees, checking that no block is given twice and that
+ * the statistics match the blocks actually held.
+ */
+static bool test_ramx_random(void)
+{
+	static uint8_t* held[POOL_BLOCK_NUM];
+	static uint32_t held_blocks[POOL_BLOCK_NUM];
+	static uint16_t owner[POOL_BLOCK_NUM];
+	uint32_t num_held = 0;
+	uint32_t used = 0;
+	uint32_t seed = 12345;
+
+	ramx_pool_init();
+	memset(owner, 0, sizeof(owner));
+
+	for (uint32_t step = 0; step < 200000; ++step)
+	{
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 2 == 0 && num_held > 0)
+		{
+			uint32_t victim = (seed >> 8) % num_held;
+			uint32_t start = (uint32_t)(held[victim] - ramx_pool.pool) / POOL_BLOCK_SIZE;
+			for (uint32_t i = 0; i < held_blocks[victim]; ++i)
+				owner[start + i] = 0;
+			ramx_pool_free(held[victim]);
+			used -= held_blocks[victim];
+			held[victim] = held[--num_held];
+			held_blocks[victim] = held_blocks[num_held];
+		}
+		else
+		{
+			// mostly small buffers, some large ones
+			uint32_t num_blocks = (seed >> 20) % 8 == 0 ? 1 + (seed >> 8) % 64
+													   : 1 + (seed >> 8) % 4;
+			uint8_t* mem = ramx_pool_alloc_blocks((pool_index_t)num_blocks);
+			if (mem == NULL)
+				continue;
+			uint32_t start = (uint32_t)(mem - ramx_pool.pool) / POOL_BLOCK_SIZE;
+			num_blocks = ramx_pool_blocks_for(num_blocks);
+			for (uint32_t i = 0; i < num_blocks; ++i)
+			{
+				if (start + i >= POOL_BLOCK_NUM || owner[start + i] != 0)
+				{
+					printf("step %u: block %u given twice\n", step, start + i);
+					return false;
+				}
+				owner[start + i] = (uint16_t)(num_held + 1);
+			}
+			held[num_held] = mem;
+			held_blocks[num_held++] = num_blocks;
+			used += num_blocks;
+		}
+		if (ramx_pool_stats_used() != used)
+		{
+			printf("step %u: %u blocks used, %u expected\n", step,
+				   ramx_pool_stats_used(), used);
+			return false;
+		}
+	}
+
+	while (num_held > 0)
+		ramx_pool_free(held[--num_held]);
+
+	return ramx_pool_stats_used() == 0 &&
+		   ramx_pool_stats_largest_free_run() == POOL_BLOCK_NUM;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_memory_allocator_ramx_alloc_bytes),
+	TEST(test_memory_allocator_ramx_alloc_all_blocks),
+	TEST(test_memory_allocator_ramx_alloc_too_many_blocks),
+	TEST(test_memory_allocator_ramx_alloc_double_free),
+	TEST(test_memory_allocator_ramx_fan_out),
+	TEST(test_memory_allocator_ramx_fan_out_interleaved),
+	TEST(test_memory_allocator_ramx_telemetry),
+	TEST(test_memory_allocator_ramx_alloc_many),
+	TEST(test_memory_allocator_ramx_alloc_many_atomic),
+#ifndef RAMX_ALLOC_BUDDY
+	TEST(test_ramx_1024_alloc_all),
+	TEST(test_ramx_1024_long_runs),
+	TEST(test_ramx_1024_high_indexes),
+	TEST(test_ramx_1024_alloc_bytes),
+#else
+	TEST(test_ramx_buddy_split_merge),
+	TEST(test_ramx_buddy_rounding),
+#endif
+#ifdef RAMX_ALLOC_NEXT_FIT
+	TEST(test_ramx_next_fit),
+#endif
+	TEST(test_ramx_random),
+	TEST(test_ram_pool_1024),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+#ifdef RAMX_ALLOC_BITMAP
+	printf("ramx_pool backend: bitmap, %d blocks\n", POOL_BLOCK_NUM);
+#elif defined(RAMX_ALLOC_BUDDY)
+	printf("ramx_pool backend: buddy, %d blocks\n", POOL_BLOCK_NUM);
+#elif defined(RAMX_ALLOC_NEXT_FIT)
+	printf("ramx_pool backend: next fit, %d blocks\n", POOL_BLOCK_NUM);
+#else
+	printf("ramx_pool backend: first fit, %d blocks\n", POOL_BLOCK_NUM);
+#endif
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Tests of the size-class allocator (ramx_alloc), compiled with three classes :
+ * RAMX_CLASS_0 to RAMX_CLASS_2 are set by the Makefile.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wch-ch56x-lib/memory/ramx_class_alloc.h"
+
+size_t bsp_critical_nesting;
+
+static bool in_class(void* ptr, uint8_t class_index)
+{
+	return (uint8_t*)ptr >= ramx_class_pool.classes[class_index].start &&
+		   (uint8_t*)ptr < ramx_class_pool.classes[class_index].end;
+}
+
+static bool test_ramx_class_init(void)
+{
+	ramx_class_pool_init();
+
+	if (ramx_alloc_stats_num_classes() != 3 ||
+		ramx_alloc_stats_slot_size(0) != RAMX_CLASS_0_SIZE ||
+		ramx_alloc_stats_slot_size(1) != RAMX_CLASS_1_SIZE ||
+		ramx_alloc_stats_slot_size(2) != RAMX_CLASS_2_SIZE)
+		return false;
+	for (uint8_t i = 0; i < ramx_alloc_stats_num_classes(); ++i)
+	{
+		if (ramx_alloc_stats_used(i) != 0)
+			return false;
+	}
+	return ramx_alloc_stats_free(0) == RAMX_CLASS_0_NUM &&
+		   ramx_alloc_stats_free(1) == RAMX_CLASS_1_NUM &&
+		   ramx_alloc_stats_free(2) == RAMX_CLASS_2_NUM;
+}
+
+static bool test_ramx_class_selection(void)
+{
+	ramx_class_pool_init();
+
+	// the smallest class that fits
+	uint8_t* small = ramx_alloc(1);
+	uint8_t* exact = ramx_alloc(RAMX_CLASS_0_SIZE);
+	uint8_t* big = ramx_alloc(RAMX_CLASS_0_SIZE + 1);
+	uint8_t* huge = ramx_alloc(RAMX_CLASS_2_SIZE);
+	if (!in_class(small, 0) || !in_class(exact, 0) || !in_class(big, 1) ||
+		!in_class(huge, 2) || small == exact)
+		return false;
+	if (ramx_alloc_stats_used(0) != 2 || ramx_alloc_stats_used(1) != 1 ||
+		ramx_alloc_stats_used(2) != 1)
+		return false;
+
+	// no class holds it
+	if (ramx_alloc(0) != NULL || ramx_alloc(RAMX_CLASS_2_SIZE + 1) != NULL)
+		return false;
+
+	ramx_free(small);
+	ramx_free(exact);
+	ramx_free(big);
+	ramx_free(huge);
+	return ramx_alloc_stats_used(0) == 0 && ramx_alloc_stats_used(1) == 0 &&
+		   ramx_alloc_stats_used(2) == 0;
+}
+
+static bool test_ramx_class_fallback(void)
+{
+	ramx_class_pool_init();
+
+	for (uint16_t i = 0; i < RAMX_CLASS_0_NUM; ++i)
+	{
+		if (!in_class(ramx_alloc(1), 0))
+			return false;
+	}
+	if (ramx_alloc_stats_free(0) != 0)
+		return false;
+
+	// class 0 is full, small requests go to class 1, then class 2
+	for (uint16_t i = 0; i < RAMX_CLASS_1_NUM; ++i)
+	{
+		if (!in_class(ramx_alloc(1), 1))
+			return false;
+	}
+	if (!in_class(ramx_alloc(1), 2))
+		return false;
+
+	// a freed slot of class 0 is taken again first
+	uint8_t* slot = ramx_class_pool.classes[0].start + RAMX_CLASS_0_SIZE;
+	ramx_free(slot);
+	return ramx_alloc_stats_free(0) == 1 && ramx_alloc(1) == slot &&
+		   ramx_alloc_stats_free(0) == 0;
+}
+
+static bool test_ramx_class_refcount(void)
+{
+	ramx_class_pool_init();
+
+	uint8_t* buffer = ramx_alloc(1);
+	ramx_alloc_take_ownership(buffer);
+	ramx_free(buffer);
+	if (ramx_alloc_stats_used(0) != 1)
+		return false;
+	ramx_free(buffer);
+	if (ramx_alloc_stats_used(0) != 0)
+		return false;
+
+	// freeing a free slot, or a pointer outside of the classes, does nothing
+	ramx_free(buffer);
+	ramx_free(&bsp_critical_nesting);
+	ramx_alloc_take_ownership(buffer);
+	return ramx_alloc_stats_used(0) == 0 && ramx_alloc(1) == buffer &&
+		   ramx_alloc_stats_used(0) == 1;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_ramx_class_init),
+	TEST(test_ramx_class_selection),
+	TEST(test_ramx_class_fallback),
+	TEST(test_ramx_class_refcount),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
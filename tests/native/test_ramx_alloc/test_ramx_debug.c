@@ -0,0 +1,196 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+/*
+ * Tests of the ALLOC_DEBUG checks of ramx_pool and hydra_pool. ALLOC_DEBUG
+ * changes the number of blocks taken by ramx_pool_alloc_bytes, so they are not
+ * run with the other tests.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "wch-ch56x-lib/memory/pool.h"
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+size_t bsp_critical_nesting;
+
+HYDRA_POOL_DEF(test_pool, uint32_t, 4);
+
+static bool test_ramx_debug_invalid_free(void)
+{
+	ramx_pool_init();
+
+	uint8_t* mem = ramx_pool_alloc_blocks(2);
+	uint32_t outside = 0;
+
+	ramx_pool_free(&outside);
+	ramx_pool_free(mem + 1); // not the start of a block
+	ramx_pool_free(mem + POOL_BLOCK_SIZE); // not the start of an allocation
+	ramx_take_ownership(mem + 3);
+	if (ramx_pool.debug_errors != 4 || ramx_pool_stats_used() != 2)
+		return false;
+
+	ramx_pool_free(mem);
+	ramx_pool_free(mem); // double free
+	return ramx_pool.debug_errors == 5 && ramx_pool_stats_used() == 0;
+}
+
+static bool test_ramx_debug_guard(void)
+{
+	ramx_pool_init();
+
+	// the guard word takes one more block when the bytes fill the last one
+	uint8_t* full = ramx_pool_alloc_bytes(POOL_BLOCK_SIZE);
+	uint8_t* partial = ramx_pool_alloc_bytes(POOL_BLOCK_SIZE - 8);
+	if (ramx_pool_stats_used() != 3)
+		return false;
+
+	memset(full, 0, POOL_BLOCK_SIZE);
+	memset(partial, 0, POOL_BLOCK_SIZE - 8);
+	ramx_pool_free(full);
+	ramx_pool_free(partial);
+	if (ramx_pool.debug_errors != 0)
+		return false;
+
+	uint8_t* overflow = ramx_pool_alloc_bytes(10);
+	memset(overflow, 0, 11);
+	ramx_pool_free(overflow);
+	return ramx_pool.debug_errors == 1;
+}
+
+static bool test_ramx_debug_poison(void)
+{
+	ramx_pool_init();
+
+	uint8_t* mem = ramx_pool_alloc_blocks(1);
+	mem[0] = 1;
+	ramx_pool_free(mem);
+	if (mem[0] != RAMX_ALLOC_POISON || mem[POOL_BLOCK_SIZE - 1] != RAMX_ALLOC_POISON)
+		return false;
+
+	// a write after the free is found when the block is allocated again
+	mem[5] = 0;
+	if (ramx_pool_alloc_blocks(1) != mem || ramx_pool.debug_errors != 1)
+		return false;
+	ramx_pool_free(mem);
+
+	// an allocation taken by another owner is not poisoned until its last free
+	mem = ramx_pool_alloc_blocks(1);
+	mem[0] = 1;
+	ramx_take_ownership(mem);
+	ramx_pool_free(mem);
+	if (mem[0] != 1)
+		return false;
+	ramx_pool_free(mem);
+	return mem[0] == RAMX_ALLOC_POISON && ramx_pool.debug_errors == 1;
+}
+
+static bool test_ramx_debug_poison_rounded(void)
+{
+	ramx_pool_init();
+
+	uint8_t* mem = ramx_pool_alloc_blocks(4);
+	ramx_pool_free(mem);
+	mem[3 * POOL_BLOCK_SIZE] = 0;
+
+	// the buddy backend rounds 3 blocks up to 4, the write after free is in
+	// the run handed out and found there, not on the next free
+	if (ramx_pool_alloc_blocks(3) != mem)
+		return false;
+	ramx_alloc_header_t* header = &ramx_pool.headers[(mem - ramx_pool.pool) / POOL_BLOCK_SIZE];
+	uint32_t expected_errors = header->num_blocks > 3 ? 1 : 0;
+	if (ramx_pool.debug_errors != expected_errors)
+		return false;
+	ramx_pool_free(mem);
+	return ramx_pool.debug_errors == expected_errors;
+}
+
+static bool test_ramx_debug_owner(void)
+{
+	uint8_t* many[2];
+	const uint32_t sizes[2] = { 10, 100 };
+
+	ramx_pool_init();
+
+	uint32_t line = __LINE__ + 1;
+	uint8_t* mem = ramx_pool_alloc_bytes(10);
+	ramx_alloc_header_t* header = &ramx_pool.headers[(mem - ramx_pool.pool) / POOL_BLOCK_SIZE];
+	if (header->owner_file == NULL || strcmp(header->owner_file, __FILE__) != 0 ||
+		header->owner_line != line || header->size != 10)
+		return false;
+
+	if (!ramx_pool_alloc_many(2, sizes, many))
+		return false;
+	header = &ramx_pool.headers[(many[1] - ramx_pool.pool) / POOL_BLOCK_SIZE];
+	if (header->owner_line != __LINE__ - 3 || header->size != 100)
+		return false;
+
+	ramx_pool_dump();
+	ramx_pool_free(mem);
+	ramx_pool_free_many(2, many);
+	return ramx_pool.debug_errors == 0 && ramx_pool_stats_used() == 0;
+}
+
+static bool test_hydra_pool_debug_invalid_free(void)
+{
+	uint32_t outside = 0;
+	uint32_t* member = hydra_pool_get(&test_pool);
+
+	hydra_pool_free(&test_pool, &outside);
+	hydra_pool_free(&test_pool, (uint8_t*)member + 1);
+	hydra_pool_free(&test_pool, member + 1); // not allocated
+	if (test_pool.debug_errors != 3)
+		return false;
+	hydra_pool_free(&test_pool, member);
+	hydra_pool_free(&test_pool, member);
+	return test_pool.debug_errors == 4;
+}
+
+typedef struct test_t
+{
+	const char* name;
+	bool (*run)(void);
+} test_t;
+
+#define TEST(_name) { #_name, _name }
+
+static const test_t tests[] = {
+	TEST(test_ramx_debug_invalid_free),
+	TEST(test_ramx_debug_guard),
+	TEST(test_ramx_debug_poison),
+	TEST(test_ramx_debug_poison_rounded),
+	TEST(test_ramx_debug_owner),
+	TEST(test_hydra_pool_debug_invalid_free),
+};
+
+int main(void)
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	{
+		bool passed = tests[i].run();
+		printf("%s: %s\n", tests[i].name, passed ? "passed" : "FAILED");
+		ok = ok && passed;
+	}
+
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+// Disable warnings in bsp arising from -pedantic -Wall -Wconversion
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wvariadic-macros"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "CH56x_common.h"
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+#include <stdint.h>
+
+#define BENCH_REPEAT 64
+
+/**
+ * @brief Start a measurement
+ * @return current SysTick count
+ */
+__attribute__((always_inline)) static inline uint64_t bench_start(void)
+{
+	return bsp_get_SysTickCNT();
+}
+
+/**
+ * @brief Number of SysTick ticks elapsed since start
+ */
+__attribute__((always_inline)) static inline uint32_t bench_stop(uint64_t start)
+{
+	return (uint32_t)(start - bsp_get_SysTickCNT()); // CNT is decremented
+}
+
+#endif
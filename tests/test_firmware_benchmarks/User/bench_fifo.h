@@ -0,0 +1,112 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_FIFO_H
+#define BENCH_FIFO_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/fifo.h"
+#include "wch-ch56x-lib/memory/typed_fifo.h"
+
+#define BENCH_FIFO_LOG2_CAPACITY 4
+#define BENCH_FIFO_CAPACITY (1 << BENCH_FIFO_LOG2_CAPACITY)
+
+typedef struct bench_fifo_element_2
+{
+	uint16_t data[1];
+} bench_fifo_element_2_t;
+
+typedef struct bench_fifo_element_16
+{
+	uint32_t data[4];
+} bench_fifo_element_16_t;
+
+typedef struct bench_fifo_element_32
+{
+	uint32_t data[8];
+} bench_fifo_element_32_t;
+
+/*
+ * For each element size, a generic FIFO, a generic SPSC FIFO and a typed FIFO
+ * of the same capacity, and a function giving the number of ticks to push then
+ * pop BENCH_REPEAT * BENCH_FIFO_CAPACITY elements with each of them.
+ */
+#define BENCH_FIFO_DEF(_bytes)                                                     \
+	HYDRA_FIFO_DEF(bench_fifo_generic_##_bytes, bench_fifo_element_##_bytes##_t,   \
+				   BENCH_FIFO_CAPACITY);                                           \
+	HYDRA_FIFO_DEF_SPSC(bench_fifo_spsc_##_bytes, bench_fifo_element_##_bytes##_t, \
+						BENCH_FIFO_CAPACITY);                                      \
+	HYDRA_TYPED_FIFO(bench_fifo_typed_##_bytes, bench_fifo_element_##_bytes##_t,   \
+					 BENCH_FIFO_LOG2_CAPACITY);                                    \
+                                                                                   \
+	uint32_t bench_fifo_hydra_fifo_##_bytes(hydra_fifo_t* fifo);                   \
+	uint32_t bench_fifo_hydra_fifo_##_bytes(hydra_fifo_t* fifo)                    \
+	{                                                                              \
+		bench_fifo_element_##_bytes##_t element = { { 0 } };                       \
+		fifo_clean(fifo);                                                          \
+		uint64_t start = bench_start();                                            \
+		for (int i = 0; i < BENCH_REPEAT; ++i)                                     \
+		{                                                                          \
+			for (int j = 0; j < BENCH_FIFO_CAPACITY; ++j)                          \
+				fifo_write(fifo, &element, 1);                                     \
+			for (int j = 0; j < BENCH_FIFO_CAPACITY; ++j)                          \
+				fifo_read_n(fifo, &element, 1);                                    \
+		}                                                                          \
+		return bench_stop(start);                                                  \
+	}                                                                              \
+                                                                                   \
+	uint32_t bench_fifo_typed_fifo_##_bytes(void);                                 \
+	uint32_t bench_fifo_typed_fifo_##_bytes(void)                                  \
+	{                                                                              \
+		bench_fifo_element_##_bytes##_t element = { { 0 } };                       \
+		bench_fifo_typed_##_bytes##_clean();                                       \
+		uint64_t start = bench_start();                                            \
+		for (int i = 0; i < BENCH_REPEAT; ++i)                                     \
+		{                                                                          \
+			for (int j = 0; j < BENCH_FIFO_CAPACITY; ++j)                          \
+				bench_fifo_typed_##_bytes##_push(&element);                        \
+			for (int j = 0; j < BENCH_FIFO_CAPACITY; ++j)                          \
+				bench_fifo_typed_##_bytes##_pop(&element);                         \
+		}                                                                          \
+		return bench_stop(start);                                                  \
+	}                                                                              \
+                                                                                   \
+	void bench_fifo_##_bytes(void);                                                \
+	void bench_fifo_##_bytes(void)                                                 \
+	{                                                                              \
+		LOG("%d-byte elements, %d push+pop: hydra_fifo %d ticks, spsc %d ticks, "  \
+			"typed %d ticks\r\n",                                                  \
+			_bytes, BENCH_REPEAT * BENCH_FIFO_CAPACITY,                            \
+			bench_fifo_hydra_fifo_##_bytes(&bench_fifo_generic_##_bytes),          \
+			bench_fifo_hydra_fifo_##_bytes(&bench_fifo_spsc_##_bytes),             \
+			bench_fifo_typed_fifo_##_bytes());                                     \
+	}
+
+BENCH_FIFO_DEF(2)
+BENCH_FIFO_DEF(16)
+BENCH_FIFO_DEF(32)
+
+void bench_fifo(void);
+void bench_fifo(void)
+{
+	bench_fifo_2();
+	bench_fifo_16();
+	bench_fifo_32();
+}
+
+#endif
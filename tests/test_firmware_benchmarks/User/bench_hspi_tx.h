@@ -0,0 +1,123 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_HSPI_TX_H
+#define BENCH_HSPI_TX_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/hspi_scheduled/hspi_scheduled.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+#define BENCH_HSPI_TX_PACKET_SIZE 1024
+#define BENCH_HSPI_TX_PACKETS 512
+
+#ifdef HSPI_TX_PIPELINED
+#define BENCH_HSPI_TX_MODE "pipelined"
+#else
+#define BENCH_HSPI_TX_MODE "blocking"
+#endif
+
+/*
+ * Transmissions still waiting : in the interrupt queue (blocking path), or in
+ * the TX ring and DMAs (HSPI_TX_PIPELINED)
+ */
+__attribute__((always_inline)) static inline bool bench_hspi_tx_busy(uint16_t remaining)
+{
+#ifdef HSPI_TX_PIPELINED
+	return remaining != 0 || hspi_tx_pending() != 0;
+#else
+	return remaining != 0;
+#endif
+}
+
+/*
+ * Ticks to send BENCH_HSPI_TX_PACKETS packets of BENCH_HSPI_TX_PACKET_SIZE
+ * bytes as host, the main loop calling hspi_send as long as it accepts
+ * packets and running the interrupt queue. All the packets are sent from the
+ * same ramx_pool buffer, so there is no copy. The measurement ends once the
+ * last transmission is done.
+ */
+uint32_t bench_hspi_tx_datasize(HSPI_DATASIZE datasize);
+uint32_t bench_hspi_tx_datasize(HSPI_DATASIZE datasize)
+{
+	uint32_t sent = 0;
+	uint16_t remaining = 0;
+
+	ramx_pool_init();
+	hydra_interrupt_queue_init();
+	hspi_init(HSPI_TYPE_HOST, datasize, BENCH_HSPI_TX_PACKET_SIZE);
+	uint8_t* packet = ramx_pool_alloc_bytes(BENCH_HSPI_TX_PACKET_SIZE);
+	if (packet == NULL)
+	{
+		LOG("bench_hspi_tx: not enough memory\r\n");
+		return 0;
+	}
+	for (uint32_t i = 0; i < BENCH_HSPI_TX_PACKET_SIZE; ++i)
+		packet[i] = (uint8_t)i;
+
+	uint64_t start = bench_start();
+	do
+	{
+		while (sent < BENCH_HSPI_TX_PACKETS &&
+			   hspi_send(packet, BENCH_HSPI_TX_PACKET_SIZE, (uint16_t)sent))
+			sent++;
+		hydra_interrupt_queue_run_budget(0, 0, &remaining);
+	} while (sent < BENCH_HSPI_TX_PACKETS || bench_hspi_tx_busy(remaining));
+	uint32_t ticks = bench_stop(start);
+
+	// the completion tasks of the last transmissions
+	hydra_interrupt_queue_run_budget(0, 0, NULL);
+	ramx_pool_free(packet);
+	return ticks;
+}
+
+void bench_hspi_tx(void);
+void bench_hspi_tx(void)
+{
+#ifdef HSPI_FLOW_CONTROL
+	// no credits without a receiver
+	LOG("hspi tx: skipped, HSPI_FLOW_CONTROL needs a receiver\r\n");
+	return;
+#endif
+#ifdef HSPI_RELIABLE
+	// no ACK without a receiver
+	LOG("hspi tx: skipped, HSPI_RELIABLE needs a receiver\r\n");
+	return;
+#endif
+	static const HSPI_DATASIZE datasizes[] = { HSPI_DATASIZE_8, HSPI_DATASIZE_16,
+											   HSPI_DATASIZE_32 };
+	const uint64_t bytes =
+		(uint64_t)BENCH_HSPI_TX_PACKETS * BENCH_HSPI_TX_PACKET_SIZE;
+
+	for (size_t i = 0; i < sizeof(datasizes) / sizeof(datasizes[0]); ++i)
+	{
+		uint32_t ticks = bench_hspi_tx_datasize(datasizes[i]);
+		// bytes per microsecond, in hundredths
+		uint32_t centi_mbps =
+			ticks == 0 ? 0
+					   : (uint32_t)(bytes * 100 * bsp_get_nbtick_1us() / ticks);
+		(void)centi_mbps; // unused if logging is disabled
+		LOG("hspi tx " BENCH_HSPI_TX_MODE ", %d bits, %d packets of %d bytes: "
+			"%d ticks, %d.%02d MB/s\r\n",
+			8 << i, BENCH_HSPI_TX_PACKETS, BENCH_HSPI_TX_PACKET_SIZE, ticks,
+			centi_mbps / 100, centi_mbps % 100);
+	}
+}
+
+#endif
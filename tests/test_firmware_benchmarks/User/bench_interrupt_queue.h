@@ -0,0 +1,161 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_INTERRUPT_QUEUE_H
+#define BENCH_INTERRUPT_QUEUE_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/interrupt_queue/interrupt_queue.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/pool.h"
+
+bool bench_interrupt_queue_task(uint8_t* args);
+bool bench_interrupt_queue_task(uint8_t* args)
+{
+	(*(uint32_t*)(void*)args)++;
+	return true;
+}
+
+/*
+ * Ticks to run BENCH_REPEAT times INTERRUPT_QUEUE_SIZE tasks doing almost
+ * nothing, with one hydra_interrupt_queue_run call per task or with
+ * hydra_interrupt_queue_run_budget. The tasks are scheduled outside of the
+ * measurement.
+ */
+uint32_t bench_interrupt_queue_drain(bool budget);
+uint32_t bench_interrupt_queue_drain(bool budget)
+{
+	uint32_t counter = 0;
+	uint32_t ticks = 0;
+
+	hydra_interrupt_queue_init();
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		for (int j = 0; j < INTERRUPT_QUEUE_SIZE; ++j)
+			hydra_interrupt_queue_set_next_task(bench_interrupt_queue_task,
+												(uint8_t*)&counter, NULL);
+		uint64_t start = bench_start();
+		if (budget)
+			hydra_interrupt_queue_run_budget(0, 0, NULL);
+		else
+		{
+			for (int j = 0; j < INTERRUPT_QUEUE_SIZE; ++j)
+				hydra_interrupt_queue_run();
+		}
+		ticks += bench_stop(start);
+	}
+	if (counter != BENCH_REPEAT * INTERRUPT_QUEUE_SIZE)
+		LOG("bench_interrupt_queue: %d tasks run instead of %d\r\n", counter,
+			BENCH_REPEAT * INTERRUPT_QUEUE_SIZE);
+	return ticks;
+}
+
+// same size as the arguments of the hspi_scheduled tasks
+typedef struct bench_interrupt_queue_args_t
+{
+	uint8_t* buffer;
+	uint16_t offset;
+	uint16_t size;
+	uint16_t custom_register;
+} bench_interrupt_queue_args_t;
+
+HYDRA_POOL_DEF_FREE_LIST(bench_interrupt_queue_arg_pool,
+						 bench_interrupt_queue_args_t, INTERRUPT_QUEUE_SIZE);
+
+static uint32_t bench_interrupt_queue_arg_sum;
+
+bool bench_interrupt_queue_args_task(uint8_t* args);
+bool bench_interrupt_queue_args_task(uint8_t* args)
+{
+	bench_interrupt_queue_arg_sum +=
+		((bench_interrupt_queue_args_t*)(void*)args)->size;
+	return true;
+}
+
+void bench_interrupt_queue_args_cleanup(uint8_t* args);
+void bench_interrupt_queue_args_cleanup(uint8_t* args)
+{
+	hydra_pool_free(&bench_interrupt_queue_arg_pool, args);
+}
+
+/*
+ * Ticks to schedule and run BENCH_REPEAT times INTERRUPT_QUEUE_SIZE tasks
+ * taking arguments like hspi_send : taken from a hydra_pool and freed by the
+ * cleanup function, or copied in the task.
+ */
+uint32_t bench_interrupt_queue_args(bool inline_args);
+uint32_t bench_interrupt_queue_args(bool inline_args)
+{
+	uint32_t ticks = 0;
+
+	hydra_interrupt_queue_init();
+	hydra_pool_clean(&bench_interrupt_queue_arg_pool);
+	bench_interrupt_queue_arg_sum = 0;
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		for (uint16_t j = 0; j < INTERRUPT_QUEUE_SIZE; ++j)
+		{
+			if (inline_args)
+			{
+				bench_interrupt_queue_args_t args = { .buffer = NULL,
+													  .offset = 0,
+													  .size = 1,
+													  .custom_register = j };
+				hydra_interrupt_queue_set_next_task_inline(
+					bench_interrupt_queue_args_task, &args, sizeof(args), NULL);
+			}
+			else
+			{
+				bench_interrupt_queue_args_t* args =
+					hydra_pool_get(&bench_interrupt_queue_arg_pool);
+				if (args == NULL)
+					break;
+				args->buffer = NULL;
+				args->offset = 0;
+				args->size = 1;
+				args->custom_register = j;
+				hydra_interrupt_queue_set_next_task(
+					bench_interrupt_queue_args_task, (uint8_t*)args,
+					bench_interrupt_queue_args_cleanup);
+			}
+		}
+		for (int j = 0; j < INTERRUPT_QUEUE_SIZE; ++j)
+			hydra_interrupt_queue_run();
+		ticks += bench_stop(start);
+	}
+	if (bench_interrupt_queue_arg_sum != BENCH_REPEAT * INTERRUPT_QUEUE_SIZE)
+		LOG("bench_interrupt_queue_args: %d tasks run instead of %d\r\n",
+			bench_interrupt_queue_arg_sum, BENCH_REPEAT * INTERRUPT_QUEUE_SIZE);
+	return ticks;
+}
+
+void bench_interrupt_queue(void);
+void bench_interrupt_queue(void)
+{
+	LOG("interrupt queue, %d tasks: hydra_interrupt_queue_run %d ticks, "
+		"hydra_interrupt_queue_run_budget %d ticks\r\n",
+		BENCH_REPEAT * INTERRUPT_QUEUE_SIZE, bench_interrupt_queue_drain(false),
+		bench_interrupt_queue_drain(true));
+	LOG("interrupt queue, %d tasks with %d bytes of arguments: hydra_pool %d "
+		"ticks, inline %d ticks\r\n",
+		BENCH_REPEAT * INTERRUPT_QUEUE_SIZE,
+		(uint32_t)sizeof(bench_interrupt_queue_args_t),
+		bench_interrupt_queue_args(false), bench_interrupt_queue_args(true));
+}
+
+#endif
@@ -0,0 +1,89 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_POOL_H
+#define BENCH_POOL_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/pool.h"
+
+HYDRA_POOL_DEF(bench_scan_pool_8, uint32_t, 8);
+HYDRA_POOL_DEF(bench_scan_pool_64, uint32_t, 64);
+HYDRA_POOL_DEF(bench_scan_pool_256, uint32_t, 256);
+HYDRA_POOL_DEF_FREE_LIST(bench_free_list_pool_8, uint32_t, 8);
+HYDRA_POOL_DEF_FREE_LIST(bench_free_list_pool_64, uint32_t, 64);
+HYDRA_POOL_DEF_FREE_LIST(bench_free_list_pool_256, uint32_t, 256);
+
+/**
+ * @brief Worst-case number of ticks for hydra_pool_get and hydra_pool_free,
+ * when only the last member of the pool is free.
+ */
+void bench_pool_worst_case(hydra_pool_t* pool, uint32_t* get_ticks,
+						   uint32_t* free_ticks);
+void bench_pool_worst_case(hydra_pool_t* pool, uint32_t* get_ticks,
+						   uint32_t* free_ticks)
+{
+	void* last = NULL;
+
+	*get_ticks = 0;
+	*free_ticks = 0;
+	hydra_pool_clean(pool);
+	for (uint16_t i = 0; i < pool->size; ++i)
+		last = hydra_pool_get(pool);
+	hydra_pool_free(pool, last);
+
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		void* member = hydra_pool_get(pool);
+		uint32_t ticks = bench_stop(start);
+		if (ticks > *get_ticks)
+			*get_ticks = ticks;
+
+		start = bench_start();
+		hydra_pool_free(pool, member);
+		ticks = bench_stop(start);
+		if (ticks > *free_ticks)
+			*free_ticks = ticks;
+	}
+}
+
+void bench_pool(void);
+void bench_pool(void)
+{
+	hydra_pool_t* scan_pools[] = { &bench_scan_pool_8, &bench_scan_pool_64,
+								   &bench_scan_pool_256 };
+	hydra_pool_t* free_list_pools[] = { &bench_free_list_pool_8,
+										&bench_free_list_pool_64,
+										&bench_free_list_pool_256 };
+
+	for (size_t i = 0; i < sizeof(scan_pools) / sizeof(scan_pools[0]); ++i)
+	{
+		uint32_t get_ticks, free_ticks;
+
+		bench_pool_worst_case(scan_pools[i], &get_ticks, &free_ticks);
+		LOG("hydra_pool size %d scan: get %d ticks, free %d ticks\r\n",
+			scan_pools[i]->size, get_ticks, free_ticks);
+
+		bench_pool_worst_case(free_list_pools[i], &get_ticks, &free_ticks);
+		LOG("hydra_pool size %d free list: get %d ticks, free %d ticks\r\n",
+			free_list_pools[i]->size, get_ticks, free_ticks);
+	}
+}
+
+#endif
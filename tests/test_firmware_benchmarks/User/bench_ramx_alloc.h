@@ -0,0 +1,164 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_RAMX_ALLOC_H
+#define BENCH_RAMX_ALLOC_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+
+/**
+ * @brief Fragment ramx_pool so that the only run of num_blocks free blocks is
+ * at the end of the pool, every other free run being one block too short.
+ * This is the worst case for a search starting at block 0.
+ */
+void bench_ramx_alloc_fragment(uint8_t num_blocks);
+void bench_ramx_alloc_fragment(uint8_t num_blocks)
+{
+	ramx_pool_init();
+
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_alloc_blocks(1);
+
+	uint32_t last_run_start = POOL_BLOCK_NUM - num_blocks;
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM; ++i)
+	{
+		bool last_run = i >= last_run_start;
+		bool separator = (i % num_blocks) == (uint32_t)(num_blocks - 1) ||
+						 i == last_run_start - 1;
+		if (last_run || !separator)
+			ramx_pool_free(ramx_pool.pool + i * POOL_BLOCK_SIZE);
+	}
+}
+
+/**
+ * @brief Worst-case number of ticks for ramx_pool_alloc_blocks(num_blocks)
+ */
+uint32_t bench_ramx_alloc_worst_case(uint8_t num_blocks);
+uint32_t bench_ramx_alloc_worst_case(uint8_t num_blocks)
+{
+	uint32_t worst = 0;
+
+	bench_ramx_alloc_fragment(num_blocks);
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		uint8_t* ptr = ramx_pool_alloc_blocks(num_blocks);
+		uint32_t ticks = bench_stop(start);
+
+		if (ptr != ramx_pool.pool + (POOL_BLOCK_NUM - num_blocks) * POOL_BLOCK_SIZE)
+		{
+			LOG("ramx_pool_alloc_blocks(%d) did not return the last run\r\n",
+				num_blocks);
+			return 0;
+		}
+		ramx_pool_free(ptr);
+		if (ticks > worst)
+			worst = ticks;
+	}
+	return worst;
+}
+
+/**
+ * @brief Number of ticks of a scan of the whole blocks[] array, with
+ * ramx_pool_stats_largest_free_run
+ */
+uint32_t bench_ramx_alloc_full_scan(void);
+uint32_t bench_ramx_alloc_full_scan(void)
+{
+	uint32_t worst = 0;
+
+	bench_ramx_alloc_fragment(2);
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		pool_index_t largest = ramx_pool_stats_largest_free_run();
+		uint32_t ticks = bench_stop(start);
+
+		if (largest != 2)
+		{
+			LOG("ramx_pool_stats_largest_free_run returned %d\r\n", largest);
+			return 0;
+		}
+		if (ticks > worst)
+			worst = ticks;
+	}
+	return worst;
+}
+
+/**
+ * @brief Number of ticks to allocate then free 4 buffers of 2 blocks, the first
+ * half of the pool being used, with separate calls (many == false) or with
+ * ramx_pool_alloc_many and ramx_pool_free_many (many == true)
+ */
+uint32_t bench_ramx_alloc_many(bool many);
+uint32_t bench_ramx_alloc_many(bool many)
+{
+	const uint32_t sizes[4] = { 2 * POOL_BLOCK_SIZE, 2 * POOL_BLOCK_SIZE,
+								2 * POOL_BLOCK_SIZE, 2 * POOL_BLOCK_SIZE };
+	uint8_t* buffers[4];
+	uint32_t worst = 0;
+
+	ramx_pool_init();
+	for (uint32_t i = 0; i < POOL_BLOCK_NUM / 2; ++i)
+		ramx_pool_alloc_blocks(1);
+
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		if (many)
+		{
+			ramx_pool_alloc_many(4, sizes, buffers);
+			ramx_pool_free_many(4, buffers);
+		}
+		else
+		{
+			for (int j = 0; j < 4; ++j)
+				buffers[j] = ramx_pool_alloc_bytes(sizes[j]);
+			for (int j = 0; j < 4; ++j)
+				ramx_pool_free(buffers[j]);
+		}
+		uint32_t ticks = bench_stop(start);
+		if (ticks > worst)
+			worst = ticks;
+	}
+	return worst;
+}
+
+void bench_ramx_alloc(void);
+void bench_ramx_alloc(void)
+{
+#ifdef RAMX_ALLOC_BITMAP
+	LOG("ramx_pool_alloc_blocks (bitmap), %d blocks of %d bytes, %d-bit indexes\r\n",
+		POOL_BLOCK_NUM, POOL_BLOCK_SIZE, POOL_INDEX_BITS);
+#elif defined(RAMX_ALLOC_BUDDY)
+	LOG("ramx_pool_alloc_blocks (buddy), %d blocks of %d bytes, %d-bit indexes\r\n",
+		POOL_BLOCK_NUM, POOL_BLOCK_SIZE, POOL_INDEX_BITS);
+#else
+	LOG("ramx_pool_alloc_blocks (first fit), %d blocks of %d bytes, %d-bit indexes\r\n",
+		POOL_BLOCK_NUM, POOL_BLOCK_SIZE, POOL_INDEX_BITS);
+#endif
+	LOG("worst case 1 block: %d ticks\r\n", bench_ramx_alloc_worst_case(1));
+	LOG("worst case 2 blocks: %d ticks\r\n", bench_ramx_alloc_worst_case(2));
+	LOG("worst case 8 blocks: %d ticks\r\n", bench_ramx_alloc_worst_case(8));
+	LOG("full scan (largest free run): %d ticks\r\n", bench_ramx_alloc_full_scan());
+	LOG("4 buffers, separate calls: %d ticks\r\n", bench_ramx_alloc_many(false));
+	LOG("4 buffers, ramx_pool_alloc_many: %d ticks\r\n", bench_ramx_alloc_many(true));
+}
+
+#endif
@@ -0,0 +1,77 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef BENCH_RAMX_CLASS_ALLOC_H
+#define BENCH_RAMX_CLASS_ALLOC_H
+
+#include "bench.h"
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/ramx_alloc.h"
+#include "wch-ch56x-lib/memory/ramx_class_alloc.h"
+
+#define BENCH_RAMX_CLASS_SMALL_NUM 16
+#define BENCH_RAMX_CLASS_SMALL_SIZE 40
+
+/**
+ * @brief Worst-case number of ticks for ramx_alloc + ramx_free of a small
+ * buffer, with only the last slot of the smallest class free.
+ */
+uint32_t bench_ramx_class_alloc_worst_case(void);
+uint32_t bench_ramx_class_alloc_worst_case(void)
+{
+	uint32_t worst = 0;
+
+	ramx_class_pool_init();
+	for (uint16_t i = 0; i < RAMX_CLASS_0_NUM; ++i)
+		ramx_alloc(1);
+	ramx_free(ramx_class_pool.classes[0].end - RAMX_CLASS_0_SIZE);
+
+	for (int i = 0; i < BENCH_REPEAT; ++i)
+	{
+		uint64_t start = bench_start();
+		void* ptr = ramx_alloc(1);
+		ramx_free(ptr);
+		uint32_t ticks = bench_stop(start);
+
+		if (ticks > worst)
+			worst = ticks;
+	}
+	return worst;
+}
+
+void bench_ramx_class_alloc(void);
+void bench_ramx_class_alloc(void)
+{
+	// memory reserved for small control buffers, in both allocators
+	ramx_pool_init();
+	ramx_class_pool_init();
+	for (int i = 0; i < BENCH_RAMX_CLASS_SMALL_NUM; ++i)
+	{
+		ramx_pool_alloc_bytes(BENCH_RAMX_CLASS_SMALL_SIZE);
+		ramx_alloc(BENCH_RAMX_CLASS_SMALL_SIZE);
+	}
+	LOG("%d buffers of %d bytes: ramx_pool reserves %d bytes, ramx_alloc %d bytes\r\n",
+		BENCH_RAMX_CLASS_SMALL_NUM, BENCH_RAMX_CLASS_SMALL_SIZE,
+		ramx_pool_stats_used() * POOL_BLOCK_SIZE,
+		ramx_alloc_stats_used(0) * ramx_alloc_stats_slot_size(0));
+	ramx_pool_init();
+
+	LOG("ramx_alloc worst case: %d ticks\r\n",
+		bench_ramx_class_alloc_worst_case());
+}
+
+#endif
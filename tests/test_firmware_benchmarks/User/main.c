@@ -0,0 +1,141 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2023 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+// Disable warnings in bsp arising from -pedantic -Wall -Wconversion
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wvariadic-macros"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "CH56x_common.h"
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+#pragma GCC diagnostic pop
+
+#include "bench_fifo.h"
+#include "bench_hspi_tx.h"
+#include "bench_interrupt_queue.h"
+#include "bench_pool.h"
+#include "bench_ramx_alloc.h"
+#include "bench_ramx_class_alloc.h"
+#include "wch-ch56x-lib/logging/logging.h"
+
+#undef FREQ_SYS
+/* System clock / MCU frequency in Hz (lowest possible speed 15MHz) */
+#define FREQ_SYS (120000000)
+
+static void (*benchmarks[])(void) = {
+	bench_ramx_alloc,
+	bench_pool,
+	bench_ramx_class_alloc,
+	bench_fifo,
+	bench_interrupt_queue,
+	bench_hspi_tx,
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/*********************************************************************
+ * @fn      main
+ *
+ * @brief   Main program.
+ *
+ * @return  none
+ */
+int main()
+{
+	bsp_gpio_init();
+
+	bsp_init(FREQ_SYS);
+
+	LOG_INIT(FREQ_SYS);
+
+	LOG("Starting the benchmarks, tick frequency %d Hz\r\n",
+		bsp_get_tick_frequency());
+
+	for (size_t i = 0; i < NUM_BENCHMARKS; ++i)
+	{
+		LOG("Running benchmark n°%d \r\n", i);
+		benchmarks[i]();
+	}
+
+	LOG("Benchmarks done \r\n");
+	LOG_DUMP();
+}
+
+__attribute__((interrupt("WCH-Interrupt-fast"))) void WDOG_IRQHandler(void);
+__attribute__((interrupt("WCH-Interrupt-fast"))) void WDOG_IRQHandler(void)
+{
+	LOG_DUMP();
+
+	LOG_IF_LEVEL(LOG_LEVEL_CRITICAL,
+				 "WDOG_IRQHandler\r\n"
+				 " SP=0x%08X\r\n"
+				 " MIE=0x%08X\r\n"
+				 " MSTATUS=0x%08X\r\n"
+				 " MCAUSE=0x%08X\r\n"
+				 " MVENDORID=0x%08X\r\n"
+				 " MARCHID=0x%08X\r\n"
+				 " MISA=0x%08X\r\n"
+				 " MIMPID=0x%08X\r\n"
+				 " MHARTID=0x%08X\r\n"
+				 " MEPC=0x%08X\r\n"
+				 " MSCRATCH=0x%08X\r\n"
+				 " MTVEC=0x%08X\r\n",
+				 __get_SP(), __get_MIE(), __get_MSTATUS(), __get_MCAUSE(),
+				 __get_MVENDORID(), __get_MARCHID(), __get_MISA(), __get_MIMPID(),
+				 __get_MHARTID(), __get_MEPC(), __get_MSCRATCH(), __get_MTVEC());
+
+	LOG_DUMP();
+
+	bsp_wait_ms_delay(100000000);
+}
+
+/*********************************************************************
+ * @fn      HardFault_Handler
+ *
+ * @brief   Example of basic HardFault Handler called if an exception occurs
+ *
+ * @return  none
+ */
+__attribute__((interrupt("WCH-Interrupt-fast"))) void HardFault_Handler(void);
+__attribute__((interrupt("WCH-Interrupt-fast"))) void HardFault_Handler(void)
+{
+	LOG_DUMP();
+
+	// asm("ebreak"); to trigger a breakpoint and test hardfault_handler
+	LOG_IF_LEVEL(LOG_LEVEL_CRITICAL,
+				 "HardFault_Handler\r\n"
+				 " SP=0x%08X\r\n"
+				 " MIE=0x%08X\r\n"
+				 " MSTATUS=0x%08X\r\n"
+				 " MCAUSE=0x%08X\r\n"
+				 " MVENDORID=0x%08X\r\n"
+				 " MARCHID=0x%08X\r\n"
+				 " MISA=0x%08X\r\n"
+				 " MIMPID=0x%08X\r\n"
+				 " MHARTID=0x%08X\r\n"
+				 " MEPC=0x%08X\r\n"
+				 " MSCRATCH=0x%08X\r\n"
+				 " MTVEC=0x%08X\r\n",
+				 __get_SP(), __get_MIE(), __get_MSTATUS(), __get_MCAUSE(),
+				 __get_MVENDORID(), __get_MARCHID(), __get_MISA(), __get_MIMPID(),
+				 __get_MHARTID(), __get_MEPC(), __get_MSCRATCH(), __get_MTVEC());
+
+	LOG_DUMP();
+
+	bsp_wait_ms_delay(100000000);
+}
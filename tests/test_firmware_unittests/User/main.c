@@ -25,6 +25,8 @@ limitations under the License.
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic pop
 
+#include "test_buf.h"
+#include "test_fifo.h"
 #include "test_interrupt_queue.h"
 #include "test_memory_allocator.h"
 #include "test_pool.h"
@@ -35,19 +37,44 @@ limitations under the License.
 /* System clock / MCU frequency in Hz (lowest possible speed 15MHz) */
 #define FREQ_SYS (120000000)
 
-#define NUM_TESTS 10
+#define NUM_TESTS 35
 
 static bool (*tests[NUM_TESTS])(void) = {
 	test_memory_allocator_ramx_alloc_bytes,
 	test_memory_allocator_ramx_alloc_all_blocks,
 	test_memory_allocator_ramx_alloc_too_many_blocks,
 	test_memory_allocator_ramx_alloc_double_free,
+	test_memory_allocator_ramx_fan_out,
+	test_memory_allocator_ramx_fan_out_interleaved,
+	test_memory_allocator_ramx_telemetry,
+	test_memory_allocator_ramx_alloc_many,
+	test_memory_allocator_ramx_alloc_many_atomic,
 	test_interrupt_queue_set_tasks,
 	test_interrupt_queue_overflow,
 	test_interrupt_queue_stress,
+	test_interrupt_queue_run_budget,
+	test_interrupt_queue_run_budget_free_all,
+	test_interrupt_queue_inline_args,
+	test_interrupt_queue_telemetry,
+	test_interrupt_queue_timer,
+	test_interrupt_queue_priorities,
 	test_usb_device,
 	test_pool_alloc_max,
-	test_pool_overflow
+	test_pool_overflow,
+	test_pool_free_list_alloc_max,
+	test_pool_free_list_reuse,
+	test_pool_free_list_double_free,
+	test_pool_telemetry,
+	test_fifo_reserve_commit_wrap,
+	test_fifo_acquire_release_wrap,
+	test_typed_fifo_full_empty,
+	test_typed_fifo_index_wrap,
+	test_buf_slice_ref_unref,
+	test_buf_slice_out_of_range,
+	test_buf_usb_tx_reference,
+	test_buf_usb_tx_reset,
+	test_buf_usb_rx_reference,
+	test_buf_usb_rx_no_memory
 };
 
 /*********************************************************************
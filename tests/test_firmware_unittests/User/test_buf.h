@@ -0,0 +1,284 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef TEST_BUF_H
+#define TEST_BUF_H
+
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/buf.h"
+#include "wch-ch56x-lib/usb/usb20.h"
+#include "wch-ch56x-lib/usb/usb_device.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+bool test_buf_slice_ref_unref(void);
+bool test_buf_slice_ref_unref(void)
+{
+	hydra_buf_t buf;
+	hydra_buf_t header;
+	hydra_buf_t payload;
+
+	ramx_pool_init();
+
+	if (!buf_alloc(&buf, POOL_BLOCK_SIZE * 2))
+		return false;
+	for (uint16_t i = 0; i < buf.length; ++i)
+		buf_data(&buf)[i] = (uint8_t)i;
+
+	// strip a 4-byte header, then a slice of the slice
+	if (!buf_slice(&buf, 0, 4, &header) ||
+		!buf_slice(&buf, 4, (uint16_t)(buf.length - 4), &payload))
+		return false;
+	hydra_buf_t inner;
+	if (!buf_slice(&payload, POOL_BLOCK_SIZE, 8, &inner))
+		return false;
+
+	if (buf_data(&payload)[0] != 4 || inner.offset != POOL_BLOCK_SIZE + 4 ||
+		buf_data(&inner)[0] != (uint8_t)(POOL_BLOCK_SIZE + 4))
+	{
+		LOG("wrong slice data\r\n");
+		return false;
+	}
+
+	// the allocation is shared by all the slices, and only freed by the last one
+	buf_unref(&buf);
+	buf_unref(&header);
+	buf_unref(&payload);
+	if (ramx_pool_stats_used() != 2)
+	{
+		LOG("blocks freed before the last slice\r\n");
+		return false;
+	}
+	buf_unref(&inner);
+
+	LOG("free : %d, used: %d \r\n", ramx_pool_stats_free(),
+		ramx_pool_stats_used());
+
+	return ramx_pool_stats_used() == 0;
+}
+
+bool test_buf_slice_out_of_range(void);
+bool test_buf_slice_out_of_range(void)
+{
+	hydra_buf_t buf;
+	hydra_buf_t slice = { .base = NULL, .offset = 0, .length = 0 };
+	bool success = true;
+
+	ramx_pool_init();
+
+	if (!buf_alloc(&buf, 16))
+		return false;
+
+	if (buf_slice(&buf, 8, 9, &slice) || buf_slice(&buf, 17, 0, &slice) ||
+		buf_slice(&buf, UINT16_MAX, 2, &slice))
+		success = false;
+	if (slice.base != NULL)
+		success = false;
+
+	// an empty slice at the end is valid
+	if (!buf_slice(&buf, 16, 0, &slice))
+		success = false;
+	else
+		buf_unref(&slice);
+
+	buf_unref(&buf);
+
+	return success && ramx_pool_stats_used() == 0;
+}
+
+bool test_buf_usb_tx_reference(void);
+bool test_buf_usb_tx_reference(void)
+{
+	hydra_buf_t buf;
+	bool success = true;
+
+	ramx_pool_init();
+
+	usb_device_0.endpoints.tx[1].buffer = NULL;
+	usb_device_0.endpoints.tx[1].max_packet_size = 512;
+	usb_device_0.endpoints.tx[1].max_burst = 1;
+	usb_device_0.endpoints.tx[1].max_packet_size_with_burst = 512;
+	usb_device_0.endpoints.tx[1].state = ENDP_STATE_NAK;
+	usb_device_0.endpoints.tx_buf_base[1] = NULL;
+
+	if (!buf_alloc(&buf, 64))
+		return false;
+
+	if (!endp_tx_set_new_buf(&usb_device_0, 1, &buf))
+		success = false;
+	// the endpoint keeps the buffer after the caller releases it
+	buf_unref(&buf);
+	if (ramx_pool_stats_used() != 1 ||
+		usb_device_0.endpoints.tx[1].buffer != buf_data(&buf))
+	{
+		LOG("endpoint does not hold a reference\r\n");
+		success = false;
+	}
+
+	// the previous transfer has not completed yet
+	if (endp_tx_set_new_buf(&usb_device_0, 1, &buf))
+		success = false;
+
+	_endp_tx_buf_release(&usb_device_0, 1);
+
+	return success && ramx_pool_stats_used() == 0;
+}
+
+bool test_buf_usb_tx_reset(void);
+bool test_buf_usb_tx_reset(void)
+{
+	hydra_buf_t buf;
+	bool success = true;
+
+	ramx_pool_init();
+
+	usb_device_0.endpoints.tx[1].buffer = NULL;
+	usb_device_0.endpoints.tx[1].max_packet_size = 512;
+	usb_device_0.endpoints.tx[1].max_burst = 1;
+	usb_device_0.endpoints.tx[1].max_packet_size_with_burst = 512;
+	usb_device_0.endpoints.tx[1].state = ENDP_STATE_NAK;
+	usb_device_0.endpoints.tx_buf_base[1] = NULL;
+
+	if (!buf_alloc(&buf, 64))
+		return false;
+	if (!endp_tx_set_new_buf(&usb_device_0, 1, &buf))
+		success = false;
+	buf_unref(&buf);
+
+	// the transfer is cut off by SET_CONFIGURATION
+	usb2_reset_endpoints();
+	if (ramx_pool_stats_used() != 0 || usb_device_0.endpoints.tx_buf_base[1] != NULL)
+	{
+		LOG("reference of the pending transfer not released\r\n");
+		success = false;
+	}
+
+	// the endpoint accepts new buffers
+	if (!buf_alloc(&buf, 64))
+		return false;
+	if (!endp_tx_set_new_buf(&usb_device_0, 1, &buf))
+		success = false;
+	buf_unref(&buf);
+	_endp_tx_buf_release(&usb_device_0, 1);
+
+	return success && ramx_pool_stats_used() == 0;
+}
+
+static hydra_buf_t test_buf_usb_rx_kept;
+static uint16_t test_buf_usb_rx_owners;
+
+static uint8_t test_buf_usb_rx_callback(hydra_buf_t* buf);
+static uint8_t test_buf_usb_rx_callback(hydra_buf_t* buf)
+{
+	test_buf_usb_rx_owners = ramx_pool_owners(buf->base);
+	return ENDP_STATE_ACK;
+}
+
+static uint8_t test_buf_usb_rx_keep_callback(hydra_buf_t* buf);
+static uint8_t test_buf_usb_rx_keep_callback(hydra_buf_t* buf)
+{
+	buf_ref(buf);
+	test_buf_usb_rx_kept = *buf;
+	return ENDP_STATE_ACK;
+}
+
+bool test_buf_usb_rx_reference(void);
+bool test_buf_usb_rx_reference(void)
+{
+	bool success = true;
+
+	ramx_pool_init();
+
+	uint8_t* rx_buffer = ramx_pool_alloc_bytes(512);
+	if (rx_buffer == NULL)
+		return false;
+	usb_device_0.endpoints.rx[1].buffer = rx_buffer;
+	usb_device_0.endpoints.rx[1].max_packet_size_with_burst = 512;
+
+	// buf holds its own reference during the call, the endpoint keeps its buffer
+	usb_device_0.endpoints.rx_buf_callback[1] = test_buf_usb_rx_callback;
+	if (_endp_rx_callback(&usb_device_0, 1, 10) != ENDP_STATE_ACK ||
+		test_buf_usb_rx_owners != 2 ||
+		usb_device_0.endpoints.rx[1].buffer != rx_buffer ||
+		ramx_pool_owners(rx_buffer) != 1)
+	{
+		LOG("wrong references during rx_buf_callback\r\n");
+		success = false;
+	}
+
+	// the data kept is not overwritten by the next packet
+	usb_device_0.endpoints.rx_buf_callback[1] = test_buf_usb_rx_keep_callback;
+	if (_endp_rx_callback(&usb_device_0, 1, 10) != ENDP_STATE_ACK ||
+		test_buf_usb_rx_kept.base != rx_buffer ||
+		usb_device_0.endpoints.rx[1].buffer == rx_buffer ||
+		!ramx_address_in_pool(usb_device_0.endpoints.rx[1].buffer) ||
+		ramx_pool_owners(rx_buffer) != 1)
+	{
+		LOG("endpoint not given a new buffer\r\n");
+		success = false;
+	}
+	buf_unref(&test_buf_usb_rx_kept);
+	ramx_pool_free(usb_device_0.endpoints.rx[1].buffer);
+	usb_device_0.endpoints.rx[1].buffer = NULL;
+	usb_device_0.endpoints.rx_buf_callback[1] = NULL;
+
+	return success && ramx_pool_stats_used() == 0;
+}
+
+bool test_buf_usb_rx_no_memory(void);
+bool test_buf_usb_rx_no_memory(void)
+{
+	static uint8_t* filler[POOL_BLOCK_NUM];
+	uint16_t num_filler = 0;
+	bool success = true;
+
+	ramx_pool_init();
+
+	uint8_t* rx_buffer = ramx_pool_alloc_bytes(512);
+	if (rx_buffer == NULL)
+		return false;
+	usb_device_0.endpoints.rx[1].buffer = rx_buffer;
+	usb_device_0.endpoints.rx[1].max_packet_size_with_burst = 512;
+
+	while (num_filler < POOL_BLOCK_NUM &&
+		   (filler[num_filler] = ramx_pool_alloc_bytes(1)) != NULL)
+		num_filler++;
+
+	// no fresh buffer : the endpoint keeps its own and answers NAK
+	usb_device_0.endpoints.rx_buf_callback[1] = test_buf_usb_rx_keep_callback;
+	if (_endp_rx_callback(&usb_device_0, 1, 10) != ENDP_STATE_NAK ||
+		test_buf_usb_rx_kept.base != rx_buffer ||
+		usb_device_0.endpoints.rx[1].buffer != rx_buffer ||
+		ramx_pool_owners(rx_buffer) != 2)
+	{
+		LOG("endpoint not set to NAK without memory\r\n");
+		success = false;
+	}
+	buf_unref(&test_buf_usb_rx_kept);
+	if (ramx_pool_owners(rx_buffer) != 1)
+		success = false;
+
+	while (num_filler > 0)
+		ramx_pool_free(filler[--num_filler]);
+	ramx_pool_free(rx_buffer);
+	usb_device_0.endpoints.rx[1].buffer = NULL;
+	usb_device_0.endpoints.rx_buf_callback[1] = NULL;
+
+	return success && ramx_pool_stats_used() == 0;
+}
+
+#endif
@@ -0,0 +1,176 @@
+/********************************** (C) COPYRIGHT *******************************
+Copyright (c) 2024 Quarkslab
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#ifndef TEST_FIFO_H
+#define TEST_FIFO_H
+#include "wch-ch56x-lib/logging/logging.h"
+#include "wch-ch56x-lib/memory/fifo.h"
+#include "wch-ch56x-lib/memory/typed_fifo.h"
+
+#define TEST_FIFO_SIZE 8
+
+typedef struct test_fifo_element
+{
+	uint8_t a;
+	uint8_t b;
+} test_fifo_element_t;
+
+HYDRA_FIFO_DEF(test_fifo, uint16_t, TEST_FIFO_SIZE);
+HYDRA_TYPED_FIFO(test_typed_fifo, test_fifo_element_t, 3);
+
+bool test_fifo_reserve_commit_wrap(void);
+bool test_fifo_reserve_commit_wrap(void)
+{
+	hydra_fifo_span_t spans[2];
+	uint16_t values[TEST_FIFO_SIZE];
+
+	fifo_clean(&test_fifo);
+
+	// move the indexes close to the end of the buffer
+	for (uint16_t i = 0; i < TEST_FIFO_SIZE - 2; ++i)
+		values[i] = i;
+	fifo_write(&test_fifo, values, TEST_FIFO_SIZE - 2);
+	fifo_read_n(&test_fifo, values, TEST_FIFO_SIZE - 2);
+
+	// more than the free space : only TEST_FIFO_SIZE elements are reserved
+	uint16_t reserved = fifo_write_reserve(&test_fifo, TEST_FIFO_SIZE + 2, spans);
+	LOG("reserved %d, spans %d %d \r\n", reserved, spans[0].count,
+		spans[1].count);
+	if (reserved != TEST_FIFO_SIZE || spans[1].count == 0 ||
+		spans[0].count + spans[1].count != TEST_FIFO_SIZE)
+		return false;
+
+	uint16_t value = 100;
+	for (int s = 0; s < 2; ++s)
+		for (uint16_t i = 0; i < spans[s].count; ++i)
+			((uint16_t*)spans[s].ptr)[i] = value++;
+
+	// nothing is visible before the commit
+	if (fifo_count(&test_fifo) != 0)
+		return false;
+	fifo_write_commit(&test_fifo, reserved);
+
+	if (fifo_read_n(&test_fifo, values, TEST_FIFO_SIZE) != TEST_FIFO_SIZE)
+		return false;
+	for (uint16_t i = 0; i < TEST_FIFO_SIZE; ++i)
+	{
+		if (values[i] != 100 + i)
+			return false;
+	}
+	return fifo_count(&test_fifo) == 0;
+}
+
+bool test_fifo_acquire_release_wrap(void);
+bool test_fifo_acquire_release_wrap(void)
+{
+	hydra_fifo_span_t spans[2];
+	uint16_t values[TEST_FIFO_SIZE];
+
+	fifo_clean(&test_fifo);
+
+	for (uint16_t i = 0; i < TEST_FIFO_SIZE - 3; ++i)
+		values[i] = i;
+	fifo_write(&test_fifo, values, TEST_FIFO_SIZE - 3);
+	fifo_read_n(&test_fifo, values, TEST_FIFO_SIZE - 3);
+
+	for (uint16_t i = 0; i < TEST_FIFO_SIZE; ++i)
+		values[i] = 200 + i;
+	fifo_write(&test_fifo, values, TEST_FIFO_SIZE);
+
+	uint16_t acquired = fifo_read_acquire(&test_fifo, TEST_FIFO_SIZE + 2, spans);
+	LOG("acquired %d, spans %d %d \r\n", acquired, spans[0].count,
+		spans[1].count);
+	if (acquired != TEST_FIFO_SIZE || spans[1].count == 0)
+		return false;
+
+	uint16_t expected = 200;
+	for (int s = 0; s < 2; ++s)
+		for (uint16_t i = 0; i < spans[s].count; ++i)
+			if (((uint16_t*)spans[s].ptr)[i] != expected++)
+				return false;
+
+	// partial release : the other elements stay in the FIFO
+	fifo_read_release(&test_fifo, 3);
+	if (fifo_count(&test_fifo) != TEST_FIFO_SIZE - 3 ||
+		fifo_read_n(&test_fifo, values, 1) != 1 || values[0] != 203)
+		return false;
+
+	fifo_read_release(&test_fifo, TEST_FIFO_SIZE - 4);
+	return fifo_count(&test_fifo) == 0;
+}
+
+bool test_typed_fifo_full_empty(void);
+bool test_typed_fifo_full_empty(void)
+{
+	test_fifo_element_t element;
+
+	test_typed_fifo_clean();
+	if (test_typed_fifo_pop(&element) || test_typed_fifo_peek(&element))
+		return false;
+
+	// all the slots can be used
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		element.a = i;
+		element.b = (uint8_t)(i + 1);
+		if (!test_typed_fifo_push(&element))
+			return false;
+	}
+	if (test_typed_fifo_push(&element) || test_typed_fifo_count() != 8)
+		return false;
+
+	if (!test_typed_fifo_peek(&element) || element.a != 0 ||
+		test_typed_fifo_count() != 8)
+		return false;
+
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		if (!test_typed_fifo_pop(&element) || element.a != i ||
+			element.b != i + 1)
+			return false;
+	}
+	return test_typed_fifo_count() == 0 && !test_typed_fifo_pop(&element);
+}
+
+bool test_typed_fifo_index_wrap(void);
+bool test_typed_fifo_index_wrap(void)
+{
+	test_fifo_element_t element;
+	uint8_t expected = 0;
+	uint8_t next = 0;
+
+	test_typed_fifo_clean();
+
+	// more operations than the 16-bit indexes can count, with a varying fill
+	// level so that the elements wrap at every position of the buffer
+	for (uint32_t round = 0; round < 30000; ++round)
+	{
+		for (uint32_t i = 0; i < round % 4 + 1; ++i)
+		{
+			element.a = next++;
+			if (!test_typed_fifo_push(&element))
+				return false;
+		}
+		for (uint32_t i = 0; i < round % 4 + 1; ++i)
+		{
+			if (!test_typed_fifo_pop(&element) || element.a != expected++)
+				return false;
+		}
+	}
+	return test_typed_fifo_count() == 0;
+}
+#endif
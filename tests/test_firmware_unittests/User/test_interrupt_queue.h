@@ -113,4 +113,324 @@ bool test_interrupt_queue_stress(void)
 
 	return num_run == INTERRUPT_QUEUE_SIZE * num_runs && result == true;
 }
+
+bool wait_100us(uint8_t* args);
+bool wait_100us(uint8_t* args)
+{
+	*(size_t*)(void*)(args) += 1;
+	bsp_wait_us_delay(100);
+	return true;
+}
+
+bool test_interrupt_queue_run_budget(void);
+bool test_interrupt_queue_run_budget(void)
+{
+	uint16_t remaining;
+
+	num_run = 0;
+	hydra_interrupt_queue_init();
+
+	for (int i = 0; i < 5; ++i)
+		hydra_interrupt_queue_set_next_task(some_random_function,
+											(uint8_t*)&num_run, NULL);
+	if (hydra_interrupt_queue_run_budget(2, 0, &remaining) != 2 ||
+		remaining != 3 || num_run != 2)
+		return false;
+	if (hydra_interrupt_queue_run_budget(0, 0, &remaining) != 3 ||
+		remaining != 0 || num_run != 5)
+		return false;
+
+	// the budget is checked after each task : 3 tasks of 100us for 250us
+	num_run = 0;
+	for (int i = 0; i < 5; ++i)
+		hydra_interrupt_queue_set_next_task(wait_100us, (uint8_t*)&num_run, NULL);
+	if (hydra_interrupt_queue_run_budget(0, 250 * bsp_get_nbtick_1us(),
+										 &remaining) != 3 ||
+		remaining != 2)
+		return false;
+	return hydra_interrupt_queue_run_budget(0, 0, NULL) == 2 && num_run == 5 &&
+		   hydra_interrupt_queue_ready == 0;
+}
+
+typedef struct inline_args_t
+{
+	uint16_t value;
+	uint8_t* counter;
+} inline_args_t;
+
+static uint32_t inline_args_sum = 0;
+static uint32_t inline_args_cleaned = 0;
+
+bool add_inline_args(uint8_t* args);
+bool add_inline_args(uint8_t* args)
+{
+	inline_args_t* inline_args = (inline_args_t*)(void*)args;
+	if (((uint32_t)args & 3) != 0)
+		return false;
+	inline_args_sum += inline_args->value;
+	(*inline_args->counter)++;
+	return true;
+}
+
+void cleanup_inline_args(uint8_t* args);
+void cleanup_inline_args(uint8_t* args)
+{
+	inline_args_cleaned += ((inline_args_t*)(void*)args)->value;
+}
+
+bool test_interrupt_queue_inline_args(void);
+bool test_interrupt_queue_inline_args(void)
+{
+	uint8_t counter = 0;
+	uint8_t too_large[INTERRUPT_QUEUE_INLINE_ARGS_SIZE + 1] = { 0 };
+	inline_args_t args = { .value = 1, .counter = &counter };
+
+	num_run = 0;
+	inline_args_sum = 0;
+	inline_args_cleaned = 0;
+	hydra_interrupt_queue_init();
+
+	// the arguments are copied : args can change once the task is set
+	for (uint16_t i = 1; i <= 4; ++i)
+	{
+		args.value = i;
+		if (!hydra_interrupt_queue_set_next_task_inline(
+				add_inline_args, &args, sizeof(args), cleanup_inline_args))
+			return false;
+		hydra_interrupt_queue_set_next_task(some_random_function,
+											(uint8_t*)&num_run, NULL);
+	}
+	if (hydra_interrupt_queue_set_next_task_inline(add_inline_args, too_large,
+												   sizeof(too_large), NULL) ||
+		hydra_interrupt_queue_set_next_task_inline(add_inline_args, &args, 0,
+												   NULL))
+		return false;
+
+	hydra_interrupt_queue_run();
+	hydra_interrupt_queue_run();
+	if (hydra_interrupt_queue_run_budget(4, 0, NULL) != 4)
+		return false;
+	if (inline_args_sum != 1 + 2 + 3 || inline_args_cleaned != 1 + 2 + 3 ||
+		counter != 3 || num_run != 3)
+		return false;
+
+	// the cleanup function also gets the copy when the tasks are freed
+	hydra_interrupt_queue_free_all();
+	return inline_args_sum == 1 + 2 + 3 && inline_args_cleaned == 1 + 2 + 3 + 4 &&
+		   hydra_interrupt_queue_ready == 0;
+}
+
+static uint32_t free_all_cleaned = 0;
+
+bool free_all_task(uint8_t* args);
+bool free_all_task(uint8_t* args)
+{
+	(void)args;
+	hydra_interrupt_queue_free_all();
+	return true;
+}
+
+void count_cleanup(uint8_t* args);
+void count_cleanup(uint8_t* args)
+{
+	(void)args;
+	free_all_cleaned++;
+}
+
+bool test_interrupt_queue_run_budget_free_all(void);
+bool test_interrupt_queue_run_budget_free_all(void)
+{
+	num_run = 0;
+	free_all_cleaned = 0;
+	hydra_interrupt_queue_init();
+
+	// the tasks after the reset are freed, not run, and cleaned up once
+	hydra_interrupt_queue_set_next_task(free_all_task, NULL, NULL);
+	for (int i = 0; i < 2; ++i)
+		hydra_interrupt_queue_set_next_task(some_random_function,
+											(uint8_t*)&num_run, count_cleanup);
+	if (hydra_interrupt_queue_run_budget(0, 0, NULL) != 1 || num_run != 0 ||
+		free_all_cleaned != 2 ||
+		fifo_count(task_queues[HYDRA_INTERRUPT_QUEUE_HIGH_PRIO]) != 0 ||
+		hydra_interrupt_queue_ready != 0)
+		return false;
+
+	// the queue is still usable
+	hydra_interrupt_queue_set_next_task(some_random_function, (uint8_t*)&num_run,
+										count_cleanup);
+	return hydra_interrupt_queue_run_budget(0, 0, NULL) == 1 && num_run == 1 &&
+		   free_all_cleaned == 3;
+}
+
+#ifdef INTERRUPT_QUEUE_TELEMETRY
+bool test_interrupt_queue_telemetry(void);
+bool test_interrupt_queue_telemetry(void)
+{
+	const hydra_interrupt_queue_func_telemetry_t* telemetry;
+
+	num_run = 0;
+	hydra_interrupt_queue_init();
+
+	// each task waits for the ones before it, 100us each
+	for (int i = 0; i < 3; ++i)
+		hydra_interrupt_queue_set_next_task(wait_100us, (uint8_t*)&num_run, NULL);
+	hydra_interrupt_queue_set_next_task(some_random_function, (uint8_t*)&num_run,
+										NULL);
+	if (hydra_interrupt_queue_run_budget(0, 0, NULL) != 4)
+		return false;
+	hydra_interrupt_queue_telemetry_dump();
+
+	telemetry = hydra_interrupt_queue_get_func_telemetry(wait_100us);
+	if (telemetry == NULL || telemetry->runs != 3 ||
+		telemetry->max_run_us < 100 || telemetry->max_wait_us < 200 ||
+		telemetry->run_histogram[0] != 0)
+		return false;
+	telemetry = hydra_interrupt_queue_get_func_telemetry(some_random_function);
+	if (telemetry == NULL || telemetry->runs != 1 ||
+		telemetry->max_wait_us < 300 ||
+		hydra_interrupt_queue_get_func_telemetry(add_inline_args) != NULL)
+		return false;
+	if (hydra_interrupt_queue_get_stats(HYDRA_INTERRUPT_QUEUE_HIGH_PRIO)->max_depth != 4)
+		return false;
+
+	hydra_interrupt_queue_telemetry_reset();
+	return hydra_interrupt_queue_get_func_telemetry(wait_100us) == NULL &&
+		   hydra_interrupt_queue_get_stats(HYDRA_INTERRUPT_QUEUE_HIGH_PRIO)->max_depth == 0;
+}
+#endif
+
+#ifdef INTERRUPT_QUEUE_TIMER
+static uint64_t timer_ran_at[4];
+static uint32_t timer_order[4];
+static size_t timer_order_len = 0;
+
+bool record_timer(uint8_t* args);
+bool record_timer(uint8_t* args)
+{
+	uint32_t number;
+	memcpy(&number, args, sizeof(number));
+	timer_ran_at[timer_order_len] = HYDRA_INTERRUPT_QUEUE_TICKS();
+	timer_order[timer_order_len++] = number;
+	return true;
+}
+
+bool test_interrupt_queue_timer(void);
+bool test_interrupt_queue_timer(void)
+{
+	static const uint32_t delays_us[4] = { 2000, 300, 300, 1000 };
+	uint64_t deadlines[4];
+	uint64_t start;
+
+	timer_order_len = 0;
+	hydra_interrupt_queue_init();
+
+	start = HYDRA_INTERRUPT_QUEUE_TICKS();
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		deadlines[i] = start - (uint64_t)delays_us[i] * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US();
+		if (!hydra_interrupt_queue_set_task_at(deadlines[i],
+											   HYDRA_INTERRUPT_QUEUE_HIGH_PRIO,
+											   record_timer, &i, sizeof(i), NULL))
+			return false;
+	}
+	if (hydra_interrupt_queue_timer_pending() != 4)
+		return false;
+
+	// the timer interrupt moves the tasks to the queue
+	while (timer_order_len < 4 &&
+		   start - HYDRA_INTERRUPT_QUEUE_TICKS() <
+			   (uint64_t)10000 * HYDRA_INTERRUPT_QUEUE_TICKS_PER_US())
+		hydra_interrupt_queue_run();
+
+	if (timer_order_len != 4 || hydra_interrupt_queue_timer_pending() != 0 ||
+		timer_order[0] != 1 || timer_order[1] != 2 || timer_order[2] != 3 ||
+		timer_order[3] != 0)
+		return false;
+	for (size_t i = 0; i < timer_order_len; ++i)
+	{
+		if (timer_ran_at[i] > deadlines[timer_order[i]])
+			return false;
+	}
+
+	// a task waiting for its deadline is dropped by free_all
+	uint32_t number = 0;
+	hydra_interrupt_queue_set_task_after(1000, HYDRA_INTERRUPT_QUEUE_HIGH_PRIO,
+										 record_timer, &number, sizeof(number),
+										 NULL);
+	hydra_interrupt_queue_free_all();
+	return hydra_interrupt_queue_timer_pending() == 0;
+}
+#endif
+
+#if INTERRUPT_QUEUE_PRIORITIES > 1
+static uint8_t prio_order[8];
+static size_t prio_order_len = 0;
+
+bool record_prio(uint8_t* args);
+bool record_prio(uint8_t* args)
+{
+	prio_order[prio_order_len++] = *args;
+	return true;
+}
+
+bool record_prio_then_high(uint8_t* args);
+bool record_prio_then_high(uint8_t* args)
+{
+	static uint8_t high = HYDRA_INTERRUPT_QUEUE_HIGH_PRIO;
+	record_prio(args);
+	return hydra_interrupt_queue_set_next_task(record_prio, &high, NULL);
+}
+
+bool test_interrupt_queue_priorities(void);
+bool test_interrupt_queue_priorities(void)
+{
+	static uint8_t high = HYDRA_INTERRUPT_QUEUE_HIGH_PRIO;
+	static uint8_t low = HYDRA_INTERRUPT_QUEUE_LOW_PRIO;
+	hydra_interrupt_queue_task_t task;
+
+	prio_order_len = 0;
+	hydra_interrupt_queue_init();
+
+	// low priority tasks wait for all the high priority ones, even those added
+	// after them
+	hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_LOW_PRIO,
+											 record_prio, &low, NULL);
+	hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_LOW_PRIO,
+											 record_prio, &low, NULL);
+	hydra_interrupt_queue_set_next_task(record_prio, &high, NULL);
+	if (!hydra_interrupt_queue_peek_next_task(&task) || task.args != &high ||
+		hydra_interrupt_queue_depth(HYDRA_INTERRUPT_QUEUE_LOW_PRIO) != 2)
+		return false;
+	hydra_interrupt_queue_run();
+	hydra_interrupt_queue_run();
+	hydra_interrupt_queue_set_next_task(record_prio, &high, NULL);
+	for (int i = 0; i < 4; ++i)
+		hydra_interrupt_queue_run();
+
+	if (prio_order_len != 4 || prio_order[0] != high || prio_order[1] != low ||
+		prio_order[2] != high || prio_order[3] != low ||
+		hydra_interrupt_queue_ready != 0)
+		return false;
+
+	if (hydra_interrupt_queue_set_next_task_prio(INTERRUPT_QUEUE_PRIORITIES,
+												 record_prio, &low, NULL))
+		return false;
+
+	const hydra_interrupt_queue_stats_t* stats =
+		hydra_interrupt_queue_get_stats(HYDRA_INTERRUPT_QUEUE_LOW_PRIO);
+	if (stats->scheduled != 2 || stats->max_depth != 2 || stats->full != 0 ||
+		hydra_interrupt_queue_get_stats(HYDRA_INTERRUPT_QUEUE_HIGH_PRIO)->scheduled != 2)
+		return false;
+
+	// a high priority task added by a task of a batch runs right after it
+	prio_order_len = 0;
+	hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_LOW_PRIO,
+											 record_prio_then_high, &low, NULL);
+	hydra_interrupt_queue_set_next_task_prio(HYDRA_INTERRUPT_QUEUE_LOW_PRIO,
+											 record_prio, &low, NULL);
+	return hydra_interrupt_queue_run_budget(0, 0, NULL) == 3 &&
+		   prio_order_len == 3 && prio_order[0] == low &&
+		   prio_order[1] == HYDRA_INTERRUPT_QUEUE_HIGH_PRIO && prio_order[2] == low;
+}
+#endif
 #endif
@@ -108,4 +108,191 @@ bool test_memory_allocator_ramx_alloc_double_free(void)
 	return ramx_pool_stats_free() == POOL_BLOCK_NUM &&
 		   ramx_pool_stats_used() == 0;
 }
+
+#define TEST_MEMORY_ALLOCATOR_CONSUMERS 300
+
+bool test_memory_allocator_ramx_fan_out(void);
+bool test_memory_allocator_ramx_fan_out(void)
+{
+	ramx_pool_init();
+
+	// more owners than an 8-bit counter can hold
+	uint8_t* mem = ramx_pool_alloc_blocks(4);
+	for (int i = 0; i < TEST_MEMORY_ALLOCATOR_CONSUMERS; ++i)
+		ramx_take_ownership(mem);
+
+	for (int i = 0; i < TEST_MEMORY_ALLOCATOR_CONSUMERS; ++i)
+	{
+		ramx_pool_free(mem);
+		if (ramx_pool_stats_used() != 4)
+		{
+			LOG("blocks freed after %d consumers \r\n", i + 1);
+			return false;
+		}
+	}
+
+	ramx_pool_free(mem);
+
+	LOG("free : %d, used: %d \r\n", ramx_pool_stats_free(),
+		ramx_pool_stats_used());
+
+	return ramx_pool_stats_free() == POOL_BLOCK_NUM &&
+		   ramx_pool_stats_used() == 0;
+}
+
+bool test_memory_allocator_ramx_fan_out_interleaved(void);
+bool test_memory_allocator_ramx_fan_out_interleaved(void)
+{
+	ramx_pool_init();
+
+	// each buffer is shared by a different number of consumers, which
+	// release it in a different order than the buffers were allocated
+	uint8_t* mem[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		mem[i] = ramx_pool_alloc_blocks((uint8_t)(i + 1));
+		for (int j = 0; j < i; ++j)
+			ramx_take_ownership(mem[i]);
+	}
+
+	for (int round = 0; round < 4; ++round)
+	{
+		for (int i = 3; i >= 0; --i)
+			ramx_pool_free(mem[i]);
+
+		// buffer i had i + 1 owners
+		uint8_t expected_used = 0;
+		for (int i = round + 1; i < 4; ++i)
+			expected_used += (uint8_t)ramx_pool_blocks_for((uint32_t)(i + 1));
+		if (ramx_pool_stats_used() != expected_used)
+		{
+			LOG("round %d used %d expected %d \r\n", round,
+				ramx_pool_stats_used(), expected_used);
+			return false;
+		}
+	}
+
+	// the freed blocks can be allocated again as one run
+	uint8_t* all = ramx_pool_alloc_blocks(10);
+#if defined(RAMX_ALLOC_BUDDY) || defined(RAMX_ALLOC_NEXT_FIT)
+	// the buddy allocator takes the smallest free run, and next fit the one
+	// after the last allocation, not the first one
+	bool ok = all != NULL;
+#else
+	bool ok = all == mem[0];
+#endif
+	ramx_pool_free(all);
+
+	return ok && ramx_pool_stats_free() == POOL_BLOCK_NUM &&
+		   ramx_pool_stats_used() == 0;
+}
+
+bool test_memory_allocator_ramx_telemetry(void);
+bool test_memory_allocator_ramx_telemetry(void)
+{
+	ramx_pool_init();
+
+	uint8_t* three = ramx_pool_alloc_blocks(3);
+	uint8_t* one = ramx_pool_alloc_blocks(1);
+	ramx_pool_free(three);
+	ramx_pool_free(one);
+
+	// bigger than the pool
+	if (ramx_pool_alloc_blocks(POOL_BLOCK_NUM + 1) != NULL)
+		return false;
+
+	// fragment the pool so that only single blocks are free
+	for (int i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_alloc_blocks(1);
+	for (int i = 0; i < POOL_BLOCK_NUM; i += 2)
+		ramx_pool_free(ramx_pool.pool + i * POOL_BLOCK_SIZE);
+
+	if (ramx_pool_stats_largest_free_run() != 1 ||
+		ramx_pool_alloc_blocks(2) != NULL)
+		return false;
+
+	ramx_pool_telemetry_dump();
+
+	alloc_telemetry_t* telemetry = &ramx_pool.telemetry;
+	return telemetry->peak_used == POOL_BLOCK_NUM && telemetry->failures == 2 &&
+		   telemetry->failure_histogram[1] == 1 &&
+		   telemetry->failure_histogram[alloc_telemetry_bucket(POOL_BLOCK_NUM + 1)] == 1 &&
+		   telemetry->size_histogram[0] == POOL_BLOCK_NUM + 1 &&
+		   telemetry->size_histogram[2] == 1;
+}
+
+bool test_memory_allocator_ramx_alloc_many(void);
+bool test_memory_allocator_ramx_alloc_many(void)
+{
+	const uint32_t sizes[4] = { POOL_BLOCK_SIZE, 2 * POOL_BLOCK_SIZE, 1,
+								4 * POOL_BLOCK_SIZE };
+	uint8_t* mem[4];
+
+	ramx_pool_init();
+
+	if (!ramx_pool_alloc_many(4, sizes, mem))
+		return false;
+	uint32_t expected_used = ramx_pool_blocks_for(1) + ramx_pool_blocks_for(2) +
+							 ramx_pool_blocks_for(1) + ramx_pool_blocks_for(4);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (mem[i] == NULL)
+			return false;
+		for (int j = 0; j < i; ++j)
+		{
+			if (mem[i] == mem[j])
+				return false;
+		}
+	}
+	if (ramx_pool_stats_used() != expected_used)
+	{
+		LOG("used %d expected %d \r\n", ramx_pool_stats_used(), expected_used);
+		return false;
+	}
+
+	ramx_pool_free_many(4, mem);
+	for (int i = 0; i < 4; ++i)
+	{
+		if (mem[i] != NULL)
+			return false;
+	}
+	// freeing again is harmless
+	ramx_pool_free_many(4, mem);
+
+	return ramx_pool_stats_free() == POOL_BLOCK_NUM &&
+		   ramx_pool_stats_used() == 0;
+}
+
+bool test_memory_allocator_ramx_alloc_many_atomic(void);
+bool test_memory_allocator_ramx_alloc_many_atomic(void)
+{
+	uint8_t* mem[2];
+
+	ramx_pool_init();
+
+	// the first buffer fits, the second one does not : none is allocated
+	const uint32_t too_big[2] = { POOL_BLOCK_SIZE, POOL_BLOCK_NUM * POOL_BLOCK_SIZE };
+	if (ramx_pool_alloc_many(2, too_big, mem) || mem[0] != NULL ||
+		mem[1] != NULL || ramx_pool_stats_used() != 0)
+		return false;
+
+	// free : block 0, blocks 2 and 3. The buffers do not fit one after the
+	// other, but do when looked for separately.
+	for (int i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_alloc_blocks(1);
+	ramx_pool_free(ramx_pool.pool);
+	ramx_pool_free(ramx_pool.pool + 2 * POOL_BLOCK_SIZE);
+	ramx_pool_free(ramx_pool.pool + 3 * POOL_BLOCK_SIZE);
+
+	const uint32_t sizes[2] = { 2 * POOL_BLOCK_SIZE, POOL_BLOCK_SIZE };
+	bool success = ramx_pool_alloc_many(2, sizes, mem) &&
+				   mem[0] == ramx_pool.pool + 2 * POOL_BLOCK_SIZE &&
+				   mem[1] == ramx_pool.pool && ramx_pool_stats_free() == 0;
+
+	ramx_pool_free_many(2, mem);
+	for (int i = 0; i < POOL_BLOCK_NUM; ++i)
+		ramx_pool_free(ramx_pool.pool + i * POOL_BLOCK_SIZE);
+
+	return success && ramx_pool_stats_used() == 0;
+}
 #endif
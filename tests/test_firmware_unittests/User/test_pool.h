@@ -28,6 +28,7 @@ typedef struct custom_type
 #define TEST_POOL_SIZE 20
 
 HYDRA_POOL_DEF(pool, custom_type_t, TEST_POOL_SIZE);
+HYDRA_POOL_DEF_FREE_LIST(free_list_pool, custom_type_t, TEST_POOL_SIZE);
 
 bool test_pool_alloc_max(void);
 bool test_pool_alloc_max(void)
@@ -75,4 +76,94 @@ bool test_pool_overflow(void)
 	return true;
 }
 
+bool test_pool_free_list_alloc_max(void);
+bool test_pool_free_list_alloc_max(void)
+{
+	hydra_pool_clean(&free_list_pool);
+
+	for (int i = 0; i < TEST_POOL_SIZE; ++i)
+	{
+		custom_type_t* member = (custom_type_t*)hydra_pool_get(&free_list_pool);
+		if (member == NULL)
+			return false;
+		member->a = i;
+		member->b = i;
+	}
+
+	if (hydra_pool_get(&free_list_pool) != NULL)
+		return false;
+
+	for (int i = 0; i < TEST_POOL_SIZE; ++i)
+	{
+		custom_type_t* member =
+			(custom_type_t*)&free_list_pool_pool_members[i * sizeof(custom_type_t)];
+
+		if (member->a != i || member->b != i)
+			return false;
+	}
+	return true;
+}
+
+bool test_pool_free_list_reuse(void);
+bool test_pool_free_list_reuse(void)
+{
+	custom_type_t* members[TEST_POOL_SIZE];
+	hydra_pool_clean(&free_list_pool);
+
+	for (int i = 0; i < TEST_POOL_SIZE; ++i)
+		members[i] = (custom_type_t*)hydra_pool_get(&free_list_pool);
+
+	// the last freed member is the first one given back
+	hydra_pool_free(&free_list_pool, members[3]);
+	hydra_pool_free(&free_list_pool, members[7]);
+
+	if (hydra_pool_get(&free_list_pool) != members[7])
+		return false;
+	if (hydra_pool_get(&free_list_pool) != members[3])
+		return false;
+	return hydra_pool_get(&free_list_pool) == NULL;
+}
+
+bool test_pool_free_list_double_free(void);
+bool test_pool_free_list_double_free(void)
+{
+	hydra_pool_clean(&free_list_pool);
+
+	custom_type_t* first = (custom_type_t*)hydra_pool_get(&free_list_pool);
+	custom_type_t* second = (custom_type_t*)hydra_pool_get(&free_list_pool);
+
+	hydra_pool_free(&free_list_pool, first);
+	hydra_pool_free(&free_list_pool, first);
+
+	// a double free must not put the member twice in the list
+	if (hydra_pool_get(&free_list_pool) != first)
+		return false;
+	custom_type_t* third = (custom_type_t*)hydra_pool_get(&free_list_pool);
+	return third != first && third != second && third != NULL;
+}
+
+bool test_pool_telemetry(void);
+bool test_pool_telemetry(void)
+{
+	custom_type_t* members[TEST_POOL_SIZE];
+	hydra_pool_clean(&free_list_pool);
+
+	for (int i = 0; i < TEST_POOL_SIZE; ++i)
+		members[i] = (custom_type_t*)hydra_pool_get(&free_list_pool);
+	if (hydra_pool_get(&free_list_pool) != NULL)
+		return false;
+
+	for (int i = 0; i < 5; ++i)
+		hydra_pool_free(&free_list_pool, members[i]);
+	// double free, not counted
+	hydra_pool_free(&free_list_pool, members[0]);
+
+	hydra_pool_telemetry_dump(&free_list_pool, "free_list_pool");
+
+	return free_list_pool.used == TEST_POOL_SIZE - 5 &&
+		   free_list_pool.telemetry.peak_used == TEST_POOL_SIZE &&
+		   free_list_pool.telemetry.failures == 1 &&
+		   free_list_pool.telemetry.size_histogram[0] == TEST_POOL_SIZE;
+}
+
 #endif